@@ -0,0 +1,328 @@
+/*
+ * event-replay.c（録画したイベントをメモリ上のリングから consumer に流す / root 不要）
+ *
+ * 目的:
+ *   hello-buffer-config の consumer（handle_event: 整形と出力）を速くしたいとき、
+ *   本物の perf buffer を使うと root と execve の嵐が要り、入力も毎回変わる。
+ *   ここでは hello-buffer-config -w で録画したレコードを読み込み、
+ *     producer スレッド : 録画どおりの間隔（-s 倍速）または全速でリングに積む
+ *     consumer スレッド : リングから取り出し、hello-buffer-config と同じ handle_event に渡す
+ *   という形で流し、スループットと遅れを出す。BPF も libbpf も使わないので一般ユーザで動き、
+ *   perf record などでそのままプロファイルできる。
+ *
+ * 使い方:
+ *   sudo ./hello-buffer-config -w events.rec        # 一度だけ root で録画
+ *   ./event-replay [-s speed] [-p passes] [-o sink] [-b ring_bytes] events.rec
+ *
+ *   -s  0 = 全速（既定）, 1 = 録画どおりの間隔, 2 = 2 倍速 ...
+ *   -p  録画を何周流すか（既定 1。プロファイル用に長く回したいとき）
+ *   -o  handle_event の出力先（既定 stdout。出力のコストを外すなら /dev/null）
+ *   -b  リングの大きさ（2 の冪, 既定 1 MiB。hello-buffer-config の perf buffer 8 ページ x CPU 数に合わせるとよい）
+ *
+ * リング:
+ *
+ *   prod（producer だけが進める） / cons（consumer だけが進める）の 2 つの位置で回す SPSC リング。
+ *   レコードは 16 bytes 境界（= slot_header の大きさ）に詰め、位置は release / acquire で公開する。
+ *
+ *   ┌────────────┬──────┬────────────┬──────┬───────────────┐
+ *   │ slot_header│ data │ slot_header│ data │ ... (skip)    │
+ *   └────────────┴──────┴────────────┴──────┴───────────────┘
+ *      ^cons                                  ^prod
+ *   末尾に収まらないレコードは SLOT_SKIP で残りを埋めて先頭から書く
+ *   （16 bytes 境界なので、残りは必ず slot_header 1 つ分以上ある）。
+ *
+ * 出力（stderr）:
+ *   events / lost / 経過時間 / events/s / ns/event、
+ *   -s を付けたときは「予定時刻から consumer が受け取るまで」の遅れ（平均・最大）。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "hello-buffer-config.h"
+#include "hello-buffer-consumer.h"
+
+#define SLOT_SKIP 0xFFFF
+
+struct slot_header {
+    __u32 size;       /* data の長さ（SKIP ではリング末尾までの詰め物の長さ） */
+    __u16 cpu;
+    __u16 kind;       /* enum rec_kind / SLOT_SKIP */
+    __u64 due_ns;     /* producer が積む予定だった時刻（遅れの計算用） */
+};
+
+struct record {
+    const struct rec_header *hdr;
+    const void *data;
+};
+
+static struct {
+    unsigned char *buf;
+    size_t size;                  /* 2 の冪 */
+    unsigned long long prod;
+    unsigned long long cons;
+    bool done;
+} ring;
+
+static struct record *records;
+static size_t nr_records;
+static double speed;
+static int passes = 1;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t slot_len(__u32 size)
+{
+    return sizeof(struct slot_header) + ((size + 15) & ~15U);
+}
+
+static int load_recording(const char *path, unsigned char **bufp)
+{
+    const struct rec_file_header *fh;
+    unsigned char *buf;
+    size_t off, cap = 0;
+    FILE *f;
+    long size;
+
+    f = fopen(path, "rb");
+    if (!f)
+        return -errno;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = malloc(size > 0 ? size : 1);
+    if (!buf || fread(buf, 1, size, f) != (size_t)size || (size_t)size < sizeof(*fh)) {
+        free(buf);
+        fclose(f);
+        return -EINVAL;
+    }
+    fclose(f);
+
+    fh = (const void *)buf;
+    if (fh->magic != REC_MAGIC || fh->version != REC_VERSION) {
+        free(buf);
+        return -EINVAL;
+    }
+
+    for (off = sizeof(*fh); off + sizeof(struct rec_header) <= (size_t)size;) {
+        const struct rec_header *h = (const void *)(buf + off);
+
+        if (off + sizeof(*h) + h->size > (size_t)size)
+            break;   /* 録画が途中で切れている */
+        if (nr_records == cap) {
+            struct record *r;
+
+            cap = cap ? cap * 2 : 4096;
+            r = realloc(records, cap * sizeof(*records));
+            if (!r) {
+                free(buf);
+                return -ENOMEM;
+            }
+            records = r;
+        }
+        records[nr_records].hdr = h;
+        records[nr_records].data = h + 1;
+        nr_records++;
+        off += sizeof(*h) + ((h->size + 7) & ~7U);
+    }
+    *bufp = buf;
+    return 0;
+}
+
+/* 予定時刻まで待つ（遠ければ眠り、近ければ回る） */
+static void wait_until(unsigned long long due)
+{
+    for (;;) {
+        unsigned long long now = now_ns();
+
+        if (now >= due)
+            return;
+        if (due - now > 50000) {
+            struct timespec ts = {
+                .tv_sec = (due - 20000) / 1000000000ULL,
+                .tv_nsec = (due - 20000) % 1000000000ULL,
+            };
+
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+    }
+}
+
+/* リングに need bytes の空きができるまで待つ */
+static void wait_space(unsigned long long prod, size_t need)
+{
+    while (prod + need - __atomic_load_n(&ring.cons, __ATOMIC_ACQUIRE) > ring.size)
+        sched_yield();
+}
+
+static void *producer(void *arg)
+{
+    unsigned long long start = now_ns(), base = 0, ts0 = nr_records ? records[0].hdr->ts_ns : 0;
+    unsigned long long span = nr_records ? records[nr_records - 1].hdr->ts_ns - ts0 + 1 : 0;
+    unsigned long long prod = 0;
+
+    (void)arg;
+
+    for (int p = 0; p < passes; p++, base += span) {
+        for (size_t i = 0; i < nr_records; i++) {
+            const struct rec_header *h = records[i].hdr;
+            size_t len = slot_len(h->size), off;
+            unsigned long long due = 0;
+            struct slot_header *s;
+
+            if (speed > 0) {
+                due = start + (unsigned long long)((base + h->ts_ns - ts0) / speed);
+                wait_until(due);
+            }
+
+            /* 末尾に収まらなければ残りを SKIP で埋めて先頭へ */
+            off = prod & (ring.size - 1);
+            if (off + len > ring.size) {
+                size_t rest = ring.size - off;
+
+                wait_space(prod, rest);
+                s = (struct slot_header *)(ring.buf + off);
+                s->size = rest - sizeof(*s);
+                s->kind = SLOT_SKIP;
+                prod += rest;
+                off = 0;
+            }
+
+            wait_space(prod, len);
+            s = (struct slot_header *)(ring.buf + off);
+            s->size = h->size;
+            s->cpu = h->cpu;
+            s->kind = h->kind;
+            s->due_ns = due ? due : now_ns();
+            memcpy(s + 1, records[i].data, h->size);
+            prod += len;
+            __atomic_store_n(&ring.prod, prod, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_store_n(&ring.prod, prod, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring.done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct consumer c = { .sink = stdout };
+    unsigned long long cons = 0, lag_sum = 0, lag_max = 0, lagged = 0, start, elapsed;
+    unsigned char *file = NULL;
+    const char *sink_path = NULL;
+    pthread_t thread;
+    int err, opt;
+
+    ring.size = 1 << 20;
+
+    while ((opt = getopt(argc, argv, "s:p:o:b:")) != -1) {
+        switch (opt) {
+        case 's': speed = strtod(optarg, NULL); break;
+        case 'p': passes = atoi(optarg); break;
+        case 'o': sink_path = optarg; break;
+        case 'b': ring.size = strtoul(optarg, NULL, 0); break;
+        default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1 || passes <= 0 || speed < 0 ||
+        ring.size < 4096 || (ring.size & (ring.size - 1))) {
+        fprintf(stderr, "Usage: %s [-s speed] [-p passes] [-o sink] [-b ring_bytes] events.rec\n",
+                argv[0]);
+        return 1;
+    }
+
+    err = load_recording(argv[optind], &file);
+    if (err) {
+        fprintf(stderr, "Failed to read %s: %d\n", argv[optind], err);
+        return 1;
+    }
+    for (size_t i = 0; i < nr_records; i++) {
+        if (slot_len(records[i].hdr->size) > ring.size) {
+            fprintf(stderr, "record %zu (%u bytes) does not fit in the ring\n",
+                    i, records[i].hdr->size);
+            return 1;
+        }
+    }
+
+    if (sink_path) {
+        c.sink = fopen(sink_path, "w");
+        if (!c.sink) {
+            fprintf(stderr, "Failed to open %s: %s\n", sink_path, strerror(errno));
+            return 1;
+        }
+    }
+    ring.buf = aligned_alloc(64, ring.size);
+    if (!ring.buf)
+        return 1;
+
+    start = now_ns();
+    pthread_create(&thread, NULL, producer, NULL);
+
+    /* consumer: 本物の perf buffer の poll ループの代わり */
+    for (;;) {
+        unsigned long long prod = __atomic_load_n(&ring.prod, __ATOMIC_ACQUIRE);
+
+        if (cons == prod) {
+            if (__atomic_load_n(&ring.done, __ATOMIC_ACQUIRE) &&
+                cons == __atomic_load_n(&ring.prod, __ATOMIC_ACQUIRE))
+                break;
+            sched_yield();
+            continue;
+        }
+        while (cons < prod) {
+            struct slot_header *s = (struct slot_header *)(ring.buf + (cons & (ring.size - 1)));
+
+            if (s->kind == REC_SAMPLE) {
+                handle_event(&c, s->cpu, s + 1, s->size);
+            } else if (s->kind == REC_LOST) {
+                __u64 lost;
+
+                memcpy(&lost, s + 1, sizeof(lost));
+                lost_event(&c, s->cpu, lost);
+            }
+            if (s->kind != SLOT_SKIP && speed > 0) {
+                unsigned long long lag = now_ns() - s->due_ns;
+
+                lag_sum += lag;
+                lagged++;
+                if (lag > lag_max)
+                    lag_max = lag;
+            }
+            cons += s->kind == SLOT_SKIP ? sizeof(*s) + s->size : slot_len(s->size);
+        }
+        __atomic_store_n(&ring.cons, cons, __ATOMIC_RELEASE);
+    }
+    fflush(c.sink);
+    elapsed = now_ns() - start;
+    pthread_join(thread, NULL);
+
+    fprintf(stderr, "\nreplayed %zu records x %d passes: %llu events, %llu lost\n",
+            nr_records, passes, c.events, c.lost);
+    fprintf(stderr, "elapsed %.3f s, %.0f events/s, %.1f ns/event\n",
+            elapsed / 1e9, c.events ? c.events / (elapsed / 1e9) : 0.0,
+            c.events ? (double)elapsed / c.events : 0.0);
+    if (lagged)
+        fprintf(stderr, "lag behind schedule: avg %.1f us, max %.1f us\n",
+                lag_sum / 1e3 / lagged, lag_max / 1e3);
+
+    if (sink_path)
+        fclose(c.sink);
+    free(ring.buf);
+    free(records);
+    free(file);
+    return 0;
+}
@@ -14,19 +14,44 @@
  * 修正方針:
  *   struct perf_buffer_opts にコールバック等を詰めて、
  *   perf_buffer__new(map_fd, page_cnt, &opts) で作る。
+ *
+ * 録画:
+ *   sudo ./hello-buffer-config -w events.rec
+ *   受け取った生レコードを時刻付きで events.rec に保存する（形式は hello-buffer-consumer.h）。
+ *   整形・出力（handle_event）は hello-buffer-consumer.h にあり、event-replay も同じものを使う。
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <signal.h>
+#include <time.h>
 
 #include <bpf/libbpf.h>
 
 #include "hello-buffer-config.h"
+#include "hello-buffer-consumer.h"
 #include "hello-buffer-config.skel.h"
 
+static volatile sig_atomic_t exiting = 0;
+
+/* Ctrl-C で poll ループを抜ける（録画ファイルを閉じてから終わるため） */
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+/* -w のときの ctx（録画ファイル + 本来の consumer） */
+struct recorder {
+    FILE *file;
+    struct consumer consumer;
+};
+
 /* libbpf のログ出力フック（DEBUG を抑制） */
 static int libbpf_print_fn(enum libbpf_print_level level,
                            const char *format,
@@ -37,46 +62,68 @@ static int libbpf_print_fn(enum libbpf_print_level level,
     return vfprintf(stderr, format, args);
 }
 
-/*
- * sample_cb の型（libbpf が期待する型）:
- *   typedef void (*perf_buffer_sample_fn)(void *ctx, int cpu, void *data, __u32 size);
- *
- * あなたの warning は「この型自体は合ってる」のに、
- * 旧APIの引数位置に入れてしまっていたせいで関数ポインタ扱いになっていた。
- * 新APIでは opts.sample_cb に入れる。
- */
-static void handle_event(void *ctx, int cpu, void *data, __u32 data_sz)
+static void write_record(FILE *f, int cpu, enum rec_kind kind, const void *data, __u32 size)
 {
-    (void)ctx;
-    (void)cpu;
-    (void)data_sz;
+    static const char pad[8];
+    struct rec_header h = {
+        .cpu = cpu,
+        .kind = kind,
+        .size = size,
+    };
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    h.ts_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(data, 1, size, f);
+    fwrite(pad, 1, (8 - size % 8) % 8, f);
+}
 
-    const struct data_t *m = (const struct data_t *)data;
+/* 録画してから、録画しないときと同じ handle_event に渡す */
+static void record_event(void *ctx, int cpu, void *data, __u32 data_sz)
+{
+    struct recorder *r = ctx;
 
-    printf("%-6d %-6d %-16s %-16s %s\n",
-           m->pid, m->uid, m->command, m->path, m->message);
+    write_record(r->file, cpu, REC_SAMPLE, data, data_sz);
+    handle_event(&r->consumer, cpu, data, data_sz);
 }
 
-/*
- * lost_cb の型（libbpf が期待する型）:
- *   typedef void (*perf_buffer_lost_fn)(void *ctx, int cpu, __u64 lost_cnt);
- *
- * ※昔のシグネチャと違う環境があるので、ここは libbpf.h の typedef に合わせるのが重要。
- */
-static void lost_event(void *ctx, int cpu, __u64 lost_cnt)
+static void record_lost(void *ctx, int cpu, __u64 lost_cnt)
 {
-    (void)ctx;
-    (void)cpu;
-    fprintf(stderr, "lost event: %llu\n", (unsigned long long)lost_cnt);
+    struct recorder *r = ctx;
+
+    write_record(r->file, cpu, REC_LOST, &lost_cnt, sizeof(lost_cnt));
+    lost_event(&r->consumer, cpu, lost_cnt);
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
     struct hello_buffer_config_bpf *skel = NULL;
     struct perf_buffer *pb = NULL;
+    struct recorder rec = { .consumer = { .sink = stdout } };
     int err = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:")) != -1) {
+        if (opt != 'w') {
+            fprintf(stderr, "Usage: %s [-w events.rec]\n", argv[0]);
+            return 1;
+        }
+        rec.file = fopen(optarg, "wb");
+        if (!rec.file) {
+            fprintf(stderr, "Failed to open %s: %s\n", optarg, strerror(errno));
+            return 1;
+        }
+    }
+    if (rec.file) {
+        struct rec_file_header fh = { .magic = REC_MAGIC, .version = REC_VERSION };
+
+        fwrite(&fh, sizeof(fh), 1, rec.file);
+    }
 
     libbpf_set_print(libbpf_print_fn);
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
 
     /* (1) open & load */
     skel = hello_buffer_config_bpf__open_and_load();
@@ -103,9 +150,10 @@ int main(void)
          */
         opts = (struct perf_buffer_opts){};
 
-        opts.sample_cb = handle_event; /* ここに入れる */
-        opts.lost_cb   = lost_event;   /* ここに入れる */
-        opts.ctx       = NULL;         /* handle_event / lost_event の ctx 引数に渡る */
+        opts.sample_cb = rec.file ? record_event : handle_event; /* ここに入れる */
+        opts.lost_cb   = rec.file ? record_lost : lost_event;    /* ここに入れる */
+        /* handle_event / lost_event の ctx 引数に渡る（録画時は struct recorder） */
+        opts.ctx       = rec.file ? (void *)&rec : (void *)&rec.consumer;
 
         pb = perf_buffer__new(bpf_map__fd(skel->maps.output), 8 /* page_cnt */, &opts);
         if (!pb) {
@@ -117,7 +165,7 @@ int main(void)
     }
 
     /* (4) poll ループ */
-    while (true) {
+    while (!exiting) {
         err = perf_buffer__poll(pb, 100 /* timeout ms */);
         if (err == -EINTR) { /* Ctrl-C */
             err = 0;
@@ -131,5 +179,10 @@ int main(void)
 
     perf_buffer__free(pb);
     hello_buffer_config_bpf__destroy(skel);
+    if (rec.file) {
+        fclose(rec.file);
+        fprintf(stderr, "recorded %llu events (%llu lost)\n",
+                rec.consumer.events, rec.consumer.lost);
+    }
     return (err < 0) ? -err : 0;
 }
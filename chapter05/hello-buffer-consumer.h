@@ -0,0 +1,106 @@
+#ifndef HELLO_BUFFER_CONSUMER_H
+#define HELLO_BUFFER_CONSUMER_H
+
+/*
+ * hello-buffer-consumer.h
+ *
+ * 目的:
+ *   perf buffer から受け取ったイベントを「整形して出力する」ユーザ空間側の処理（consumer）と、
+ *   受け取った生レコードをファイルに保存する形式（recording）をまとめたヘッダである。
+ *
+ *   - hello-buffer-config.c : 本物の perf buffer から受け取り、consumer に渡す（-w で録画もする）
+ *   - event-replay.c        : 録画したレコードをメモリ上のリングから同じ consumer に流す
+ *
+ *   consumer を両方から同じコードで呼ぶことで、整形や出力先の最適化を
+ *   root も execve の嵐も無しに、毎回同じ入力で測れる。
+ *
+ *   ┌──────────────┐ perf buffer ┌──────────────────┐
+ *   │ BPF (execve) │ ──────────> │ hello-buffer-    │──┬──> handle_event ──> sink
+ *   └──────────────┘             │ config           │  │
+ *                                └──────────────────┘  └──> 録画ファイル（-w）
+ *                                                                │
+ *   ┌──────────────┐ メモリ上のリング                              │
+ *   │ event-replay │ <─────────────────────────────────────────────┘
+ *   │ (root 不要)   │ ──────────> handle_event ──> sink
+ *   └──────────────┘
+ *
+ * 録画ファイルの形式（ホストのバイト順）:
+ *   struct rec_file_header の後ろに、struct rec_header + データ（8 bytes 境界まで詰め物）が並ぶ。
+ *   ts_ns は consumer が受け取った時刻（CLOCK_MONOTONIC）。data_t に時刻が無いので、
+ *   カーネルでの発生時刻ではなく「ユーザ空間に届いた間隔」を再現する。
+ */
+
+#include <stdio.h>
+#include <linux/types.h>
+
+#include "hello-buffer-config.h"
+
+#define REC_MAGIC   0x43455245   /* "EREC" */
+#define REC_VERSION 1
+
+enum rec_kind {
+    REC_SAMPLE = 0,   /* data = perf buffer のサンプル（struct data_t） */
+    REC_LOST   = 1,   /* data = 失われた件数（__u64） */
+};
+
+struct rec_file_header {
+    __u32 magic;
+    __u32 version;
+};
+
+struct rec_header {
+    __u64 ts_ns;
+    __u32 cpu;
+    __u16 kind;
+    __u16 pad;
+    __u32 size;       /* 続くデータの長さ（詰め物は含まない） */
+    __u32 pad2;
+};
+
+/*
+ * struct consumer:
+ *   handle_event / lost_event の ctx。
+ *
+ *   sink   : 整形した行の出力先（stdout / ファイル / /dev/null）
+ *   events : 受け取ったサンプル数
+ *   lost   : 失われたと報告された件数
+ */
+struct consumer {
+    FILE *sink;
+    unsigned long long events;
+    unsigned long long lost;
+};
+
+/*
+ * sample_cb の型（libbpf が期待する型）:
+ *   typedef void (*perf_buffer_sample_fn)(void *ctx, int cpu, void *data, __u32 size);
+ */
+static void handle_event(void *ctx, int cpu, void *data, __u32 data_sz)
+{
+    struct consumer *c = ctx;
+    const struct data_t *m = (const struct data_t *)data;
+
+    (void)cpu;
+
+    if (data_sz < sizeof(*m))
+        return;
+
+    c->events++;
+    fprintf(c->sink, "%-6d %-6d %-16s %-16s %s\n",
+            m->pid, m->uid, m->command, m->path, m->message);
+}
+
+/*
+ * lost_cb の型（libbpf が期待する型）:
+ *   typedef void (*perf_buffer_lost_fn)(void *ctx, int cpu, __u64 lost_cnt);
+ */
+static void lost_event(void *ctx, int cpu, __u64 lost_cnt)
+{
+    struct consumer *c = ctx;
+
+    (void)cpu;
+    c->lost += lost_cnt;
+    fprintf(stderr, "lost event: %llu\n", (unsigned long long)lost_cnt);
+}
+
+#endif /* HELLO_BUFFER_CONSUMER_H */
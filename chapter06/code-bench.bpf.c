@@ -0,0 +1,293 @@
+/*
+ * code-bench.bpf.c（BPF の書き方ごとのコストを測るマイクロベンチ / BPF 側）
+ *
+ * 目的:
+ *   同じ計算を「書き方だけ変えて」実行する小さな XDP プログラムを並べる。
+ *   ユーザ空間（code-bench.c）がそれぞれを BPF_PROG_TEST_RUN で大量に回し、ns/op を比べる。
+ *   XDP にしているのは、test_run の repeat と duration（平均実行時間）が使えるプログラム型だから。
+ *   （raw_tp / fentry / syscall の test_run は repeat を受け付けない）
+ *
+ * 比べるもの（グループごとに 1 行目が基準）:
+ *
+ *   call  : inline            static __always_inline の関数（呼び出しは消える）
+ *           subprog           static __noinline（BPF-to-BPF 呼び出し。hello-func の get_opcode と同じ）
+ *           global            非 static の __noinline（global function。verifier が単独で検証する）
+ *           unrolled          inline と同じ本体を #pragma unroll で BENCH_INNER 回展開
+ *           bpf_loop          bpf_loop() のコールバックで 1 回ずつ（ヘルパ経由の間接呼び出し）
+ *   tail  : empty             何もしない（test_run の固定費）
+ *           tail_call         bpf_tail_call() で別のプログラムへ 1 回飛ぶ
+ *   read  : direct            map の値をポインタで直接読む（verifier が範囲を確認済みのロード）
+ *           probe_read        同じ場所を bpf_probe_read_kernel() で 8 bytes コピーして読む
+ *   output: inline            （call の基準と同じ計算だけ）
+ *           printk            計算 + bpf_printk()（trace_pipe へ文字列整形して書く）
+ *           ringbuf_output    計算 + bpf_ringbuf_output()（16 bytes をコピー）
+ *           ringbuf_reserve   計算 + bpf_ringbuf_reserve() / submit（ring 上に直接書く）
+ *
+ *   ループ系は 1 回の実行で BENCH_INNER 回同じ操作をする。
+ *   ループは #pragma clang loop unroll(disable) で「展開しない」ことを明示し、
+ *   barrier_var() で毎回の計算結果を消させない（clang に畳み込まれると何も測れない）。
+ *
+ * 注意:
+ *   - ringbuf は BPF_RB_NO_WAKEUP で書くので、consumer を起こすコストは含まない。
+ *     満杯で書けなかった回数は drops に数える（ユーザ空間が実行の合間に読み捨てる）。
+ *   - bpf_printk は trace バッファへの書き込み。trace_pipe を読んでいなくても整形コストはかかる。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include "code-bench.h"
+
+#ifndef barrier_var
+#define barrier_var(var) asm volatile("" : "+r"(var))
+#endif
+
+/* 計算結果の捨て先（全プログラムが最後に 1 回書く。条件を揃えるため） */
+__u64 sink = 0;
+
+/* ringbuf が満杯で書けなかった回数 */
+__u64 drops = 0;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct bench_src);
+} src SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 8 * 1024 * 1024);
+} rb SEC(".maps");
+
+/* ---- 呼び出し方の違い ------------------------------------------------------ */
+
+static __always_inline u64 work_inline(u64 x, u32 i)
+{
+    return x * 31 + i;
+}
+
+static __noinline u64 work_subprog(u64 x, u32 i)
+{
+    return x * 31 + i;
+}
+
+__noinline u64 work_global(u64 x, u32 i)
+{
+    return x * 31 + i;
+}
+
+SEC("xdp")
+int bench_inline(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        acc = work_inline(acc, i);
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int bench_subprog(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        acc = work_subprog(acc, i);
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int bench_global(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        acc = work_global(acc, i);
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int bench_unrolled(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+#pragma unroll
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        acc = work_inline(acc, i);
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+static long loop_cb(u32 i, void *data)
+{
+    u64 *acc = data;
+
+    *acc = work_inline(*acc, i);
+    return 0;
+}
+
+SEC("xdp")
+int bench_bpf_loop(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+    bpf_loop(BENCH_INNER, loop_cb, &acc, 0);
+    sink = acc;
+    return XDP_PASS;
+}
+
+/* ---- tail call -------------------------------------------------------------- */
+
+SEC("xdp")
+int bench_empty(struct xdp_md *ctx)
+{
+    sink = 0;
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int bench_tail_target(struct xdp_md *ctx)
+{
+    sink = 1;
+    return XDP_PASS;
+}
+
+/* 静的に初期化した prog_array（libbpf がロード時に bench_tail_target の fd を入れる） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PROG_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __array(values, int (struct xdp_md *));
+} jmp SEC(".maps") = {
+    .values = { [0] = (void *)&bench_tail_target },
+};
+
+SEC("xdp")
+int bench_tail_call(struct xdp_md *ctx)
+{
+    bpf_tail_call(ctx, &jmp, 0);
+    /* ここに来たら tail call が失敗している（ユーザ空間は retval で見分ける） */
+    return XDP_ABORTED;
+}
+
+/* ---- 読み方の違い ------------------------------------------------------------ */
+
+SEC("xdp")
+int bench_direct(struct xdp_md *ctx)
+{
+    struct bench_src *s;
+    u32 zero = 0;
+    u64 acc = 0;
+
+    s = bpf_map_lookup_elem(&src, &zero);
+    if (!s)
+        return XDP_ABORTED;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        acc += s->v[i & 3];
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int bench_probe_read(struct xdp_md *ctx)
+{
+    struct bench_src *s;
+    u32 zero = 0;
+    u64 acc = 0;
+
+    s = bpf_map_lookup_elem(&src, &zero);
+    if (!s)
+        return XDP_ABORTED;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        u64 v = 0;
+
+        bpf_probe_read_kernel(&v, sizeof(v), &s->v[i & 3]);
+        acc += v;
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+/* ---- 出力の違い -------------------------------------------------------------- */
+
+SEC("xdp")
+int bench_printk(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        acc = work_inline(acc, i);
+        bpf_printk("bench %u %llu", i, acc);
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int bench_ringbuf_output(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        struct bench_rec r;
+
+        acc = work_inline(acc, i);
+        r.seq = i;
+        r.acc = acc;
+        if (bpf_ringbuf_output(&rb, &r, sizeof(r), BPF_RB_NO_WAKEUP))
+            __sync_fetch_and_add(&drops, 1);
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int bench_ringbuf_reserve(struct xdp_md *ctx)
+{
+    u64 acc = 0;
+
+#pragma clang loop unroll(disable)
+    for (u32 i = 0; i < BENCH_INNER; i++) {
+        struct bench_rec *r;
+
+        acc = work_inline(acc, i);
+        r = bpf_ringbuf_reserve(&rb, sizeof(*r), 0);
+        if (r) {
+            r->seq = i;
+            r->acc = acc;
+            bpf_ringbuf_submit(r, BPF_RB_NO_WAKEUP);
+        } else {
+            __sync_fetch_and_add(&drops, 1);
+        }
+        barrier_var(acc);
+    }
+    sink = acc;
+    return XDP_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,227 @@
+/*
+ * code-bench.c（ユーザ空間側 / BPF の書き方ごとの ns/op を表にする）
+ *
+ * 目的:
+ *   code-bench.bpf.c の各 XDP プログラムを BPF_PROG_TEST_RUN で repeat 回ずつ実行し、
+ *   カーネルが返す平均実行時間（duration）から
+ *     ns/run  : プログラム 1 回の実行時間
+ *     ns/op   : ns/run / ops（ループ系は BENCH_INNER 回の操作で割る）
+ *     +ns/op  : 同じグループの基準（1 行目）との差 = その書き方の追加コスト
+ *   を出す。
+ *
+ * 使い方:
+ *   sudo ./code-bench [-r repeat] [-n rounds] [-c cpu]
+ *
+ *   -r  1 回の test_run で回す回数（既定 1000000。printk は 1/100, ringbuf は ring に収まる回数に減らす）
+ *   -n  同じ測定を何回やって最小値を取るか（既定 5。割り込みなどの外れ値を落とす）
+ *   -c  測定するスレッドを固定する CPU（既定 0）
+ *
+ * 流れ:
+ *
+ *   open_and_load（bench_tail_target は静的 prog_array でロード時に jmp[0] に入る）
+ *     → src に読む値を入れる
+ *     → 各ケース × rounds: ringbuf を読み捨てる → test_run(repeat) → duration の最小を取る
+ *     → グループごとに基準との差を出して表にする
+ *
+ * 注意:
+ *   - JIT が無効（/proc/sys/net/core/bpf_jit_enable = 0）だとインタプリタの数字になる。起動時に警告する。
+ *   - duration はカーネル内の ktime で測った平均なので、数 ns の差は誤差に埋もれる。
+ *     傾向を見るためのもので、絶対値は CPU / カーネル設定（retpoline, spectre 対策等）で大きく変わる。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "code-bench.h"
+#include "code-bench.skel.h"
+
+#define XDP_PASS 2
+
+struct bench_case {
+    const char *group;
+    const char *name;
+    struct bpf_program *prog;
+    int ops;            /* 1 回の実行で行う操作の数 */
+    int base;           /* 差を取る基準ケースの添字（自分自身なら基準） */
+    int repeat_div;     /* repeat をこの数で割る（重いケース用） */
+    bool ringbuf;       /* ring に収まる repeat に抑える */
+    /* 結果 */
+    unsigned int ns_run;
+    unsigned int repeat;
+};
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static int discard_rec(void *ctx, void *data, size_t size)
+{
+    (void)ctx;
+    (void)data;
+    (void)size;
+    return 0;
+}
+
+static void check_jit(void)
+{
+    FILE *f = fopen("/proc/sys/net/core/bpf_jit_enable", "r");
+    int v = -1;
+
+    if (!f)
+        return;
+    if (fscanf(f, "%d", &v) == 1 && v == 0)
+        fprintf(stderr, "warning: bpf_jit_enable=0, numbers are for the interpreter\n");
+    fclose(f);
+}
+
+/* rounds 回測って最小の平均実行時間（ns）を返す。retval が XDP_PASS でなければエラー */
+static int measure(const struct bench_case *c, struct ring_buffer *rb, int rounds,
+                   unsigned int *ns)
+{
+    unsigned char pkt[64] = {};
+    unsigned int best = ~0U;
+
+    for (int r = 0; r < rounds; r++) {
+        LIBBPF_OPTS(bpf_test_run_opts, opts,
+                    .data_in = pkt,
+                    .data_size_in = sizeof(pkt),
+                    .repeat = c->repeat);
+
+        ring_buffer__consume(rb);
+        if (bpf_prog_test_run_opts(bpf_program__fd(c->prog), &opts))
+            return -errno;
+        if (opts.retval != XDP_PASS)
+            return -EINVAL;
+        if (opts.duration < best)
+            best = opts.duration;
+    }
+    *ns = best;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct code_bench_bpf *skel = NULL;
+    struct ring_buffer *rb = NULL;
+    struct bench_src val = { .v = { 1, 2, 3, 4 } };
+    unsigned int repeat = 1000000, rb_repeat;
+    int rounds = 5, cpu = 0;
+    cpu_set_t set;
+    __u32 zero = 0;
+    int err = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:c:")) != -1) {
+        switch (opt) {
+        case 'r': repeat = strtoul(optarg, NULL, 0); break;
+        case 'n': rounds = atoi(optarg); break;
+        case 'c': cpu = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-r repeat] [-n rounds] [-c cpu]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!repeat || rounds <= 0) {
+        fprintf(stderr, "repeat and rounds must be positive\n");
+        return 1;
+    }
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+    check_jit();
+
+    /* test_run は呼び出したスレッドの CPU で動くので、そのスレッドを固定する */
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set))
+        fprintf(stderr, "warning: failed to pin to CPU %d: %s\n", cpu, strerror(errno));
+
+    skel = code_bench_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open and load BPF object\n");
+        return 1;
+    }
+
+    err = bpf_map__update_elem(skel->maps.src, &zero, sizeof(zero), &val, sizeof(val), 0);
+    if (err) {
+        fprintf(stderr, "Failed to set src map (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    rb = ring_buffer__new(bpf_map__fd(skel->maps.rb), discard_rec, NULL, NULL);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create ring buffer: %d\n", err);
+        goto cleanup;
+    }
+
+    /* 1 回の実行で BENCH_INNER 件（8 bytes ヘッダ + 16 bytes）書くので、ring に収まる repeat にする */
+    rb_repeat = bpf_map__max_entries(skel->maps.rb) / (BENCH_INNER * (8 + sizeof(struct bench_rec)));
+    if (rb_repeat > repeat)
+        rb_repeat = repeat;
+
+    struct bench_case cases[] = {
+        { "call",   "inline",          skel->progs.bench_inline,          BENCH_INNER, 0, 1 },
+        { "call",   "subprog",         skel->progs.bench_subprog,         BENCH_INNER, 0, 1 },
+        { "call",   "global",          skel->progs.bench_global,          BENCH_INNER, 0, 1 },
+        { "call",   "unrolled",        skel->progs.bench_unrolled,        BENCH_INNER, 0, 1 },
+        { "call",   "bpf_loop",        skel->progs.bench_bpf_loop,        BENCH_INNER, 0, 1 },
+        { "tail",   "empty",           skel->progs.bench_empty,           1,           5, 1 },
+        { "tail",   "tail_call",       skel->progs.bench_tail_call,       1,           5, 1 },
+        { "read",   "direct",          skel->progs.bench_direct,          BENCH_INNER, 7, 1 },
+        { "read",   "probe_read",      skel->progs.bench_probe_read,      BENCH_INNER, 7, 1 },
+        { "output", "printk",          skel->progs.bench_printk,          BENCH_INNER, 0, 100 },
+        { "output", "ringbuf_output",  skel->progs.bench_ringbuf_output,  BENCH_INNER, 0, 1, true },
+        { "output", "ringbuf_reserve", skel->progs.bench_ringbuf_reserve, BENCH_INNER, 0, 1, true },
+    };
+    int nr_cases = sizeof(cases) / sizeof(cases[0]);
+
+    for (int i = 0; i < nr_cases; i++) {
+        struct bench_case *c = &cases[i];
+
+        c->repeat = c->ringbuf ? rb_repeat : repeat / c->repeat_div;
+        if (!c->repeat)
+            c->repeat = 1;
+        err = measure(c, rb, rounds, &c->ns_run);
+        if (err) {
+            fprintf(stderr, "%s: test_run failed: %d\n", c->name, err);
+            goto cleanup;
+        }
+    }
+
+    printf("%-7s %-16s %4s %9s %10s %9s %10s  %s\n",
+           "group", "pattern", "ops", "repeat", "ns/run", "ns/op", "+ns/op", "(vs)");
+    for (int i = 0; i < nr_cases; i++) {
+        const struct bench_case *c = &cases[i];
+        const struct bench_case *b = &cases[c->base];
+        double op = (double)c->ns_run / c->ops;
+
+        printf("%-7s %-16s %4d %9u %10u %9.2f ", c->group, c->name, c->ops, c->repeat, c->ns_run, op);
+        if (b == c)
+            printf("%10s  %s\n", "-", "(base)");
+        else
+            printf("%+10.2f  %s\n", op - (double)b->ns_run / b->ops, b->name);
+    }
+    printf("\nringbuf drops: %llu (BENCH_INNER=%d, rounds=%d, cpu=%d)\n",
+           (unsigned long long)skel->bss->drops, BENCH_INNER, rounds, cpu);
+
+cleanup:
+    ring_buffer__free(rb);
+    code_bench_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
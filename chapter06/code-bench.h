@@ -0,0 +1,33 @@
+#ifndef CODE_BENCH_H
+#define CODE_BENCH_H
+
+/*
+ * code-bench.h（BPF の書き方ごとのコストを測るマイクロベンチで共有する定義）
+ *
+ * 目的:
+ *   chapter03/hello-func.bpf.c の get_opcode() は static noinline の BPF-to-BPF 呼び出し、
+ *   hello-verifier.bpf.c は bpf_probe_read_kernel() や bpf_printk() を使っている。
+ *   こうした書き方がそれぞれ 1 回あたり何 ns かかるかを、同じ形の小さな XDP プログラムを
+ *   BPF_PROG_TEST_RUN で大量に回して比べる。
+ */
+
+/*
+ * BENCH_INNER:
+ *   ループ系のプログラムが 1 回の実行（= test_run の 1 repeat）の中で対象の操作を繰り返す回数。
+ *   test_run 自体の固定費（ctx の準備など）を薄めるためのもの。
+ *   ns/op = 1 回の実行時間 / ops。unrolled 版はこの回数だけ展開されるので大きくしすぎない。
+ */
+#define BENCH_INNER 64
+
+/* ringbuf 版が 1 回の操作で書くレコード */
+struct bench_rec {
+   unsigned long long seq;
+   unsigned long long acc;
+};
+
+/* direct / probe_read 版が読む map の値（1 回に 1 要素 = 8 bytes を読む） */
+struct bench_src {
+   unsigned long long v[4];
+};
+
+#endif /* CODE_BENCH_H */
@@ -0,0 +1,251 @@
+/*
+ * config-channel.bpf.c（CO-RE + libbpf 想定 / USER_RINGBUF による設定投入）
+ *
+ * 目的:
+ *   hello-verifier と同じ「UID ごとのメッセージ」を扱う execve トレーサに、
+ *   ユーザ空間 → カーネル方向の設定チャネル（BPF_MAP_TYPE_USER_RINGBUF）を付ける。
+ *
+ *   このファイルには 3 種類のプログラムが入っている:
+ *     1) SEC("ksyscall/execve") : 設定（my_config / uid_filter / sample_rate）を見てイベントを出す
+ *     2) SEC("syscall")         : ユーザ空間が bpf_prog_test_run_opts() で呼ぶ “drain 口”
+ *     3) bpf_timer のコールバック: 2) で起動すると、一定周期で自動的に drain する
+ *
+ * アルゴリズム（drain）:
+ *
+ *   bpf_user_ringbuf_drain(&commands, apply_cmd, ctx, 0)
+ *      │
+ *      ├─ ring に積まれたサンプルを 1 件ずつ dynptr で受け取る
+ *      │     apply_cmd(dynptr, ctx)
+ *      │        ├─ bpf_dynptr_read() で struct config_cmd をスタックへコピー
+ *      │        └─ op に応じて map を更新（失敗は invalid としてカウント）
+ *      │
+ *      └─ 戻り値 = 処理したサンプル数（負値はエラー）
+ *
+ * verifier 観点の注意:
+ *   - dynptr の中身はユーザ空間が書いたもの。サイズが想定と違うこともあり得るので、
+ *     bpf_dynptr_read() の戻り値（失敗なら負）を必ず見る。
+ *   - SEC("syscall") は sleepable 扱いでロードされる。sleepable から使える map は
+ *     array / hash / ringbuf 系などに限られるので、ここでもその範囲だけを使う。
+ *   - bpf_timer は tracing 系プログラム（kprobe 等）からは使えないため、
+ *     タイマー起動は syscall プログラム側で行う。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "config-channel.h"
+
+/* vmlinux.h にはマクロが入らないので bpf_timer_init() 用に自前で定義する */
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC 1
+#endif
+
+/* 既定メッセージ（hello-verifier の message と同じ） */
+char message[12] = "Hello World";
+
+/* サンプリング間隔（1 なら全件）。CONFIG_OP_SET_SAMPLING で書き換わる */
+__u32 sample_rate = 1;
+
+/* サンプリング用の通し番号（race は許容：間引きの目安なので厳密さは不要） */
+__u64 seen = 0;
+
+/* drain の結果カウンタ（ユーザ空間は skel->bss->stats で読む） */
+struct drain_stats stats = {};
+
+/* イベント出力（hello-verifier と同じ perf buffer） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(u32));
+} output SEC(".maps");
+
+/* uid -> メッセージ（hello-verifier の my_config と同じ形） */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 10240);
+    __type(key, u32);
+    __type(value, struct msg_t);
+} my_config SEC(".maps");
+
+/* イベントを出さない uid の集合（value はダミー） */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 10240);
+    __type(key, u32);
+    __type(value, u8);
+} uid_filter SEC(".maps");
+
+/*
+ * commands: BPF_MAP_TYPE_USER_RINGBUF
+ *   - ユーザ空間が user_ring_buffer__reserve()/submit() で書き込む。
+ *   - max_entries はバイト数（ページサイズの 2 のべき乗倍）。
+ *     256KB なら struct config_cmd（24 bytes + 8 bytes ヘッダ）を約 8000 件溜められる。
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_USER_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} commands SEC(".maps");
+
+/*
+ * 周期 drain 用の bpf_timer を置く array（要素 1 個）。
+ * bpf_timer は map value の中にしか置けない。
+ */
+struct drain_timer {
+    struct bpf_timer timer;
+    __u64 interval_ns;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct drain_timer);
+} drain_timer SEC(".maps");
+
+/*
+ * apply_cmd: bpf_user_ringbuf_drain() のコールバック
+ *
+ * 戻り値:
+ *   0 : 次のサンプルへ進む
+ *   1 : drain を打ち切る（ここでは使わない）
+ */
+static long apply_cmd(struct bpf_dynptr *dynptr, void *ctx)
+{
+    struct config_cmd cmd;
+    struct msg_t msg = {};
+    u8 one = 1;
+    long err;
+
+    (void)ctx;
+
+    /* サンプルが短すぎる（壊れている）場合は読めずに負値が返る */
+    err = bpf_dynptr_read(&cmd, sizeof(cmd), dynptr, 0, 0);
+    if (err) {
+        __sync_fetch_and_add(&stats.invalid, 1);
+        return 0;
+    }
+
+    switch (cmd.op) {
+    case CONFIG_OP_SET_MSG:
+        __builtin_memcpy(msg.message, cmd.message, sizeof(msg.message));
+        msg.message[sizeof(msg.message) - 1] = '\0';
+        err = bpf_map_update_elem(&my_config, &cmd.uid, &msg, BPF_ANY);
+        break;
+    case CONFIG_OP_DEL_MSG:
+        err = bpf_map_delete_elem(&my_config, &cmd.uid);
+        break;
+    case CONFIG_OP_ADD_FILTER:
+        err = bpf_map_update_elem(&uid_filter, &cmd.uid, &one, BPF_ANY);
+        break;
+    case CONFIG_OP_DEL_FILTER:
+        err = bpf_map_delete_elem(&uid_filter, &cmd.uid);
+        break;
+    case CONFIG_OP_SET_SAMPLING:
+        sample_rate = cmd.value ? cmd.value : 1;
+        err = 0;
+        break;
+    default:
+        err = -1;
+        break;
+    }
+
+    /* 存在しないキーの削除（-ENOENT）も “反映できなかった” として数える */
+    if (err)
+        __sync_fetch_and_add(&stats.invalid, 1);
+    else
+        __sync_fetch_and_add(&stats.applied, 1);
+
+    return 0;
+}
+
+/*
+ * タイマーのコールバック:
+ *   drain して、同じ周期で自分自身を再登録する。
+ */
+static int drain_timer_cb(void *map, int *key, struct drain_timer *t)
+{
+    bpf_user_ringbuf_drain(&commands, apply_cmd, NULL, 0);
+    __sync_fetch_and_add(&stats.drains, 1);
+
+    bpf_timer_start(&t->timer, t->interval_ns, 0);
+    return 0;
+}
+
+/*
+ * drain_commands: SEC("syscall")
+ *
+ * ユーザ空間は
+ *   LIBBPF_OPTS(bpf_test_run_opts, topts, .ctx_in = &args, .ctx_size_in = sizeof(args));
+ *   bpf_prog_test_run_opts(bpf_program__fd(skel->progs.drain_commands), &topts);
+ * で呼び出す。syscall プログラムの ctx はユーザ空間が渡したバッファそのもので、
+ * ここで書いた値（args->drained）は呼び出し後にユーザ空間へ書き戻される。
+ */
+SEC("syscall")
+int drain_commands(struct drain_args *args)
+{
+    u32 zero = 0;
+    struct drain_timer *t;
+
+    args->drained = bpf_user_ringbuf_drain(&commands, apply_cmd, NULL, 0);
+    __sync_fetch_and_add(&stats.drains, 1);
+
+    /* drain の失敗（負の errno）は retval でも返す。ユーザ空間は retval を先に見る */
+    if (args->drained < 0)
+        return args->drained;
+
+    if (!args->timer_interval_ns)
+        return 0;
+
+    /* 周期 drain を起動する（2 回目以降の init は -EBUSY になるが無害） */
+    t = bpf_map_lookup_elem(&drain_timer, &zero);
+    if (!t)
+        return 0;
+
+    t->interval_ns = args->timer_interval_ns;
+    bpf_timer_init(&t->timer, &drain_timer, CLOCK_MONOTONIC);
+    bpf_timer_set_callback(&t->timer, drain_timer_cb);
+    bpf_timer_start(&t->timer, t->interval_ns, 0);
+    return 0;
+}
+
+/*
+ * ksyscall/execve:
+ *   hello-verifier の kprobe_exec と同じイベントを出すが、
+ *   drain で反映された設定（uid_filter / sample_rate / my_config）を参照する。
+ */
+SEC("ksyscall/execve")
+int kprobe_exec(void *ctx)
+{
+    struct data_t data = {};
+    struct msg_t *p;
+    u32 uid;
+    u64 n;
+
+    uid = bpf_get_current_uid_gid() & 0xFFFFFFFF;
+
+    /* フィルタ対象の UID は出さない */
+    if (bpf_map_lookup_elem(&uid_filter, &uid))
+        return 0;
+
+    /* sample_rate 回に 1 回だけ出す */
+    n = __sync_fetch_and_add(&seen, 1);
+    if (sample_rate > 1 && (n % sample_rate) != 0)
+        return 0;
+
+    data.pid = bpf_get_current_pid_tgid() >> 32;
+    data.uid = uid;
+    data.counter = (int)n;
+    bpf_get_current_comm(&data.command, sizeof(data.command));
+
+    p = bpf_map_lookup_elem(&my_config, &uid);
+    if (p)
+        bpf_probe_read_kernel_str(&data.message, sizeof(data.message), p->message);
+    else
+        bpf_probe_read_kernel_str(&data.message, sizeof(data.message), message);
+
+    bpf_perf_event_output(ctx, &output, BPF_F_CURRENT_CPU, &data, sizeof(data));
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
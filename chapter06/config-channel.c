@@ -0,0 +1,320 @@
+/*
+ * config-channel.c（ユーザ空間側 / USER_RINGBUF で設定をまとめて投入する）
+ *
+ * 目的:
+ *   hello-verifier.c では
+ *     bpf_map__update_elem(skel->maps.my_config, &key, ..., &msg, ..., 0);
+ *   のように「1 キー = 1 syscall」で設定を入れていた。
+ *
+ *   ここでは設定コマンド（struct config_cmd）を USER_RINGBUF に積み、
+ *   カーネル側の BPF プログラムにまとめて反映させる。
+ *     - 積む側（reserve/submit）は共有メモリへの書き込みだけなので syscall 不要
+ *     - 反映は SEC("syscall") プログラムを 1 回 test_run するか、bpf_timer に任せる
+ *
+ * 使い方:
+ *   sudo ./config-channel              # トレーサとして動かす（100ms 周期の timer drain）
+ *   sudo ./config-channel bench [N]    # N 件の更新を per-key syscall と ring で比較する
+ *
+ * 全体の流れ（トレーサモード）:
+ *
+ *   open_and_load
+ *        │
+ *        v
+ *   user_ring_buffer__new(commands)
+ *        │
+ *        v
+ *   初期設定を ring に積む（UID=501 のメッセージ等）
+ *        │
+ *        v
+ *   drain_commands を test_run（即時 drain + 周期 timer 起動）
+ *        │
+ *        v
+ *   attach → perf buffer poll（以降の設定変更は ring に積むだけで timer が拾う）
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "config-channel.h"
+#include "config-channel.skel.h"
+
+/* bench で書き換える UID の範囲（my_config の max_entries 10240 に収める） */
+#define BENCH_KEYS 10000
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static void handle_event(void *ctx, int cpu, void *data, unsigned int data_sz)
+{
+    (void)ctx;
+    (void)cpu;
+    (void)data_sz;
+
+    struct data_t *m = (struct data_t *)data;
+
+    printf("%-6d %-6d %-4d %-16s %s\n",
+           m->pid, m->uid, m->counter, m->command, m->message);
+}
+
+static void lost_event(void *ctx, int cpu, long long unsigned int data_sz)
+{
+    (void)ctx;
+    (void)cpu;
+    (void)data_sz;
+
+    printf("lost event\n");
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * drain_commands を 1 回呼ぶ。
+ *
+ * interval_ns:
+ *   0 以外なら周期 drain 用の bpf_timer も起動する。
+ *
+ * 戻り値:
+ *   drain したコマンド数。失敗したら負の errno（test_run 自体の失敗、BPF 側の retval、
+ *   drained の順に見る。errno は当てにしないこと）
+ */
+static long long drain_now(struct config_channel_bpf *skel,
+                           unsigned long long interval_ns)
+{
+    struct drain_args args = {
+        .timer_interval_ns = interval_ns,
+    };
+    LIBBPF_OPTS(bpf_test_run_opts, topts,
+        .ctx_in      = &args,
+        .ctx_size_in = sizeof(args),
+    );
+    int err;
+
+    err = bpf_prog_test_run_opts(bpf_program__fd(skel->progs.drain_commands), &topts);
+    if (err)
+        return -errno;
+    if ((int)topts.retval < 0)
+        return (int)topts.retval;
+
+    return args.drained;   /* BPF 側が負の値を書いていればそのまま返る */
+}
+
+/*
+ * ring にコマンドを 1 件積む。
+ *
+ * ring が満杯（reserve が NULL / errno=ENOSPC）のときは、
+ * その場で drain してから積み直す。timer drain に任せて待つより速い。
+ */
+static int push_cmd(struct config_channel_bpf *skel,
+                    struct user_ring_buffer *rb,
+                    const struct config_cmd *cmd)
+{
+    struct config_cmd *slot;
+    long long drained;
+
+    slot = user_ring_buffer__reserve(rb, sizeof(*slot));
+    if (!slot && errno == ENOSPC) {
+        drained = drain_now(skel, 0);
+        if (drained < 0)
+            return (int)drained;
+        slot = user_ring_buffer__reserve(rb, sizeof(*slot));
+    }
+    if (!slot)
+        return -errno;
+
+    *slot = *cmd;
+    user_ring_buffer__submit(rb, slot);
+    return 0;
+}
+
+static void make_set_msg(struct config_cmd *cmd, unsigned int uid, const char *m)
+{
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->op = CONFIG_OP_SET_MSG;
+    cmd->uid = uid;
+    strncpy(cmd->message, m, sizeof(cmd->message) - 1);
+}
+
+/*
+ * bench:
+ *   同じ N 件の SET_MSG を
+ *     (a) bpf_map__update_elem() を N 回
+ *     (b) USER_RINGBUF に N 件積んで drain（満杯ごと + 最後に 1 回）
+ *   で反映し、updates/sec を比べる。
+ *
+ *   (b) は “カーネル側で map に反映し終わるまで” を計測に含める
+ *   （最後の drain が返った時点で全件が my_config に入っている）。
+ */
+static int run_bench(struct config_channel_bpf *skel,
+                     struct user_ring_buffer *rb,
+                     long n)
+{
+    struct config_cmd cmd;
+    struct msg_t msg = {};
+    unsigned long long applied0;
+    double t0, t_syscall, t_ring;
+    long long drained;
+    long i;
+    int err;
+
+    strncpy(msg.message, "bench", sizeof(msg.message) - 1);
+
+    /* (a) per-key syscall */
+    t0 = now_sec();
+    for (i = 0; i < n; i++) {
+        uint32_t key = (uint32_t)(i % BENCH_KEYS);
+
+        err = bpf_map__update_elem(skel->maps.my_config,
+                                   &key, sizeof(key),
+                                   &msg, sizeof(msg),
+                                   0);
+        if (err) {
+            fprintf(stderr, "Failed to update my_config map (err=%d)\n", err);
+            return err;
+        }
+    }
+    t_syscall = now_sec() - t0;
+
+    /* (b) USER_RINGBUF + drain */
+    applied0 = skel->bss->stats.applied;
+    t0 = now_sec();
+    for (i = 0; i < n; i++) {
+        make_set_msg(&cmd, (unsigned int)(i % BENCH_KEYS), "bench");
+        err = push_cmd(skel, rb, &cmd);
+        if (err) {
+            fprintf(stderr, "Failed to push command: %d (%s)\n", err, strerror(-err));
+            return err;
+        }
+    }
+    drained = drain_now(skel, 0);
+    if (drained < 0) {
+        err = (int)drained;
+        fprintf(stderr, "Failed to drain commands: %d\n", err);
+        return err;
+    }
+    t_ring = now_sec() - t0;
+
+    printf("%-22s %10s %12s %14s\n", "method", "updates", "seconds", "updates/sec");
+    printf("%-22s %10ld %12.6f %14.0f\n", "bpf_map__update_elem", n, t_syscall, n / t_syscall);
+    printf("%-22s %10llu %12.6f %14.0f\n", "user_ringbuf + drain",
+           skel->bss->stats.applied - applied0, t_ring,
+           (skel->bss->stats.applied - applied0) / t_ring);
+    printf("speedup: %.2fx  (invalid=%llu drains=%llu)\n",
+           t_syscall / t_ring, skel->bss->stats.invalid, skel->bss->stats.drains);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct config_channel_bpf *skel = NULL;
+    struct user_ring_buffer *rb = NULL;
+    struct perf_buffer *pb = NULL;
+    struct config_cmd cmd;
+    bool bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+    long long drained;
+    int err = 0;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    skel = config_channel_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open and load BPF object\n");
+        return 1;
+    }
+
+    /*
+     * user_ring_buffer__new:
+     *   USER_RINGBUF map を mmap し、reserve/submit で書ける状態にする。
+     */
+    rb = user_ring_buffer__new(bpf_map__fd(skel->maps.commands), NULL);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create user ring buffer: %d (%s)\n", -err, strerror(-err));
+        goto cleanup;
+    }
+
+    if (bench) {
+        long n = argc > 2 ? strtol(argv[2], NULL, 0) : 1000000;
+
+        err = run_bench(skel, rb, n > 0 ? n : 1000000);
+        goto cleanup;
+    }
+
+    /*
+     * 初期設定を ring に積む:
+     *   - UID=501 のメッセージ（hello-verifier と同じ設定）
+     *   - root は “Hey root!”
+     */
+    make_set_msg(&cmd, 501, "hello Liz");
+    err = push_cmd(skel, rb, &cmd);
+    if (!err) {
+        make_set_msg(&cmd, 0, "Hey root!");
+        err = push_cmd(skel, rb, &cmd);
+    }
+    if (err) {
+        fprintf(stderr, "Failed to push command: %d (%s)\n", err, strerror(-err));
+        goto cleanup;
+    }
+
+    /* 即時 drain + 100ms 周期の timer drain を起動 */
+    drained = drain_now(skel, 100ULL * 1000 * 1000);
+    if (drained < 0) {
+        err = (int)drained;
+        fprintf(stderr, "Failed to start drain timer: %d\n", err);
+        goto cleanup;
+    }
+
+    err = config_channel_bpf__attach(skel);
+    if (err) {
+        fprintf(stderr, "Failed to attach BPF skeleton: %d\n", err);
+        goto cleanup;
+    }
+
+    pb = perf_buffer__new(bpf_map__fd(skel->maps.output), 8,
+                          handle_event, lost_event, NULL, NULL);
+    if (!pb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create perf buffer (errno=%d)\n", errno);
+        goto cleanup;
+    }
+
+    while (true) {
+        err = perf_buffer__poll(pb, 100 /* timeout, ms */);
+        if (err == -EINTR) {
+            err = 0;
+            break;
+        }
+        if (err < 0) {
+            fprintf(stderr, "Error polling perf buffer: %d\n", err);
+            break;
+        }
+    }
+
+cleanup:
+    perf_buffer__free(pb);
+    user_ring_buffer__free(rb);
+    config_channel_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
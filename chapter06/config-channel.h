@@ -0,0 +1,98 @@
+#ifndef CONFIG_CHANNEL_H
+#define CONFIG_CHANNEL_H
+
+/*
+ * config-channel.h（eBPF とユーザ空間で共有する “設定コマンド” の定義）
+ *
+ * 目的:
+ *   hello-verifier.c は UID=501 のメッセージを
+ *     bpf_map__update_elem(skel->maps.my_config, ...)
+ *   で 1 キーずつ書き込んでいた。キーが増えるとその分だけ bpf() syscall が走る。
+ *
+ *   config-channel では、ユーザ空間が「設定コマンド」を
+ *   BPF_MAP_TYPE_USER_RINGBUF にまとめて書き込み、
+ *   カーネル側の BPF プログラムが bpf_user_ringbuf_drain() で一気に読み出して
+ *   map に反映する。ユーザ空間 → カーネルの向きのリングバッファである。
+ *
+ *   ┌────────────┐ reserve/submit ┌──────────────────┐ drain ┌───────────────┐
+ *   │ user space │ ─────────────> │ USER_RINGBUF     │ ────> │ BPF (syscall/ │
+ *   │ (コマンド列)│  (syscall 不要) │ commands         │       │  timer 起動)  │
+ *   └────────────┘                └──────────────────┘       └──────┬────────┘
+ *                                                                   │ map update
+ *                                                                   v
+ *                                              my_config / uid_filter / sample_rate
+ *
+ * 重要（ABI）:
+ *   - struct config_cmd はユーザ空間が書いたバイト列を BPF 側がそのまま読む。
+ *     フィールド順・型・サイズは両側で完全一致が必要。
+ *   - イベント側の struct data_t / 設定値 struct msg_t は hello-verifier.h のものを使う。
+ */
+
+#include "hello-verifier.h"   // struct data_t / struct msg_t
+
+/*
+ * config_op:
+ *   ring に積むコマンドの種類。
+ *
+ *   CONFIG_OP_SET_MSG      : my_config[uid] = message（hello-verifier の UID=501 設定と同じ）
+ *   CONFIG_OP_DEL_MSG      : my_config から uid を削除
+ *   CONFIG_OP_ADD_FILTER   : uid_filter に uid を追加（その UID のイベントは出さない）
+ *   CONFIG_OP_DEL_FILTER   : uid_filter から uid を削除
+ *   CONFIG_OP_SET_SAMPLING : value 回に 1 回だけイベントを出す（0/1 は全件）
+ */
+enum config_op {
+   CONFIG_OP_SET_MSG      = 1,
+   CONFIG_OP_DEL_MSG      = 2,
+   CONFIG_OP_ADD_FILTER   = 3,
+   CONFIG_OP_DEL_FILTER   = 4,
+   CONFIG_OP_SET_SAMPLING = 5,
+};
+
+/*
+ * struct config_cmd:
+ *   USER_RINGBUF の 1 サンプル = 1 コマンド。
+ *
+ *   op      : enum config_op
+ *   uid     : 対象 UID（SET_SAMPLING では未使用）
+ *   value   : SET_SAMPLING のサンプリング間隔
+ *   message : SET_MSG で書き込むメッセージ（msg_t.message と同じ 12 bytes）
+ *
+ * NOTE:
+ *   サンプルは 8 byte 境界に揃えて ring に置かれるので、
+ *   ここを 8 の倍数（4+4+4+12 = 24 bytes）にしておくと無駄がない。
+ */
+struct config_cmd {
+   unsigned int op;
+   unsigned int uid;
+   unsigned int value;
+   char message[12];
+};
+
+/*
+ * struct drain_stats:
+ *   drain の結果カウンタ。BPF 側の .bss に置き、ユーザ空間が skeleton 経由で読む。
+ *
+ *   applied : 反映できたコマンド数
+ *   invalid : サイズ不正・未知の op・map 更新失敗で捨てたコマンド数
+ *   drains  : bpf_user_ringbuf_drain() を呼んだ回数（syscall 起動 + timer 起動）
+ */
+struct drain_stats {
+   unsigned long long applied;
+   unsigned long long invalid;
+   unsigned long long drains;
+};
+
+/*
+ * struct drain_args:
+ *   SEC("syscall") プログラムへ bpf_prog_test_run_opts() の ctx_in として渡す引数。
+ *
+ *   timer_interval_ns : 0 以外なら、その周期で drain する bpf_timer を起動する
+ *                       （0 なら “今すぐ 1 回 drain する” だけ）
+ *   drained           : 今回の呼び出しで drain したコマンド数（BPF 側が書き戻す）
+ */
+struct drain_args {
+   unsigned long long timer_interval_ns;
+   long long drained;
+};
+
+#endif /* CONFIG_CHANNEL_H */
@@ -0,0 +1,225 @@
+/*
+ * map-bench.bpf.c（map 種別ごとの lookup / update / delete コスト / BPF 側）
+ *
+ * 目的:
+ *   ユーザ空間（map-bench.c）が BPF_PROG_TEST_RUN で run_bench を呼ぶと、
+ *   指定された map に指定された操作を nr_ops 回 bpf_loop で行い、
+ *   かかった時間を results[自分の CPU] に書く。
+ *
+ * なぜ raw_tp か:
+ *   SEC("syscall") は sleepable 扱いでロードされ、カーネルによっては LPM_TRIE / BLOOM_FILTER を使えない。
+ *   raw_tp は test_run で
+ *     - 引数（u64 の配列 = struct bench_args）を渡せる
+ *     - BPF_F_TEST_RUN_ON_CPU で実行 CPU を選べる（同時に複数 CPU から叩ける）
+ *     - tracing 系ヘルパ（bpf_get_current_task_btf / bpf_task_storage_get）が使える
+ *   ので、全部の map を 1 つのプログラムで扱える。
+ *
+ * 流れ:
+ *
+ *   run_bench(args)
+ *     ├─ t0 = bpf_ktime_get_ns()
+ *     ├─ bpf_loop(nr_ops, bench_cb, &c)
+ *     │     bench_cb(i):
+ *     │        idx = (start + i * stride) % key_space を key（bloom は value）に書く
+ *     │        map 番号 × 操作 で 1 つのヘルパを呼ぶ（失敗は errors に数える）
+ *     └─ results[cpu] = { t1 - t0, nr_ops, errors }
+ *
+ * map の定義について:
+ *   key_size / value_size / max_entries はユーザ空間がロード前に上書きする。
+ *   そのため型（__type）ではなく __uint(key_size, ...) で定義し、BTF の型を持たせない
+ *   （BTF の型とサイズが食い違うと map 作成に失敗する）。
+ *   task storage だけは BTF が必須なので value は struct task_val 固定。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include "map-bench.h"
+
+struct bench_result results[MAX_CPUS] = {};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 1);
+    __uint(key_size, 4);
+    __uint(value_size, 8);
+} hash SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, 1);
+    __uint(key_size, 4);
+    __uint(value_size, 8);
+} percpu_hash SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 1);
+    __uint(key_size, 4);
+    __uint(value_size, 8);
+} lru_hash SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __uint(key_size, 4);
+    __uint(value_size, 8);
+} array SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __uint(key_size, 4);
+    __uint(value_size, 8);
+} percpu_array SEC(".maps");
+
+/* key = struct { u32 prefixlen; u8 data[key_size - 4]; } */
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, 1);
+    __uint(key_size, 8);
+    __uint(value_size, 8);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} lpm_trie SEC(".maps");
+
+/* key を持たない。value がそのまま「集合の要素」。map_extra はハッシュ関数の数 */
+struct {
+    __uint(type, BPF_MAP_TYPE_BLOOM_FILTER);
+    __uint(max_entries, 1);
+    __uint(value_size, 8);
+    __uint(map_extra, 5);
+} bloom_filter SEC(".maps");
+
+struct task_val {
+    u8 data[TASK_VALUE];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, int);
+    __type(value, struct task_val);
+} task_storage SEC(".maps");
+
+struct loop_ctx {
+    u32 map;
+    u32 op;
+    u32 start;
+    u32 stride;
+    u32 key_space;
+    u64 errors;
+    u8 key[MAX_KEY];
+    u8 val[MAX_VALUE];
+};
+
+/* key（value）を引数に取る通常の map 操作 */
+#define MAP_OP(m)                                                           \
+    do {                                                                    \
+        if (c->op == OP_LOOKUP)                                             \
+            err = bpf_map_lookup_elem(&m, c->key) ? 0 : -1;                 \
+        else if (c->op == OP_UPDATE)                                        \
+            err = bpf_map_update_elem(&m, c->key, c->val, BPF_ANY);         \
+        else if (c->op == OP_DELETE)                                        \
+            err = bpf_map_delete_elem(&m, c->key);                          \
+    } while (0)
+
+static long bench_cb(u32 i, void *data)
+{
+    struct loop_ctx *c = data;
+    u32 idx = (c->start + i * c->stride) % c->key_space;
+    struct task_struct *task;
+    struct task_val *tv;
+    long err = 0;
+
+    if (c->op == OP_LOOP)
+        return 0;
+
+    switch (c->map) {
+    case BM_HASH:
+        *(u32 *)c->key = idx;
+        MAP_OP(hash);
+        break;
+    case BM_PERCPU_HASH:
+        *(u32 *)c->key = idx;
+        MAP_OP(percpu_hash);
+        break;
+    case BM_LRU_HASH:
+        *(u32 *)c->key = idx;
+        MAP_OP(lru_hash);
+        break;
+    case BM_ARRAY:
+        *(u32 *)c->key = idx;
+        MAP_OP(array);
+        break;
+    case BM_PERCPU_ARRAY:
+        *(u32 *)c->key = idx;
+        MAP_OP(percpu_array);
+        break;
+    case BM_LPM_TRIE:
+        /* 先頭 4 bytes は prefixlen（run_bench で設定済み）。その後ろに番号を書く */
+        *(u32 *)&c->key[4] = idx;
+        MAP_OP(lpm_trie);
+        break;
+    case BM_BLOOM_FILTER:
+        *(u32 *)c->val = idx;
+        if (c->op == OP_LOOKUP)
+            err = bpf_map_peek_elem(&bloom_filter, c->val);
+        else if (c->op == OP_UPDATE)
+            err = bpf_map_push_elem(&bloom_filter, c->val, BPF_ANY);
+        else
+            err = -1;
+        break;
+    case BM_TASK_STORAGE:
+        /* task ポインタは loop_ctx に置かず毎回取る（この helper の分もコストに入る） */
+        task = bpf_get_current_task_btf();
+        if (c->op == OP_LOOKUP) {
+            err = bpf_task_storage_get(&task_storage, task, 0, 0) ? 0 : -1;
+        } else if (c->op == OP_UPDATE) {
+            tv = bpf_task_storage_get(&task_storage, task, 0,
+                                      BPF_LOCAL_STORAGE_GET_F_CREATE);
+            if (tv)
+                *(u64 *)tv->data = i;
+            else
+                err = -1;
+        } else if (c->op == OP_DELETE) {
+            err = bpf_task_storage_delete(&task_storage, task);
+            if (!bpf_task_storage_get(&task_storage, task, 0,
+                                      BPF_LOCAL_STORAGE_GET_F_CREATE))
+                err = -1;
+        }
+        break;
+    }
+
+    if (err)
+        c->errors++;
+    return 0;
+}
+
+SEC("raw_tp")
+int run_bench(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct loop_ctx c = {};
+    u32 cpu = bpf_get_smp_processor_id();
+    u64 nr_ops = ctx->args[2];
+    u64 t0, t1;
+    long ret;
+
+    c.map = ctx->args[0];
+    c.op = ctx->args[1];
+    c.start = ctx->args[3];
+    c.stride = ctx->args[4];
+    c.key_space = ctx->args[5] ? ctx->args[5] : 1;
+    *(u32 *)c.key = ctx->args[6];   /* LPM_TRIE の prefixlen（他の map では bench_cb が上書きする） */
+
+    t0 = bpf_ktime_get_ns();
+    ret = bpf_loop(nr_ops, bench_cb, &c, 0);
+    t1 = bpf_ktime_get_ns();
+
+    if (cpu >= MAX_CPUS)
+        return 0;
+    results[cpu].ns = t1 - t0;
+    results[cpu].ops = ret > 0 ? ret : 0;
+    results[cpu].errors = c.errors;
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
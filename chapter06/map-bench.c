@@ -0,0 +1,643 @@
+/*
+ * map-bench.c（map 種別 × key/value サイズ × 埋まり具合 × CPU 数 のコスト表を CSV で出す）
+ *
+ * 目的:
+ *   HASH / PERCPU_HASH / LRU_HASH / ARRAY / PERCPU_ARRAY / LPM_TRIE / BLOOM_FILTER / TASK_STORAGE の
+ *   lookup / update / delete 1 回あたりの時間を、BPF 側（map-bench.bpf.c の run_bench を test_run）と
+ *   ユーザ空間側（1 要素ずつの syscall と *_batch）の両方で測る。
+ *   結果は 1 行 1 測定の CSV にして、カーネルを上げたときに前回の CSV と比べられるようにする。
+ *
+ * 使い方:
+ *   sudo ./map-bench [-M maps] [-s key:value,...] [-m max_entries] [-O occ%,...] [-c cpus,...]
+ *                    [-n ops] [-o out.csv]
+ *
+ *   -M  測る map（既定は全部）: hash,percpu_hash,lru_hash,array,percpu_array,lpm_trie,bloom_filter,task_storage
+ *   -s  key:value サイズの組（既定 8:8,16:64,64:256。上限は MAX_KEY / MAX_VALUE）
+ *       array 系と task storage の key は 4 固定、LPM_TRIE の key は 8 以上、bloom は key なし
+ *   -m  max_entries（既定 65536）
+ *   -O  埋まり具合 %（既定 10,50,90,100。array 系は常に 100、task storage は対象外）
+ *   -c  同時に叩く CPU 数（既定 1 と全 CPU。CPU 0 から順に使う）
+ *   -n  BPF 側で 1 CPU が行う操作の回数（既定 1048576）
+ *   -o  CSV の出力先（既定 stdout。進み具合は stderr）
+ *
+ * CSV の列:
+ *   kernel,map,key_size,value_size,max_entries,occupancy_pct,cpus,op,ops,ns_per_op,ns_per_op_net,mops,errors
+ *
+ *   op            : bpf_lookup / bpf_update / bpf_delete（BPF 側）
+ *                   user_lookup（1 要素 1 syscall）/ user_lookup_batch / user_update_batch / user_delete_batch
+ *   ns_per_op     : 1 操作の平均時間（BPF 側は各 CPU の合計時間 / 合計操作数）
+ *   ns_per_op_net : ns_per_op から bpf_loop だけ回したときの時間を引いたもの（BPF 側のみ）
+ *   mops          : 全 CPU 合計のスループット（合計操作数 / 一番遅い CPU の時間）
+ *   errors        : 失敗した操作の数（lookup のミス, bloom の「無い」判定など）
+ *
+ * 流れ（map × サイズごと）:
+ *
+ *   open → 対象 map の key/value/max_entries を設定（他の map は max_entries = 1）→ load
+ *     └─ 埋まり具合ごと（昇順）:
+ *          ユーザ空間から足りない分を埋める（batch が使えなければ 1 つずつ）
+ *          CPU 数ごと: loop / lookup / update / delete を run_bench で測る（delete の後は埋め直す）
+ *          最後の埋まり具合でだけユーザ空間の操作を測る
+ *
+ * 注意:
+ *   - 各スレッドは自分の CPU に固定したうえで BPF_F_TEST_RUN_ON_CPU を付けるので、
+ *     run_bench は IPI ではなく呼び出したスレッドの文脈で動く。
+ *   - lookup / update はその時点で入っている key（0 .. filled-1）だけを叩く。update は上書き。
+ *     delete は CPU ごとに重ならない key を消し、測定後にユーザ空間から埋め直す。
+ *   - inode storage は LSM プログラムからしか触れず test_run で動かせないので対象外。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/utsname.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "map-bench.h"
+#include "map-bench.skel.h"
+
+#define MAX_LIST  16
+#define BATCH     4096   /* ユーザ空間の batch 操作 1 回の要素数 */
+
+struct map_desc {
+    const char *name;
+    enum bench_map id;
+    bool fixed_key;     /* key は 4 bytes 固定（array 系） */
+    bool has_delete;
+    bool occupancy;     /* 埋まり具合を変えて測る意味がある */
+    bool user_ops;      /* ユーザ空間から key で触れる */
+};
+
+static const struct map_desc descs[NR_BENCH_MAPS] = {
+    { "hash",         BM_HASH,         false, true,  true,  true },
+    { "percpu_hash",  BM_PERCPU_HASH,  false, true,  true,  true },
+    { "lru_hash",     BM_LRU_HASH,     false, true,  true,  true },
+    { "array",        BM_ARRAY,        true,  false, false, true },
+    { "percpu_array", BM_PERCPU_ARRAY, true,  false, false, true },
+    { "lpm_trie",     BM_LPM_TRIE,     false, true,  true,  true },
+    { "bloom_filter", BM_BLOOM_FILTER, false, false, true,  true },
+    { "task_storage", BM_TASK_STORAGE, true,  true,  false, false },
+};
+
+static const char *op_names[NR_BENCH_OPS] = { "bpf_loop", "bpf_lookup", "bpf_update", "bpf_delete" };
+
+/* 1 回の測定（CSV の 1 行）に共通する列 */
+struct run_state {
+    FILE *out;
+    const char *kernel;
+    const struct map_desc *desc;
+    struct map_bench_bpf *skel;
+    struct bpf_map *map;
+    unsigned int key_size;
+    unsigned int value_size;
+    unsigned int max_entries;
+    int occupancy;          /* -1 は対象外 */
+    int nr_cpus;            /* possible CPU 数（per-CPU の値の大きさに使う） */
+};
+
+struct worker {
+    pthread_t thread;
+    int cpu;
+    int prog_fd;
+    struct bench_args args;
+    int err;
+};
+
+static pthread_barrier_t start_barrier;
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int parse_list(const char *s, int *out, int max)
+{
+    int n = 0;
+
+    while (*s && n < max) {
+        out[n++] = strtol(s, (char **)&s, 0);
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return -1;
+    }
+    return n;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static void emit(const struct run_state *st, int cpus, const char *op, unsigned long long ops,
+                 double ns_per_op, double net, double mops, unsigned long long errors)
+{
+    fprintf(st->out, "%s,%s,%u,%u,%u,", st->kernel, st->desc->name,
+            st->key_size, st->value_size, st->max_entries);
+    if (st->occupancy >= 0)
+        fprintf(st->out, "%d", st->occupancy);
+    fprintf(st->out, ",%d,%s,%llu,%.2f,", cpus, op, ops, ns_per_op);
+    if (!isnan(net))
+        fprintf(st->out, "%.2f", net);
+    fprintf(st->out, ",%.3f,%llu\n", mops, errors);
+    fflush(st->out);
+}
+
+static struct bpf_map *target_map(struct map_bench_bpf *skel, enum bench_map id)
+{
+    switch (id) {
+    case BM_HASH:         return skel->maps.hash;
+    case BM_PERCPU_HASH:  return skel->maps.percpu_hash;
+    case BM_LRU_HASH:     return skel->maps.lru_hash;
+    case BM_ARRAY:        return skel->maps.array;
+    case BM_PERCPU_ARRAY: return skel->maps.percpu_array;
+    case BM_LPM_TRIE:     return skel->maps.lpm_trie;
+    case BM_BLOOM_FILTER: return skel->maps.bloom_filter;
+    case BM_TASK_STORAGE: return skel->maps.task_storage;
+    default:              return NULL;
+    }
+}
+
+/* BPF 側の bench_cb と同じ並びで idx 番の key を作る */
+static void make_key(const struct run_state *st, unsigned char *key, unsigned int idx)
+{
+    memset(key, 0, st->key_size);
+    if (st->desc->id == BM_LPM_TRIE) {
+        unsigned int prefixlen = (st->key_size - 4) * 8;
+
+        memcpy(key, &prefixlen, 4);
+        memcpy(key + 4, &idx, 4);
+    } else {
+        memcpy(key, &idx, 4);
+    }
+}
+
+/* ユーザ空間から見た 1 要素の value の大きさ（per-CPU map は CPU 分） */
+static size_t user_value_size(const struct run_state *st)
+{
+    if (st->desc->id == BM_PERCPU_HASH || st->desc->id == BM_PERCPU_ARRAY)
+        return ((st->value_size + 7) & ~7U) * st->nr_cpus;
+    return st->value_size;
+}
+
+/*
+ * key [from, to) を入れる。batch が使えればまとめて、使えなければ 1 つずつ。
+ * bloom は value が要素そのもの（bench_cb と同じく先頭 4 bytes に番号）。
+ */
+static int fill(const struct run_state *st, unsigned int from, unsigned int to)
+{
+    int fd = bpf_map__fd(st->map);
+    size_t vsz = user_value_size(st);
+    unsigned char *keys = calloc(BATCH, st->key_size ? st->key_size : 1);
+    unsigned char *vals = calloc(BATCH, vsz);
+    bool batch = st->desc->id != BM_BLOOM_FILTER;
+    int err = 0;
+
+    if (!keys || !vals) {
+        err = -ENOMEM;
+        goto out;
+    }
+
+    for (unsigned int i = from; i < to && !err; i += BATCH) {
+        unsigned int n = to - i < BATCH ? to - i : BATCH;
+        __u32 count = n;
+
+        for (unsigned int j = 0; j < n; j++) {
+            if (st->key_size)
+                make_key(st, keys + (size_t)j * st->key_size, i + j);
+            else
+                memcpy(vals + (size_t)j * vsz, &(unsigned int){ i + j }, 4);
+        }
+        if (batch && !bpf_map_update_batch(fd, keys, vals, &count, NULL))
+            continue;
+        batch = false;   /* 一度失敗したら以降は 1 つずつ */
+        for (unsigned int j = 0; j < n && !err; j++) {
+            if (bpf_map_update_elem(fd, st->key_size ? keys + (size_t)j * st->key_size : NULL,
+                                    vals + (size_t)j * vsz, BPF_ANY))
+                err = -errno;
+        }
+    }
+out:
+    free(keys);
+    free(vals);
+    return err;
+}
+
+static void *worker_fn(void *arg)
+{
+    struct worker *w = arg;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    pthread_barrier_wait(&start_barrier);
+    {
+        LIBBPF_OPTS(bpf_test_run_opts, opts,
+                    .ctx_in = &w->args,
+                    .ctx_size_in = sizeof(w->args),
+                    .flags = BPF_F_TEST_RUN_ON_CPU,
+                    .cpu = w->cpu);
+
+        if (bpf_prog_test_run_opts(w->prog_fd, &opts))
+            w->err = -errno;
+    }
+    return NULL;
+}
+
+/*
+ * cpus 本のスレッドで同時に run_bench を 1 回ずつ実行する。
+ *   lookup / update : CPU ごとに開始位置をずらして [0, filled) を nr_ops 回
+ *   delete          : CPU t は key t, t + cpus, t + 2 * cpus, ... を消す（重ならない）
+ * loop_ns は同じ CPU 数で OP_LOOP を回したときの ns/op（net の計算用）。
+ * 戻り値は ns/op（失敗なら負）。
+ */
+static double run_bpf(const struct run_state *st, int cpus, enum bench_op op,
+                      unsigned int filled, unsigned long long nr_ops, double loop_ns)
+{
+    struct worker *w = calloc(cpus, sizeof(*w));
+    unsigned long long ops = 0, errors = 0, ns_sum = 0, ns_max = 0;
+    double ns_per_op = -1;
+
+    if (!w)
+        return -1;
+    if (op == OP_DELETE && st->desc->id != BM_TASK_STORAGE)
+        nr_ops = filled / cpus;
+    if (!nr_ops)
+        goto out;
+
+    memset(st->skel->bss->results, 0, sizeof(st->skel->bss->results));
+    pthread_barrier_init(&start_barrier, NULL, cpus);
+    for (int t = 0; t < cpus; t++) {
+        w[t].cpu = t;
+        w[t].prog_fd = bpf_program__fd(st->skel->progs.run_bench);
+        w[t].args = (struct bench_args){
+            .map = st->desc->id,
+            .op = op,
+            .nr_ops = nr_ops,
+            .start = (unsigned long long)t * (op == OP_DELETE ? 1 : filled / cpus),
+            .stride = op == OP_DELETE ? cpus : 1,
+            .key_space = filled ? filled : 1,
+            .prefixlen = st->key_size > 4 ? (st->key_size - 4) * 8 : 0,
+        };
+        pthread_create(&w[t].thread, NULL, worker_fn, &w[t]);
+    }
+    for (int t = 0; t < cpus; t++)
+        pthread_join(w[t].thread, NULL);
+    pthread_barrier_destroy(&start_barrier);
+
+    for (int t = 0; t < cpus; t++) {
+        const struct bench_result *r = &st->skel->bss->results[t];
+
+        if (w[t].err) {
+            fprintf(stderr, "%s %s: test_run on CPU %d failed: %d\n",
+                    st->desc->name, op_names[op], t, w[t].err);
+            goto out;
+        }
+        ops += r->ops;
+        errors += r->errors;
+        ns_sum += r->ns;
+        if (r->ns > ns_max)
+            ns_max = r->ns;
+    }
+    if (!ops)
+        goto out;
+
+    ns_per_op = (double)ns_sum / ops;
+    if (op != OP_LOOP)
+        emit(st, cpus, op_names[op], ops, ns_per_op, loop_ns >= 0 ? ns_per_op - loop_ns : NAN,
+             ns_max ? ops * 1e3 / ns_max : 0, errors);
+out:
+    free(w);
+    return ns_per_op;
+}
+
+/* ユーザ空間からの操作（最後の埋まり具合で 1 回だけ）。batch が使えない map では batch の行を出さない */
+static void run_user(const struct run_state *st, unsigned int filled)
+{
+    int fd = bpf_map__fd(st->map);
+    size_t vsz = user_value_size(st), ksz = st->key_size ? st->key_size : 1;
+    unsigned char *keys = calloc(filled > BATCH ? filled : BATCH, ksz);
+    unsigned char *vals = calloc(BATCH, vsz);
+    unsigned char *val = calloc(1, vsz);
+    unsigned char in[16], out[16];
+    unsigned long long errors = 0, total;
+    double t0, t;
+    bool first;
+
+    if (!keys || !vals || !val || !filled)
+        goto out;
+
+    for (unsigned int i = 0; i < filled; i++) {
+        if (st->key_size)
+            make_key(st, keys + (size_t)i * ksz, i);
+    }
+
+    /* 1 要素 1 syscall（bloom は key の代わりに value を渡して「入っているか」を聞く） */
+    t0 = now_ns();
+    for (unsigned int i = 0; i < filled; i++) {
+        int err;
+
+        if (st->key_size) {
+            err = bpf_map_lookup_elem(fd, keys + (size_t)i * ksz, val);
+        } else {
+            memcpy(val, &i, 4);
+            err = bpf_map_lookup_elem(fd, NULL, val);
+        }
+        if (err)
+            errors++;
+    }
+    t = now_ns() - t0;
+    emit(st, 1, "user_lookup", filled, t / filled, NAN, filled * 1e3 / t, errors);
+
+    if (!st->key_size)
+        goto out;
+
+    /* lookup_batch で全部読む（in/out は map 内部の位置を表す不透明な値） */
+    total = 0;
+    first = true;
+    t0 = now_ns();
+    for (;;) {
+        __u32 count = BATCH;
+        int err = bpf_map_lookup_batch(fd, first ? NULL : in, out, keys, vals, &count, NULL);
+
+        if (err && errno != ENOENT)
+            goto out;           /* batch 非対応 */
+        total += count;
+        if (err)
+            break;              /* ENOENT = 最後まで読んだ */
+        memcpy(in, out, sizeof(in));
+        first = false;
+    }
+    t = now_ns() - t0;
+    if (total)
+        emit(st, 1, "user_lookup_batch", total, t / total, NAN, total * 1e3 / t, 0);
+
+    /* 上の lookup_batch で keys を上書きしたので作り直す */
+    for (unsigned int i = 0; i < filled; i++)
+        make_key(st, keys + (size_t)i * ksz, i);
+
+    /* update_batch: 入っている key を上書き */
+    memset(vals, 0, BATCH * vsz);
+    t0 = now_ns();
+    for (unsigned int i = 0; i < filled; i += BATCH) {
+        __u32 count = filled - i < BATCH ? filled - i : BATCH;
+
+        if (bpf_map_update_batch(fd, keys + (size_t)i * ksz, vals, &count, NULL))
+            goto out;
+    }
+    t = now_ns() - t0;
+    emit(st, 1, "user_update_batch", filled, t / filled, NAN, filled * 1e3 / t, 0);
+
+    if (!st->desc->has_delete)
+        goto out;
+
+    /* delete_batch: 全部消して、測定の外で埋め直す */
+    t0 = now_ns();
+    for (unsigned int i = 0; i < filled; i += BATCH) {
+        __u32 count = filled - i < BATCH ? filled - i : BATCH;
+
+        if (bpf_map_delete_batch(fd, keys + (size_t)i * ksz, &count, NULL)) {
+            fill(st, 0, filled);
+            goto out;
+        }
+    }
+    t = now_ns() - t0;
+    emit(st, 1, "user_delete_batch", filled, t / filled, NAN, filled * 1e3 / t, 0);
+    fill(st, 0, filled);
+out:
+    free(keys);
+    free(vals);
+    free(val);
+}
+
+static int bench_map(struct run_state *st, const int *occs, int nr_occs,
+                     const int *cpus, int nr_cpu_list, unsigned long long nr_ops)
+{
+    struct map_bench_bpf *skel;
+    struct bpf_map *m;
+    unsigned int filled = 0;
+    int passes, err;
+
+    skel = map_bench_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF skeleton\n");
+        return -1;
+    }
+    st->skel = skel;
+    st->map = target_map(skel, st->desc->id);
+
+    /* 対象以外の map は最小にしておく（per-CPU array を全部大きくするとメモリを食う） */
+    bpf_object__for_each_map(m, skel->obj) {
+        if (bpf_map__type(m) == BPF_MAP_TYPE_TASK_STORAGE || bpf_map__is_internal(m))
+            continue;
+        if (m != st->map) {
+            bpf_map__set_max_entries(m, 1);
+            continue;
+        }
+        if (st->key_size)
+            bpf_map__set_key_size(m, st->key_size);
+        bpf_map__set_value_size(m, st->value_size);
+        bpf_map__set_max_entries(m, st->max_entries);
+    }
+
+    err = map_bench_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF skeleton for %s (key %u, value %u): %d\n",
+                st->desc->name, st->key_size, st->value_size, err);
+        goto cleanup;
+    }
+
+    /* array 系は常に全要素あり、task storage は自分の task の 1 つだけなので 1 回で終わり */
+    passes = st->desc->occupancy ? nr_occs : 1;
+    for (int o = 0; o < passes; o++) {
+        if (!st->desc->occupancy) {
+            st->occupancy = st->desc->id == BM_TASK_STORAGE ? -1 : 100;
+            filled = st->desc->id == BM_TASK_STORAGE ? 1 : st->max_entries;
+        } else {
+            unsigned int want = (unsigned long long)st->max_entries * occs[o] / 100;
+
+            st->occupancy = occs[o];
+            if (want > filled) {
+                err = fill(st, filled, want);
+                if (err) {
+                    fprintf(stderr, "%s: failed to fill to %u entries: %d\n",
+                            st->desc->name, want, err);
+                    goto cleanup;
+                }
+            }
+            filled = want;
+            if (!filled)
+                continue;
+        }
+        fprintf(stderr, "%s key=%u value=%u occupancy=%d%% entries=%u\n", st->desc->name,
+                st->key_size, st->value_size, st->occupancy, filled);
+
+        for (int c = 0; c < nr_cpu_list; c++) {
+            double loop_ns = run_bpf(st, cpus[c], OP_LOOP, filled, nr_ops, -1);
+
+            for (int op = OP_LOOKUP; op < NR_BENCH_OPS; op++) {
+                if (op == OP_DELETE && !st->desc->has_delete)
+                    continue;
+                run_bpf(st, cpus[c], op, filled, nr_ops, loop_ns);
+                if (op == OP_DELETE && st->desc->id != BM_TASK_STORAGE)
+                    fill(st, 0, filled);
+            }
+        }
+
+        if (o == passes - 1 && st->desc->user_ops)
+            run_user(st, filled);
+    }
+    err = 0;
+
+cleanup:
+    map_bench_bpf__destroy(skel);
+    st->skel = NULL;
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    const char *maps_opt = NULL, *sizes_opt = "8:8,16:64,64:256", *out_path = NULL;
+    int occs[MAX_LIST] = { 10, 50, 90, 100 }, nr_occs = 4;
+    int cpus[MAX_LIST], nr_cpu_list = 0;
+    int online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long nr_ops = 1 << 20;
+    struct run_state st = { .max_entries = 65536 };
+    struct utsname uts;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "M:s:m:O:c:n:o:")) != -1) {
+        switch (opt) {
+        case 'M': maps_opt = optarg; break;
+        case 's': sizes_opt = optarg; break;
+        case 'm': st.max_entries = strtoul(optarg, NULL, 0); break;
+        case 'O': nr_occs = parse_list(optarg, occs, MAX_LIST); break;
+        case 'c': nr_cpu_list = parse_list(optarg, cpus, MAX_LIST); break;
+        case 'n': nr_ops = strtoull(optarg, NULL, 0); break;
+        case 'o': out_path = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-M maps] [-s key:value,...] [-m max_entries] "
+                            "[-O occ%%,...] [-c cpus,...] [-n ops] [-o out.csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!nr_cpu_list) {
+        cpus[nr_cpu_list++] = 1;
+        if (online > 1)
+            cpus[nr_cpu_list++] = online < MAX_CPUS ? online : MAX_CPUS;
+    }
+    if (nr_occs <= 0 || nr_cpu_list <= 0 || !st.max_entries || !nr_ops || nr_ops > (1 << 23)) {
+        fprintf(stderr, "Invalid -O / -c / -m / -n (ops must be 1..%d)\n", 1 << 23);
+        return 1;
+    }
+    for (int c = 0; c < nr_cpu_list; c++) {
+        if (cpus[c] <= 0 || cpus[c] > online || cpus[c] > MAX_CPUS) {
+            fprintf(stderr, "Invalid CPU count %d (online %d)\n", cpus[c], online);
+            return 1;
+        }
+    }
+    qsort(occs, nr_occs, sizeof(occs[0]), cmp_int);
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    uname(&uts);
+    st.kernel = uts.release;
+    st.nr_cpus = libbpf_num_possible_cpus();
+    st.out = out_path ? fopen(out_path, "w") : stdout;
+    if (!st.out || st.nr_cpus <= 0) {
+        fprintf(stderr, "Failed to open %s\n", out_path);
+        return 1;
+    }
+    fprintf(st.out, "kernel,map,key_size,value_size,max_entries,occupancy_pct,cpus,op,ops,"
+                    "ns_per_op,ns_per_op_net,mops,errors\n");
+
+    for (int d = 0; d < NR_BENCH_MAPS; d++) {
+        /* 同じ map で実効サイズが同じ組み合わせは 1 回だけ測る */
+        unsigned int seen[MAX_LIST][2];
+        int nr_seen = 0;
+        const char *s = sizes_opt;
+
+        st.desc = &descs[d];
+        if (maps_opt) {
+            const char *p = strstr(maps_opt, descs[d].name);
+            size_t len = strlen(descs[d].name);
+
+            if (!p || (p != maps_opt && p[-1] != ',') || (p[len] && p[len] != ','))
+                continue;
+        }
+
+        while (*s) {
+            unsigned int k = strtoul(s, (char **)&s, 0), v;
+            bool dup = false;
+
+            if (*s++ != ':') {
+                fprintf(stderr, "Invalid -s %s\n", sizes_opt);
+                return 1;
+            }
+            v = strtoul(s, (char **)&s, 0);
+            if (*s == ',')
+                s++;
+
+            if (descs[d].id == BM_TASK_STORAGE) {
+                k = 4;
+                v = TASK_VALUE;
+            } else if (descs[d].fixed_key) {
+                k = 4;
+            } else if (descs[d].id == BM_LPM_TRIE) {
+                k = k < 8 ? 8 : k;
+            } else if (descs[d].id == BM_BLOOM_FILTER) {
+                k = 0;
+            }
+            if (k < 4 && descs[d].id != BM_BLOOM_FILTER)
+                k = 4;
+            if (v < 8)
+                v = 8;
+            if (k > MAX_KEY || v > MAX_VALUE) {
+                fprintf(stderr, "key/value size %u:%u exceeds %d:%d\n", k, v, MAX_KEY, MAX_VALUE);
+                return 1;
+            }
+
+            for (int i = 0; i < nr_seen; i++)
+                dup |= seen[i][0] == k && seen[i][1] == v;
+            if (dup || nr_seen == MAX_LIST)
+                continue;
+            seen[nr_seen][0] = k;
+            seen[nr_seen][1] = v;
+            nr_seen++;
+
+            st.key_size = k;
+            st.value_size = v;
+            bench_map(&st, occs, nr_occs, cpus, nr_cpu_list, nr_ops);
+        }
+    }
+
+    if (out_path)
+        fclose(st.out);
+    return 0;
+}
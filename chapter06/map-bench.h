@@ -0,0 +1,72 @@
+#ifndef MAP_BENCH_H
+#define MAP_BENCH_H
+
+/*
+ * map-bench.h（map 種別ごとの lookup / update / delete コストを測るベンチで共有する定義）
+ *
+ * 目的:
+ *   どの map 種別を使うかを「経験則」ではなく数字で決めるために、
+ *   map 種別 × key/value サイズ × 埋まり具合 × 同時に叩く CPU 数 の組み合わせで
+ *   BPF 側からの操作 1 回あたりの時間を測り、CSV に出す。
+ */
+
+#define MAX_KEY    64    /* BPF 側の key バッファ。これより大きい key_size は verifier に弾かれる */
+#define MAX_VALUE  256   /* 同じく value バッファ */
+#define MAX_CPUS   256   /* 結果スロットの数（bpf_get_smp_processor_id() で引く） */
+#define TASK_VALUE 64    /* task storage の value サイズ（BTF 必須なのでロード時に変えられない） */
+
+/*
+ * bench_map:
+ *   測る map。BPF 側は同じ番号で map を選ぶ。
+ */
+enum bench_map {
+   BM_HASH,
+   BM_PERCPU_HASH,
+   BM_LRU_HASH,
+   BM_ARRAY,
+   BM_PERCPU_ARRAY,
+   BM_LPM_TRIE,
+   BM_BLOOM_FILTER,
+   BM_TASK_STORAGE,
+   NR_BENCH_MAPS,
+};
+
+/*
+ * bench_op:
+ *   OP_LOOP   : map を触らずにループだけ回す（bpf_loop の固定費。net の計算に使う）
+ *   OP_LOOKUP : lookup（bloom は peek, task storage は作らない get）
+ *   OP_UPDATE : update（bloom は push, task storage は get(F_CREATE) して 8 bytes 書く）
+ *   OP_DELETE : delete（task storage は delete してから作り直す 2 操作で 1 回）
+ */
+enum bench_op {
+   OP_LOOP,
+   OP_LOOKUP,
+   OP_UPDATE,
+   OP_DELETE,
+   NR_BENCH_OPS,
+};
+
+/*
+ * bench_args:
+ *   raw_tp の test_run に ctx_in として渡す引数（u64 の配列として読まれる）。
+ *   i 回目の操作は key 番号 (start + i * stride) % key_space を使う。
+ *   prefixlen は LPM_TRIE の key に入れる prefix 長（key_size - 4 bytes 全体 = 全ビット一致）。
+ */
+struct bench_args {
+   unsigned long long map;
+   unsigned long long op;
+   unsigned long long nr_ops;
+   unsigned long long start;
+   unsigned long long stride;
+   unsigned long long key_space;
+   unsigned long long prefixlen;
+};
+
+/* CPU ごとの結果（.bss の results[cpu]） */
+struct bench_result {
+   unsigned long long ns;
+   unsigned long long ops;
+   unsigned long long errors;
+};
+
+#endif /* MAP_BENCH_H */
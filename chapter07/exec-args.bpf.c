@@ -0,0 +1,264 @@
+/*
+ * exec-args.bpf.c（execve の argv / envp を取りこぼさずに読む: sleepable と非 sleepable の比較）
+ *
+ * 目的:
+ *   hello.bpf.c の各フックは bpf_probe_read_user でユーザメモリを読む。
+ *   このヘルパはページフォルトを起こせないので、読みたいページがまだ常駐していない
+ *   （swap out された / fork 直後で PTE がまだ無い / ファイルを mmap しただけ）と黙って失敗する。
+ *   exec 直前に組み立てた argv や、大きな環境変数はちょうどこの状態になりやすい。
+ *
+ *   sleepable なプログラム（fentry.s）では bpf_copy_from_user が使え、
+ *   これは通常の copy_from_user と同じくフォルトさせてページを持ってくる。
+ *   同じ syscall 入口に両方を付け、取れた割合と読み取りコストを並べて比べられるようにする。
+ *
+ * フック位置:
+ *
+ *   execve(path, argv, envp)
+ *     │
+ *     ├─ __x64_sys_execve ── [P] fentry   : bpf_probe_read_user / _str
+ *     │                   └─ [S] fentry.s : bpf_copy_from_user でフォルトさせてから _str で読む
+ *     v
+ *   do_execveat_common → copy_strings（カーネルが argv を新しい mm へコピー）→ bprm_* フック
+ *
+ *   bprm_* の LSM フックも sleepable にできるが、その時点で文字列は「まだ切り替わっていない新しい mm」
+ *   に移っていて、current->mm から読める元の argv ポインタは bprm に残っていない。
+ *   元の argv / envp を読めるのは syscall 入口だけなので、syscall のラッパ関数に付ける。
+ *   fentry.s が付けられるのは ALLOW_ERROR_INJECTION 付きの関数（syscall は全部そう）で、
+ *   CONFIG_FUNCTION_ERROR_INJECTION=y が必要。
+ *
+ * 読み方（argv / envp 共通。bpf_loop で 1 本ずつ）:
+ *
+ *   i 番目のポインタを読む ──失敗──> failed++ で打ち切り（配列自体が読めない）
+ *     │ NULL → 終わり
+ *     │ i >= max_argv / max_envp → truncated++ で打ち切り（本数の上限）
+ *     v
+ *   [S] のみ: bpf_copy_from_user で文字列のページをフォルトさせる（ページ境界で 2 回に分ける）
+ *     v
+ *   bpf_probe_read_user_str で data に NUL 終端まで詰める
+ *     └─ 失敗 → failed++（位置がずれないよう空文字列を置く）
+ *
+ *   bpf_copy_from_user は長さ固定のコピーしかできず、NUL で止まらない。
+ *   文字列の終わりを越えて未マップのページに入ると全体が失敗するので、
+ *   フォルトさせる役だけに使い、長さを決めるコピーは _str ヘルパに任せる。
+ *
+ * per-CPU scratch:
+ *   イベントは 8 KiB を超えるのでスタック（512 bytes）には置けない。モードごとに per-CPU の作業領域を持つ。
+ *   sleepable プログラムは migrate_disable で CPU には留まるが、途中で眠るので
+ *   同じ CPU で別の exec が同じプログラムに入ってくることがある。busy フラグで入れ子を検出し、
+ *   後から来た方は読まずに stats.busy に数える（上書きして壊すよりは「取れなかった」と分かる方がよい）。
+ *
+ * 注意:
+ *   - 32bit の互換 syscall（ia32 の execve）はポインタ幅が違うので対象外。
+ *   - max_argv / max_envp はローダが .rodata に書く（ARGS_MAX_LOOP 以下）。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "exec-args.h"
+
+/* syscall ラッパ関数名の接頭辞（ksyscall と違い fentry は自分で名前を組み立てる） */
+#if defined(__TARGET_ARCH_x86)
+#define SYS_PREFIX "__x64_"
+#elif defined(__TARGET_ARCH_arm64)
+#define SYS_PREFIX "__arm64_"
+#else
+#error "exec-args: unsupported architecture"
+#endif
+
+/* ページ境界の計算に使う。64 KiB ページの環境でも 4 KiB 単位で分ければ境界を跨がない */
+#define MIN_PAGE_SIZE 4096
+
+/* 本数の上限（ローダが -a / -e で書き換える） */
+const volatile u32 max_argv = 64;
+const volatile u32 max_envp = 64;
+
+/* モードごとの統計（enum capture_mode で引く） */
+struct mode_stats stats[NR_CAPTURE_MODES];
+
+struct scratch {
+    u32 busy;                 /* 1 = この CPU で誰かが ev を組み立て中 */
+    u32 pad;
+    struct exec_event ev;
+};
+
+/* key = enum capture_mode。モードが違えば作業領域も別 */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_CAPTURE_MODES);
+    __type(key, u32);
+    __type(value, struct scratch);
+} scratch SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 8 * 1024 * 1024);
+} events SEC(".maps");
+
+struct walk_ctx {
+    struct exec_event *e;
+    const char *const *uptr;  /* argv または envp（ユーザ空間のポインタ配列） */
+    u32 max;
+    u32 count;
+    bool sleepable;
+};
+
+static __always_inline long read_user_ptr(const char **dst, const char *const *src,
+                                          bool sleepable)
+{
+    if (sleepable)
+        return bpf_copy_from_user(dst, sizeof(*dst), src);
+    return bpf_probe_read_user(dst, sizeof(*dst), src);
+}
+
+/*
+ * p から ARGS_MAX_STR bytes 分のページをフォルトさせる（dst は作業用に上書きされる）。
+ * 2 ページ目は文字列が 1 ページ目で終わっていれば未マップのこともあるので、失敗しても構わない。
+ */
+static __always_inline void fault_in(char *dst, const char *p)
+{
+    u32 first = MIN_PAGE_SIZE - ((unsigned long)p & (MIN_PAGE_SIZE - 1));
+
+    if (first >= ARGS_MAX_STR) {
+        bpf_copy_from_user(dst, ARGS_MAX_STR, p);
+        return;
+    }
+    if (bpf_copy_from_user(dst, first, p))
+        return;
+    bpf_copy_from_user(dst, ARGS_MAX_STR - first, p + first);
+}
+
+/* bpf_loop のコールバック: i 番目の文字列を data の末尾に足す。1 を返すと打ち切り */
+static long walk_one(u32 i, void *data)
+{
+    struct walk_ctx *c = data;
+    struct exec_event *e = c->e;
+    const char *p = NULL;
+    u32 off;
+    long n;
+
+    if (read_user_ptr(&p, &c->uptr[i], c->sleepable)) {
+        e->failed++;
+        return 1;
+    }
+    if (!p)
+        return 1;
+    if (i >= c->max) {
+        e->truncated++;
+        return 1;
+    }
+
+    off = e->size;
+    if (off > ARGS_BUF - ARGS_MAX_STR) {
+        e->truncated++;
+        return 1;
+    }
+
+    if (c->sleepable)
+        fault_in(&e->data[off], p);
+
+    n = bpf_probe_read_user_str(&e->data[off], ARGS_MAX_STR, p);
+    if (n <= 0) {
+        e->failed++;
+        e->data[off] = '\0';
+        n = 1;
+    } else if (n == ARGS_MAX_STR) {
+        e->truncated++;   /* ちょうど 255 文字の文字列もここに来るが区別しない */
+    }
+
+    e->size = off + n;
+    c->count++;
+    return 0;
+}
+
+static __always_inline int capture(u32 mode, const char *const *argv,
+                                   const char *const *envp)
+{
+    struct walk_ctx c = {};
+    struct scratch *s;
+    struct exec_event *e;
+    u64 t0 = bpf_ktime_get_ns();
+    u32 size;
+
+    s = bpf_map_lookup_elem(&scratch, &mode);
+    if (!s)
+        return 0;
+    if (__sync_val_compare_and_swap(&s->busy, 0, 1)) {
+        __sync_fetch_and_add(&stats[mode].busy, 1);
+        return 0;
+    }
+
+    e = &s->ev;
+    e->pid = bpf_get_current_pid_tgid() >> 32;
+    e->uid = (u32)bpf_get_current_uid_gid();
+    e->mode = mode;
+    e->failed = 0;
+    e->truncated = 0;
+    e->size = 0;
+    bpf_get_current_comm(e->comm, sizeof(e->comm));
+
+    c.e = e;
+    c.sleepable = mode == CAPTURE_SLEEPABLE;
+
+    /* argv = NULL は Linux では空の argv として通るので、読み落としには数えない */
+    c.uptr = argv;
+    c.max = max_argv;
+    if (argv)
+        bpf_loop(ARGS_MAX_LOOP + 1, walk_one, &c, 0);
+    e->argc = c.count;
+
+    c.uptr = envp;
+    c.max = max_envp;
+    c.count = 0;
+    if (envp)
+        bpf_loop(ARGS_MAX_LOOP + 1, walk_one, &c, 0);
+    e->envc = c.count;
+
+    e->cost_ns = bpf_ktime_get_ns() - t0;
+
+    size = offsetof(struct exec_event, data) + e->size;
+    if (size > sizeof(*e))
+        size = sizeof(*e);
+    if (bpf_ringbuf_output(&events, e, size, 0)) {
+        __sync_fetch_and_add(&stats[mode].lost, 1);
+    } else {
+        __sync_fetch_and_add(&stats[mode].events, 1);
+        if (e->failed || e->truncated)
+            __sync_fetch_and_add(&stats[mode].incomplete, 1);
+    }
+
+    s->busy = 0;
+    return 0;
+}
+
+/* syscall ラッパの引数は「ユーザ空間から来たときのレジスタ」なので *_SYSCALL 版で取り出す */
+#define SYSCALL_ARG(regs, n) ((const char *const *)PT_REGS_PARM##n##_CORE_SYSCALL(regs))
+
+/* [P] 非 sleepable: execve(path, argv, envp) / execveat(dfd, path, argv, envp, flags) */
+SEC("fentry/" SYS_PREFIX "sys_execve")
+int BPF_PROG(probe_execve, struct pt_regs *regs)
+{
+    return capture(CAPTURE_PROBE, SYSCALL_ARG(regs, 2), SYSCALL_ARG(regs, 3));
+}
+
+SEC("fentry/" SYS_PREFIX "sys_execveat")
+int BPF_PROG(probe_execveat, struct pt_regs *regs)
+{
+    return capture(CAPTURE_PROBE, SYSCALL_ARG(regs, 3), SYSCALL_ARG(regs, 4));
+}
+
+/* [S] sleepable: 同じ場所で bpf_copy_from_user を使う */
+SEC("fentry.s/" SYS_PREFIX "sys_execve")
+int BPF_PROG(sleep_execve, struct pt_regs *regs)
+{
+    return capture(CAPTURE_SLEEPABLE, SYSCALL_ARG(regs, 2), SYSCALL_ARG(regs, 3));
+}
+
+SEC("fentry.s/" SYS_PREFIX "sys_execveat")
+int BPF_PROG(sleep_execveat, struct pt_regs *regs)
+{
+    return capture(CAPTURE_SLEEPABLE, SYSCALL_ARG(regs, 3), SYSCALL_ARG(regs, 4));
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,484 @@
+/*
+ * exec-args.c（ユーザ空間側 / exec-args.bpf.c のローダと比較ベンチ）
+ *
+ * 目的:
+ *   execve / execveat の argv・envp を 2 通りの読み方で取り、
+ *   「全部取れたか」と「1 回の exec あたりいくら掛かったか」を比べる。
+ *
+ *     probe     : fentry   + bpf_probe_read_user（フォルトできない。常駐していないページは読めない）
+ *     sleepable : fentry.s + bpf_copy_from_user  （フォルトさせて読む）
+ *
+ * 使い方:
+ *   sudo ./exec-args                        # 両方付けて、exec ごとに 2 行（probe / sleepable）出す
+ *   sudo ./exec-args -m sleepable -v        # sleepable だけ。envp も表示
+ *   sudo ./exec-args -b 2000 -C             # ベンチ: 自分で 2000 回 exec して比べる（-C: argv を非常駐に）
+ *
+ *   -m probe|sleepable|both  付けるプログラム（既定 both）
+ *   -a <n>                   argv の本数の上限（既定 64、最大 ARGS_MAX_LOOP）
+ *   -e <n>                   envp の本数の上限（既定 64、最大 ARGS_MAX_LOOP）
+ *   -v                       envp も表示する
+ *   -q                       exec ごとの行を出さず、終了時の集計だけ出す
+ *   -b <execs>               ベンチモード（下記）
+ *   -C                       ベンチで argv / envp の文字列を「ページが常駐していない」状態で渡す
+ *
+ *   Ctrl-C で終了すると、モードごとの集計を出す。
+ *
+ * 出力（1 exec 1 行）:
+ *
+ *   MODE       PID     COMM             ARGC ENVC  FAIL TRUNC  COST(us)  ARGV
+ *   probe      12345   bash                3   24     0     0      3.1  ls -l /tmp
+ *   sleepable  12345   bash                3   24     0     0      4.0  ls -l /tmp
+ *
+ *   FAIL  : 読めなかったポインタ / 文字列の数（probe で常駐していないページに当たると増える）
+ *   TRUNC : 上限（-a / -e、1 本 ARGS_MAX_STR bytes、合計 ARGS_BUF bytes）で切った数
+ *   COST  : BPF 側で argv + envp を読むのに掛かった時間（ringbuf 送信は含まない）
+ *
+ * ベンチモード（-b）:
+ *
+ *   none（何も付けない）→ probe → sleepable の順に、
+ *     fork → [子] (-C なら madvise(MADV_DONTNEED)) → execve("/bin/true", 32 args, 32 envs)
+ *   を <execs> 回繰り返し、1 exec あたりの壁時計時間と none からの増分、
+ *   取れた割合（complete）、BPF 側の平均コストを並べる。
+ *
+ *   -C では文字列を tmpfile を MAP_SHARED で mmap した領域に置き、exec 直前に PTE を落とす。
+ *   ページキャッシュには残っているので、フォルトすればすぐ読める（= sleepable なら取れる）が、
+ *   フォルトできない probe は文字列を 1 本も読めない。
+ *   ポインタ配列は普通のヒープに置くので、probe でも本数までは分かる。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <bpf/libbpf.h>
+
+#include "exec-args.h"
+#include "exec-args.skel.h"
+
+#define BENCH_NR_ARGS  32
+#define BENCH_NR_ENVS  32
+#define BENCH_STR_LEN  100    /* NUL を除いた 1 本の長さ */
+
+static const char *mode_names[NR_CAPTURE_MODES] = { "probe", "sleepable" };
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* ユーザ空間で数えるモードごとの集計（ringbuf で受け取ったイベントから） */
+struct totals {
+    unsigned long long events;
+    unsigned long long complete;    /* failed == 0 && truncated == 0 */
+    unsigned long long failed;      /* failed の合計（本数） */
+    unsigned long long truncated;   /* truncated の合計（本数） */
+    unsigned long long cost_ns;
+    unsigned long long cost_max_ns;
+};
+
+static struct totals totals[NR_CAPTURE_MODES];
+
+static bool print_events = true;
+static bool print_env = false;
+static const char *filter_comm = NULL;   /* ベンチ中は自分の子（exec 前の comm = 自分）だけ数える */
+
+/* data から n 本の NUL 区切り文字列を空白区切りで表示し、次の位置を返す */
+static const char *print_strings(const char *p, const char *end, unsigned int n)
+{
+    for (unsigned int i = 0; i < n && p < end; i++) {
+        size_t len = strnlen(p, end - p);
+
+        printf("%s%.*s", i ? " " : "", (int)len, p);
+        p += len + 1;
+    }
+    return p;
+}
+
+static int handle_event(void *ctx, void *data, size_t size)
+{
+    const struct exec_event *e = data;
+    const char *p, *end;
+    struct totals *t;
+
+    (void)ctx;
+
+    if (size < offsetof(struct exec_event, data) || e->mode >= NR_CAPTURE_MODES)
+        return 0;
+    if (filter_comm && strncmp(e->comm, filter_comm, sizeof(e->comm)))
+        return 0;
+
+    t = &totals[e->mode];
+    t->events++;
+    if (!e->failed && !e->truncated)
+        t->complete++;
+    t->failed += e->failed;
+    t->truncated += e->truncated;
+    t->cost_ns += e->cost_ns;
+    if (e->cost_ns > t->cost_max_ns)
+        t->cost_max_ns = e->cost_ns;
+
+    if (!print_events)
+        return 0;
+
+    printf("%-10s %-7u %-16.16s %4u %4u %5u %5u %9.1f  ",
+           mode_names[e->mode], e->pid, e->comm, e->argc, e->envc,
+           e->failed, e->truncated, e->cost_ns / 1000.0);
+
+    end = (const char *)data + size;
+    p = print_strings(e->data, end, e->argc);
+    if (print_env && e->envc) {
+        printf("\n%-60s", "");
+        print_strings(p, end, e->envc);
+    }
+    printf("\n");
+    return 0;
+}
+
+static void print_summary(struct exec_args_bpf *skel)
+{
+    printf("\n%-10s %10s %10s %10s %10s %8s %8s %10s %10s\n",
+           "MODE", "EVENTS", "COMPLETE", "FAILED", "TRUNC", "BUSY", "LOST",
+           "AVG(us)", "MAX(us)");
+
+    for (int m = 0; m < NR_CAPTURE_MODES; m++) {
+        const struct totals *t = &totals[m];
+        const struct mode_stats *s = &skel->bss->stats[m];
+
+        if (!t->events && !s->busy && !s->lost)
+            continue;
+        printf("%-10s %10llu %9.1f%% %10llu %10llu %8llu %8llu %10.2f %10.2f\n",
+               mode_names[m], t->events,
+               t->events ? 100.0 * t->complete / t->events : 0.0,
+               t->failed, t->truncated,
+               (unsigned long long)s->busy, (unsigned long long)s->lost,
+               t->events ? t->cost_ns / 1000.0 / t->events : 0.0,
+               t->cost_max_ns / 1000.0);
+    }
+}
+
+/* mode の 2 本（execve / execveat）を attach する。links[2] に入れる */
+static int attach_mode(struct exec_args_bpf *skel, int mode, struct bpf_link **links)
+{
+    struct bpf_program *progs[NR_CAPTURE_MODES][2] = {
+        { skel->progs.probe_execve, skel->progs.probe_execveat },
+        { skel->progs.sleep_execve, skel->progs.sleep_execveat },
+    };
+
+    for (int i = 0; i < 2; i++) {
+        links[i] = bpf_program__attach(progs[mode][i]);
+        if (!links[i]) {
+            int err = -errno;
+
+            fprintf(stderr, "Failed to attach %s: %d\n",
+                    bpf_program__name(progs[mode][i]), err);
+            return err;
+        }
+    }
+    return 0;
+}
+
+static void detach_links(struct bpf_link **links, int n)
+{
+    for (int i = 0; i < n; i++) {
+        bpf_link__destroy(links[i]);
+        links[i] = NULL;
+    }
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * ベンチ用の argv / envp を作る。
+ * 文字列は cold なら tmpfile の MAP_SHARED mmap（子が exec 直前に PTE を落とす）、そうでなければヒープ。
+ */
+static char *bench_strings(bool cold, size_t len)
+{
+    char path[] = "/tmp/exec-args.XXXXXX";
+    char *buf;
+    int fd;
+
+    if (!cold)
+        return malloc(len);
+
+    fd = mkstemp(path);
+    if (fd < 0)
+        return NULL;
+    unlink(path);
+    if (ftruncate(fd, len)) {
+        close(fd);
+        return NULL;
+    }
+    buf = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return buf == MAP_FAILED ? NULL : buf;
+}
+
+/* n 回 fork + execve して 1 exec あたりの秒数を返す（負ならエラー） */
+static double bench_run(struct ring_buffer *rb, long n, char **args, char **envs,
+                        char *strs, size_t strs_len, bool cold)
+{
+    double t0 = now_sec();
+
+    for (long i = 0; i < n && !exiting; i++) {
+        pid_t pid = fork();
+        int status;
+
+        if (pid < 0)
+            return -1;
+        if (pid == 0) {
+            if (cold)
+                madvise(strs, strs_len, MADV_DONTNEED);
+            execve("/bin/true", args, envs);
+            _exit(127);
+        }
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+            fprintf(stderr, "bench: exec of /bin/true failed\n");
+            return -1;
+        }
+
+        /* ringbuf が溢れないよう、ときどき取り出す */
+        if ((i & 63) == 63)
+            ring_buffer__consume(rb);
+    }
+    ring_buffer__consume(rb);
+    return (now_sec() - t0) / n;
+}
+
+static int run_bench(struct exec_args_bpf *skel, struct ring_buffer *rb,
+                     long n, bool cold, const bool *enabled)
+{
+    const int nr_strs = BENCH_NR_ARGS + BENCH_NR_ENVS;
+    const size_t strs_len = (size_t)nr_strs * (BENCH_STR_LEN + 1);
+    char *args[BENCH_NR_ARGS + 1], *envs[BENCH_NR_ENVS + 1];
+    char comm[16] = {};
+    double base = 0;
+    char *strs;
+    int err = 0;
+
+    strs = bench_strings(cold, strs_len);
+    if (!strs) {
+        fprintf(stderr, "bench: failed to allocate argument strings\n");
+        return -ENOMEM;
+    }
+
+    for (int i = 0; i < nr_strs; i++) {
+        char *s = strs + (size_t)i * (BENCH_STR_LEN + 1);
+
+        /* "argNN=xxxx..." / "ENVNN=xxxx..." を BENCH_STR_LEN 文字で */
+        snprintf(s, BENCH_STR_LEN + 1, "%s%02d=", i < BENCH_NR_ARGS ? "arg" : "ENV",
+                 i % BENCH_NR_ARGS);
+        memset(s + 6, 'x', BENCH_STR_LEN - 6);
+        s[BENCH_STR_LEN] = '\0';
+        if (i < BENCH_NR_ARGS)
+            args[i] = s;
+        else
+            envs[i - BENCH_NR_ARGS] = s;
+    }
+    args[BENCH_NR_ARGS] = NULL;
+    envs[BENCH_NR_ENVS] = NULL;
+
+    prctl(PR_GET_NAME, comm);
+    filter_comm = comm;
+    print_events = false;
+
+    printf("bench: %ld execs of /bin/true, %d args + %d envs x %d bytes, strings %s\n\n",
+           n, BENCH_NR_ARGS, BENCH_NR_ENVS, BENCH_STR_LEN,
+           cold ? "not resident (-C)" : "resident");
+    printf("%-10s %12s %12s %10s %12s\n",
+           "MODE", "us/exec", "+us/exec", "COMPLETE", "BPF avg(us)");
+
+    /* -1 = 何も付けない基準 */
+    for (int mode = -1; mode < NR_CAPTURE_MODES && !exiting; mode++) {
+        struct bpf_link *links[2] = {};
+        struct totals *t = NULL;
+        double per_exec;
+
+        if (mode >= 0) {
+            if (!enabled[mode])
+                continue;
+            err = attach_mode(skel, mode, links);
+            if (err) {
+                detach_links(links, 2);
+                break;
+            }
+            t = &totals[mode];
+            memset(t, 0, sizeof(*t));
+        }
+
+        per_exec = bench_run(rb, n, args, envs, strs, strs_len, cold);
+        detach_links(links, 2);
+        if (per_exec < 0) {
+            err = -1;
+            break;
+        }
+
+        if (mode < 0) {
+            base = per_exec;
+            printf("%-10s %12.2f %12s %10s %12s\n", "none", per_exec * 1e6, "-", "-", "-");
+            continue;
+        }
+        printf("%-10s %12.2f %12.2f %9.1f%% %12.2f\n",
+               mode_names[mode], per_exec * 1e6, (per_exec - base) * 1e6,
+               t->events ? 100.0 * t->complete / t->events : 0.0,
+               t->events ? t->cost_ns / 1000.0 / t->events : 0.0);
+    }
+
+    if (cold)
+        munmap(strs, strs_len);
+    else
+        free(strs);
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    struct exec_args_bpf *skel = NULL;
+    struct ring_buffer *rb = NULL;
+    struct bpf_link *links[NR_CAPTURE_MODES * 2] = {};
+    bool enabled[NR_CAPTURE_MODES] = { true, true };
+    unsigned long max_argv = 64, max_envp = 64;
+    long bench = 0;
+    bool cold = false;
+    int err = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:a:e:vqb:C")) != -1) {
+        switch (opt) {
+        case 'm':
+            enabled[CAPTURE_PROBE] = !strcmp(optarg, "probe") || !strcmp(optarg, "both");
+            enabled[CAPTURE_SLEEPABLE] = !strcmp(optarg, "sleepable") || !strcmp(optarg, "both");
+            if (!enabled[CAPTURE_PROBE] && !enabled[CAPTURE_SLEEPABLE]) {
+                fprintf(stderr, "Invalid -m %s (probe, sleepable or both)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'a':
+            max_argv = strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            max_envp = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            print_env = true;
+            break;
+        case 'q':
+            print_events = false;
+            break;
+        case 'b':
+            bench = strtol(optarg, NULL, 0);
+            break;
+        case 'C':
+            cold = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-m probe|sleepable|both] [-a max_argv] [-e max_envp] [-v] [-q]\n"
+                    "       %s -b execs [-C] [-m ...] [-a ...] [-e ...]\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (max_argv > ARGS_MAX_LOOP || max_envp > ARGS_MAX_LOOP) {
+        fprintf(stderr, "-a / -e must be <= %d\n", ARGS_MAX_LOOP);
+        return 1;
+    }
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    skel = exec_args_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    skel->rodata->max_argv = max_argv;
+    skel->rodata->max_envp = max_envp;
+
+    /* 使わないモードは load もしない（fentry.s が付けられないカーネルでも probe だけは動くように） */
+    bpf_program__set_autoload(skel->progs.probe_execve, enabled[CAPTURE_PROBE]);
+    bpf_program__set_autoload(skel->progs.probe_execveat, enabled[CAPTURE_PROBE]);
+    bpf_program__set_autoload(skel->progs.sleep_execve, enabled[CAPTURE_SLEEPABLE]);
+    bpf_program__set_autoload(skel->progs.sleep_execveat, enabled[CAPTURE_SLEEPABLE]);
+
+    err = exec_args_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    rb = ring_buffer__new(bpf_map__fd(skel->maps.events), handle_event, NULL, NULL);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create ring buffer: %d\n", err);
+        goto cleanup;
+    }
+
+    if (bench > 0) {
+        err = run_bench(skel, rb, bench, cold, enabled);
+        goto cleanup;
+    }
+
+    for (int m = 0; m < NR_CAPTURE_MODES; m++) {
+        if (!enabled[m])
+            continue;
+        err = attach_mode(skel, m, &links[m * 2]);
+        if (err)
+            goto cleanup;
+    }
+
+    if (print_events)
+        printf("%-10s %-7s %-16s %4s %4s %5s %5s %9s  %s\n",
+               "MODE", "PID", "COMM", "ARGC", "ENVC", "FAIL", "TRUNC", "COST(us)", "ARGV");
+
+    while (!exiting) {
+        err = ring_buffer__poll(rb, 100);
+        if (err == -EINTR) {
+            err = 0;
+            break;
+        }
+        if (err < 0) {
+            fprintf(stderr, "Error polling ring buffer: %d\n", err);
+            break;
+        }
+        err = 0;
+    }
+    print_summary(skel);
+
+cleanup:
+    detach_links(links, NR_CAPTURE_MODES * 2);
+    ring_buffer__free(rb);
+    exec_args_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
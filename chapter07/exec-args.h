@@ -0,0 +1,54 @@
+#ifndef EXEC_ARGS_H
+#define EXEC_ARGS_H
+
+/*
+ * exec-args.h（exec-args.bpf.c とローダ exec-args.c で共有する定義）
+ *
+ * 目的:
+ *   execve / execveat の argv と envp を「全部」取る。
+ *   同じ syscall 入口に 2 通りの読み方を並べ、取れた割合と 1 回あたりのコストを比べる。
+ *
+ *     CAPTURE_PROBE     : fentry   + bpf_probe_read_user（ページフォルトを起こせない）
+ *     CAPTURE_SLEEPABLE : fentry.s + bpf_copy_from_user  （フォルトさせてページを持ってくる）
+ *
+ * イベントの data:
+ *
+ *   "arg0\0arg1\0...argN\0env0\0env1\0...\0"
+ *    └──── argc 個 ────┘└──── envc 個 ────┘   有効長 = size
+ *
+ *   ringbuf には data の有効長までしか送らない（レコード長は可変）。
+ */
+
+#define ARGS_MAX_STR   256    /* 1 本の文字列の上限（NUL 込み。超えたら切り詰め） */
+#define ARGS_BUF       8192   /* argv + envp を詰めるバッファ（超えたら以降は切り詰め） */
+#define ARGS_MAX_LOOP  256    /* argv / envp それぞれの要素数の上限（コンパイル時） */
+
+enum capture_mode {
+   CAPTURE_PROBE = 0,
+   CAPTURE_SLEEPABLE,
+   NR_CAPTURE_MODES,
+};
+
+struct exec_event {
+   unsigned int pid;
+   unsigned int uid;
+   unsigned int mode;            /* enum capture_mode */
+   unsigned int argc;            /* data に入れた argv の本数 */
+   unsigned int envc;            /* data に入れた envp の本数 */
+   unsigned int failed;          /* 読めなかったポインタ / 文字列の数（0 なら読み落としなし） */
+   unsigned int truncated;       /* 上限で切った数（本数・長さ・バッファのどれか） */
+   unsigned int size;            /* data の有効長 */
+   unsigned long long cost_ns;   /* argv + envp の読み取りにかかった時間（BPF 側） */
+   char comm[16];
+   char data[ARGS_BUF];
+};
+
+/* モードごとの統計（.bss。ローダが直接読む） */
+struct mode_stats {
+   unsigned long long events;       /* ringbuf に出したイベント数 */
+   unsigned long long incomplete;   /* failed か truncated が 1 以上だったイベント数 */
+   unsigned long long busy;         /* scratch が使用中で読めなかった exec の数 */
+   unsigned long long lost;         /* ringbuf が満杯で捨てたイベント数 */
+};
+
+#endif /* EXEC_ARGS_H */
@@ -0,0 +1,80 @@
+/*
+ * exec-filter.bpf.c（exec を観測し、差し替え可能なフィルタ関数で絞ってから送るトレーサ）
+ *
+ * 目的:
+ *   「uid == 1000 && comm ~ "python*"」のような条件で exec を絞りたいが、
+ *   条件ごとに .bpf.c を書き直して再コンパイルするのは避けたい。
+ *   そこで判定だけをグローバル関数 exec_filter() に切り出し、
+ *   ユーザ空間（exec-filter.c / filter-expr.h）が式から直接組み立てた BPF 命令列を
+ *   freplace（BPF_PROG_TYPE_EXT）でここに差し込む。判定はカーネル内でネイティブに走り、
+ *   一致しなかった exec は ringbuf にも載らない。
+ *
+ * 流れ:
+ *
+ *   tp_btf/sched_process_exec
+ *     │  exec_fields を埋める（pid, ppid, uid, gid, comm, filename）
+ *     v
+ *   exec_filter(&f) ──(freplace でユーザ空間が組み立てたプログラムに置き換わる)
+ *     │  0 → 捨てる / 0 以外 → ringbuf へ
+ *     v
+ *   events（ringbuf）
+ *
+ *   差し替えていないとき exec_filter は常に 1 を返す（全部送る）。
+ *   ユーザ空間で絞る比較モードはこの状態で動かす。
+ *
+ * exec_filter の決まりごと（xdp-chain.bpf.c のスロットと同じ）:
+ *   - freplace の差し替え先になれるのはグローバル関数だけなので static にしない。
+ *   - __noinline で呼び出しを残し、volatile の戻り値で「常に 1」と決め打ちさせない。
+ *   - 引数は構造体へのポインタで、verifier は NULL かもしれないメモリとして扱う。
+ *     差し替える側も最初に NULL を確認する。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "exec-filter.h"
+
+/* 統計（ローダがベンチで読む・0 に戻す） */
+u64 nr_execs = 0;     /* exec_filter を呼んだ回数 */
+u64 nr_matched = 0;   /* exec_filter が 0 以外を返した回数 */
+u64 nr_lost = 0;      /* ringbuf が満杯で送れなかった回数 */
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 8 * 1024 * 1024);
+} events SEC(".maps");
+
+__noinline int exec_filter(struct exec_fields *f)
+{
+    volatile int ret = 1;
+
+    if (!f)
+        return 0;
+    return ret;
+}
+
+SEC("tp_btf/sched_process_exec")
+int BPF_PROG(handle_exec, struct task_struct *p, pid_t old_pid, struct linux_binprm *bprm)
+{
+    struct exec_fields f = {};
+    u64 uid_gid = bpf_get_current_uid_gid();
+
+    f.pid = bpf_get_current_pid_tgid() >> 32;
+    f.ppid = BPF_CORE_READ(p, real_parent, tgid);
+    f.uid = (u32)uid_gid;
+    f.gid = uid_gid >> 32;
+    bpf_get_current_comm(f.comm, sizeof(f.comm));
+    bpf_probe_read_kernel_str(f.filename, sizeof(f.filename), BPF_CORE_READ(bprm, filename));
+
+    __sync_fetch_and_add(&nr_execs, 1);
+    if (!exec_filter(&f))
+        return 0;
+    __sync_fetch_and_add(&nr_matched, 1);
+
+    if (bpf_ringbuf_output(&events, &f, sizeof(f), 0))
+        __sync_fetch_and_add(&nr_lost, 1);
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,495 @@
+/*
+ * exec-filter.c（ユーザ空間側 / フィルタ式を BPF 命令列にしてカーネル内で exec を絞るトレーサ）
+ *
+ * 目的:
+ *   exec-filter.bpf.c の exec_filter() を、コマンドラインで渡した式から組み立てたプログラムで
+ *   freplace する。clang も .bpf.c の再コンパイルも使わず、式ごとにその場で BPF にする。
+ *   一致しない exec は ringbuf に載らないので、ユーザ空間は一致したものだけを受け取る。
+ *
+ * 使い方:
+ *   sudo ./exec-filter 'uid == 1000 && comm ~ "python*"'    # カーネルで絞る（freplace）
+ *   sudo ./exec-filter -u 'uid == 1000 && comm ~ "python*"' # 比較用: 全部受けてユーザ空間で絞る
+ *   ./exec-filter -d 'comm ~ "py*"'                          # 生成した命令列を表示して終了（root 不要）
+ *   sudo ./exec-filter -b 5000 'comm == "nomatch"'           # ベンチ: user と kernel を同じ exec 嵐で比べる
+ *
+ *   -u        ユーザ空間で絞る（exec_filter は差し替えず、全部受けて filter_eval）
+ *   -d        命令列を表示して終了
+ *   -q        一致したイベントを表示しない（終了時の集計だけ）
+ *   -b <n>    ベンチモード（下記）
+ *
+ *   式は残りの引数を空白でつないだもの（省略時は true）。文法とフィールドは filter-expr.h。
+ *     数値: pid ppid uid gid（== != < <= > >=）  文字列: comm filename（== != ~ !~、~ は glob）
+ *
+ * 全体の流れ（カーネルで絞る場合）:
+ *
+ *   式 ──filter_parse──> 構文木 ──filter_compile──> struct bpf_insn[]
+ *                                                        │
+ *   exec-filter.bpf.c を open / load / attach             │
+ *     │                                                  v
+ *     │   exec_filter と同じ型の BTF を作って load ─> bpf_prog_load(BPF_PROG_TYPE_EXT,
+ *     │                                                   attach_prog_fd = handle_exec,
+ *     │                                                   attach_btf_id  = exec_filter)
+ *     v                                                  │
+ *   handle_exec の exec_filter() <──bpf_link_create（EXT の link）
+ *     │
+ *     v
+ *   一致した exec だけが ringbuf へ ──> handle_event で表示
+ *
+ * freplace に BTF が要る理由:
+ *   EXT プログラムは差し替え先の関数と引数の型が一致している必要があり、カーネルはそれを
+ *   プログラム自身の BTF（func_info）で照合する。clang が作る .bpf.o なら BTF が付いてくるが、
+ *   ここでは命令列を直接作るので、exec_filter(struct exec_fields *f) と同じ形の BTF も
+ *   libbpf の btf__add_* で組み立てて一緒に渡す（構造体は名前とサイズで照合される）。
+ *
+ * ベンチモード（-b）:
+ *   user → kernel の順に、子プロセスが /bin/true を n 回 fork + exec する間 ringbuf を読み続け、
+ *
+ *     MODE      EXECS  DELIVERED  MATCHED  LOST  BPF(ns/exec)  USER(ns/exec)  TOTAL(ns/exec)
+ *     user       5012       5012        0     0           410           2150            2560
+ *     kernel     5009          0        0     0           455             12             467
+ *
+ *   BPF   : handle_exec の run_time_ns / run_cnt（bpf_enable_stats で有効にする。freplace 先も含む）
+ *   USER  : このプロセスの CPU 時間（utime + stime）/ EXECS。exec 嵐を起こす子は含まない
+ *   TOTAL : BPF + USER。フィルタをカーネルに置いた分 BPF は少し増え、ringbuf と USER がほぼ消える。
+ *
+ * 注意:
+ *   - EXECS はシステム全体の exec 数（ベンチ中に他で起きた exec も含む）。
+ *   - freplace のリンクは 1 本だけ。式を変えたいときはプロセスを起動し直す。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include <bpf/btf.h>
+
+#include "exec-filter.h"
+#include "filter-expr.h"
+#include "exec-filter.skel.h"
+
+struct consumer {
+    bool user_filter;               /* true: 全部受けて filter_eval で絞る */
+    bool quiet;
+    unsigned long long received;    /* ringbuf から受け取った数 */
+    unsigned long long matched;     /* 式に一致した数（カーネルで絞ったなら received と同じ） */
+};
+
+static struct filter filter;
+static struct filter_prog prog;     /* 命令 FILTER_MAX_INSNS 個分あるので静的に持つ */
+static char verifier_log[256 * 1024];
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static int handle_event(void *ctx, void *data, size_t size)
+{
+    struct consumer *c = ctx;
+    const struct exec_fields *e = data;
+
+    if (size < sizeof(*e))
+        return 0;
+
+    c->received++;
+    if (c->user_filter && !filter_eval(&filter, e))
+        return 0;
+    c->matched++;
+
+    if (!c->quiet)
+        printf("%-7u %-7u %-6u %-6u %-16.16s %.64s\n",
+               e->pid, e->ppid, e->uid, e->gid, e->comm, e->filename);
+    return 0;
+}
+
+/*
+ * exec_filter(struct exec_fields *f) と同じ形の BTF を作ってカーネルへ入れる。
+ * *func_id に FUNC "exec_filter" の型 ID を返す（func_info に書く）。
+ */
+static struct btf *build_filter_btf(int *func_id)
+{
+    struct btf *btf = btf__new_empty();
+    int u32_id, char_id, comm_id, fname_id, st_id, ptr_id, int_id, proto_id;
+
+    if (!btf)
+        return NULL;
+
+    u32_id   = btf__add_int(btf, "unsigned int", 4, 0);
+    char_id  = btf__add_int(btf, "char", 1, BTF_INT_SIGNED);
+    comm_id  = btf__add_array(btf, u32_id, char_id, EXEC_COMM_LEN);
+    fname_id = btf__add_array(btf, u32_id, char_id, EXEC_FILENAME_LEN);
+
+    st_id = btf__add_struct(btf, "exec_fields", sizeof(struct exec_fields));
+    btf__add_field(btf, "pid", u32_id, offsetof(struct exec_fields, pid) * 8, 0);
+    btf__add_field(btf, "ppid", u32_id, offsetof(struct exec_fields, ppid) * 8, 0);
+    btf__add_field(btf, "uid", u32_id, offsetof(struct exec_fields, uid) * 8, 0);
+    btf__add_field(btf, "gid", u32_id, offsetof(struct exec_fields, gid) * 8, 0);
+    btf__add_field(btf, "comm", comm_id, offsetof(struct exec_fields, comm) * 8, 0);
+    btf__add_field(btf, "filename", fname_id, offsetof(struct exec_fields, filename) * 8, 0);
+
+    ptr_id   = btf__add_ptr(btf, st_id);
+    int_id   = btf__add_int(btf, "int", 4, BTF_INT_SIGNED);
+    proto_id = btf__add_func_proto(btf, int_id);
+    btf__add_func_param(btf, "f", ptr_id);
+    *func_id = btf__add_func(btf, "exec_filter", BTF_FUNC_GLOBAL, proto_id);
+
+    /* 途中で失敗すると以降の ID も負になるので、最後の 1 つと load の結果だけ見ればよい */
+    if (*func_id < 0 || btf__load_into_kernel(btf)) {
+        btf__free(btf);
+        return NULL;
+    }
+    return btf;
+}
+
+/* prog_fd のプログラムの BTF から関数 func の型 ID を探す（freplace の attach_btf_id） */
+static int target_btf_id(int prog_fd, const char *func)
+{
+    struct bpf_prog_info info = {};
+    __u32 len = sizeof(info);
+    struct btf *btf;
+    int id;
+
+    if (bpf_obj_get_info_by_fd(prog_fd, &info, &len))
+        return -errno;
+    if (!info.btf_id)
+        return -ENOENT;
+
+    btf = btf__load_from_kernel_by_id(info.btf_id);
+    if (!btf)
+        return -errno;
+    id = btf__find_by_name_kind(btf, func, BTF_KIND_FUNC);
+    btf__free(btf);
+    return id;
+}
+
+/*
+ * p の命令列を BPF_PROG_TYPE_EXT として load し、handle_exec の exec_filter に freplace で付ける。
+ * 成功したら link の fd を返す（close すると元の exec_filter に戻る）。
+ */
+static int attach_filter(struct exec_filter_bpf *skel, const struct filter_prog *p)
+{
+    int tgt_fd = bpf_program__fd(skel->progs.handle_exec);
+    struct bpf_func_info finfo = {};
+    int btf_id, func_id, prog_fd, link_fd;
+    struct btf *btf;
+
+    btf_id = target_btf_id(tgt_fd, "exec_filter");
+    if (btf_id < 0) {
+        fprintf(stderr, "exec_filter not found in handle_exec's BTF: %d\n", btf_id);
+        return btf_id;
+    }
+
+    btf = build_filter_btf(&func_id);
+    if (!btf) {
+        fprintf(stderr, "Failed to build BTF for the filter\n");
+        return -EINVAL;
+    }
+    finfo.insn_off = 0;
+    finfo.type_id = func_id;
+
+    LIBBPF_OPTS(bpf_prog_load_opts, opts,
+        .prog_btf_fd        = btf__fd(btf),
+        .func_info          = &finfo,
+        .func_info_cnt      = 1,
+        .func_info_rec_size = sizeof(finfo),
+        .attach_prog_fd     = tgt_fd,
+        .attach_btf_id      = btf_id,
+    );
+
+    /* まずはログ無しで。失敗したらログ付きでもう一度 load して理由を出す */
+    prog_fd = bpf_prog_load(BPF_PROG_TYPE_EXT, "exec_filter", "Dual BSD/GPL",
+                            p->insns, p->len, &opts);
+    if (prog_fd < 0) {
+        opts.log_buf = verifier_log;
+        opts.log_size = sizeof(verifier_log);
+        opts.log_level = 1;
+        prog_fd = bpf_prog_load(BPF_PROG_TYPE_EXT, "exec_filter", "Dual BSD/GPL",
+                                p->insns, p->len, &opts);
+        if (prog_fd < 0) {
+            fprintf(stderr, "Failed to load filter program: %d\n%s\n", prog_fd, verifier_log);
+            btf__free(btf);
+            return prog_fd;
+        }
+    }
+
+    /*
+     * 差し替え先は load 時に渡したので target_fd / btf_id は 0 でよい。
+     * EXT の attach_type はカーネルが見ないので、libbpf と同じく expected_attach_type（0）を渡す。
+     */
+    link_fd = bpf_link_create(prog_fd, 0, 0, NULL);
+    if (link_fd < 0)
+        fprintf(stderr, "Failed to attach filter (freplace): %d\n", link_fd);
+
+    close(prog_fd);
+    btf__free(btf);
+    return link_fd;
+}
+
+static void prog_stats(int prog_fd, __u64 *run_ns, __u64 *run_cnt)
+{
+    struct bpf_prog_info info = {};
+    __u32 len = sizeof(info);
+
+    *run_ns = *run_cnt = 0;
+    if (!bpf_obj_get_info_by_fd(prog_fd, &info, &len)) {
+        *run_ns = info.run_time_ns;
+        *run_cnt = info.run_cnt;
+    }
+}
+
+static double cpu_sec(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* 子プロセスで /bin/true を n 回 fork + exec する（exec 嵐）。子の pid を返す */
+static pid_t start_storm(long n)
+{
+    pid_t pid = fork();
+
+    if (pid != 0)
+        return pid;
+
+    for (long i = 0; i < n; i++) {
+        pid_t c = fork();
+
+        if (c < 0)
+            _exit(1);
+        if (c == 0) {
+            execl("/bin/true", "true", (char *)NULL);
+            _exit(127);
+        }
+        waitpid(c, NULL, 0);
+    }
+    _exit(0);
+}
+
+/* 今の設定（freplace の有無と c->user_filter）で n 回 exec させ、1 行出す */
+static int bench_one(struct exec_filter_bpf *skel, struct ring_buffer *rb,
+                     struct consumer *c, const char *name, long n)
+{
+    int prog_fd = bpf_program__fd(skel->progs.handle_exec);
+    __u64 ns0, cnt0, ns1, cnt1, execs;
+    double cpu0, cpu1, bpf_ns, user_ns;
+    pid_t storm;
+
+    c->received = c->matched = 0;
+    skel->bss->nr_execs = 0;
+    skel->bss->nr_matched = 0;
+    skel->bss->nr_lost = 0;
+
+    prog_stats(prog_fd, &ns0, &cnt0);
+    cpu0 = cpu_sec();
+
+    storm = start_storm(n);
+    if (storm < 0)
+        return -errno;
+    while (waitpid(storm, NULL, WNOHANG) == 0) {
+        if (exiting) {
+            kill(storm, SIGKILL);
+            waitpid(storm, NULL, 0);
+            break;
+        }
+        ring_buffer__poll(rb, 50);
+    }
+    ring_buffer__consume(rb);
+
+    cpu1 = cpu_sec();
+    prog_stats(prog_fd, &ns1, &cnt1);
+
+    execs = skel->bss->nr_execs;
+    bpf_ns = cnt1 > cnt0 ? (double)(ns1 - ns0) / (cnt1 - cnt0) : 0;
+    user_ns = execs ? (cpu1 - cpu0) * 1e9 / execs : 0;
+    printf("%-8s %8llu %10llu %8llu %6llu %13.0f %14.0f %15.0f\n",
+           name, (unsigned long long)execs, c->received, c->matched,
+           (unsigned long long)skel->bss->nr_lost, bpf_ns, user_ns, bpf_ns + user_ns);
+    return 0;
+}
+
+static int run_bench(struct exec_filter_bpf *skel, struct ring_buffer *rb,
+                     struct consumer *c, long n)
+{
+    int stats_fd, link_fd, err;
+
+    stats_fd = bpf_enable_stats(BPF_STATS_RUN_TIME);
+    if (stats_fd < 0)
+        fprintf(stderr, "bpf_enable_stats failed (%d): BPF(ns/exec) will read 0\n", stats_fd);
+
+    printf("%-8s %8s %10s %8s %6s %13s %14s %15s\n",
+           "MODE", "EXECS", "DELIVERED", "MATCHED", "LOST",
+           "BPF(ns/exec)", "USER(ns/exec)", "TOTAL(ns/exec)");
+
+    c->quiet = true;
+
+    /* 1) exec_filter はそのまま（全部通す）で、ユーザ空間で絞る */
+    c->user_filter = true;
+    err = bench_one(skel, rb, c, "user", n);
+
+    /* 2) freplace でカーネル内で絞る */
+    if (!err && !exiting) {
+        link_fd = attach_filter(skel, &prog);
+        if (link_fd < 0) {
+            err = link_fd;
+        } else {
+            c->user_filter = false;
+            err = bench_one(skel, rb, c, "kernel", n);
+            close(link_fd);
+        }
+    }
+
+    if (stats_fd >= 0)
+        close(stats_fd);
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    struct exec_filter_bpf *skel = NULL;
+    struct ring_buffer *rb = NULL;
+    struct consumer c = {};
+    char expr[4096] = "";
+    bool dump = false;
+    long bench = 0;
+    int link_fd = -1;
+    int err = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "udqb:")) != -1) {
+        switch (opt) {
+        case 'u':
+            c.user_filter = true;
+            break;
+        case 'd':
+            dump = true;
+            break;
+        case 'q':
+            c.quiet = true;
+            break;
+        case 'b':
+            bench = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-u] [-d] [-q] [-b execs] [expression]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* 残りの引数を空白でつないで 1 つの式にする */
+    for (int i = optind; i < argc; i++) {
+        if (strlen(expr) + strlen(argv[i]) + 2 > sizeof(expr)) {
+            fprintf(stderr, "Expression too long\n");
+            return 1;
+        }
+        if (i > optind)
+            strcat(expr, " ");
+        strcat(expr, argv[i]);
+    }
+    if (!expr[0])
+        strcpy(expr, "true");
+
+    if (filter_parse(&filter, expr)) {
+        fprintf(stderr, "Invalid filter: %s\n  %s\n", filter.err, expr);
+        return 1;
+    }
+    if (filter_compile(&filter, &prog)) {
+        fprintf(stderr, "Failed to compile filter: %s\n", prog.err);
+        return 1;
+    }
+    if (dump) {
+        filter_dump(&prog, stdout);
+        printf("; %d instructions\n", prog.len);
+        return 0;
+    }
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    skel = exec_filter_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open and load BPF object\n");
+        return 1;
+    }
+
+    err = exec_filter_bpf__attach(skel);
+    if (err) {
+        fprintf(stderr, "Failed to attach BPF skeleton: %d\n", err);
+        goto cleanup;
+    }
+
+    rb = ring_buffer__new(bpf_map__fd(skel->maps.events), handle_event, &c, NULL);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create ring buffer: %d\n", err);
+        goto cleanup;
+    }
+
+    if (bench > 0) {
+        err = run_bench(skel, rb, &c, bench);
+        goto cleanup;
+    }
+
+    if (!c.user_filter) {
+        link_fd = attach_filter(skel, &prog);
+        if (link_fd < 0) {
+            err = link_fd;
+            goto cleanup;
+        }
+    }
+
+    fprintf(stderr, "filter (%s, %d insns): %s\n",
+            c.user_filter ? "user space" : "kernel", prog.len, expr);
+    if (!c.quiet)
+        printf("%-7s %-7s %-6s %-6s %-16s %s\n", "PID", "PPID", "UID", "GID", "COMM", "FILENAME");
+
+    while (!exiting) {
+        err = ring_buffer__poll(rb, 100);
+        if (err == -EINTR) {
+            err = 0;
+            break;
+        }
+        if (err < 0) {
+            fprintf(stderr, "Error polling ring buffer: %d\n", err);
+            break;
+        }
+        err = 0;
+    }
+
+    fprintf(stderr, "\nexecs %llu, delivered %llu, matched %llu, lost %llu\n",
+            (unsigned long long)skel->bss->nr_execs, c.received, c.matched,
+            (unsigned long long)skel->bss->nr_lost);
+
+cleanup:
+    if (link_fd >= 0)
+        close(link_fd);
+    ring_buffer__free(rb);
+    exec_filter_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
@@ -0,0 +1,28 @@
+#ifndef EXEC_FILTER_H
+#define EXEC_FILTER_H
+
+/*
+ * exec-filter.h（exec-filter.bpf.c / exec-filter.c / filter-expr.h で共有する定義）
+ *
+ * exec_fields:
+ *   sched_process_exec 1 回分のフィールド。フィルタ式が参照できるのはここにあるものだけで、
+ *   そのままイベントとして ringbuf にも送る。
+ *
+ *   ユーザ空間で組み立てるフィルタ（freplace）は、この構造体へのポインタを受け取る
+ *   exec_filter(struct exec_fields *f) の代わりに動く。オフセットは filter-expr.h の
+ *   フィールド表と、ユーザ空間で作る BTF の両方がこの定義から offsetof で取る。
+ */
+
+#define EXEC_COMM_LEN      16
+#define EXEC_FILENAME_LEN  64
+
+struct exec_fields {
+   unsigned int pid;                      /* TGID */
+   unsigned int ppid;                     /* 親の TGID */
+   unsigned int uid;
+   unsigned int gid;
+   char comm[EXEC_COMM_LEN];              /* exec 後の comm（実行ファイル名の先頭 15 文字） */
+   char filename[EXEC_FILENAME_LEN];      /* execve に渡されたパス（長いものは切り詰め） */
+};
+
+#endif /* EXEC_FILTER_H */
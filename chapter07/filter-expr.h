@@ -0,0 +1,736 @@
+#ifndef FILTER_EXPR_H
+#define FILTER_EXPR_H
+
+/*
+ * filter-expr.h（exec フィルタ式の構文解析・ユーザ空間での評価・BPF 命令列への変換）
+ *
+ * 目的:
+ *   uid == 1000 && comm ~ "python*" のような式を、exec-filter.bpf.c の exec_filter() を
+ *   freplace で置き換える BPF 命令列に直接変換する。clang も .bpf.c の再コンパイルも要らない。
+ *   同じ構文木をユーザ空間でも評価できる（filter_eval）ので、「全部受けてユーザ空間で絞る」との比較や、
+ *   生成した命令列が正しいかの突き合わせに使える。
+ *
+ * 文法:
+ *
+ *   expr  := and ( "||" and )*
+ *   and   := unary ( "&&" unary )*
+ *   unary := "!" unary | "(" expr ")" | "true" | field op value
+ *
+ *   数値フィールド  pid ppid uid gid        : == != < <= > >=  10 進 / 0x 16 進（u32。010 も 10 進）
+ *   文字列フィールド comm filename           : == != ~ !~       "..." （~ は glob: * と ?、\ で打ち消し）
+ *
+ *   例: uid == 1000 && comm ~ "python*"
+ *       !(filename ~ "/usr/bin*") || ppid == 1
+ *
+ * 生成するプログラム（r1 = struct exec_fields *。NULL かもしれないので最初に確認する）:
+ *
+ *   r6 = r1
+ *   if r1 == 0 goto FALSE
+ *   <式>           && / || / ! は短絡評価のジャンプに展開する（値を積むスタックは使わない）
+ *   TRUE:  r0 = 1; exit
+ *   FALSE: r0 = 0; exit
+ *
+ *   数値の比較: r1 = *(u32 *)(r6 + off); if w1 <op> imm goto T; goto F（JMP32 で符号なし比較）
+ *
+ *   glob: パターンを NFA（位置の集合）→ DFA にして、文字列の 1 バイトごとに展開する。
+ *   (位置 i, DFA 状態) ごとに 1 ブロックで、ブロックの中身は「1 バイト読む → NUL なら受理/不受理 →
+ *   パターンに出てくる文字ごとに分岐 → それ以外」。ループも後ろ向きのジャンプも無いので
+ *   verifier はそのまま通し、実行時は 1 バイトあたり load 1 回と比較数回で済む。
+ *
+ *     "py*" の例（comm は 16 bytes）:
+ *       i=0 {p}   : 'p' → i=1 {y}      それ以外 → F
+ *       i=1 {y}   : 'y' → i=2 {*,end}  それ以外 → F
+ *       i=2 {*,end}: 末尾の * に入ったので何が来ても一致 → T（残りのバイトは読まない）
+ *
+ * 注意:
+ *   - ジャンプはすべて前向き。命令数は FILTER_MAX_INSNS までで、超える式はエラーにする。
+ *   - 文字列フィールドは NUL 終端している前提（BPF 側が *_str ヘルパと bpf_get_current_comm で埋める）。
+ *     size バイト以内に NUL が無いときは一致しない扱い。ただし末尾が * のパターンは、先頭 size - 1 バイト
+ *     までで一致が決まった時点で一致とする（filter_eval も同じ）。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/bpf.h>
+
+#include "exec-filter.h"
+
+#define FILTER_MAX_NODES    64
+#define FILTER_MAX_DEPTH    32       /* 括弧と ! の入れ子の深さ */
+#define FILTER_MAX_PATTERN  32       /* glob のトークン数（NFA の位置の集合を u64 で持つ） */
+#define FILTER_MAX_DFA      64       /* 1 バイト位置あたりの DFA 状態数 */
+#define FILTER_MAX_INSNS    16384
+
+/* glob のトークン: 0..255 はその文字 */
+#define GLOB_STAR 256
+#define GLOB_ANY  257
+
+enum filter_node_kind {
+   FNODE_TRUE = 0,
+   FNODE_CMP,
+   FNODE_AND,
+   FNODE_OR,
+   FNODE_NOT,
+};
+
+enum filter_op {
+   FOP_EQ = 0,
+   FOP_NE,
+   FOP_LT,
+   FOP_LE,
+   FOP_GT,
+   FOP_GE,
+   FOP_MATCH,
+   FOP_NMATCH,
+};
+
+struct filter_field_desc {
+   const char *name;
+   unsigned int off;
+   unsigned int size;
+   bool is_str;
+};
+
+#define FILTER_FIELD(f, str) \
+    { #f, offsetof(struct exec_fields, f), sizeof(((struct exec_fields *)0)->f), str }
+
+static const struct filter_field_desc filter_fields[] = {
+    FILTER_FIELD(pid, false),
+    FILTER_FIELD(ppid, false),
+    FILTER_FIELD(uid, false),
+    FILTER_FIELD(gid, false),
+    FILTER_FIELD(comm, true),
+    FILTER_FIELD(filename, true),
+};
+
+#define NR_FILTER_FIELDS ((int)(sizeof(filter_fields) / sizeof(filter_fields[0])))
+
+struct filter_node {
+   int kind;                          /* enum filter_node_kind */
+   int field;                         /* filter_fields の添字（FNODE_CMP） */
+   int op;                            /* enum filter_op（FNODE_CMP） */
+   unsigned int num;                  /* 数値フィールドの比較値 */
+   short pat[FILTER_MAX_PATTERN];     /* 文字列は glob で持つ（== / != はワイルドカード無し） */
+   int pat_len;
+   int left, right;                   /* 子ノード（FNODE_NOT は left だけ） */
+};
+
+struct filter {
+   struct filter_node nodes[FILTER_MAX_NODES];
+   int nr_nodes;
+   int root;
+   const char *src;                   /* 構文解析中の入力と位置 */
+   const char *pos;
+   int depth;
+   char err[128];
+};
+
+/* ------------------------------------------------------------------------- */
+/* 構文解析                                                                   */
+/* ------------------------------------------------------------------------- */
+
+static int filter_error(struct filter *f, const char *msg)
+{
+    if (!f->err[0])
+        snprintf(f->err, sizeof(f->err), "%s at offset %d", msg, (int)(f->pos - f->src));
+    return -1;
+}
+
+static void filter_skip_ws(struct filter *f)
+{
+    while (isspace((unsigned char)*f->pos))
+        f->pos++;
+}
+
+static bool filter_accept(struct filter *f, const char *tok)
+{
+    size_t n = strlen(tok);
+
+    filter_skip_ws(f);
+    if (strncmp(f->pos, tok, n))
+        return false;
+    f->pos += n;
+    return true;
+}
+
+static int filter_new_node(struct filter *f, int kind)
+{
+    struct filter_node *n;
+
+    if (f->nr_nodes == FILTER_MAX_NODES)
+        return filter_error(f, "expression too long");
+    n = &f->nodes[f->nr_nodes];
+    memset(n, 0, sizeof(*n));
+    n->kind = kind;
+    return f->nr_nodes++;
+}
+
+/* "..." を n->pat に読む。glob なら * と ? をワイルドカードにする */
+static int filter_parse_string(struct filter *f, struct filter_node *n, bool glob)
+{
+    filter_skip_ws(f);
+    if (*f->pos != '"')
+        return filter_error(f, "expected string");
+    f->pos++;
+
+    while (*f->pos && *f->pos != '"') {
+        int c = (unsigned char)*f->pos++;
+
+        if (c == '\\' && *f->pos)
+            c = (unsigned char)*f->pos++;
+        else if (glob && c == '*')
+            c = GLOB_STAR;
+        else if (glob && c == '?')
+            c = GLOB_ANY;
+
+        if (n->pat_len == FILTER_MAX_PATTERN)
+            return filter_error(f, "string too long");
+        n->pat[n->pat_len++] = (short)c;
+    }
+    if (*f->pos != '"')
+        return filter_error(f, "unterminated string");
+    f->pos++;
+    return 0;
+}
+
+static int filter_parse_cmp(struct filter *f)
+{
+    static const struct { const char *tok; int op; } ops[] = {
+        { "==", FOP_EQ }, { "!=", FOP_NE }, { "!~", FOP_NMATCH }, { "<=", FOP_LE },
+        { ">=", FOP_GE }, { "<", FOP_LT }, { ">", FOP_GT }, { "~", FOP_MATCH },
+    };
+    const struct filter_field_desc *d;
+    struct filter_node *n;
+    char name[32];
+    size_t len = 0;
+    int field = -1, op = -1, id;
+
+    filter_skip_ws(f);
+    while ((isalnum((unsigned char)*f->pos) || *f->pos == '_') && len < sizeof(name) - 1)
+        name[len++] = *f->pos++;
+    name[len] = '\0';
+    if (!len)
+        return filter_error(f, "expected field name");
+    if (!strcmp(name, "true"))
+        return filter_new_node(f, FNODE_TRUE);
+
+    for (int i = 0; i < NR_FILTER_FIELDS; i++)
+        if (!strcmp(name, filter_fields[i].name))
+            field = i;
+    if (field < 0)
+        return filter_error(f, "unknown field");
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]) && op < 0; i++)
+        if (filter_accept(f, ops[i].tok))
+            op = ops[i].op;
+    if (op < 0)
+        return filter_error(f, "expected operator");
+
+    id = filter_new_node(f, FNODE_CMP);
+    if (id < 0)
+        return -1;
+    n = &f->nodes[id];
+    n->field = field;
+    n->op = op;
+    d = &filter_fields[field];
+
+    if (d->is_str) {
+        if (op != FOP_EQ && op != FOP_NE && op != FOP_MATCH && op != FOP_NMATCH)
+            return filter_error(f, "string fields take == != ~ !~");
+        return filter_parse_string(f, n, op == FOP_MATCH || op == FOP_NMATCH) ? -1 : id;
+    }
+
+    if (op == FOP_MATCH || op == FOP_NMATCH)
+        return filter_error(f, "~ needs a string field");
+
+    filter_skip_ws(f);
+    if (!isdigit((unsigned char)*f->pos))
+        return filter_error(f, "expected number");
+    {
+        char *end;
+        /* 0x で始まれば 16 進、それ以外は 10 進（先頭の 0 を 8 進とは読まない） */
+        bool hex = f->pos[0] == '0' && (f->pos[1] == 'x' || f->pos[1] == 'X');
+        unsigned long long v = strtoull(f->pos, &end, hex ? 16 : 10);
+
+        if (v > UINT_MAX)
+            return filter_error(f, "number out of range");
+        n->num = (unsigned int)v;
+        f->pos = end;
+    }
+    return id;
+}
+
+static int filter_parse_or(struct filter *f);
+
+static int filter_parse_unary(struct filter *f)
+{
+    int id, child;
+
+    if (f->depth == FILTER_MAX_DEPTH)
+        return filter_error(f, "nested too deeply");
+
+    if (filter_accept(f, "!")) {
+        f->depth++;
+        child = filter_parse_unary(f);
+        f->depth--;
+        if (child < 0)
+            return -1;
+        id = filter_new_node(f, FNODE_NOT);
+        if (id >= 0)
+            f->nodes[id].left = child;
+        return id;
+    }
+
+    if (filter_accept(f, "(")) {
+        f->depth++;
+        id = filter_parse_or(f);
+        f->depth--;
+        if (id < 0)
+            return -1;
+        if (!filter_accept(f, ")"))
+            return filter_error(f, "expected ')'");
+        return id;
+    }
+
+    return filter_parse_cmp(f);
+}
+
+/* left (tok right)* を kind のノードで左結合に積む */
+static int filter_parse_binary(struct filter *f, const char *tok, int kind,
+                               int (*sub)(struct filter *))
+{
+    int left = sub(f);
+
+    while (left >= 0 && filter_accept(f, tok)) {
+        int right = sub(f);
+        int id;
+
+        if (right < 0)
+            return -1;
+        id = filter_new_node(f, kind);
+        if (id < 0)
+            return -1;
+        f->nodes[id].left = left;
+        f->nodes[id].right = right;
+        left = id;
+    }
+    return left;
+}
+
+static int filter_parse_and(struct filter *f)
+{
+    return filter_parse_binary(f, "&&", FNODE_AND, filter_parse_unary);
+}
+
+static int filter_parse_or(struct filter *f)
+{
+    return filter_parse_binary(f, "||", FNODE_OR, filter_parse_and);
+}
+
+/* src を構文解析する。失敗したら -1 で、f->err に理由が入る */
+static int filter_parse(struct filter *f, const char *src)
+{
+    memset(f, 0, sizeof(*f));
+    f->src = f->pos = src;
+
+    f->root = filter_parse_or(f);
+    if (f->root < 0)
+        return -1;
+    filter_skip_ws(f);
+    if (*f->pos)
+        return filter_error(f, "unexpected input");
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ユーザ空間での評価                                                         */
+/* ------------------------------------------------------------------------- */
+
+/*
+ * s（size bytes の NUL 終端文字列）が pat に一致するか。* は最後に見た位置から再開する。
+ * NUL が無いときは BPF 側に合わせる: 末尾が * なら先頭 size - 1 バイトで判定し、それ以外は不一致。
+ */
+static bool filter_glob(const short *pat, int n, const char *s, size_t size)
+{
+    const char *nul = memchr(s, '\0', size);
+    size_t len, si = 0, mark = 0;
+    int pi = 0, star = -1;
+
+    if (nul)
+        len = nul - s;
+    else if (n && pat[n - 1] == GLOB_STAR)
+        len = size - 1;
+    else
+        return false;
+
+    while (si < len) {
+        if (pi < n && (pat[pi] == GLOB_ANY || pat[pi] == (unsigned char)s[si])) {
+            pi++;
+            si++;
+        } else if (pi < n && pat[pi] == GLOB_STAR) {
+            star = pi++;
+            mark = si;
+        } else if (star >= 0) {
+            pi = star + 1;
+            si = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (pi < n && pat[pi] == GLOB_STAR)
+        pi++;
+    return pi == n;
+}
+
+static bool filter_eval_node(const struct filter *f, int id, const struct exec_fields *e)
+{
+    const struct filter_node *n = &f->nodes[id];
+    const struct filter_field_desc *d;
+    unsigned int v;
+    bool r;
+
+    switch (n->kind) {
+    case FNODE_TRUE:
+        return true;
+    case FNODE_AND:
+        return filter_eval_node(f, n->left, e) && filter_eval_node(f, n->right, e);
+    case FNODE_OR:
+        return filter_eval_node(f, n->left, e) || filter_eval_node(f, n->right, e);
+    case FNODE_NOT:
+        return !filter_eval_node(f, n->left, e);
+    }
+
+    d = &filter_fields[n->field];
+    if (d->is_str) {
+        r = filter_glob(n->pat, n->pat_len, (const char *)e + d->off, d->size);
+        return (n->op == FOP_EQ || n->op == FOP_MATCH) ? r : !r;
+    }
+
+    memcpy(&v, (const char *)e + d->off, sizeof(v));
+    switch (n->op) {
+    case FOP_EQ: return v == n->num;
+    case FOP_NE: return v != n->num;
+    case FOP_LT: return v < n->num;
+    case FOP_LE: return v <= n->num;
+    case FOP_GT: return v > n->num;
+    case FOP_GE: return v >= n->num;
+    }
+    return false;
+}
+
+static bool filter_eval(const struct filter *f, const struct exec_fields *e)
+{
+    return filter_eval_node(f, f->root, e);
+}
+
+/* ------------------------------------------------------------------------- */
+/* BPF 命令列への変換                                                         */
+/* ------------------------------------------------------------------------- */
+
+struct filter_fixup {
+   int insn;                          /* off を埋めるジャンプ命令 */
+   int label;
+};
+
+struct filter_prog {
+   struct bpf_insn insns[FILTER_MAX_INSNS];
+   int len;
+   int labels[FILTER_MAX_INSNS];      /* ラベル → 命令位置（-1 = まだ置いていない） */
+   int nr_labels;
+   struct filter_fixup fixups[FILTER_MAX_INSNS];
+   int nr_fixups;
+   char err[128];
+};
+
+static void fp_error(struct filter_prog *p, const char *msg)
+{
+    if (!p->err[0])
+        snprintf(p->err, sizeof(p->err), "%s", msg);
+}
+
+static void fp_emit(struct filter_prog *p, __u8 code, __u8 dst, __u8 src, __s16 off, __s32 imm)
+{
+    if (p->len == FILTER_MAX_INSNS) {
+        fp_error(p, "filter too large");
+        return;
+    }
+    p->insns[p->len++] = (struct bpf_insn){
+        .code = code, .dst_reg = dst, .src_reg = src, .off = off, .imm = imm,
+    };
+}
+
+static int fp_label(struct filter_prog *p)
+{
+    if (p->nr_labels == FILTER_MAX_INSNS) {
+        fp_error(p, "filter too large");
+        return 0;
+    }
+    p->labels[p->nr_labels] = -1;
+    return p->nr_labels++;
+}
+
+static void fp_place(struct filter_prog *p, int label)
+{
+    p->labels[label] = p->len;
+}
+
+/* label へのジャンプ。off は filter_compile の最後に埋める */
+static void fp_jump(struct filter_prog *p, __u8 code, __u8 dst, __s32 imm, int label)
+{
+    if (p->len < FILTER_MAX_INSNS) {
+        p->fixups[p->nr_fixups].insn = p->len;
+        p->fixups[p->nr_fixups].label = label;
+        p->nr_fixups++;
+    }
+    fp_emit(p, code, dst, 0, 0, imm);
+}
+
+static __u64 glob_closure(const short *pat, int n, __u64 set)
+{
+    for (int j = 0; j < n; j++)
+        if (((set >> j) & 1) && pat[j] == GLOB_STAR)
+            set |= 1ULL << (j + 1);
+    return set;
+}
+
+static __u64 glob_step(const short *pat, int n, __u64 set, int c)
+{
+    __u64 next = 0;
+
+    for (int j = 0; j < n; j++) {
+        if (!((set >> j) & 1))
+            continue;
+        if (pat[j] == GLOB_STAR)
+            next |= 1ULL << j;
+        else if (pat[j] == GLOB_ANY || pat[j] == c)
+            next |= 1ULL << (j + 1);
+    }
+    return glob_closure(pat, n, next);
+}
+
+/*
+ * set が「この先は何が来ても一致」の状態か（末尾が * だけのパターン位置を含む）。
+ * comm / filename はカーネル側で必ず NUL 終端されるので、残りのバイトを読む必要は無い。
+ */
+static bool glob_accepts_all(const short *pat, int n, __u64 set)
+{
+    for (int j = 0; j < n; j++) {
+        bool stars = true;
+
+        if (!((set >> j) & 1))
+            continue;
+        for (int k = j; k < n; k++)
+            stars &= pat[k] == GLOB_STAR;
+        if (stars)
+            return true;
+    }
+    return false;
+}
+
+/* 次の位置の DFA 状態 set のブロックのラベル（初めてならブロックを足す） */
+struct glob_level {
+   __u64 sets[FILTER_MAX_DFA];
+   int labels[FILTER_MAX_DFA];
+   int nr;
+};
+
+static int glob_target(struct filter_prog *p, struct glob_level *next, __u64 set, int f)
+{
+    if (!set)
+        return f;
+    for (int k = 0; k < next->nr; k++)
+        if (next->sets[k] == set)
+            return next->labels[k];
+    if (next->nr == FILTER_MAX_DFA) {
+        fp_error(p, "pattern too complex");
+        return f;
+    }
+    next->sets[next->nr] = set;
+    next->labels[next->nr] = fp_label(p);
+    return next->labels[next->nr++];
+}
+
+/* 文字列フィールド（off, size）が n->pat に一致すれば t、しなければ f へ飛ぶ */
+static void fp_gen_glob(struct filter_prog *p, const struct filter_node *n,
+                        unsigned int off, unsigned int size, int t, int f)
+{
+    struct glob_level level[2] = {};
+    int chars[FILTER_MAX_PATTERN];
+    int nr_chars = 0, other, cur = 0;
+
+    /* パターンに出てくる文字と、出てこない文字の代表（「それ以外」の遷移を計算する用） */
+    for (int j = 0; j < n->pat_len; j++) {
+        bool seen = false;
+
+        if (n->pat[j] >= 256)
+            continue;
+        for (int k = 0; k < nr_chars; k++)
+            seen |= chars[k] == n->pat[j];
+        if (!seen)
+            chars[nr_chars++] = n->pat[j];
+    }
+    for (other = 1; other < 256; other++) {
+        bool used = false;
+
+        for (int k = 0; k < nr_chars; k++)
+            used |= chars[k] == other;
+        if (!used)
+            break;
+    }
+
+    level[0].sets[0] = glob_closure(n->pat, n->pat_len, 1);
+    level[0].labels[0] = fp_label(p);
+    level[0].nr = 1;
+
+    for (unsigned int i = 0; i < size; i++) {
+        struct glob_level *now = &level[cur], *next = &level[cur ^ 1];
+
+        next->nr = 0;
+        for (int k = 0; k < now->nr; k++) {
+            __u64 set = now->sets[k];
+            bool last = i + 1 == size;   /* ここで NUL でなければ、どのパターンにも一致しない */
+            int dflt;
+
+            fp_place(p, now->labels[k]);
+            if (glob_accepts_all(n->pat, n->pat_len, set)) {
+                /* "/usr/bin*" の * に入った後など: 残りを 1 バイトずつ読まずに t へ */
+                fp_jump(p, BPF_JMP | BPF_JA, 0, 0, t);
+                continue;
+            }
+
+            dflt = last ? f : glob_target(p, next, glob_step(n->pat, n->pat_len, set, other), f);
+            fp_emit(p, BPF_LDX | BPF_MEM | BPF_B, BPF_REG_1, BPF_REG_6, (__s16)(off + i), 0);
+            fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_1, 0,
+                    ((set >> n->pat_len) & 1) ? t : f);
+
+            for (int c = 0; c < nr_chars; c++) {
+                int tgt = last ? f : glob_target(p, next, glob_step(n->pat, n->pat_len, set, chars[c]), f);
+
+                if (tgt != dflt)
+                    fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_1, chars[c], tgt);
+            }
+            fp_jump(p, BPF_JMP | BPF_JA, 0, 0, dflt);
+        }
+        cur ^= 1;
+    }
+}
+
+static void fp_gen(struct filter_prog *p, const struct filter *f, int id, int t, int fl)
+{
+    static const __u8 jops[] = {
+        [FOP_EQ] = BPF_JEQ, [FOP_NE] = BPF_JNE, [FOP_LT] = BPF_JLT,
+        [FOP_LE] = BPF_JLE, [FOP_GT] = BPF_JGT, [FOP_GE] = BPF_JGE,
+    };
+    const struct filter_node *n = &f->nodes[id];
+    const struct filter_field_desc *d;
+    int mid;
+
+    switch (n->kind) {
+    case FNODE_TRUE:
+        fp_jump(p, BPF_JMP | BPF_JA, 0, 0, t);
+        return;
+    case FNODE_AND:
+        mid = fp_label(p);
+        fp_gen(p, f, n->left, mid, fl);
+        fp_place(p, mid);
+        fp_gen(p, f, n->right, t, fl);
+        return;
+    case FNODE_OR:
+        mid = fp_label(p);
+        fp_gen(p, f, n->left, t, mid);
+        fp_place(p, mid);
+        fp_gen(p, f, n->right, t, fl);
+        return;
+    case FNODE_NOT:
+        fp_gen(p, f, n->left, fl, t);
+        return;
+    }
+
+    d = &filter_fields[n->field];
+    if (d->is_str) {
+        if (n->op == FOP_EQ || n->op == FOP_MATCH)
+            fp_gen_glob(p, n, d->off, d->size, t, fl);
+        else
+            fp_gen_glob(p, n, d->off, d->size, fl, t);
+        return;
+    }
+
+    fp_emit(p, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_1, BPF_REG_6, (__s16)d->off, 0);
+    fp_jump(p, BPF_JMP32 | jops[n->op] | BPF_K, BPF_REG_1, (__s32)n->num, t);
+    fp_jump(p, BPF_JMP | BPF_JA, 0, 0, fl);
+}
+
+/* 構文木 f を exec_filter(struct exec_fields *) の代わりになる命令列にする */
+static int filter_compile(const struct filter *f, struct filter_prog *p)
+{
+    int t, fl;
+
+    p->len = 0;
+    p->nr_labels = 0;
+    p->nr_fixups = 0;
+    p->err[0] = '\0';
+
+    t = fp_label(p);
+    fl = fp_label(p);
+
+    fp_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0);
+    fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_1, 0, fl);
+    fp_gen(p, f, f->root, t, fl);
+
+    fp_place(p, t);
+    fp_emit(p, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 1);
+    fp_emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+    fp_place(p, fl);
+    fp_emit(p, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0);
+    fp_emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    for (int i = 0; i < p->nr_fixups && !p->err[0]; i++) {
+        const struct filter_fixup *x = &p->fixups[i];
+        int off = p->labels[x->label] - (x->insn + 1);
+
+        if (p->labels[x->label] < 0 || off < 0 || off > SHRT_MAX)
+            fp_error(p, "jump out of range");
+        p->insns[x->insn].off = (__s16)off;
+    }
+    return p->err[0] ? -1 : 0;
+}
+
+/* 生成した命令列を bpftool prog dump xlated に近い形で出す */
+static void filter_dump(const struct filter_prog *p, FILE *out)
+{
+    static const char *jops[16] = {
+        [BPF_JEQ >> 4] = "==", [BPF_JNE >> 4] = "!=", [BPF_JLT >> 4] = "<",
+        [BPF_JLE >> 4] = "<=", [BPF_JGT >> 4] = ">",  [BPF_JGE >> 4] = ">=",
+    };
+
+    for (int i = 0; i < p->len; i++) {
+        const struct bpf_insn *in = &p->insns[i];
+        int cls = BPF_CLASS(in->code);
+
+        fprintf(out, "%5d: ", i);
+        if (in->code == (BPF_ALU64 | BPF_MOV | BPF_X))
+            fprintf(out, "r%d = r%d\n", in->dst_reg, in->src_reg);
+        else if (in->code == (BPF_ALU64 | BPF_MOV | BPF_K))
+            fprintf(out, "r%d = %d\n", in->dst_reg, in->imm);
+        else if (cls == BPF_LDX)
+            fprintf(out, "r%d = *(u%d *)(r%d %+d)\n", in->dst_reg,
+                    BPF_SIZE(in->code) == BPF_W ? 32 : 8, in->src_reg, in->off);
+        else if (in->code == (BPF_JMP | BPF_EXIT))
+            fprintf(out, "exit\n");
+        else if (in->code == (BPF_JMP | BPF_JA))
+            fprintf(out, "goto %d\n", i + 1 + in->off);
+        else if ((cls == BPF_JMP || cls == BPF_JMP32) && jops[BPF_OP(in->code) >> 4])
+            fprintf(out, "if %c%d %s %u goto %d\n", cls == BPF_JMP32 ? 'w' : 'r',
+                    in->dst_reg, jops[BPF_OP(in->code) >> 4], (unsigned int)in->imm,
+                    i + 1 + in->off);
+        else
+            fprintf(out, "code 0x%02x\n", in->code);
+    }
+}
+
+#endif /* FILTER_EXPR_H */
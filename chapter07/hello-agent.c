@@ -0,0 +1,574 @@
+/*
+ * hello-agent.c（ユーザ空間側 / hello 系 3 オブジェクトを 1 プロセスで動かすエージェント）
+ *
+ * 目的:
+ *   chapter05 の hello-buffer-config、chapter06 の hello-verifier、chapter07 の hello は
+ *   どれも execve を観測して perf buffer（output）に data_t を送り、my_config（UID → メッセージ）を引く。
+ *   別々のプロセスで動かすと output / my_config / perf buffer の mmap / poll ループが 3 つずつできる。
+ *
+ *   このエージェントは 3 つの skeleton を 1 プロセスで開き、
+ *   最初に load したオブジェクトの output と my_config を bpf_map__reuse_fd で残り 2 つに使わせる。
+ *   perf buffer は 1 つ、poll ループも 1 つで全部のイベントを受ける。
+ *
+ * 使い方:
+ *   sudo ./hello-agent                     # 1 プロセスで 3 つを動かす（Ctrl-C で終了）
+ *   sudo ./hello-agent -S                  # 比較用: 同じ 3 つを子プロセス 3 つで別々に動かす
+ *   sudo ./hello-agent -q -d 30            # 出力を捨てて 30 秒動かし、使用量を出して終了
+ *
+ *   -c <uid>:<message>  my_config[uid] = message（複数指定可。共有しているので 1 回書けば全部に効く）
+ *   -d <sec>            sec 秒で終了する（既定 0 = Ctrl-C まで）
+ *   -q                  イベントの行を /dev/null に捨てる（使用量の比較で表示のコストを揃えるため）
+ *   -S                  3 つを別プロセスで動かす（3 本のツールを並べて起動したのと同じ構成）
+ *
+ *   比較するときは別の端末で exec を発生させ続ける（例: while :; do /bin/true; done）。
+ *
+ * 全体の流れ（1 プロセス）:
+ *
+ *   open x 3（hello-buffer-config / hello-verifier / hello）
+ *     │
+ *     v
+ *   load hello-buffer-config ……… output と my_config をここで作る（持ち主）
+ *     │
+ *     v
+ *   hello-verifier, hello の output / my_config を bpf_map__reuse_fd で持ち主の fd に差し替えて load
+ *     │   map は作られず、プログラムは持ち主の map を参照する
+ *     v
+ *   -c の設定を my_config に 1 回書く → attach x 3
+ *     │
+ *     v
+ *   perf_buffer__new（output 1 本）→ poll ループ 1 つ
+ *
+ *       hello-buffer-config ─┐
+ *       hello-verifier ──────┼──> output（共有）──> perf buffer ──> agent_event ──> sink
+ *       hello ───────────────┘        ^
+ *                                     └── my_config（共有）
+ *
+ * イベントの見分け:
+ *   hello-buffer-config と hello の data_t は同じ並び（pid, uid, command, message, path = 52 bytes）で、
+ *   hello-verifier の data_t は path が無く counter がある（40 bytes）。
+ *   perf のサンプルは 8 bytes 境界に詰められて 52 / 44 bytes で届くので、長さで振り分ける。
+ *   前者の表示は chapter05 の consumer（hello-buffer-consumer.h）をそのまま使う。
+ *
+ * 使用量の表示（終了時）:
+ *
+ *   PROCESS               RSS(KiB)  MEMLOCK(KiB)  RING(KiB)   CPU(ms)
+ *   hello-agent               2816           312        288        41
+ *
+ *   RSS     : /proc/<pid>/status の VmRSS
+ *   MEMLOCK : /proc/<pid>/fdinfo の map / prog の memlock の合計（同じ map_id / prog_id は 1 回だけ数える）
+ *   RING    : /proc/<pid>/maps の perf_event の mmap（perf buffer のリング。CPU 数 x (8 + 1) ページ）
+ *   CPU     : /proc/<pid>/stat の utime + stime（load と verifier の時間も含む）
+ *
+ *   -S では子プロセスごとの行と合計を出す。
+ *
+ * 注意:
+ *   - reuse_fd する map は型・key/value サイズ・max_entries が一致している必要がある
+ *     （3 つとも output = PERF_EVENT_ARRAY、my_config = HASH<u32, char[12]> x 10240 で揃っている）。
+ *   - hello は 6 種類のフックを持つので、1 回の execve で複数行出る（message がフック名）。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <bpf/libbpf.h>
+
+#include "../chapter05/hello-buffer-consumer.h"   /* struct data_t（chapter05/07 共通の並び）と consumer */
+
+/* chapter06 の data_t / msg_t は並びが違うので、名前を変えて取り込む */
+#define data_t verifier_data_t
+#define msg_t  verifier_msg_t
+#include "../chapter06/hello-verifier.h"
+#undef data_t
+#undef msg_t
+
+#include "../chapter05/hello-buffer-config.skel.h"
+#include "../chapter06/hello-verifier.skel.h"
+#include "hello.skel.h"
+
+#define PERF_PAGE_CNT 8      /* CPU ごとのリングのページ数（単体のツールと同じ） */
+#define MAX_CONFIGS   64
+#define MAX_BPF_IDS   256    /* 1 プロセスが持つ map / prog の数の上限（使用量の集計用） */
+
+enum obj_id {
+   OBJ_BUFFER_CONFIG = 0,
+   OBJ_VERIFIER,
+   OBJ_HELLO,
+   NR_OBJS,
+};
+
+static const char *obj_names[NR_OBJS] = {
+    "hello-buffer-config", "hello-verifier", "hello",
+};
+
+struct agent {
+    struct hello_buffer_config_bpf *cfg;
+    struct hello_verifier_bpf *ver;
+    struct hello_bpf *hello;
+    struct bpf_object *objs[NR_OBJS];   /* 開いたものだけ非 NULL */
+    struct perf_buffer *pb;
+    struct consumer consumer;
+};
+
+struct usage {
+    unsigned long long rss_kb;
+    unsigned long long memlock_kb;
+    unsigned long long ring_kb;
+    unsigned long long cpu_ms;
+};
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* 長さで振り分ける: 52 bytes = chapter05/07 の data_t、44 bytes = chapter06 の data_t */
+static void agent_event(void *ctx, int cpu, void *data, __u32 data_sz)
+{
+    struct consumer *c = ctx;
+    const struct verifier_data_t *v = data;
+
+    if (data_sz >= sizeof(struct data_t)) {
+        handle_event(ctx, cpu, data, data_sz);
+        return;
+    }
+    if (data_sz < sizeof(*v))
+        return;
+
+    c->events++;
+    fprintf(c->sink, "%-6d %-6d %-16s %-16s %s\n",
+            v->pid, v->uid, v->command, "-", v->message);
+}
+
+static int open_obj(struct agent *a, int id)
+{
+    switch (id) {
+    case OBJ_BUFFER_CONFIG:
+        a->cfg = hello_buffer_config_bpf__open();
+        a->objs[id] = a->cfg ? a->cfg->obj : NULL;
+        break;
+    case OBJ_VERIFIER:
+        a->ver = hello_verifier_bpf__open();
+        a->objs[id] = a->ver ? a->ver->obj : NULL;
+        break;
+    case OBJ_HELLO:
+        a->hello = hello_bpf__open();
+        a->objs[id] = a->hello ? a->hello->obj : NULL;
+        break;
+    }
+    return a->objs[id] ? 0 : -errno;
+}
+
+static int load_obj(struct agent *a, int id)
+{
+    switch (id) {
+    case OBJ_BUFFER_CONFIG:
+        return hello_buffer_config_bpf__load(a->cfg);
+    case OBJ_VERIFIER:
+        return hello_verifier_bpf__load(a->ver);
+    case OBJ_HELLO:
+        return hello_bpf__load(a->hello);
+    }
+    return -EINVAL;
+}
+
+static int attach_obj(struct agent *a, int id)
+{
+    switch (id) {
+    case OBJ_BUFFER_CONFIG:
+        return hello_buffer_config_bpf__attach(a->cfg);
+    case OBJ_VERIFIER:
+        return hello_verifier_bpf__attach(a->ver);
+    case OBJ_HELLO:
+        return hello_bpf__attach(a->hello);
+    }
+    return -EINVAL;
+}
+
+static void agent_destroy(struct agent *a)
+{
+    perf_buffer__free(a->pb);
+    hello_buffer_config_bpf__destroy(a->cfg);
+    hello_verifier_bpf__destroy(a->ver);
+    hello_bpf__destroy(a->hello);
+    memset(a, 0, sizeof(*a));
+}
+
+/* obj の name という map を、load 前に既存の fd（持ち主の map）に差し替える */
+static int reuse_map(struct bpf_object *obj, const char *name, struct bpf_object *owner)
+{
+    struct bpf_map *map = bpf_object__find_map_by_name(obj, name);
+    int fd = bpf_map__fd(bpf_object__find_map_by_name(owner, name));
+    int err;
+
+    if (!map || fd < 0) {
+        fprintf(stderr, "Map %s not found\n", name);
+        return -ENOENT;
+    }
+    err = bpf_map__reuse_fd(map, fd);
+    if (err)
+        fprintf(stderr, "Failed to reuse map %s: %d\n", name, err);
+    return err;
+}
+
+/* "<uid>:<message>" を my_config に書き込む */
+static int set_config(struct bpf_object *obj, const char *arg)
+{
+    struct bpf_map *map = bpf_object__find_map_by_name(obj, "my_config");
+    char message[sizeof(((struct data_t *)0)->message)] = {};
+    const char *colon = strchr(arg, ':');
+    __u32 uid;
+    int err;
+
+    if (!map || !colon || colon == arg) {
+        fprintf(stderr, "Invalid -c argument (want <uid>:<message>): %s\n", arg);
+        return -EINVAL;
+    }
+    uid = (__u32)strtoul(arg, NULL, 0);
+    strncpy(message, colon + 1, sizeof(message) - 1);
+
+    err = bpf_map__update_elem(map, &uid, sizeof(uid), message, sizeof(message), 0);
+    if (err)
+        fprintf(stderr, "Failed to update my_config map (err=%d)\n", err);
+    return err;
+}
+
+/*
+ * mask のオブジェクトを open / load / attach して perf buffer を作る。
+ * 2 つ目以降は最初に load したもの（持ち主）の output と my_config を使う。
+ */
+static int agent_start(struct agent *a, unsigned int mask, char **configs, int nr_configs,
+                       FILE *sink)
+{
+    struct bpf_object *owner = NULL;
+    int err;
+
+    a->consumer.sink = sink;
+
+    for (int id = 0; id < NR_OBJS; id++) {
+        if (!(mask & (1u << id)))
+            continue;
+        err = open_obj(a, id);
+        if (err) {
+            fprintf(stderr, "Failed to open %s: %d\n", obj_names[id], err);
+            return err;
+        }
+    }
+
+    for (int id = 0; id < NR_OBJS; id++) {
+        if (!a->objs[id])
+            continue;
+        if (owner) {
+            err = reuse_map(a->objs[id], "output", owner);
+            if (!err)
+                err = reuse_map(a->objs[id], "my_config", owner);
+            if (err)
+                return err;
+        }
+        err = load_obj(a, id);
+        if (err) {
+            fprintf(stderr, "Failed to load %s: %d\n", obj_names[id], err);
+            return err;
+        }
+        if (!owner)
+            owner = a->objs[id];
+    }
+    if (!owner)
+        return -EINVAL;
+
+    for (int i = 0; i < nr_configs; i++) {
+        err = set_config(owner, configs[i]);
+        if (err)
+            return err;
+    }
+
+    for (int id = 0; id < NR_OBJS; id++) {
+        if (!a->objs[id])
+            continue;
+        err = attach_obj(a, id);
+        if (err) {
+            fprintf(stderr, "Failed to attach %s: %d\n", obj_names[id], err);
+            return err;
+        }
+    }
+
+    a->pb = perf_buffer__new(bpf_map__fd(bpf_object__find_map_by_name(owner, "output")),
+                             PERF_PAGE_CNT, agent_event, lost_event, &a->consumer, NULL);
+    if (!a->pb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create perf buffer: %d\n", err);
+        return err;
+    }
+    return 0;
+}
+
+/* duration_s 秒（0 なら exiting まで）poll する */
+static int agent_run(struct agent *a, int duration_s)
+{
+    time_t end = time(NULL) + duration_s;
+    int err = 0;
+
+    while (!exiting && (!duration_s || time(NULL) < end)) {
+        err = perf_buffer__poll(a->pb, 100 /* timeout ms */);
+        if (err == -EINTR) {
+            err = 0;
+            break;
+        }
+        if (err < 0) {
+            fprintf(stderr, "Error polling perf buffer: %d\n", err);
+            return err;
+        }
+        err = 0;
+    }
+    return err;
+}
+
+/* /proc/<pid>/fdinfo から map / prog の memlock を合計する（同じ id は 1 回） */
+static unsigned long long read_memlock(pid_t pid)
+{
+    unsigned long long seen[MAX_BPF_IDS];
+    unsigned long long total = 0;
+    int nr_seen = 0;
+    char path[64], line[256];
+    struct dirent *de;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "/proc/%d/fdinfo", (int)pid);
+    dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    while ((de = readdir(dir))) {
+        unsigned long long id = 0, memlock = 0, v;
+        bool dup = false;
+        FILE *f;
+
+        if (de->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "/proc/%d/fdinfo/%s", (int)pid, de->d_name);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        while (fgets(line, sizeof(line), f)) {
+            /* map と prog の id は別の番号空間なので上位ビットで区別する */
+            if (sscanf(line, "map_id: %llu", &v) == 1)
+                id = v | (1ULL << 62);
+            else if (sscanf(line, "prog_id: %llu", &v) == 1)
+                id = v | (1ULL << 63);
+            else if (sscanf(line, "memlock: %llu", &v) == 1)
+                memlock = v;
+        }
+        fclose(f);
+
+        if (!id)
+            continue;
+        for (int i = 0; i < nr_seen; i++)
+            dup |= seen[i] == id;
+        if (dup)
+            continue;
+        if (nr_seen < MAX_BPF_IDS)
+            seen[nr_seen++] = id;
+        total += memlock;
+    }
+    closedir(dir);
+    return total;
+}
+
+static int read_usage(pid_t pid, struct usage *u)
+{
+    unsigned long long utime = 0, stime = 0, start, end;
+    char path[64], line[512];
+    char *p;
+    FILE *f;
+
+    memset(u, 0, sizeof(*u));
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    f = fopen(path, "r");
+    if (!f)
+        return -errno;
+    while (fgets(line, sizeof(line), f))
+        sscanf(line, "VmRSS: %llu", &u->rss_kb);
+    fclose(f);
+
+    /* comm に空白や ')' が入っても読めるように、最後の ')' の後ろから数える（utime = 14, stime = 15） */
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    f = fopen(path, "r");
+    if (f) {
+        if (fgets(line, sizeof(line), f) && (p = strrchr(line, ')')))
+            sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                   &utime, &stime);
+        fclose(f);
+        u->cpu_ms = (utime + stime) * 1000 / sysconf(_SC_CLK_TCK);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    f = fopen(path, "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (!strstr(line, "[perf_event]"))
+                continue;
+            if (sscanf(line, "%llx-%llx", &start, &end) == 2)
+                u->ring_kb += (end - start) / 1024;
+        }
+        fclose(f);
+    }
+
+    u->memlock_kb = read_memlock(pid) / 1024;
+    return 0;
+}
+
+static void print_usage_header(void)
+{
+    printf("\n%-22s %10s %13s %10s %9s\n",
+           "PROCESS", "RSS(KiB)", "MEMLOCK(KiB)", "RING(KiB)", "CPU(ms)");
+}
+
+static void print_usage(const char *name, const struct usage *u)
+{
+    printf("%-22s %10llu %13llu %10llu %9llu\n",
+           name, u->rss_kb, u->memlock_kb, u->ring_kb, u->cpu_ms);
+}
+
+/* -S: 3 つを子プロセスで別々に動かし、duration_s 後（または Ctrl-C）に使用量を集める */
+static int run_separate(char **configs, int nr_configs, FILE *sink, int duration_s)
+{
+    pid_t pids[NR_OBJS] = {};
+    struct usage total = {};
+    int err = 0;
+
+    for (int id = 0; id < NR_OBJS; id++) {
+        pids[id] = fork();
+        if (pids[id] < 0) {
+            err = -errno;
+            fprintf(stderr, "fork failed: %d\n", err);
+            break;
+        }
+        if (pids[id] == 0) {
+            struct agent a = {};
+
+            err = agent_start(&a, 1u << id, configs, nr_configs, sink);
+            if (!err)
+                err = agent_run(&a, 0);
+            fprintf(stderr, "%s: %llu events (%llu lost)\n", obj_names[id],
+                    a.consumer.events, a.consumer.lost);
+            agent_destroy(&a);
+            _exit(err ? 1 : 0);
+        }
+    }
+
+    if (!err) {
+        time_t end = time(NULL) + duration_s;
+
+        while (!exiting && (!duration_s || time(NULL) < end))
+            sleep(1);
+
+        print_usage_header();
+        for (int id = 0; id < NR_OBJS; id++) {
+            struct usage u;
+
+            if (read_usage(pids[id], &u))
+                continue;
+            print_usage(obj_names[id], &u);
+            total.rss_kb += u.rss_kb;
+            total.memlock_kb += u.memlock_kb;
+            total.ring_kb += u.ring_kb;
+            total.cpu_ms += u.cpu_ms;
+        }
+        print_usage("total", &total);
+    }
+
+    for (int id = 0; id < NR_OBJS; id++) {
+        if (pids[id] <= 0)
+            continue;
+        kill(pids[id], SIGTERM);
+        waitpid(pids[id], NULL, 0);
+    }
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    struct agent a = {};
+    char *configs[MAX_CONFIGS];
+    int nr_configs = 0;
+    int duration_s = 0;
+    bool separate = false;
+    FILE *sink = stdout;
+    struct usage u;
+    int err = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:d:qS")) != -1) {
+        switch (opt) {
+        case 'c':
+            if (nr_configs == MAX_CONFIGS) {
+                fprintf(stderr, "Too many -c options (max %d)\n", MAX_CONFIGS);
+                return 1;
+            }
+            configs[nr_configs++] = optarg;
+            break;
+        case 'd':
+            duration_s = atoi(optarg);
+            break;
+        case 'q':
+            sink = fopen("/dev/null", "w");
+            if (!sink) {
+                fprintf(stderr, "Failed to open /dev/null: %s\n", strerror(errno));
+                return 1;
+            }
+            break;
+        case 'S':
+            separate = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c uid:message]... [-d sec] [-q] [-S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (separate) {
+        err = run_separate(configs, nr_configs, sink, duration_s);
+        return err < 0 ? -err : 0;
+    }
+
+    err = agent_start(&a, (1u << NR_OBJS) - 1, configs, nr_configs, sink);
+    if (!err)
+        err = agent_run(&a, duration_s);
+
+    if (!read_usage(getpid(), &u)) {
+        print_usage_header();
+        print_usage("hello-agent", &u);
+    }
+    fprintf(stderr, "hello-agent: %llu events (%llu lost)\n",
+            a.consumer.events, a.consumer.lost);
+
+    agent_destroy(&a);
+    return err < 0 ? -err : 0;
+}
@@ -104,6 +104,8 @@ struct {
  * BPF_KPROBE_SYSCALL マクロを使うと syscall の第1引数（pathname）を直接受け取れる。
  *
  * pathname はユーザ空間ポインタなので読むときは bpf_probe_read_user / _str を使う。
+ * このヘルパはページフォルトを起こせず、ページが常駐していないと黙って失敗する
+ * （argv / envp まで確実に取りたい場合の sleepable 版は exec-args.bpf.c）。
  *
  * 注意（超重要）:
  *   この関数内で bpf_perf_event_output(ctx, ...) を使っているが、
@@ -0,0 +1,358 @@
+/*
+ * scx-tiers.bpf.c（sched_ext / struct_ops で動く “優先度 tier 付き” スケジューラ）
+ *
+ * 目的:
+ *   これまでの chapter は「カーネルを観測する」BPF だけだったが、
+ *   sched_ext（CONFIG_SCHED_CLASS_EXT, 6.12+）を使うと BPF でスケジューリング方針そのものを書ける。
+ *   ここではレイテンシ重視のサービスをバッチジョブより先に走らせる、最小限の方針を実装する。
+ *
+ * 方針（アルゴリズム）:
+ *
+ *   task が起床（select_cpu）
+ *      │
+ *      ├─ idle CPU が見つかった → その CPU の local DSQ に直接入れる（最短経路）
+ *      │
+ *      v
+ *   enqueue
+ *      │  tier = cgroup → tier の map を “最も近い祖先” まで辿って決める
+ *      │  vtime = p->scx.dsq_vtime（長く寝ていた task は 1 slice 分までしか貯金できない）
+ *      ├─ tier ごとの共有 DSQ に vtime 順で入れる（= tier 内は vtime で公平）
+ *      └─ TIER_LATENCY なら、下位 tier を走らせている CPU を SCX_KICK_PREEMPT で蹴る
+ *
+ *   dispatch（CPU が次の task を欲しがった）
+ *      ├─ 下位 tier の待ちが starve_ns を超えていたら、上位を飛ばしてその tier から 1 つ取る
+ *      └─ それ以外は DSQ(TIER_LATENCY) → DSQ(TIER_NORMAL) → DSQ(TIER_BATCH) の順に 1 つ取る
+ *
+ *   running / stopping
+ *      ├─ running : その CPU が今どの tier を走らせているか記録、tier の vtime_now を進める
+ *      └─ stopping: 使った分だけ vtime を進める（weight が大きいほどゆっくり進む）
+ *
+ * struct_ops について:
+ *   - SEC(".struct_ops.link") に置いた struct sched_ext_ops の各メンバに BPF プログラムを入れる。
+ *   - ローダが bpf_map__attach_struct_ops() すると、カーネルのスケジューラクラスとして有効化される。
+ *   - BPF 側が異常終了（watchdog タイムアウト等）すると、カーネルが自動で CFS/EEVDF に戻す。
+ *
+ * 注意:
+ *   - kfunc 名は 6.13 以降のもの（scx_bpf_dsq_insert 等）を使っている。
+ *     6.12 では scx_bpf_dispatch / scx_bpf_consume という旧名なので、そこだけ置き換えが必要。
+ *   - sched_ext の kfunc は GPL 限定なので LICENSE は GPL 互換であること。
+ *   - 厳密優先だけだと、上位 tier が CPU を埋め続けたときに下位 tier の task が永久に走らず、
+ *     sched_ext の watchdog（既定 30 秒 runnable のまま）がスケジューラごと落とす。
+ *     starve_ns はその上限で、下位 tier にも starve_ns ごとに最低 1 回は CPU が回ってくる。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "scx-tiers.h"
+
+/* cgroup 階層を何段まで遡って tier を探すか */
+#define MAX_CGRP_DEPTH 8
+
+/*
+ * ローダが open 後・load 前に書き換える設定（.rodata）。
+ *   slice_ns     : 1 回に与えるタイムスライス（0 なら SCX_SLICE_DFL = 20ms）
+ *   default_tier : map に無い cgroup の tier
+ *   starve_ns    : 下位 tier の待ちがこれだけ dispatch されなければ、上位より先に 1 つ取る（0 = 厳密優先）
+ */
+const volatile u64 slice_ns = 0;
+const volatile u32 default_tier = TIER_NORMAL;
+const volatile u64 starve_ns = 100ULL * 1000 * 1000;
+
+/*
+ * sched_ext の kfunc 宣言。
+ * scx リポジトリの common.bpf.h を持ち込まずに、使う分だけ __ksym で宣言する。
+ */
+s32 scx_bpf_create_dsq(u64 dsq_id, s32 node) __ksym;
+s32 scx_bpf_select_cpu_dfl(struct task_struct *p, s32 prev_cpu, u64 wake_flags, bool *is_idle) __ksym;
+void scx_bpf_dsq_insert(struct task_struct *p, u64 dsq_id, u64 slice, u64 enq_flags) __ksym;
+void scx_bpf_dsq_insert_vtime(struct task_struct *p, u64 dsq_id, u64 slice, u64 vtime, u64 enq_flags) __ksym;
+bool scx_bpf_dsq_move_to_local(u64 dsq_id) __ksym;
+void scx_bpf_kick_cpu(s32 cpu, u64 flags) __ksym;
+s32 scx_bpf_task_cpu(const struct task_struct *p) __ksym;
+s32 scx_bpf_dsq_nr_queued(u64 dsq_id) __ksym;
+
+/* tier ごとの「いま走っている task の最大 vtime」（tier 内公平性の基準） */
+u64 vtime_now[NR_TIERS];
+
+/*
+ * tier ごとに「最後にその DSQ から dispatch した時刻」。空の DSQ に積まれたときもそこから数え直すので、
+ * now との差が「その tier の先頭がどれだけ待たされているか」の目安になる。
+ */
+u64 tier_served_ns[NR_TIERS];
+
+/* 終了理由（ローダが表示する） */
+s32 exit_kind = 0;
+char exit_reason[128] = {};
+
+/*
+ * cgrp_tier: cgroup id（= cgroupfs ディレクトリの inode 番号）→ tier
+ *   ローダが -t <cgroup path>:<tier> で書き込む。
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 4096);
+    __type(key, u64);
+    __type(value, u32);
+} cgrp_tier SEC(".maps");
+
+/* task ごとの tier キャッシュ（enqueue で更新し、running/stopping で使う） */
+struct task_ctx {
+    u32 tier;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, int);
+    __type(value, struct task_ctx);
+} task_ctxs SEC(".maps");
+
+/* CPU ごとに「いま走らせている tier」（NR_TIERS = 何も走っていない） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u32);
+} cpu_tier SEC(".maps");
+
+/* per-CPU 統計カウンタ（enum stat_idx） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_STATS);
+    __type(key, u32);
+    __type(value, u64);
+} stats SEC(".maps");
+
+static __always_inline void stat_inc(u32 idx)
+{
+    u64 *cnt = bpf_map_lookup_elem(&stats, &idx);
+
+    if (cnt)
+        (*cnt)++;
+}
+
+static __always_inline u64 task_slice(void)
+{
+    return slice_ns ? slice_ns : SCX_SLICE_DFL;
+}
+
+static __always_inline bool vtime_before(u64 a, u64 b)
+{
+    return (s64)(a - b) < 0;
+}
+
+/*
+ * task の tier を決める:
+ *   自分の cgroup から根に向かって MAX_CGRP_DEPTH 段まで cgrp_tier を引き、
+ *   最初に見つかったもの（= 最も近い祖先の設定）を採用する。
+ *
+ *   cgroup->ancestors[level] が自分自身、[0] が root cgroup。
+ */
+static u32 lookup_tier(struct task_struct *p)
+{
+    struct cgroup *cgrp = BPF_CORE_READ(p, cgroups, dfl_cgrp);
+    int level = BPF_CORE_READ(cgrp, level);
+
+    for (int d = 0; d < MAX_CGRP_DEPTH; d++) {
+        struct cgroup *anc = NULL;
+        int i = level - d;
+        u64 cgid;
+        u32 *tier;
+
+        if (i < 0)
+            break;
+
+        bpf_core_read(&anc, sizeof(anc), &cgrp->ancestors[i]);
+        if (!anc)
+            break;
+
+        cgid = BPF_CORE_READ(anc, kn, id);
+        tier = bpf_map_lookup_elem(&cgrp_tier, &cgid);
+        if (tier && *tier < NR_TIERS)
+            return *tier;
+    }
+
+    return default_tier < NR_TIERS ? default_tier : TIER_NORMAL;
+}
+
+static __always_inline u32 cached_tier(struct task_struct *p)
+{
+    struct task_ctx *tctx = bpf_task_storage_get(&task_ctxs, p, 0, 0);
+
+    if (tctx && tctx->tier < NR_TIERS)
+        return tctx->tier;
+    return TIER_NORMAL;
+}
+
+static __always_inline void set_cpu_tier(u32 tier)
+{
+    u32 zero = 0;
+    u32 *cur = bpf_map_lookup_elem(&cpu_tier, &zero);
+
+    if (cur)
+        *cur = tier;
+}
+
+SEC("struct_ops/tiers_select_cpu")
+s32 BPF_PROG(tiers_select_cpu, struct task_struct *p, s32 prev_cpu, u64 wake_flags)
+{
+    bool is_idle = false;
+    s32 cpu;
+
+    cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+    if (is_idle) {
+        /* idle CPU が取れたら tier に関係なくそのまま走らせる（enqueue は呼ばれない） */
+        stat_inc(STAT_LOCAL_DIRECT);
+        scx_bpf_dsq_insert(p, SCX_DSQ_LOCAL, task_slice(), 0);
+    }
+    return cpu;
+}
+
+SEC("struct_ops/tiers_enqueue")
+void BPF_PROG(tiers_enqueue, struct task_struct *p, u64 enq_flags)
+{
+    struct task_ctx *tctx;
+    u32 tier = lookup_tier(p);
+    u64 vtime = p->scx.dsq_vtime;
+    u64 floor;
+
+    tctx = bpf_task_storage_get(&task_ctxs, p, 0, 0);
+    if (tctx)
+        tctx->tier = tier;
+
+    if (tier >= NR_TIERS)
+        tier = TIER_NORMAL;
+
+    /*
+     * 長く寝ていた task が大量の vtime 貯金で tier を独占しないよう、
+     * “現在の vtime - 1 slice” より前には戻さない。
+     */
+    floor = vtime_now[tier] - task_slice();
+    if (vtime_before(vtime, floor))
+        vtime = floor;
+
+    /* 空の DSQ に最初に積まれたところが待ちの起点 */
+    if (starve_ns && scx_bpf_dsq_nr_queued(TIER_DSQ_BASE + tier) <= 0)
+        tier_served_ns[tier] = bpf_ktime_get_ns();
+
+    scx_bpf_dsq_insert_vtime(p, TIER_DSQ_BASE + tier, task_slice(), vtime, enq_flags);
+    stat_inc(STAT_ENQ_LATENCY + tier);
+
+    /*
+     * レイテンシ tier の task が DSQ 待ちになった:
+     *   直前に走っていた CPU が下位 tier を走らせていたら横取りさせる。
+     *   蹴られた CPU は dispatch で DSQ(TIER_LATENCY) から先に取る。
+     */
+    if (tier == TIER_LATENCY) {
+        u32 zero = 0;
+        s32 cpu = scx_bpf_task_cpu(p);
+        u32 *running = bpf_map_lookup_percpu_elem(&cpu_tier, &zero, cpu);
+
+        if (running && *running > TIER_LATENCY && *running < NR_TIERS) {
+            stat_inc(STAT_PREEMPT_KICK);
+            scx_bpf_kick_cpu(cpu, SCX_KICK_PREEMPT);
+        }
+    }
+}
+
+SEC("struct_ops/tiers_dispatch")
+void BPF_PROG(tiers_dispatch, s32 cpu, struct task_struct *prev)
+{
+    u64 now = bpf_ktime_get_ns();
+
+    /* 飢餓の上限: 待ちすぎている下位 tier（低い方から見る）があれば、上位に待ちがあっても 1 つ渡す */
+    if (starve_ns) {
+        for (u32 tier = NR_TIERS - 1; tier > TIER_LATENCY; tier--) {
+            if (now - tier_served_ns[tier] > starve_ns &&
+                scx_bpf_dsq_nr_queued(TIER_DSQ_BASE + tier) > 0 &&
+                scx_bpf_dsq_move_to_local(TIER_DSQ_BASE + tier)) {
+                tier_served_ns[tier] = now;
+                stat_inc(STAT_STARVE_BOOST);
+                return;
+            }
+        }
+    }
+
+    /* ふだんは優先順: 上位 tier に待ちがあれば下位 tier は走らない */
+    for (u32 tier = 0; tier < NR_TIERS; tier++) {
+        if (scx_bpf_dsq_move_to_local(TIER_DSQ_BASE + tier)) {
+            tier_served_ns[tier] = now;
+            return;
+        }
+    }
+}
+
+SEC("struct_ops/tiers_running")
+void BPF_PROG(tiers_running, struct task_struct *p)
+{
+    u32 tier = cached_tier(p);
+
+    set_cpu_tier(tier);
+
+    if (tier < NR_TIERS && vtime_before(vtime_now[tier], p->scx.dsq_vtime))
+        vtime_now[tier] = p->scx.dsq_vtime;
+}
+
+SEC("struct_ops/tiers_stopping")
+void BPF_PROG(tiers_stopping, struct task_struct *p, bool runnable)
+{
+    set_cpu_tier(NR_TIERS);
+
+    /*
+     * 使ったスライス分だけ vtime を進める。
+     * weight は nice 0 で 100。重い（nice が低い）task ほど vtime の進みが遅い。
+     */
+    p->scx.dsq_vtime += (task_slice() - p->scx.slice) * 100 / p->scx.weight;
+}
+
+SEC("struct_ops/tiers_enable")
+void BPF_PROG(tiers_enable, struct task_struct *p)
+{
+    struct task_ctx *tctx;
+    u32 tier = lookup_tier(p);
+
+    tctx = bpf_task_storage_get(&task_ctxs, p, 0, BPF_LOCAL_STORAGE_GET_F_CREATE);
+    if (tctx)
+        tctx->tier = tier;
+
+    /* 新しく sched_ext 管理下に入った task は tier の現在 vtime から始める */
+    if (tier < NR_TIERS)
+        p->scx.dsq_vtime = vtime_now[tier];
+}
+
+/* init は sleepable（DSQ の作成はメモリ確保を伴う） */
+SEC("struct_ops.s/tiers_init")
+s32 BPF_PROG(tiers_init)
+{
+    for (u32 tier = 0; tier < NR_TIERS; tier++) {
+        s32 err = scx_bpf_create_dsq(TIER_DSQ_BASE + tier, -1);
+
+        if (err)
+            return err;
+    }
+    return 0;
+}
+
+SEC("struct_ops/tiers_exit")
+void BPF_PROG(tiers_exit, struct scx_exit_info *ei)
+{
+    exit_kind = ei->kind;
+    bpf_probe_read_kernel_str(exit_reason, sizeof(exit_reason), ei->reason);
+}
+
+SEC(".struct_ops.link")
+struct sched_ext_ops tiers_ops = {
+    .select_cpu = (void *)tiers_select_cpu,
+    .enqueue    = (void *)tiers_enqueue,
+    .dispatch   = (void *)tiers_dispatch,
+    .running    = (void *)tiers_running,
+    .stopping   = (void *)tiers_stopping,
+    .enable     = (void *)tiers_enable,
+    .init       = (void *)tiers_init,
+    .exit       = (void *)tiers_exit,
+    .name       = "tiers",
+};
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
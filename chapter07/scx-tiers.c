@@ -0,0 +1,220 @@
+/*
+ * scx-tiers.c（ユーザ空間側 / sched_ext スケジューラのローダ）
+ *
+ * 目的:
+ *   scx-tiers.bpf.c の struct sched_ext_ops を struct_ops としてカーネルへ登録し、
+ *   cgroup ごとの tier 設定を map に書き込んで、1 秒ごとに統計を表示する。
+ *
+ * 使い方:
+ *   sudo ./scx-tiers -t /sys/fs/cgroup/latency:0 -t /sys/fs/cgroup/batch:2
+ *
+ *   -t <cgroup path>:<tier>  cgroup（とその子孫）の tier を設定する（複数指定可）
+ *                            0=latency / 1=normal / 2=batch
+ *   -d <tier>                map に無い cgroup の tier（既定 1）
+ *   -s <usec>                タイムスライス（既定 0 = SCX_SLICE_DFL）
+ *   -S <msec>                下位 tier の飢餓の上限（既定 100。0 = 厳密優先、watchdog に落とされうる）
+ *
+ *   Ctrl-C で struct_ops の link を破棄すると、カーネルは CFS/EEVDF に戻る。
+ *
+ * 全体の流れ:
+ *
+ *   open（.rodata の slice_ns / default_tier / starve_ns を書き換え）
+ *     │
+ *     v
+ *   load（struct_ops の各プログラムを verifier に通す）
+ *     │
+ *     v
+ *   cgrp_tier map に <cgroup id, tier> を書き込む
+ *     │   cgroup id は cgroup v2 ディレクトリの inode 番号と一致する
+ *     v
+ *   bpf_map__attach_struct_ops(tiers_ops) … ここで sched_ext が有効になる
+ *     │
+ *     v
+ *   1 秒ごとに per-CPU 統計を合算して表示（BPF 側が exit したら理由を出して終了）
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <bpf/libbpf.h>
+
+#include "scx-tiers.h"
+#include "scx-tiers.skel.h"
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/*
+ * "<cgroup path>:<tier>" を cgrp_tier map に書き込む。
+ * cgroup v2 では cgroup id = cgroupfs 上のディレクトリの inode 番号。
+ */
+static int set_cgroup_tier(struct scx_tiers_bpf *skel, const char *arg)
+{
+    char path[4096];
+    const char *colon = strrchr(arg, ':');
+    struct stat st;
+    __u64 cgid;
+    __u32 tier;
+    int err;
+
+    if (!colon || colon == arg || (size_t)(colon - arg) >= sizeof(path)) {
+        fprintf(stderr, "Invalid -t argument (want <cgroup path>:<tier>): %s\n", arg);
+        return -EINVAL;
+    }
+
+    memcpy(path, arg, colon - arg);
+    path[colon - arg] = '\0';
+    tier = (__u32)strtoul(colon + 1, NULL, 0);
+    if (tier >= NR_TIERS) {
+        fprintf(stderr, "Invalid tier %u (0..%d)\n", tier, NR_TIERS - 1);
+        return -EINVAL;
+    }
+
+    if (stat(path, &st)) {
+        err = -errno;
+        fprintf(stderr, "Failed to stat cgroup %s: %s\n", path, strerror(errno));
+        return err;
+    }
+    cgid = st.st_ino;
+
+    err = bpf_map__update_elem(skel->maps.cgrp_tier,
+                               &cgid, sizeof(cgid),
+                               &tier, sizeof(tier),
+                               0);
+    if (err) {
+        fprintf(stderr, "Failed to update cgrp_tier map (err=%d)\n", err);
+        return err;
+    }
+
+    printf("cgroup %s (id %llu) -> tier %u\n", path, (unsigned long long)cgid, tier);
+    return 0;
+}
+
+/* per-CPU カウンタを CPU 分合算して返す */
+static __u64 read_stat(struct scx_tiers_bpf *skel, __u32 idx, int nr_cpus)
+{
+    __u64 values[nr_cpus];
+    __u64 sum = 0;
+
+    if (bpf_map__lookup_elem(skel->maps.stats, &idx, sizeof(idx),
+                             values, sizeof(values), 0))
+        return 0;
+
+    for (int i = 0; i < nr_cpus; i++)
+        sum += values[i];
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    struct scx_tiers_bpf *skel = NULL;
+    struct bpf_link *link = NULL;
+    int nr_cpus = libbpf_num_possible_cpus();
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+
+    skel = scx_tiers_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    /* 1 パス目: load 前に決める必要がある .rodata だけ処理する */
+    while ((opt = getopt(argc, argv, "t:d:s:S:")) != -1) {
+        switch (opt) {
+        case 'd':
+            skel->rodata->default_tier = (__u32)strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            skel->rodata->slice_ns = strtoull(optarg, NULL, 0) * 1000;
+            break;
+        case 'S':
+            skel->rodata->starve_ns = strtoull(optarg, NULL, 0) * 1000000;
+            break;
+        case 't':
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-t cgroup:tier]... [-d tier] [-s slice_us] [-S starve_ms]\n", argv[0]);
+            err = -EINVAL;
+            goto cleanup;
+        }
+    }
+
+    err = scx_tiers_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    /* 2 パス目: map への書き込みは load 後 */
+    optind = 1;
+    while ((opt = getopt(argc, argv, "t:d:s:S:")) != -1) {
+        if (opt != 't')
+            continue;
+        err = set_cgroup_tier(skel, optarg);
+        if (err)
+            goto cleanup;
+    }
+
+    link = bpf_map__attach_struct_ops(skel->maps.tiers_ops);
+    if (!link) {
+        err = -errno;
+        fprintf(stderr, "Failed to attach struct_ops (is sched_ext enabled?): %d\n", err);
+        goto cleanup;
+    }
+
+    printf("%-10s %-10s %-10s %-10s %-10s %-10s\n",
+           "direct", "enq_lat", "enq_norm", "enq_batch", "kick", "boost");
+
+    while (!exiting && !skel->bss->exit_kind) {
+        sleep(1);
+        printf("%-10llu %-10llu %-10llu %-10llu %-10llu %-10llu\n",
+               (unsigned long long)read_stat(skel, STAT_LOCAL_DIRECT, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_ENQ_LATENCY, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_ENQ_NORMAL, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_ENQ_BATCH, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_PREEMPT_KICK, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_STARVE_BOOST, nr_cpus));
+    }
+
+    if (skel->bss->exit_kind)
+        fprintf(stderr, "sched_ext exited (kind=%d): %s\n",
+                skel->bss->exit_kind, skel->bss->exit_reason);
+
+cleanup:
+    bpf_link__destroy(link);
+    scx_tiers_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SCX_TIERS_H
+#define SCX_TIERS_H
+
+/*
+ * scx-tiers.h（sched_ext スケジューラとローダで共有する定義）
+ *
+ * tier（優先度の段）:
+ *   cgroup ごとに tier を割り当て、小さい tier ほど先に CPU を渡す。
+ *
+ *     TIER_LATENCY (0) : レイテンシ重視のサービス（起床したら最優先で走らせる）
+ *     TIER_NORMAL  (1) : 何も設定していない cgroup の既定値
+ *     TIER_BATCH   (2) : バッチジョブ（他に走るものが無いときだけ走る。ただし starve_ns ごとに最低 1 回）
+ *
+ *   同じ tier の中は vtime（仮想実行時間）順で公平に回す。
+ */
+
+#define NR_TIERS      3
+#define TIER_LATENCY  0
+#define TIER_NORMAL   1
+#define TIER_BATCH    2
+
+/*
+ * tier ごとの共有 DSQ（dispatch queue）の ID。
+ * 0 番台や上位ビットは sched_ext の組み込み DSQ（SCX_DSQ_LOCAL 等）が使うので、
+ * 自前の DSQ は適当な正の値から始める。
+ */
+#define TIER_DSQ_BASE 100
+
+/*
+ * stat_idx:
+ *   per-CPU カウンタ（stats map）の添字。ローダが CPU 分を合算して表示する。
+ */
+enum stat_idx {
+   STAT_LOCAL_DIRECT = 0,   /* select_cpu で idle CPU の local DSQ に直接入れた */
+   STAT_ENQ_LATENCY,        /* TIER_LATENCY の DSQ に積んだ */
+   STAT_ENQ_NORMAL,         /* TIER_NORMAL の DSQ に積んだ */
+   STAT_ENQ_BATCH,          /* TIER_BATCH の DSQ に積んだ */
+   STAT_PREEMPT_KICK,       /* TIER_LATENCY の起床で下位 tier を走らせている CPU を蹴った */
+   STAT_STARVE_BOOST,       /* 待ちすぎた下位 tier を上位より先に dispatch した */
+   NR_STATS,
+};
+
+#endif /* SCX_TIERS_H */
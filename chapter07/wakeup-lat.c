@@ -0,0 +1,279 @@
+/*
+ * wakeup-lat.c（BPF を使わない補助ツール / CPU 飽和下の wakeup レイテンシ計測）
+ *
+ * 目的:
+ *   scx-tiers（sched_ext）を入れたときと入れないとき（CFS/EEVDF）で、
+ *   “CPU がバッチジョブで埋まっている状態” の起床レイテンシがどう変わるかを比べる。
+ *
+ * 計測方法（アルゴリズム）:
+ *
+ *   (1) spinner を N 個 fork する（既定: CPU 数 × 2）
+ *         - 何もせず回り続けるだけ = CPU 飽和（ループ回数を共有メモリに数える）
+ *         - -b を指定すると spinner を batch 用 cgroup に入れる
+ *         - -H を指定すると、同じように回り続ける hog を -l の cgroup にも入れる（上位 tier の飽和）
+ *
+ *   (2) 親プロセスは -l の cgroup（あれば）に入り、以下を繰り返す:
+ *         target = now + interval
+ *         clock_nanosleep(TIMER_ABSTIME, target)
+ *         latency = (起きた時刻) - target    ← スケジューラが CPU を渡すまでの遅れ
+ *
+ *   (3) 終了後に spinner を kill し、p50/p90/p99/p99.9/max と、
+ *       計測中の spinner の進み具合（最小 / 平均ループ数、1 回も進まなかった spinner の数）を表示する
+ *
+ * 使い方（例）:
+ *   # 準備（cgroup v2）
+ *   sudo mkdir /sys/fs/cgroup/latency /sys/fs/cgroup/batch
+ *
+ *   # CFS/EEVDF での計測
+ *   sudo ./wakeup-lat -l /sys/fs/cgroup/latency -b /sys/fs/cgroup/batch
+ *
+ *   # sched_ext（別端末で scx-tiers を起動してから同じコマンド）
+ *   sudo ./scx-tiers -t /sys/fs/cgroup/latency:0 -t /sys/fs/cgroup/batch:2
+ *   sudo ./wakeup-lat -l /sys/fs/cgroup/latency -b /sys/fs/cgroup/batch
+ *
+ *   # 上位 tier が CPU を埋め続けても batch が進むか（scx-tiers の -S、飢餓の上限の確認）
+ *   sudo ./wakeup-lat -H $(nproc) -l /sys/fs/cgroup/latency -b /sys/fs/cgroup/batch
+ *     → stalled が 0 なら batch の spinner も動いている。scx-tiers -S 0（厳密優先）では
+ *       batch が止まり、30 秒ほどで sched_ext の watchdog がスケジューラを落とす
+ *
+ * オプション:
+ *   -n <spinners>  飽和用プロセス数
+ *   -d <sec>       計測時間（既定 10 秒）
+ *   -i <usec>      起床間隔（既定 1000us）
+ *   -l <cgroup>    計測側を入れる cgroup
+ *   -b <cgroup>    spinner を入れる cgroup
+ *   -H <hogs>      -l の cgroup で回り続けるプロセス数（既定 0）
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* pid を cgroup に移す（cgroup.procs に書く）。path が NULL なら何もしない */
+static int join_cgroup(const char *path, pid_t pid)
+{
+    char procs[4096];
+    FILE *f;
+
+    if (!path)
+        return 0;
+
+    snprintf(procs, sizeof(procs), "%s/cgroup.procs", path);
+    f = fopen(procs, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to open %s: %s\n", procs, strerror(errno));
+        return -errno;
+    }
+    fprintf(f, "%d\n", (int)pid);
+    if (fclose(f)) {
+        fprintf(stderr, "Failed to write %s: %s\n", procs, strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+/* spinner ごとのループ回数（別プロセスから読むので共有メモリ。1 つずつ別のキャッシュラインに置く） */
+struct progress {
+    volatile unsigned long long loops;
+    char pad[56];
+};
+
+/* cgroup に入って回り続ける子プロセスを作る */
+static pid_t spawn_spinner(const char *cgroup, struct progress *prog)
+{
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        if (join_cgroup(cgroup, getpid()))
+            _exit(1);
+        for (;;)
+            prog->loops++;
+    }
+    return pid;
+}
+
+static void kill_all(const pid_t *pids, int n)
+{
+    for (int i = 0; i < n; i++)
+        kill(pids[i], SIGKILL);
+    for (int i = 0; i < n; i++)
+        waitpid(pids[i], NULL, 0);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static unsigned long long pct(const unsigned long long *v, size_t n, double p)
+{
+    size_t i = (size_t)(p / 100.0 * (n - 1));
+
+    return v[i];
+}
+
+int main(int argc, char **argv)
+{
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int spinners = (int)nr_cpus * 2;
+    int hogs = 0, nr_pids = 0;
+    int duration = 10;
+    long interval_us = 1000;
+    const char *lat_cgroup = NULL;
+    const char *batch_cgroup = NULL;
+    unsigned long long *samples, *loops0, t0, t1;
+    struct progress *prog;
+    size_t n = 0, cap, prog_size;
+    pid_t *pids;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:i:l:b:H:")) != -1) {
+        switch (opt) {
+        case 'n': spinners = atoi(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        case 'i': interval_us = atol(optarg); break;
+        case 'l': lat_cgroup = optarg; break;
+        case 'b': batch_cgroup = optarg; break;
+        case 'H': hogs = atoi(optarg); break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-n spinners] [-d sec] [-i usec] [-l cgroup] [-b cgroup] [-H hogs]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (spinners < 0 || hogs < 0 || duration <= 0 || interval_us <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    cap = (size_t)duration * 1000000 / interval_us + 1;
+    samples = calloc(cap, sizeof(*samples));
+    pids = calloc(spinners + hogs + 1, sizeof(*pids));
+    loops0 = calloc(spinners + 1, sizeof(*loops0));
+    prog_size = (spinners + hogs + 1) * sizeof(*prog);
+    prog = mmap(NULL, prog_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (!samples || !pids || !loops0 || prog == MAP_FAILED) {
+        fprintf(stderr, "Failed to allocate buffers\n");
+        return 1;
+    }
+
+    /*
+     * (1) CPU を埋める spinner
+     *   自分が -l の cgroup に入るのは fork の後。先に入ると -b が無いとき spinner まで
+     *   同じ cgroup を継いでしまい、tier どうしの比較にならない。
+     */
+    for (int i = 0; i < spinners + hogs; i++) {
+        /* 先頭 spinners 個が -b の spinner、残り hogs 個が -l の hog */
+        pid_t pid = spawn_spinner(i < spinners ? batch_cgroup : lat_cgroup, &prog[i]);
+
+        if (pid < 0) {
+            fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+            break;
+        }
+        pids[nr_pids++] = pid;
+    }
+    if (nr_pids < spinners)
+        spinners = nr_pids;
+    hogs = nr_pids - spinners;
+
+    /* 測る側（このプロセス）だけを -l の cgroup へ */
+    if (join_cgroup(lat_cgroup, getpid())) {
+        kill_all(pids, nr_pids);
+        return 1;
+    }
+
+    /* spinner が CPU に乗るまで少し待つ */
+    sleep(1);
+
+    for (int i = 0; i < spinners; i++)
+        loops0[i] = prog[i].loops;
+    t0 = now_ns();
+
+    /* (2) 周期的に寝て、起床の遅れを記録する */
+    {
+        unsigned long long end = now_ns() + (unsigned long long)duration * 1000000000ULL;
+        unsigned long long target = now_ns();
+
+        while (n < cap) {
+            struct timespec ts;
+            unsigned long long woke;
+
+            target += interval_us * 1000ULL;
+            ts.tv_sec = target / 1000000000ULL;
+            ts.tv_nsec = target % 1000000000ULL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+            woke = now_ns();
+            samples[n++] = woke > target ? woke - target : 0;
+
+            /* 大きく遅れた場合は次の target を現在時刻に合わせ直す */
+            if (woke > target + interval_us * 1000ULL)
+                target = woke;
+            if (woke >= end)
+                break;
+        }
+    }
+
+    /* (3) 後始末と集計（spinner の進みは kill する前に読む） */
+    t1 = now_ns();
+    for (int i = 0; i < spinners; i++)
+        loops0[i] = prog[i].loops - loops0[i];
+    kill_all(pids, nr_pids);
+
+    if (!n) {
+        fprintf(stderr, "No samples\n");
+        return 1;
+    }
+
+    qsort(samples, n, sizeof(*samples), cmp_u64);
+
+    printf("spinners=%d hogs=%d cpus=%ld interval=%ldus samples=%zu\n",
+           spinners, hogs, nr_cpus, interval_us, n);
+    printf("%-8s %-8s %-8s %-8s %-8s   (usec)\n", "p50", "p90", "p99", "p99.9", "max");
+    printf("%-8.1f %-8.1f %-8.1f %-8.1f %-8.1f\n",
+           pct(samples, n, 50) / 1000.0,
+           pct(samples, n, 90) / 1000.0,
+           pct(samples, n, 99) / 1000.0,
+           pct(samples, n, 99.9) / 1000.0,
+           samples[n - 1] / 1000.0);
+
+    if (spinners) {
+        unsigned long long min = loops0[0], sum = 0;
+        double secs = (t1 - t0) / 1e9;
+        int stalled = 0;
+
+        for (int i = 0; i < spinners; i++) {
+            if (loops0[i] < min)
+                min = loops0[i];
+            sum += loops0[i];
+            stalled += loops0[i] == 0;
+        }
+        printf("spinner progress: min %.1f avg %.1f Mloops/s, stalled %d/%d\n",
+               min / secs / 1e6, sum / secs / 1e6 / spinners, stalled, spinners);
+    }
+
+    munmap(prog, prog_size);
+    free(loops0);
+    free(samples);
+    free(pids);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * cgroup-acct.bpf.c（cgroup_skb による cgroup × プロトコル単位の送受信バイト/パケット計数）
+ *
+ * 目的:
+ *   network.bpf.c の XDP / TC はインタフェース単位のフックなので、
+ *   「どのコンテナ（cgroup）の通信か」を区別できない。
+ *   cgroup_skb/ingress・egress はソケットに紐づいた cgroup ごとに呼ばれるので、
+ *   パケットを cgroup に帰属させて数えられる。
+ *
+ * 流れ:
+ *
+ *   送信/受信 skb（ソケットの cgroup に attach された cgroup_skb が呼ばれる）
+ *     │
+ *     │  cgid  = bpf_skb_cgroup_id(skb)        … 末端（リーフ）の cgroup
+ *     │  proto = IPv4 protocol / IPv6 nexthdr
+ *     v
+ *   counters[{cgid, dir, proto, family}] += {len, 1}   （per-CPU）
+ *     │
+ *     └─ egress のみ: egress_policy[cgid] があり proto が一致 → drops++ して 0（= 破棄）を返す
+ *
+ * 注意:
+ *   - cgroup_skb は attach した cgroup の子孫すべてに効く（effective program）。
+ *     サブツリーの根に 1 回 attach すれば、子孫ごとに別々に数えられる。
+ *   - cgroup_skb の skb->data はネットワークヘッダから始まる（L2 ヘッダは無い）。
+ *   - 戻り値 1 = 通す / 0 = 落とす。ingress で落とすことはしない（計数のみ）。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "cgroup-acct.h"
+
+#define ETH_P_IP   0x0800
+#define ETH_P_IPV6 0x86DD
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, 16384);
+    __type(key, struct acct_key);
+    __type(value, struct acct_val);
+} counters SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 1024);
+    __type(key, u64);
+    __type(value, struct policy);
+} egress_policy SEC(".maps");
+
+/* skb の L3 ヘッダからプロトコル番号とファミリを取り出す（不明なら 0） */
+static __always_inline void parse_proto(struct __sk_buff *skb, struct acct_key *key)
+{
+    u8 proto = 0;
+
+    if (skb->protocol == bpf_htons(ETH_P_IP)) {
+        key->family = 4;
+        bpf_skb_load_bytes(skb, offsetof(struct iphdr, protocol), &proto, sizeof(proto));
+    } else if (skb->protocol == bpf_htons(ETH_P_IPV6)) {
+        key->family = 6;
+        bpf_skb_load_bytes(skb, offsetof(struct ipv6hdr, nexthdr), &proto, sizeof(proto));
+    }
+    key->proto = proto;
+}
+
+static __always_inline struct acct_val *get_val(struct acct_key *key)
+{
+    struct acct_val zero = {}, *val;
+
+    val = bpf_map_lookup_elem(&counters, key);
+    if (val)
+        return val;
+
+    bpf_map_update_elem(&counters, key, &zero, BPF_NOEXIST);
+    return bpf_map_lookup_elem(&counters, key);
+}
+
+static __always_inline int account(struct __sk_buff *skb, u8 dir)
+{
+    struct acct_key key = {};
+    struct acct_val *val;
+    struct policy *pol;
+
+    key.cgid = bpf_skb_cgroup_id(skb);
+    key.dir = dir;
+    parse_proto(skb, &key);
+
+    val = get_val(&key);
+    if (!val)
+        return 1;
+
+    if (dir == DIR_EGRESS) {
+        pol = bpf_map_lookup_elem(&egress_policy, &key.cgid);
+        if (pol && (pol->proto == POLICY_ANY_PROTO || pol->proto == key.proto)) {
+            val->drops++;
+            return 0;
+        }
+    }
+
+    val->bytes += skb->len;
+    val->packets++;
+    return 1;
+}
+
+SEC("cgroup_skb/ingress")
+int acct_ingress(struct __sk_buff *skb)
+{
+    return account(skb, DIR_INGRESS);
+}
+
+SEC("cgroup_skb/egress")
+int acct_egress(struct __sk_buff *skb)
+{
+    return account(skb, DIR_EGRESS);
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
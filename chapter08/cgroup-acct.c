@@ -0,0 +1,296 @@
+/*
+ * cgroup-acct.c（ユーザ空間側 / cgroup サブツリーへの attach と cgroup 別の通信量表示）
+ *
+ * 目的:
+ *   cgroup-acct.bpf.c の cgroup_skb/ingress・egress を指定した cgroup（サブツリーの根）に attach し、
+ *   1 秒ごとに cgroup × 方向 × プロトコルの bytes / packets / drops（と前回からのレート）を表示する。
+ *   -x で cgroup ごとの egress drop policy を入れられる。
+ *
+ * 使い方:
+ *   sudo ./cgroup-acct [-c cgroup_root] [-x cgroup_path[:proto]] ...
+ *
+ *   -c <path>   attach 先（既定 /sys/fs/cgroup = 全体）
+ *   -x <path>   その cgroup からの送信を落とす。:proto を付けるとそのプロトコルだけ
+ *               （tcp / udp / icmp または番号）
+ *
+ * ローカル通信での確認（cgroup.sh）:
+ *
+ *   sudo ./cgroup.sh setup                                   # /sys/fs/cgroup/acct-test/{a,b}
+ *   sudo ./cgroup-acct -c /sys/fs/cgroup/acct-test -x /sys/fs/cgroup/acct-test/b:udp &
+ *   sudo ./cgroup.sh run a ./tcp-bulk server &
+ *   sudo ./cgroup.sh run b ./tcp-bulk client 127.0.0.1 -d 5 # a/b の tcp が両方向に数えられる
+ *   sudo ./cgroup.sh run a ./udp-ping server &
+ *   sudo ./cgroup.sh run b ./udp-ping client 127.0.0.1 -d 3 # b の udp egress は drops に入る
+ *   sudo ./cgroup.sh clean
+ *
+ * 注意:
+ *   - cgroup id は cgroupfs 上のディレクトリの inode 番号なので、
+ *     起動時と表示のたびにサブツリーを nftw で歩いて id → パスの表を作り直す。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "cgroup-acct.h"
+#include "cgroup-acct.skel.h"
+
+#define MAX_CGROUPS 1024
+#define MAX_ROWS    4096
+#define MAX_POLICY  64
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* cgroup id → パス（サブツリーの根からの相対） */
+static struct {
+    unsigned long long id;
+    char path[256];
+} cgroups[MAX_CGROUPS];
+static int nr_cgroups;
+static size_t root_len;
+
+static int collect_cgroup(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)ftw;
+    if (flag != FTW_D || nr_cgroups >= MAX_CGROUPS)
+        return 0;
+
+    cgroups[nr_cgroups].id = st->st_ino;
+    snprintf(cgroups[nr_cgroups].path, sizeof(cgroups[0].path), "%s",
+             path[root_len] ? path + root_len : "/");
+    nr_cgroups++;
+    return 0;
+}
+
+static void scan_cgroups(const char *root)
+{
+    nr_cgroups = 0;
+    root_len = strlen(root);
+    nftw(root, collect_cgroup, 16, FTW_PHYS);
+}
+
+static const char *cgroup_name(unsigned long long id)
+{
+    for (int i = 0; i < nr_cgroups; i++)
+        if (cgroups[i].id == id)
+            return cgroups[i].path;
+    return "?";
+}
+
+static const char *proto_name(unsigned int proto, char *buf, size_t len)
+{
+    switch (proto) {
+    case 1:  return "icmp";
+    case 6:  return "tcp";
+    case 17: return "udp";
+    case 58: return "icmp6";
+    default:
+        snprintf(buf, len, "%u", proto);
+        return buf;
+    }
+}
+
+static int parse_proto_name(const char *s)
+{
+    if (!s)
+        return POLICY_ANY_PROTO;
+    if (!strcmp(s, "tcp"))
+        return 6;
+    if (!strcmp(s, "udp"))
+        return 17;
+    if (!strcmp(s, "icmp"))
+        return 1;
+    return atoi(s);
+}
+
+/* -x path[:proto] を egress_policy に入れる */
+static int add_policy(struct cgroup_acct_bpf *skel, char *arg)
+{
+    char *colon = strrchr(arg, ':');
+    struct policy pol;
+    struct stat st;
+    __u64 cgid;
+
+    if (colon)
+        *colon = '\0';
+    if (stat(arg, &st)) {
+        fprintf(stderr, "Failed to stat cgroup %s: %s\n", arg, strerror(errno));
+        return -errno;
+    }
+    cgid = st.st_ino;
+    pol.proto = parse_proto_name(colon ? colon + 1 : NULL);
+
+    if (bpf_map__update_elem(skel->maps.egress_policy, &cgid, sizeof(cgid),
+                             &pol, sizeof(pol), BPF_ANY)) {
+        fprintf(stderr, "Failed to set policy for %s: %s\n", arg, strerror(errno));
+        return -errno;
+    }
+    printf("egress drop policy: %s (id=%llu) proto=%s\n", arg, (unsigned long long)cgid,
+           colon ? colon + 1 : "any");
+    return 0;
+}
+
+/* 前回表示時の値（レート計算用） */
+static struct {
+    struct acct_key key;
+    struct acct_val val;
+} prev[MAX_ROWS];
+static int nr_prev;
+
+static struct acct_val *find_prev(const struct acct_key *key)
+{
+    for (int i = 0; i < nr_prev; i++)
+        if (!memcmp(&prev[i].key, key, sizeof(*key)))
+            return &prev[i].val;
+    return NULL;
+}
+
+/* counters map を走査し、CPU 分合算して表示する */
+static void print_counters(struct cgroup_acct_bpf *skel, int nr_cpus)
+{
+    int fd = bpf_map__fd(skel->maps.counters);
+    struct acct_key key, next, *pkey = NULL;
+    struct acct_val values[nr_cpus];
+    static const char *dirs[] = { "in", "out" };
+    char pbuf[8];
+
+    printf("%-32s %-4s %-6s %-14s %-10s %-12s %-10s\n",
+           "cgroup", "dir", "proto", "bytes", "packets", "bytes/s", "drops");
+
+    while (!bpf_map_get_next_key(fd, pkey, &next)) {
+        struct acct_val sum = {}, *old;
+
+        key = next;
+        pkey = &key;
+        if (bpf_map_lookup_elem(fd, &key, values))
+            continue;
+
+        for (int i = 0; i < nr_cpus; i++) {
+            sum.bytes += values[i].bytes;
+            sum.packets += values[i].packets;
+            sum.drops += values[i].drops;
+        }
+
+        old = find_prev(&key);
+        printf("%-32s %-4s %-6s %-14llu %-10llu %-12llu %-10llu\n",
+               cgroup_name(key.cgid), dirs[key.dir & 1],
+               proto_name(key.proto, pbuf, sizeof(pbuf)),
+               sum.bytes, sum.packets, old ? sum.bytes - old->bytes : sum.bytes, sum.drops);
+
+        if (old) {
+            *old = sum;
+        } else if (nr_prev < MAX_ROWS) {
+            prev[nr_prev].key = key;
+            prev[nr_prev].val = sum;
+            nr_prev++;
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct cgroup_acct_bpf *skel = NULL;
+    struct bpf_link *links[2] = {};
+    const char *root = "/sys/fs/cgroup";
+    char *policies[MAX_POLICY];
+    int nr_policies = 0;
+    int nr_cpus = libbpf_num_possible_cpus();
+    int cgfd = -1;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+
+    while ((opt = getopt(argc, argv, "c:x:")) != -1) {
+        switch (opt) {
+        case 'c': root = optarg; break;
+        case 'x':
+            if (nr_policies < MAX_POLICY)
+                policies[nr_policies++] = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c cgroup_root] [-x cgroup_path[:proto]] ...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    skel = cgroup_acct_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open/load BPF object\n");
+        return 1;
+    }
+
+    for (int i = 0; i < nr_policies; i++) {
+        err = add_policy(skel, policies[i]);
+        if (err)
+            goto cleanup;
+    }
+
+    cgfd = open(root, O_RDONLY | O_DIRECTORY);
+    if (cgfd < 0) {
+        err = -errno;
+        fprintf(stderr, "Failed to open cgroup %s: %s\n", root, strerror(errno));
+        goto cleanup;
+    }
+
+    links[0] = bpf_program__attach_cgroup(skel->progs.acct_ingress, cgfd);
+    links[1] = bpf_program__attach_cgroup(skel->progs.acct_egress, cgfd);
+    if (!links[0] || !links[1]) {
+        err = -errno;
+        fprintf(stderr, "Failed to attach cgroup_skb programs to %s: %d\n", root, err);
+        goto cleanup;
+    }
+
+    printf("Attached to %s. Ctrl-C to stop.\n", root);
+
+    while (!exiting) {
+        sleep(1);
+        scan_cgroups(root);
+        print_counters(skel, nr_cpus);
+    }
+
+cleanup:
+    bpf_link__destroy(links[1]);
+    bpf_link__destroy(links[0]);
+    if (cgfd >= 0)
+        close(cgfd);
+    cgroup_acct_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
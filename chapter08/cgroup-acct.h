@@ -0,0 +1,51 @@
+#ifndef CGROUP_ACCT_H
+#define CGROUP_ACCT_H
+
+/*
+ * cgroup-acct.h（cgroup_skb アカウンティングとローダで共有する定義）
+ */
+
+#define DIR_INGRESS 0
+#define DIR_EGRESS  1
+
+/* policy.proto に入れると “全プロトコル” の意味になる値 */
+#define POLICY_ANY_PROTO 0xff
+
+/*
+ * struct acct_key:
+ *   counters map（PERCPU_HASH）の key。
+ *
+ *   cgid  : パケットを送受信したソケットの cgroup id（= cgroupfs 上のディレクトリの inode 番号）
+ *   dir   : DIR_INGRESS / DIR_EGRESS
+ *   proto : IP ヘッダのプロトコル番号（IPv6 は next header。拡張ヘッダは辿らない）
+ *   family: 4 / 6
+ */
+struct acct_key {
+   unsigned long long cgid;
+   unsigned char dir;
+   unsigned char proto;
+   unsigned char family;
+   unsigned char pad[5];
+};
+
+/*
+ * struct acct_val:
+ *   counters map の value（CPU ごと。ローダが合算する）。
+ *   drops は egress の drop policy で落としたもの（bytes/packets には含めない）。
+ */
+struct acct_val {
+   unsigned long long bytes;
+   unsigned long long packets;
+   unsigned long long drops;
+};
+
+/*
+ * struct policy:
+ *   egress_policy map（key = cgid）の value。エントリがある cgroup からの送信のうち
+ *   proto が一致するもの（POLICY_ANY_PROTO なら全部）を落とす。
+ */
+struct policy {
+   unsigned int proto;
+};
+
+#endif /* CGROUP_ACCT_H */
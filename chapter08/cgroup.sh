@@ -0,0 +1,52 @@
+#!/bin/bash
+# -----------------------------------------------------------------------------
+# cgroup.sh（chapter08 の検証用 cgroup v2 サブツリー）
+#
+# 目的:
+#   cgroup 単位のフック（cgroup_skb など）を、ホストの既存 cgroup を汚さずに
+#   「別々の cgroup のプロセス同士がローカル通信する」状態で試すための箱を作る/壊す。
+#
+# 使い方（root で実行, cgroup v2 が /sys/fs/cgroup にマウントされている前提）:
+#   ./cgroup.sh setup               # /sys/fs/cgroup/acct-test/{a,b} を作る
+#   ./cgroup.sh run <a|b> cmd ...   # cmd をその cgroup に入れて実行する
+#   ./cgroup.sh clean               # 中のプロセスを kill して消す
+# -----------------------------------------------------------------------------
+
+set -e
+
+ROOT=/sys/fs/cgroup/acct-test
+
+setup() {
+    mkdir -p $ROOT/a $ROOT/b
+}
+
+run() {
+    local cg=$1
+    shift
+
+    # 自分自身（このシェル）を移してから exec するので、cmd とその子はすべてこの cgroup に入る
+    echo $$ > $ROOT/$cg/cgroup.procs
+    exec "$@"
+}
+
+clean() {
+    for cg in a b; do
+        [ -d $ROOT/$cg ] || continue
+        for pid in $(cat $ROOT/$cg/cgroup.procs); do
+            kill "$pid" 2>/dev/null || true
+        done
+        sleep 0.2
+        rmdir $ROOT/$cg 2>/dev/null || true
+    done
+    rmdir $ROOT 2>/dev/null || true
+}
+
+case "$1" in
+    setup) setup ;;
+    run)   shift; run "$@" ;;
+    clean) clean ;;
+    *)
+        echo "Usage: $0 {setup|run <a|b> cmd ...|clean}" >&2
+        exit 1
+        ;;
+esac
@@ -0,0 +1,132 @@
+/*
+ * conn-life.bpf.c（sock:inet_sock_set_state + socket local storage による接続単位のレコード）
+ *
+ * 目的:
+ *   socket_filter でパケットごとにログを出すと、接続単位の分析には重すぎる。
+ *   TCP の状態遷移だけを見て、接続ごとの状態はソケット自身にぶら下げ（sk_storage）、
+ *   CLOSE になった瞬間に 1 レコードだけ出す。イベント数 = 接続数。
+ *
+ * 流れ（tp_btf/inet_sock_set_state）:
+ *
+ *   * -> SYN_SENT          … 能動 open。sk_storage を作り {start, pid, comm} を記録
+ *   * -> ESTABLISHED       … sk_storage が無ければ受動 open（accept される子ソケット）として作る
+ *   * -> CLOSE             … sk_storage があれば
+ *                             duration = now - start
+ *                             tx/rx = tcp_sock.bytes_acked / bytes_received（CO-RE で読む）
+ *                           を ring buffer に出して sk_storage を消す
+ *
+ *   sk_storage はソケットの寿命に結びついているので、取りこぼしてもソケット解放時に自動で消える
+ *   （ハッシュ map と違って掃除が要らない）。
+ *
+ * 注意:
+ *   - 受動 open の ESTABLISHED 遷移は softirq で起きるので、current は無関係なタスク。pid/comm は残さない。
+ *   - SYN_SENT から ESTABLISHED にならずに CLOSE（接続失敗）しても 1 レコード出る（tx/rx は 0 に近い）。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "conn-life.h"
+
+#define AF_INET  2
+#define AF_INET6 10
+
+struct conn_start {
+    u64 start_ns;
+    u32 pid;
+    u8 active;
+    char comm[TASK_COMM_LEN];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_SK_STORAGE);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, int);
+    __type(value, struct conn_start);
+} conns SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} events SEC(".maps");
+
+static __always_inline void fill_tuple(struct conn_event *e, const struct sock *sk)
+{
+    u16 family = BPF_CORE_READ(sk, __sk_common.skc_family);
+
+    e->sport = BPF_CORE_READ(sk, __sk_common.skc_num);
+    e->dport = __builtin_bswap16(BPF_CORE_READ(sk, __sk_common.skc_dport));
+    if (family == AF_INET) {
+        e->family = 4;
+        BPF_CORE_READ_INTO((u32 *)e->saddr, sk, __sk_common.skc_rcv_saddr);
+        BPF_CORE_READ_INTO((u32 *)e->daddr, sk, __sk_common.skc_daddr);
+    } else {
+        e->family = 6;
+        BPF_CORE_READ_INTO(&e->saddr, sk, __sk_common.skc_v6_rcv_saddr);
+        BPF_CORE_READ_INTO(&e->daddr, sk, __sk_common.skc_v6_daddr);
+    }
+}
+
+SEC("tp_btf/inet_sock_set_state")
+int BPF_PROG(set_state, const struct sock *sk, int oldstate, int newstate)
+{
+    struct conn_start *cs;
+    struct conn_event *e;
+    const struct tcp_sock *tp;
+    u16 family;
+
+    if (BPF_CORE_READ(sk, sk_protocol) != IPPROTO_TCP)
+        return 0;
+    family = BPF_CORE_READ(sk, __sk_common.skc_family);
+    if (family != AF_INET && family != AF_INET6)
+        return 0;
+
+    if (newstate == TCP_SYN_SENT) {
+        cs = bpf_sk_storage_get(&conns, (void *)sk, NULL, BPF_SK_STORAGE_GET_F_CREATE);
+        if (!cs)
+            return 0;
+        cs->start_ns = bpf_ktime_get_ns();
+        cs->pid = bpf_get_current_pid_tgid() >> 32;
+        cs->active = 1;
+        bpf_get_current_comm(cs->comm, sizeof(cs->comm));
+        return 0;
+    }
+
+    if (newstate == TCP_ESTABLISHED) {
+        cs = bpf_sk_storage_get(&conns, (void *)sk, NULL, 0);
+        if (cs)
+            return 0;
+        cs = bpf_sk_storage_get(&conns, (void *)sk, NULL, BPF_SK_STORAGE_GET_F_CREATE);
+        if (cs)
+            cs->start_ns = bpf_ktime_get_ns();
+        return 0;
+    }
+
+    if (newstate != TCP_CLOSE)
+        return 0;
+
+    cs = bpf_sk_storage_get(&conns, (void *)sk, NULL, 0);
+    if (!cs)
+        return 0;
+
+    e = bpf_ringbuf_reserve(&events, sizeof(*e), 0);
+    if (e) {
+        __builtin_memset(e, 0, sizeof(*e));
+        fill_tuple(e, sk);
+        tp = (const struct tcp_sock *)sk;
+        e->duration_ns = bpf_ktime_get_ns() - cs->start_ns;
+        e->tx_bytes = BPF_CORE_READ(tp, bytes_acked);
+        e->rx_bytes = BPF_CORE_READ(tp, bytes_received);
+        e->retrans = BPF_CORE_READ(tp, total_retrans);
+        e->pid = cs->pid;
+        e->active = cs->active;
+        __builtin_memcpy(e->comm, cs->comm, sizeof(e->comm));
+        bpf_ringbuf_submit(e, 0);
+    }
+
+    bpf_sk_storage_delete(&conns, (void *)sk);
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
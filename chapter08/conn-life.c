@@ -0,0 +1,142 @@
+/*
+ * conn-life.c（ユーザ空間側 / TCP 接続の寿命レコードの表示）
+ *
+ * 目的:
+ *   conn-life.bpf.c を attach し、ring buffer から接続ごとのレコード（接続終了時に 1 件）を受け取って表示する。
+ *   -c を付けると CSV で出すので、そのままファイルに落として集計できる。
+ *
+ * 使い方:
+ *   sudo ./conn-life [-c]
+ *
+ *   例:
+ *     sudo ./conn-life &
+ *     ./tcp-bulk server & ./tcp-bulk client 127.0.0.1 -d 2
+ *     # → client 側（active=1, comm=tcp-bulk）と server 側（active=0）の 2 件が出る
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <bpf/libbpf.h>
+
+#include "conn-life.h"
+#include "conn-life.skel.h"
+
+static volatile sig_atomic_t exiting = 0;
+static bool csv = false;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static int handle_event(void *ctx, void *data, size_t size)
+{
+    const struct conn_event *e = data;
+    char saddr[INET6_ADDRSTRLEN], daddr[INET6_ADDRSTRLEN];
+    int af = e->family == 6 ? AF_INET6 : AF_INET;
+
+    (void)ctx;
+    if (size < sizeof(*e))
+        return 0;
+
+    inet_ntop(af, e->saddr, saddr, sizeof(saddr));
+    inet_ntop(af, e->daddr, daddr, sizeof(daddr));
+
+    if (csv) {
+        printf("%u,%s,%d,%s,%u,%s,%u,%llu,%llu,%llu,%u\n",
+               e->pid, e->comm, e->active, saddr, e->sport, daddr, e->dport,
+               e->duration_ns, e->tx_bytes, e->rx_bytes, e->retrans);
+    } else {
+        printf("%-7u %-16.16s %-3s %-22s %-6u %-22s %-6u %-12.3f %-12llu %-12llu %-6u\n",
+               e->pid, e->active ? e->comm : "-", e->active ? "out" : "in",
+               saddr, e->sport, daddr, e->dport,
+               e->duration_ns / 1e6, e->tx_bytes, e->rx_bytes, e->retrans);
+    }
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct conn_life_bpf *skel = NULL;
+    struct ring_buffer *rb = NULL;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        switch (opt) {
+        case 'c': csv = true; break;
+        default:
+            fprintf(stderr, "Usage: %s [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    skel = conn_life_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open/load BPF object\n");
+        return 1;
+    }
+
+    err = conn_life_bpf__attach(skel);
+    if (err) {
+        fprintf(stderr, "Failed to attach BPF programs (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    rb = ring_buffer__new(bpf_map__fd(skel->maps.events), handle_event, NULL, NULL);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create ring buffer: %d\n", err);
+        goto cleanup;
+    }
+
+    if (csv)
+        printf("pid,comm,active,saddr,sport,daddr,dport,duration_ns,tx_bytes,rx_bytes,retrans\n");
+    else
+        printf("%-7s %-16s %-3s %-22s %-6s %-22s %-6s %-12s %-12s %-12s %-6s\n",
+               "pid", "comm", "dir", "saddr", "sport", "daddr", "dport",
+               "dur_ms", "tx_bytes", "rx_bytes", "retx");
+
+    while (!exiting) {
+        err = ring_buffer__poll(rb, 100);
+        if (err == -EINTR) {
+            err = 0;
+            break;
+        }
+        if (err < 0) {
+            fprintf(stderr, "Error polling ring buffer: %d\n", err);
+            break;
+        }
+        err = 0;
+    }
+
+cleanup:
+    ring_buffer__free(rb);
+    conn_life_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
@@ -0,0 +1,37 @@
+#ifndef CONN_LIFE_H
+#define CONN_LIFE_H
+
+/*
+ * conn-life.h（TCP 接続の寿命レコードの共有定義）
+ */
+
+#define TASK_COMM_LEN 16
+
+/*
+ * struct conn_event:
+ *   接続が CLOSE に落ちたときに ring buffer へ 1 回だけ出すレコード。
+ *
+ *   saddr/daddr : IPv4 は先頭 4 バイト
+ *   sport/dport : ホストバイトオーダ
+ *   pid / comm  : 接続を始めたプロセス（能動 open は connect した側。受動 open は accept 前なので 0 / 空）
+ *   duration_ns : 開始（SYN_SENT or ESTABLISHED）→ CLOSE
+ *   tx_bytes    : tcp_sock.bytes_acked（相手に届いたと確認できた送信量）
+ *   rx_bytes    : tcp_sock.bytes_received
+ */
+struct conn_event {
+   unsigned char saddr[16];
+   unsigned char daddr[16];
+   unsigned short sport;
+   unsigned short dport;
+   unsigned char family;
+   unsigned char active;
+   unsigned char pad[2];
+   unsigned int pid;
+   unsigned int retrans;
+   char comm[TASK_COMM_LEN];
+   unsigned long long duration_ns;
+   unsigned long long tx_bytes;
+   unsigned long long rx_bytes;
+};
+
+#endif /* CONN_LIFE_H */
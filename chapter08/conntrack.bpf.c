@@ -0,0 +1,426 @@
+/*
+ * conntrack.bpf.c（TC の状態付きファイアウォール: LRU_HASH の conntrack + bpf_timer による期限切れ）
+ *
+ * 目的:
+ *   これまでの TC プログラムはパケット単位（状態なし）なので、「自分から出た接続の戻りだけ通す」
+ *   「TCP の状態に合わないパケットを落とす」ができなかった。
+ *   正規化した 5-tuple をキーに接続の状態を持ち、ポリシー（rules）は新規フローの最初のパケットだけで評価する。
+ *   2 パケット目以降は conntrack の lookup 1 回で通すかどうかが決まる。
+ *
+ * 流れ（ingress / egress 共通, dir だけが違う）:
+ *
+ *   パケット ──> packet.h で 5-tuple を取り出す（TCP/UDP 以外は untracked でそのまま通す）
+ *     │  (addr, port) の小さい側を a にして key を正規化、送信元が a 側か（from_a）を覚える
+ *     v
+ *   conntrack[key]
+ *     ├─ ある : is_orig = (from_a == orig_a)
+ *     │          ESTABLISHED かつ SYN/FIN/RST なし → last_ns と counters を更新して通す（速い経路）
+ *     │          それ以外 → 状態遷移（不正なら落とす）。タイムアウトが変わる遷移なら timer を張り直す
+ *     └─ ない : TCP は SYN（ACK なし）だけが新規フロー（-l 指定時は途中の ACK も拾う）
+ *                rules を先頭から照合（無ければ dir ごとの既定 action）
+ *                許可 → エントリ作成 + bpf_timer_init / set_callback / start
+ *
+ * 期限切れ（bpf_timer）:
+ *   パケットごとに timer を張り直すと速い経路が重くなるので、パケットは last_ns を書くだけにする。
+ *   timer が発火したら「last_ns からの経過 >= 状態のタイムアウト」なら消し、そうでなければ残り時間で張り直す。
+ *
+ *   状態         タイムアウト        状態            タイムアウト
+ *   SYN_SENT     120s               TIME_WAIT       120s
+ *   SYN_RECV      60s               CLOSE            10s
+ *   ESTABLISHED   5 日              UDP_UNREPLIED    30s
+ *   FIN_WAIT     120s               UDP_REPLIED     120s
+ *
+ * 注意:
+ *   - 状態と counters の更新はロックなしで行う（同じフローの両方向を別 CPU が同時に処理すると
+ *     カウンタを取りこぼすことがあるが、状態遷移は一方向に進むだけなので壊れはしない）。
+ *   - TIME_WAIT / CLOSE のエントリに新しい SYN が来たらエントリを消して新規フローとしてポリシーを評価し直す。
+ *   - IPv6 の拡張ヘッダや IP フラグメントは辿らないので untracked になる。
+ *   - LRU なので満杯になると古いエントリから追い出される（追い出された ESTABLISHED は -l なしだと
+ *     次のパケットで INVALID になる）。max_entries はローダが bpf_map__set_max_entries で変えられる。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "packet.h"
+#include "conntrack.h"
+
+#define TC_ACT_OK   0
+#define TC_ACT_SHOT 2
+
+#define CLOCK_MONOTONIC 1
+#define NSEC_PER_SEC    1000000000ULL
+
+/* 新規フローが rules のどれにも一致しなかったときの action と、途中からのフローを拾うか */
+const volatile u8 in_default = CT_DROP;
+const volatile u8 out_default = CT_ACCEPT;
+const volatile bool loose = false;
+
+u32 nr_rules = 0;
+
+/* map の value。timer の後ろがユーザ空間と共有する ct_info（conntrack.h の ct_entry_user と同じ並び） */
+struct ct_entry {
+    struct bpf_timer timer;
+    struct ct_info info;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, CT_MAX_ENTRIES);
+    __type(key, struct ct_key);
+    __type(value, struct ct_entry);
+} conntrack SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_RULES);
+    __type(key, u32);
+    __type(value, struct ct_rule);
+} rules SEC(".maps");
+
+/* per-CPU 統計カウンタ（enum stat_idx） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_STATS);
+    __type(key, u32);
+    __type(value, u64);
+} stats SEC(".maps");
+
+/* パケットから取り出した 5-tuple と TCP フラグ */
+struct pkt {
+    u32 saddr[4];
+    u32 daddr[4];
+    u16 sport;
+    u16 dport;
+    u8 proto;
+    u8 family;
+    u8 syn, ack, fin, rst;
+    u32 len;
+};
+
+static __always_inline void stat_inc(u32 idx)
+{
+    u64 *cnt = bpf_map_lookup_elem(&stats, &idx);
+
+    if (cnt)
+        (*cnt)++;
+}
+
+static __always_inline u64 ct_timeout(u8 state)
+{
+    switch (state) {
+    case CT_SYN_SENT:      return 120 * NSEC_PER_SEC;
+    case CT_SYN_RECV:      return 60 * NSEC_PER_SEC;
+    case CT_ESTABLISHED:   return 5 * 86400 * NSEC_PER_SEC;
+    case CT_FIN_WAIT:      return 120 * NSEC_PER_SEC;
+    case CT_TIME_WAIT:     return 120 * NSEC_PER_SEC;
+    case CT_CLOSE:         return 10 * NSEC_PER_SEC;
+    case CT_UDP_UNREPLIED: return 30 * NSEC_PER_SEC;
+    case CT_UDP_REPLIED:   return 120 * NSEC_PER_SEC;
+    default:               return 10 * NSEC_PER_SEC;
+    }
+}
+
+static int ct_expire(void *map, struct ct_key *key, struct ct_entry *e)
+{
+    u64 timeout = ct_timeout(e->info.state);
+    u64 idle = bpf_ktime_get_ns() - e->info.last_ns;
+
+    if (idle >= timeout) {
+        bpf_map_delete_elem(map, key);
+        stat_inc(STAT_EXPIRED);
+    } else {
+        bpf_timer_start(&e->timer, timeout - idle, 0);
+    }
+    return 0;
+}
+
+static __always_inline int parse_pkt(struct __sk_buff *skb, struct pkt *p)
+{
+    void *data = (void *)(long)skb->data;
+    void *data_end = (void *)(long)skb->data_end;
+    struct hdr_cursor nh = { .pos = data };
+    struct ipv6hdr *ip6h;
+    struct iphdr *iph;
+    struct ethhdr *eth;
+    struct tcphdr *tcph;
+    struct udphdr *udph;
+    int proto;
+
+    proto = parse_ethhdr(&nh, data_end, &eth);
+    if (proto == bpf_htons(ETH_P_IP)) {
+        proto = parse_iphdr(&nh, data_end, &iph);
+        if (proto < 0 || (iph->frag_off & bpf_htons(0x3FFF)))
+            return -1;
+        p->family = 4;
+        p->saddr[0] = iph->saddr;
+        p->daddr[0] = iph->daddr;
+    } else if (proto == bpf_htons(ETH_P_IPV6)) {
+        proto = parse_ipv6hdr(&nh, data_end, &ip6h);
+        if (proto < 0)
+            return -1;
+        p->family = 6;
+        __builtin_memcpy(p->saddr, &ip6h->saddr, 16);
+        __builtin_memcpy(p->daddr, &ip6h->daddr, 16);
+    } else {
+        return -1;
+    }
+
+    p->proto = proto;
+    if (proto == IPPROTO_TCP) {
+        if (parse_tcphdr(&nh, data_end, &tcph) < 0)
+            return -1;
+        p->sport = tcph->source;
+        p->dport = tcph->dest;
+        p->syn = tcph->syn;
+        p->ack = tcph->ack;
+        p->fin = tcph->fin;
+        p->rst = tcph->rst;
+    } else if (proto == IPPROTO_UDP) {
+        if (parse_udphdr(&nh, data_end, &udph) < 0)
+            return -1;
+        p->sport = udph->source;
+        p->dport = udph->dest;
+    } else {
+        return -1;
+    }
+
+    p->len = skb->len;
+    return 0;
+}
+
+/* (saddr, sport) と (daddr, dport) の小さい方を a にして key を作る。送信元が a 側なら 1 */
+static __always_inline int make_key(const struct pkt *p, struct ct_key *key)
+{
+    int words = p->family == 6 ? 4 : 1;
+    int cmp = 0;
+
+    for (int i = 0; i < 4; i++) {
+        if (i >= words || cmp)
+            break;
+        if (p->saddr[i] != p->daddr[i])
+            cmp = bpf_ntohl(p->saddr[i]) < bpf_ntohl(p->daddr[i]) ? -1 : 1;
+    }
+    if (!cmp && p->sport != p->dport)
+        cmp = bpf_ntohs(p->sport) < bpf_ntohs(p->dport) ? -1 : 1;
+
+    key->proto = p->proto;
+    key->family = p->family;
+    if (cmp <= 0) {
+        __builtin_memcpy(key->addr_a, p->saddr, 16);
+        __builtin_memcpy(key->addr_b, p->daddr, 16);
+        key->port_a = p->sport;
+        key->port_b = p->dport;
+        return 1;
+    }
+    __builtin_memcpy(key->addr_a, p->daddr, 16);
+    __builtin_memcpy(key->addr_b, p->saddr, 16);
+    key->port_a = p->dport;
+    key->port_b = p->sport;
+    return 0;
+}
+
+/* 新規フローの最初のパケットに対してだけ呼ぶ。CT_ACCEPT / CT_DROP を返す */
+static __always_inline u8 policy(const struct pkt *p, u8 dir)
+{
+    u32 peer = dir == CT_DIR_IN ? p->saddr[0] : p->daddr[0];
+    u16 port = bpf_ntohs(p->dport);
+    u32 nr = nr_rules;
+
+    for (u32 i = 0; i < MAX_RULES; i++) {
+        struct ct_rule *r;
+        u32 key = i;
+
+        if (i >= nr)
+            break;
+
+        r = bpf_map_lookup_elem(&rules, &key);
+        if (!r || r->dir != dir)
+            continue;
+        if (r->proto && r->proto != p->proto)
+            continue;
+        if (r->mask && (p->family != 4 || (peer & r->mask) != r->addr))
+            continue;
+        if (port < r->port_lo || port > r->port_hi)
+            continue;
+        return r->action;
+    }
+    return dir == CT_DIR_IN ? in_default : out_default;
+}
+
+/* TCP の状態遷移。不正なら CT_NONE を返す */
+static __always_inline u8 tcp_next(struct ct_info *ci, const struct pkt *p, bool is_orig)
+{
+    u8 bit = is_orig ? 1 : 2;
+
+    if (p->rst)
+        return CT_CLOSE;
+
+    switch (ci->state) {
+    case CT_SYN_SENT:
+        if (is_orig && p->syn && !p->ack)
+            return CT_SYN_SENT;                    /* SYN 再送 */
+        if (!is_orig && p->syn && p->ack)
+            return CT_SYN_RECV;
+        return CT_NONE;
+    case CT_SYN_RECV:
+        if (p->syn)                                /* SYN / SYN+ACK の再送 */
+            return (is_orig && !p->ack) || (!is_orig && p->ack) ? CT_SYN_RECV : CT_NONE;
+        if (!is_orig || !p->ack)
+            return CT_NONE;
+        if (!p->fin)
+            return CT_ESTABLISHED;
+        ci->fin_seen |= bit;
+        return CT_FIN_WAIT;
+    case CT_ESTABLISHED:
+    case CT_FIN_WAIT:
+        if (p->syn)
+            return CT_NONE;
+        if (p->fin)
+            ci->fin_seen |= bit;
+        if (ci->fin_seen == 3)
+            return CT_TIME_WAIT;
+        return ci->fin_seen ? CT_FIN_WAIT : CT_ESTABLISHED;
+    case CT_TIME_WAIT:
+    case CT_CLOSE:
+        return ci->state;
+    default:
+        return CT_NONE;
+    }
+}
+
+static __always_inline int create(struct ct_key *key, const struct pkt *p, u8 dir, bool from_a,
+                                  u8 state, u64 now)
+{
+    struct ct_entry init = {}, *e;
+
+    init.info.state = state;
+    init.info.dir = dir;
+    init.info.orig_a = from_a;
+    init.info.created_ns = now;
+    init.info.last_ns = now;
+    init.info.packets[0] = 1;
+    init.info.bytes[0] = p->len;
+
+    /* 同じフローの最初のパケットを別 CPU が同時に処理していたら、先に作った方を使う */
+    if (bpf_map_update_elem(&conntrack, key, &init, BPF_NOEXIST))
+        return bpf_map_lookup_elem(&conntrack, key) ? 0 : -1;
+
+    e = bpf_map_lookup_elem(&conntrack, key);
+    if (!e)
+        return -1;
+    if (bpf_timer_init(&e->timer, &conntrack, CLOCK_MONOTONIC) ||
+        bpf_timer_set_callback(&e->timer, ct_expire) ||
+        bpf_timer_start(&e->timer, ct_timeout(state), 0)) {
+        bpf_map_delete_elem(&conntrack, key);
+        return -1;
+    }
+    return 0;
+}
+
+static __always_inline int handle(struct __sk_buff *skb, u8 dir)
+{
+    struct ct_key key = {};
+    struct pkt p = {};
+    u32 linear = skb->data_end - skb->data;
+    struct ct_entry *e;
+    bool from_a, is_orig;
+    u64 now;
+    u8 state;
+
+    /* ヘッダが線形領域に収まっていない skb は先頭だけ引き込んでから見る */
+    if (linear < 128 && skb->len > linear)
+        bpf_skb_pull_data(skb, skb->len < 128 ? skb->len : 128);
+
+    if (parse_pkt(skb, &p)) {
+        stat_inc(STAT_UNTRACKED);
+        return TC_ACT_OK;
+    }
+
+    from_a = make_key(&p, &key);
+    now = bpf_ktime_get_ns();
+
+    e = bpf_map_lookup_elem(&conntrack, &key);
+    if (e) {
+        struct ct_info *ci = &e->info;
+
+        is_orig = from_a == ci->orig_a;
+
+        /* 速い経路: 確立済み TCP のフラグなしパケット */
+        if (ci->state == CT_ESTABLISHED && !(p.syn | p.fin | p.rst)) {
+            ci->last_ns = now;
+            ci->packets[!is_orig]++;
+            ci->bytes[!is_orig] += p.len;
+            stat_inc(STAT_HIT);
+            return TC_ACT_OK;
+        }
+
+        if (p.proto == IPPROTO_TCP) {
+            /* 閉じたフローのポート再利用 → 新規フローとして評価し直す */
+            if ((ci->state == CT_TIME_WAIT || ci->state == CT_CLOSE) && p.syn && !p.ack) {
+                bpf_map_delete_elem(&conntrack, &key);
+                goto new_flow;
+            }
+            state = tcp_next(ci, &p, is_orig);
+            if (state == CT_NONE) {
+                stat_inc(STAT_INVALID);
+                return TC_ACT_SHOT;
+            }
+        } else {
+            state = (ci->state == CT_UDP_UNREPLIED && !is_orig) ? CT_UDP_REPLIED : ci->state;
+        }
+
+        ci->last_ns = now;
+        ci->packets[!is_orig]++;
+        ci->bytes[!is_orig] += p.len;
+        if (state != ci->state) {
+            u64 old = ct_timeout(ci->state), cur = ct_timeout(state);
+
+            ci->state = state;
+            if (cur < old)
+                bpf_timer_start(&e->timer, cur, 0);
+        }
+        stat_inc(STAT_HIT);
+        return TC_ACT_OK;
+    }
+
+new_flow:
+    if (p.proto == IPPROTO_TCP) {
+        if (p.syn && !p.ack)
+            state = CT_SYN_SENT;
+        else if (loose && !p.syn && !p.rst)
+            state = CT_ESTABLISHED;
+        else {
+            stat_inc(STAT_INVALID);
+            return TC_ACT_SHOT;
+        }
+    } else {
+        state = CT_UDP_UNREPLIED;
+    }
+
+    if (policy(&p, dir) != CT_ACCEPT) {
+        stat_inc(STAT_DENY);
+        return TC_ACT_SHOT;
+    }
+
+    if (create(&key, &p, dir, from_a, state, now)) {
+        stat_inc(STAT_CREATE_FAIL);
+        return TC_ACT_OK;
+    }
+    stat_inc(STAT_NEW);
+    return TC_ACT_OK;
+}
+
+SEC("tc")
+int ct_ingress(struct __sk_buff *skb)
+{
+    return handle(skb, CT_DIR_IN);
+}
+
+SEC("tc")
+int ct_egress(struct __sk_buff *skb)
+{
+    return handle(skb, CT_DIR_OUT);
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
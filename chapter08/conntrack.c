@@ -0,0 +1,581 @@
+/*
+ * conntrack.c（ユーザ空間側 / TC 状態付きファイアウォールの設定・表示と、速い経路 / 容量のベンチ）
+ *
+ * 目的:
+ *   conntrack.bpf.c をインタフェースの ingress / egress に attach し、新規フローに対するルールを書き込む。
+ *   1 秒ごとに統計（hit / new / deny / invalid / expired）と状態ごとのエントリ数を表示する。
+ *   bench モードでは BPF_PROG_TEST_RUN で合成パケットを流し、
+ *     - 新規フロー（SYN → SYN+ACK → ACK）の作成コスト
+ *     - ESTABLISHED の速い経路のコスト（同じフローを繰り返す hot / 全フローをランダム順に 1 回ずつの cold）
+ *     - 1M 接続を入れたときのエントリ数（LRU の追い出し）と map のメモリ量
+ *   を測る。attach はしないのでホストの通信には影響しない。
+ *
+ * 使い方:
+ *   sudo ./conntrack -i <ifname> [-a rule] [-a ...] [-I accept|drop] [-E accept|drop] [-l]
+ *
+ *   -i <ifname>  ingress / egress に attach するインタフェース
+ *   -a <rule>    新規フローのルール（先頭から照合, 最大 MAX_RULES 個）
+ *                  in|out:tcp|udp|any:<addr[/prefix]>:<lo[-hi]>[:accept|drop]
+ *                  addr は相手側（in は送信元, out は宛先）, ポートはサービス側（宛先ポート）
+ *   -I / -E      ルールに一致しなかった新規フローの扱い（既定 -I drop -E accept）
+ *   -l           途中から見えた TCP フロー（SYN の無い ACK）も新規フローとして拾う
+ *
+ *   例（netns.sh pair の ns2 を「5201/tcp と ns1 からの udp だけ受ける」ホストにする）:
+ *     sudo ./netns.sh pair
+ *     sudo ip netns exec ns2 ./conntrack -i veth2 -a in:tcp:0.0.0.0/0:5201 -a in:udp:10.0.0.1:1-65535 &
+ *     sudo ip netns exec ns2 ./tcp-bulk server &
+ *     sudo ip netns exec ns1 ./tcp-bulk client 10.0.0.2 -d 5      # 通る（new → hit）
+ *     sudo ip netns exec ns1 nc -w1 10.0.0.2 22                   # deny
+ *     sudo ip netns exec ns2 ping -c1 10.0.0.1                    # ICMP は untracked
+ *
+ *   sudo ./conntrack bench [-n flows] [-m max_entries] [-r repeat]
+ *
+ *   -n : 作る TCP 接続の数（既定 1048576）
+ *   -m : conntrack map の max_entries（既定 CT_MAX_ENTRIES。-n より小さくすると LRU の追い出しが見える）
+ *   -r : hot の繰り返し回数（既定 1000000）
+ *
+ * 注意:
+ *   - TC の clsact qdisc は無ければ作り、終了時に作ったものだけ消す。
+ *   - bench の時間は test_run が返すカーネル内の実行時間（syscall の往復は含まない）。
+ *     比較用に untracked（ICMP）パケットの時間も出すので、その差が conntrack の lookup + 更新の分。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "conntrack.h"
+#include "conntrack.skel.h"
+
+#define BATCH 4096
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+static const char *stat_names[NR_STATS] = {
+    [STAT_HIT]         = "hit",
+    [STAT_NEW]         = "new",
+    [STAT_DENY]        = "deny",
+    [STAT_INVALID]     = "invalid",
+    [STAT_EXPIRED]     = "expired",
+    [STAT_UNTRACKED]   = "untracked",
+    [STAT_CREATE_FAIL] = "fail",
+};
+
+static const char *state_names[NR_CT_STATES] = {
+    [CT_NONE]          = "none",
+    [CT_SYN_SENT]      = "syn_sent",
+    [CT_SYN_RECV]      = "syn_recv",
+    [CT_ESTABLISHED]   = "established",
+    [CT_FIN_WAIT]      = "fin_wait",
+    [CT_TIME_WAIT]     = "time_wait",
+    [CT_CLOSE]         = "close",
+    [CT_UDP_UNREPLIED] = "udp_unreplied",
+    [CT_UDP_REPLIED]   = "udp_replied",
+};
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* per-CPU カウンタを CPU 分合算して返す */
+static __u64 read_stat(struct conntrack_bpf *skel, __u32 idx, int nr_cpus)
+{
+    __u64 values[nr_cpus];
+    __u64 sum = 0;
+
+    if (bpf_map__lookup_elem(skel->maps.stats, &idx, sizeof(idx),
+                             values, sizeof(values), 0))
+        return 0;
+
+    for (int i = 0; i < nr_cpus; i++)
+        sum += values[i];
+    return sum;
+}
+
+/* in|out:tcp|udp|any:addr[/prefix]:lo[-hi][:accept|drop] */
+static int parse_rule(const char *s, struct ct_rule *rule)
+{
+    char buf[128], *f[5], *slash, *dash, *save = NULL;
+    struct in_addr in;
+    unsigned long lo, hi;
+    int prefix = 32, n = 0;
+
+    snprintf(buf, sizeof(buf), "%s", s);
+    for (char *t = strtok_r(buf, ":", &save); t && n < 5; t = strtok_r(NULL, ":", &save))
+        f[n++] = t;
+    if (n < 4)
+        return -EINVAL;
+
+    memset(rule, 0, sizeof(*rule));
+    if (!strcmp(f[0], "in"))
+        rule->dir = CT_DIR_IN;
+    else if (!strcmp(f[0], "out"))
+        rule->dir = CT_DIR_OUT;
+    else
+        return -EINVAL;
+
+    if (!strcmp(f[1], "tcp"))
+        rule->proto = IPPROTO_TCP;
+    else if (!strcmp(f[1], "udp"))
+        rule->proto = IPPROTO_UDP;
+    else if (strcmp(f[1], "any"))
+        return -EINVAL;
+
+    slash = strchr(f[2], '/');
+    if (slash) {
+        *slash = '\0';
+        prefix = atoi(slash + 1);
+        if (prefix < 0 || prefix > 32)
+            return -EINVAL;
+    }
+    if (inet_pton(AF_INET, f[2], &in) != 1)
+        return -EINVAL;
+    rule->mask = prefix ? htonl(~0U << (32 - prefix)) : 0;
+    rule->addr = in.s_addr & rule->mask;
+
+    lo = strtoul(f[3], &dash, 10);
+    hi = *dash == '-' ? strtoul(dash + 1, NULL, 10) : lo;
+    if (lo == 0 || hi > 65535 || lo > hi)
+        return -EINVAL;
+    rule->port_lo = lo;
+    rule->port_hi = hi;
+
+    if (n == 5 && !strcmp(f[4], "drop"))
+        rule->action = CT_DROP;
+    else if (n == 5 && strcmp(f[4], "accept"))
+        return -EINVAL;
+    return 0;
+}
+
+static int parse_action(const char *s)
+{
+    if (!strcmp(s, "accept"))
+        return CT_ACCEPT;
+    if (!strcmp(s, "drop"))
+        return CT_DROP;
+    return -1;
+}
+
+/* conntrack map を batch で読み、状態ごとのエントリ数を数える。総数を返す */
+static long count_states(int fd, long counts[NR_CT_STATES])
+{
+    static struct ct_key keys[BATCH];
+    static struct ct_entry_user values[BATCH];
+    __u32 out_batch, count;
+    void *in = NULL;
+    long total = 0;
+    int err;
+
+    memset(counts, 0, NR_CT_STATES * sizeof(counts[0]));
+    do {
+        count = BATCH;
+        err = bpf_map_lookup_batch(fd, in, &out_batch, keys, values, &count, NULL);
+        if (err && errno != ENOENT)
+            break;
+
+        for (__u32 i = 0; i < count; i++) {
+            if (values[i].info.state < NR_CT_STATES)
+                counts[values[i].info.state]++;
+            total++;
+        }
+        in = &out_batch;
+    } while (!err);
+    return total;
+}
+
+static void print_states(const long counts[NR_CT_STATES], long total)
+{
+    printf("  entries=%ld", total);
+    for (int s = 1; s < NR_CT_STATES; s++) {
+        if (counts[s])
+            printf(" %s=%ld", state_names[s], counts[s]);
+    }
+    printf("\n");
+}
+
+static int run_firewall(struct conntrack_bpf *skel, const char *ifname, int nr_cpus)
+{
+    LIBBPF_OPTS(bpf_tc_hook, hook, .ifindex = if_nametoindex(ifname),
+                .attach_point = BPF_TC_INGRESS);
+    LIBBPF_OPTS(bpf_tc_opts, in_opts, .handle = 1, .priority = 1);
+    LIBBPF_OPTS(bpf_tc_opts, out_opts, .handle = 1, .priority = 1);
+    bool hook_created = false, in_attached = false, out_attached = false;
+    __u64 prev[NR_STATS] = {};
+    long counts[NR_CT_STATES];
+    int err;
+
+    if (!hook.ifindex) {
+        fprintf(stderr, "Unknown interface: %s\n", ifname);
+        return -ENODEV;
+    }
+
+    /* clsact が既にあれば -EEXIST。そのときは作っていないので終了時に消さない */
+    err = bpf_tc_hook_create(&hook);
+    if (err && err != -EEXIST) {
+        fprintf(stderr, "Failed to create TC hook on %s: %d\n", ifname, err);
+        return err;
+    }
+    hook_created = !err;
+
+    in_opts.prog_fd = bpf_program__fd(skel->progs.ct_ingress);
+    err = bpf_tc_attach(&hook, &in_opts);
+    if (err) {
+        fprintf(stderr, "Failed to attach TC ingress on %s: %d\n", ifname, err);
+        goto out;
+    }
+    in_attached = true;
+
+    hook.attach_point = BPF_TC_EGRESS;
+    out_opts.prog_fd = bpf_program__fd(skel->progs.ct_egress);
+    err = bpf_tc_attach(&hook, &out_opts);
+    if (err) {
+        fprintf(stderr, "Failed to attach TC egress on %s: %d\n", ifname, err);
+        goto out;
+    }
+    out_attached = true;
+
+    printf("Tracking connections on %s (new flows: in=%s out=%s, %u rule(s)). Ctrl-C to stop.\n",
+           ifname, skel->rodata->in_default == CT_ACCEPT ? "accept" : "drop",
+           skel->rodata->out_default == CT_ACCEPT ? "accept" : "drop", skel->bss->nr_rules);
+
+    while (!exiting) {
+        sleep(1);
+        for (int i = 0; i < NR_STATS; i++) {
+            __u64 cur = read_stat(skel, i, nr_cpus);
+
+            printf("%s=%-8llu ", stat_names[i], (unsigned long long)(cur - prev[i]));
+            prev[i] = cur;
+        }
+        printf("(/s)\n");
+        print_states(counts, count_states(bpf_map__fd(skel->maps.conntrack), counts));
+    }
+
+out:
+    if (out_attached) {
+        out_opts.flags = out_opts.prog_fd = out_opts.prog_id = 0;
+        bpf_tc_detach(&hook, &out_opts);
+    }
+    if (in_attached) {
+        hook.attach_point = BPF_TC_INGRESS;
+        in_opts.flags = in_opts.prog_fd = in_opts.prog_id = 0;
+        bpf_tc_detach(&hook, &in_opts);
+    }
+    if (hook_created) {
+        hook.attach_point = BPF_TC_INGRESS | BPF_TC_EGRESS;
+        bpf_tc_hook_destroy(&hook);
+    }
+    return err;
+}
+
+/* ---- bench ---------------------------------------------------------------- */
+
+/* Ethernet + IPv4 + TCP（オプションなし）の 54 バイト。チェックサムは見ないので 0 のまま */
+struct __attribute__((packed)) tcp_pkt {
+    unsigned char dst[6], src[6];
+    unsigned short h_proto;
+    unsigned char ver_ihl, tos;
+    unsigned short tot_len, id, frag_off;
+    unsigned char ttl, protocol;
+    unsigned short check;
+    unsigned int saddr, daddr;
+    unsigned short sport, dport;
+    unsigned int seq, ack_seq;
+    unsigned char doff, flags;
+    unsigned short window, tcheck, urg;
+};
+
+#define SERVER_ADDR 0xc0a80001   /* 192.168.0.1 */
+#define SERVER_PORT 80
+
+/* フロー i のクライアント側: 10.0.0.0 + (i >> 14), ポート 1024 + (i & 0x3fff) */
+static void build_pkt(struct tcp_pkt *p, unsigned int i, bool from_client, unsigned char flags)
+{
+    unsigned int caddr = htonl(0x0a000000 | (i >> 14));
+    unsigned short cport = htons(1024 + (i & 0x3fff));
+
+    memset(p, 0, sizeof(*p));
+    p->h_proto = htons(0x0800);
+    p->ver_ihl = 0x45;
+    p->tot_len = htons(sizeof(*p) - 14);
+    p->ttl = 64;
+    p->protocol = IPPROTO_TCP;
+    p->saddr = from_client ? caddr : htonl(SERVER_ADDR);
+    p->daddr = from_client ? htonl(SERVER_ADDR) : caddr;
+    p->sport = from_client ? cport : htons(SERVER_PORT);
+    p->dport = from_client ? htons(SERVER_PORT) : cport;
+    p->doff = 5 << 4;
+    p->flags = flags;
+    p->window = htons(65535);
+}
+
+/* 1 パケットを test_run で流し、カーネル内の実行時間（ns, repeat 回の平均）を返す */
+static long run_once(int prog_fd, void *pkt, size_t len, int repeat, __u32 *retval)
+{
+    LIBBPF_OPTS(bpf_test_run_opts, opts, .data_in = pkt, .data_size_in = len, .repeat = repeat);
+    int err = bpf_prog_test_run_opts(prog_fd, &opts);
+
+    if (err)
+        return err;
+    if (retval)
+        *retval = opts.retval;
+    return opts.duration;
+}
+
+static long map_memlock(int fd)
+{
+    char path[64], line[128];
+    long memlock = -1;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", fd);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "memlock: %ld", &memlock) == 1)
+            break;
+    }
+    fclose(f);
+    return memlock;
+}
+
+static int run_bench(struct conntrack_bpf *skel, unsigned int nflows, int repeat)
+{
+    int in_fd = bpf_program__fd(skel->progs.ct_ingress);
+    int out_fd = bpf_program__fd(skel->progs.ct_egress);
+    int map_fd = bpf_map__fd(skel->maps.conntrack);
+    unsigned long long syn_ns = 0, synack_ns = 0, ack_ns = 0, cold_ns = 0, t0, t1;
+    unsigned int *order, dropped = 0, filled = 0, cold_n = 0;
+    long counts[NR_CT_STATES], total, hot, base, memlock, d;
+    struct tcp_pkt pkt;
+    __u32 retval;
+
+    printf("Filling %u TCP connections (SYN -> SYN+ACK -> ACK) into max_entries=%u ...\n",
+           nflows, bpf_map__max_entries(skel->maps.conntrack));
+
+    t0 = now_ns();
+    for (unsigned int i = 0; i < nflows && !exiting; i++) {
+        build_pkt(&pkt, i, true, TCP_SYN);
+        d = run_once(out_fd, &pkt, sizeof(pkt), 1, &retval);
+        if (d < 0)
+            goto fail;
+        syn_ns += d;
+
+        build_pkt(&pkt, i, false, TCP_SYN | TCP_ACK);
+        d = run_once(in_fd, &pkt, sizeof(pkt), 1, &retval);
+        if (d < 0)
+            goto fail;
+        synack_ns += d;
+
+        build_pkt(&pkt, i, true, TCP_ACK);
+        d = run_once(out_fd, &pkt, sizeof(pkt), 1, &retval);
+        if (d < 0)
+            goto fail;
+        ack_ns += d;
+        dropped += retval != 0;
+        filled++;
+    }
+    t1 = now_ns();
+    if (!filled)
+        return 0;   /* 1 本も張らないうちに止められた */
+
+    total = count_states(map_fd, counts);
+    memlock = map_memlock(map_fd);
+    printf("  fill: %.2f s wall, per flow: new(SYN) %llu ns, SYN+ACK %llu ns, ACK %llu ns (in kernel)\n",
+           (t1 - t0) / 1e9, syn_ns / filled, synack_ns / filled, ack_ns / filled);
+    print_states(counts, total);
+    printf("  evicted/missing: %ld, final ACK dropped: %u, map memlock: %.1f MiB (%.0f B/entry)\n",
+           (long)filled - total, dropped, memlock / 1048576.0,
+           total ? (double)memlock / total : 0.0);
+
+    /* hot: 同じ ESTABLISHED フローの ACK を繰り返す（キャッシュに乗った lookup） */
+    build_pkt(&pkt, 0, true, TCP_ACK);
+    hot = d = run_once(out_fd, &pkt, sizeof(pkt), repeat, NULL);
+    if (d < 0)
+        goto fail;
+
+    /* 比較: conntrack を引かない untracked パケット（ICMP）= 解析だけのコスト */
+    pkt.protocol = IPPROTO_ICMP;
+    base = d = run_once(out_fd, &pkt, sizeof(pkt), repeat, NULL);
+    if (d < 0)
+        goto fail;
+
+    /* cold: 全フローをランダム順に 1 回ずつ（1M エントリではほぼ毎回キャッシュミス） */
+    order = malloc(filled * sizeof(*order));
+    if (!order)
+        return -ENOMEM;
+    for (unsigned int i = 0; i < filled; i++)
+        order[i] = i;
+    for (unsigned int i = filled - 1; i > 0; i--) {
+        unsigned int j = rand() % (i + 1), tmp = order[i];
+
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (unsigned int i = 0; i < filled && !exiting; i++) {
+        build_pkt(&pkt, order[i], i & 1, TCP_ACK);
+        d = run_once(i & 1 ? out_fd : in_fd, &pkt, sizeof(pkt), 1, NULL);
+        if (d < 0) {
+            free(order);
+            goto fail;
+        }
+        cold_ns += d;
+        cold_n++;
+    }
+    free(order);
+    if (!cold_n)
+        return 0;
+
+    printf("  established fast path: hot %ld ns, cold %llu ns, untracked baseline %ld ns\n",
+           hot, cold_ns / cold_n, base);
+    printf("  conntrack cost over baseline: hot %ld ns, cold %lld ns\n",
+           hot - base, (long long)(cold_ns / cold_n) - base);
+    return 0;
+
+fail:
+    fprintf(stderr, "BPF_PROG_TEST_RUN failed: %s\n", strerror(-d));
+    return d;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s -i <ifname> [-a rule] [-a ...] [-I accept|drop] [-E accept|drop] [-l]\n"
+                    "         rule: in|out:tcp|udp|any:<addr[/prefix]>:<lo[-hi]>[:accept|drop]\n"
+                    "       %s bench [-n flows] [-m max_entries] [-r repeat]\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct conntrack_bpf *skel = NULL;
+    struct ct_rule rules[MAX_RULES];
+    int nr_cpus = libbpf_num_possible_cpus();
+    const char *ifname = NULL;
+    unsigned int nflows = 1048576, max_entries = CT_MAX_ENTRIES;
+    int in_default = CT_DROP, out_default = CT_ACCEPT;
+    int repeat = 1000000;
+    bool bench = false, loose = false;
+    int nr = 0;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench = true;
+        optind = 2;
+    }
+
+    while ((opt = getopt(argc, argv, "i:a:I:E:ln:m:r:")) != -1) {
+        switch (opt) {
+        case 'i': ifname = optarg; break;
+        case 'l': loose = true; break;
+        case 'n': nflows = strtoul(optarg, NULL, 0); break;
+        case 'm': max_entries = strtoul(optarg, NULL, 0); break;
+        case 'r': repeat = atoi(optarg); break;
+        case 'I': in_default = parse_action(optarg); break;
+        case 'E': out_default = parse_action(optarg); break;
+        case 'a':
+            if (nr >= MAX_RULES || parse_rule(optarg, &rules[nr])) {
+                fprintf(stderr, "Invalid or too many rules: %s\n", optarg);
+                return 1;
+            }
+            nr++;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((!bench && !ifname) || (bench && (nflows == 0 || nflows > (1U << 30))) ||
+        in_default < 0 || out_default < 0 || max_entries == 0 || repeat <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    skel = conntrack_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    /* bench は out を許可・in を拒否にして、SYN が egress から出るフローだけを作る */
+    skel->rodata->in_default = bench ? CT_DROP : in_default;
+    skel->rodata->out_default = bench ? CT_ACCEPT : out_default;
+    skel->rodata->loose = loose && !bench;
+    bpf_map__set_max_entries(skel->maps.conntrack, max_entries);
+
+    err = conntrack_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    for (int i = 0; i < nr && !bench; i++) {
+        __u32 key = i;
+
+        if (bpf_map__update_elem(skel->maps.rules, &key, sizeof(key),
+                                 &rules[i], sizeof(rules[i]), BPF_ANY)) {
+            err = -errno;
+            fprintf(stderr, "Failed to write rule %d: %d\n", i, err);
+            goto cleanup;
+        }
+    }
+    if (!bench)
+        skel->bss->nr_rules = nr;
+
+    if (bench)
+        err = run_bench(skel, nflows, repeat);
+    else
+        err = run_firewall(skel, ifname, nr_cpus);
+
+cleanup:
+    conntrack_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
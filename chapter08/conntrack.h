@@ -0,0 +1,122 @@
+#ifndef CONNTRACK_H
+#define CONNTRACK_H
+
+/*
+ * conntrack.h（TC の状態付きファイアウォールとローダで共有する定義）
+ */
+
+#define MAX_RULES      64        /* 新規フローに対して順に照合する許可/拒否ルール数の上限 */
+#define CT_MAX_ENTRIES 1048576   /* conntrack（LRU_HASH）の既定サイズ。bench は -n で変える */
+
+/* ルール / 新規フローの向き */
+#define CT_DIR_IN  0   /* TC ingress で最初のパケットを見たフロー（外から来た接続） */
+#define CT_DIR_OUT 1   /* TC egress で最初のパケットを見たフロー（中から出た接続） */
+
+#define CT_ACCEPT 0
+#define CT_DROP   1
+
+/*
+ * struct ct_key:
+ *   conntrack map の key。5-tuple を「(addr, port) の小さい側を a」に並べ替えて正規化したもの。
+ *   こうすると行きと戻りのパケットが同じ key になり、1 回の lookup で両方向を引ける。
+ *   アドレスは IPv4 なら先頭 4 バイトだけ使う。ポートはネットワークバイトオーダのまま。
+ */
+struct ct_key {
+   unsigned char addr_a[16];
+   unsigned char addr_b[16];
+   unsigned short port_a;
+   unsigned short port_b;
+   unsigned char proto;
+   unsigned char family;
+   unsigned char pad[2];
+};
+
+/*
+ * ct_state:
+ *   TCP は nf_conntrack を簡略化した状態遷移、UDP は「戻りが来たか」だけを持つ。
+ *
+ *     SYN_SENT ──(反対側 SYN+ACK)──> SYN_RECV ──(発信側 ACK)──> ESTABLISHED
+ *     ESTABLISHED ──(片側 FIN)──> FIN_WAIT ──(もう片側 FIN)──> TIME_WAIT
+ *     どこからでも RST ──> CLOSE
+ */
+enum ct_state {
+   CT_NONE = 0,
+   CT_SYN_SENT,
+   CT_SYN_RECV,
+   CT_ESTABLISHED,
+   CT_FIN_WAIT,
+   CT_TIME_WAIT,
+   CT_CLOSE,
+   CT_UDP_UNREPLIED,
+   CT_UDP_REPLIED,
+   NR_CT_STATES,
+};
+
+/*
+ * struct ct_info:
+ *   conntrack map の value のうちユーザ空間からも読む部分（BPF 側ではこの前に struct bpf_timer が付く）。
+ *
+ *   orig_a    : 最初のパケットの送信元が key の a 側なら 1（パケットの向き = original / reply の判定に使う）
+ *   fin_seen  : FIN を送った側のビット（bit0 = original, bit1 = reply）
+ *   last_ns   : 最後にパケットを見た時刻。timer はこれを見て期限切れか再設定かを決める
+ *   packets / bytes : [0] = original 方向, [1] = reply 方向
+ */
+struct ct_info {
+   unsigned char state;
+   unsigned char dir;
+   unsigned char orig_a;
+   unsigned char fin_seen;
+   unsigned int pad;
+   unsigned long long created_ns;
+   unsigned long long last_ns;
+   unsigned long long packets[2];
+   unsigned long long bytes[2];
+};
+
+/*
+ * struct ct_entry_user:
+ *   ユーザ空間から見た conntrack の value のレイアウト。
+ *   先頭 16 バイトは BPF 側の struct bpf_timer（lookup では 0 として読める）。
+ */
+struct ct_entry_user {
+   unsigned long long timer[2];
+   struct ct_info info;
+};
+
+/*
+ * struct ct_rule:
+ *   rules map（ARRAY, 添字 0..nr_rules-1）の value。新規フローの最初のパケットだけで先頭から照合し、
+ *   最初に一致したものの action を使う。どれにも一致しなければ向きごとの既定 action。
+ *
+ *   dir         : CT_DIR_IN / CT_DIR_OUT
+ *   proto       : IPPROTO_TCP / IPPROTO_UDP（0 なら両方）
+ *   addr / mask : 相手側 IPv4 アドレスとネットマスク（ネットワークバイトオーダ, in は送信元 / out は宛先）
+ *   port_lo/hi  : サービス側ポート範囲（ホストバイトオーダ, in はこちらの宛先ポート / out は相手の宛先ポート）
+ */
+struct ct_rule {
+   unsigned char dir;
+   unsigned char proto;
+   unsigned char action;
+   unsigned char pad;
+   unsigned int addr;
+   unsigned int mask;
+   unsigned short port_lo;
+   unsigned short port_hi;
+};
+
+/*
+ * stat_idx:
+ *   per-CPU カウンタ（stats map）の添字。ローダが CPU 分を合算して表示する。
+ */
+enum stat_idx {
+   STAT_HIT = 0,         /* 既存エントリに一致した（ESTABLISHED の速い経路を含む） */
+   STAT_NEW,             /* ルールで許可されて新しいエントリを作った */
+   STAT_DENY,            /* 新規フローがルール / 既定 action で拒否された */
+   STAT_INVALID,         /* TCP の状態に合わないパケット（エントリの無い ACK、SYN_SENT 中の不正な応答など） */
+   STAT_EXPIRED,         /* timer がタイムアウトでエントリを消した */
+   STAT_UNTRACKED,       /* TCP/UDP 以外（ARP, ICMP など）でそのまま通した */
+   STAT_CREATE_FAIL,     /* エントリの作成や timer の初期化に失敗した */
+   NR_STATS,
+};
+
+#endif /* CONNTRACK_H */
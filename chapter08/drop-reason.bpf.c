@@ -0,0 +1,263 @@
+/*
+ * drop-reason.bpf.c（tp_btf/kfree_skb によるドロップ理由の集計とサンプリング）
+ *
+ * 目的:
+ *   network.bpf.c の tc_drop / tc_drop_ping が落としたパケットや、カーネル自身が落としたパケットは
+ *   これまで printk（trace_pipe）でしか分からなかった。
+ *   kfree_skb tracepoint は “理由付きで捨てられた skb” ごとに呼ばれるので、
+ *   (理由, プロトコル, インタフェース, 呼び出し元) ごとに数え、一部のパケットは中身も送る。
+ *   集計はユーザ空間から読みに来させず、bpf_timer の flusher が増えた分だけを ring buffer で押し出す。
+ *
+ * 流れ:
+ *
+ *   kfree_skb(skb, location, reason)
+ *     │  reason <= SKB_CONSUMED は正常解放なので無視
+ *     v
+ *   drops[{location, reason, ifindex, proto}] += 1   （HASH, アトミック加算）
+ *     │
+ *     ├─ flusher が止まっていれば張る（flush_interval_ns 後に発火）
+ *     ├─ 件数が flush_threshold に達したら、すぐ発火させる
+ *     └─ sample_rate 回に 1 回（乱数）: ネットワークヘッダから SAMPLE_BYTES を samples へ
+ *
+ *   flush_timer（bpf_timer のコールバック）
+ *     │  bpf_for_each_map_elem(drops):
+ *     │     件数 n が 0 の key（前回から増えていない）は飛ばす
+ *     │     summaries に ROW{key, n} を積み、drops[key] から n を引く
+ *     │     （読んでから引くまでに増えた分は残り、次の flush に回る）
+ *     v
+ *   1 行でも積んだら END{経過 ns} を積んでユーザ空間を起こし、次の間隔で張り直す。
+ *   何も無ければ張り直さない（次のドロップが張る）ので、ドロップが無い間はタイマも syscall も起きない。
+ *
+ * パラメータ（.rodata / ローダが load 前に設定）:
+ *   sample_rate       : 0 ならサンプルを送らない。N なら平均して N 回に 1 回
+ *   flush_interval_ns : flush の間隔
+ *   flush_threshold   : 1 つの key が 1 間隔でこの件数に達したら間隔を待たずに flush（0 = 使わない）
+ *
+ * 注意:
+ *   - kfree_skb の第 3 引数（reason）は 5.17+。6.11+ では第 4 引数に rx_sk が増えているが使わない。
+ *   - 正常に消費された skb は consume_skb 側の tracepoint なのでここには来ない
+ *     （新しいカーネルで reason = SKB_CONSUMED が来ても上で弾く）。
+ *   - タイマのコールバックは 1 つの CPU で走り、bpf_for_each_map_elem は per-CPU map だと
+ *     その CPU の値しか見えない。そのため drops は per-CPU ではなく共有の HASH にして
+ *     アトミックに足す（同じ key に複数 CPU から大量に落ちる場合はキャッシュラインの取り合いになる）。
+ *   - ring buffer が一杯で積めなかった key は引かずに残し、summary_full に数える（次の flush で送る）。
+ *     1 行も積めなかったときもタイマは張り直す。END 1 件分の空きは常に残すので END は欠けない。
+ *   - 一度も増えなくなった key も map に残る（max_entries まで）。walk は 0 の key を読み飛ばすだけ。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "drop-reason.h"
+
+#define CLOCK_MONOTONIC 1
+
+const volatile u32 sample_rate = 64;
+const volatile u64 flush_interval_ns = 1000000000ULL;
+const volatile u64 flush_threshold = 0;
+
+/* ring buffer が一杯で送れなかった回数（その key は次の flush に持ち越し） */
+u64 summary_full = 0;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 4096);
+    __type(key, struct drop_key);
+    __type(value, u64);
+} drops SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} samples SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} summaries SEC(".maps");
+
+/*
+ * struct flusher:
+ *   armed   : タイマが張られている（または flush 中）なら 1。0 → 1 にした者だけがタイマを張る
+ *   last_ns : 前回の flush（または止まっていた flusher を張った）時刻。END の経過時間に使う
+ */
+struct flusher {
+    struct bpf_timer timer;
+    u64 last_ns;
+    u32 armed;
+    u32 pad;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct flusher);
+} flusher SEC(".maps");
+
+struct flush_ctx {
+    u64 rows;
+    bool deferred;   /* 積み切れずに残した key がある（行が 0 でも張り直す） */
+};
+
+/* ring buffer 上の 1 レコードの大きさ（8 バイトのヘッダ込み、8 バイト境界） */
+#define SUMMARY_REC_SZ  ((sizeof(struct drop_summary) + BPF_RINGBUF_HDR_SZ + 7) & ~7UL)
+
+static long flush_one(struct bpf_map *map, struct drop_key *key, u64 *cnt,
+                      struct flush_ctx *ctx)
+{
+    struct drop_summary *s;
+    u64 n = *(volatile u64 *)cnt;
+
+    if (!n)
+        return 0;   /* 前回から増えていない */
+
+    /*
+     * END 1 件分の空きは必ず残す（ROW だけ送って END が欠けると、ユーザ空間が 2 回分の flush を
+     * 1 つの表にまとめ、経過時間も取り違える）。summaries に積むのはこのタイマだけなので、
+     * ここで空きを確かめれば END の reserve は失敗しない。
+     */
+    if (bpf_ringbuf_query(&summaries, BPF_RB_RING_SIZE) -
+        bpf_ringbuf_query(&summaries, BPF_RB_AVAIL_DATA) < 2 * SUMMARY_REC_SZ)
+        s = NULL;
+    else
+        s = bpf_ringbuf_reserve(&summaries, sizeof(*s), 0);
+    if (!s) {
+        __sync_fetch_and_add(&summary_full, 1);
+        ctx->deferred = true;
+        return 1;   /* 一杯: 残りは次の flush で */
+    }
+    s->kind = SUMMARY_ROW;
+    s->pad = 0;
+    s->count = n;
+    s->key = *key;
+    bpf_ringbuf_submit(s, BPF_RB_NO_WAKEUP);
+
+    /* 0 を書くと読んでから今までに増えた分が消えるので、送った分だけ引く */
+    __sync_fetch_and_sub(cnt, n);
+    ctx->rows++;
+    return 0;
+}
+
+static int flush_timer(void *map, u32 *key, struct flusher *f)
+{
+    struct flush_ctx ctx = {};
+    struct drop_summary *s;
+    u64 now;
+
+    /* walk の最中・後に来たドロップが自分で張り直せるよう、先に下ろしておく */
+    f->armed = 0;
+    bpf_for_each_map_elem(&drops, flush_one, &ctx, 0);
+    if (!ctx.rows) {
+        /* 何も無かったなら張り直さない。一杯で 1 行も積めなかったときは次の間隔でやり直す */
+        if (ctx.deferred && !__sync_val_compare_and_swap(&f->armed, 0, 1))
+            bpf_timer_start(&f->timer, flush_interval_ns, 0);
+        return 0;
+    }
+
+    now = bpf_ktime_get_ns();
+    s = bpf_ringbuf_reserve(&summaries, sizeof(*s), 0);
+    if (s) {
+        __builtin_memset(s, 0, sizeof(*s));
+        s->kind = SUMMARY_END;
+        s->count = now - f->last_ns;
+        bpf_ringbuf_submit(s, BPF_RB_FORCE_WAKEUP);
+    } else {
+        __sync_fetch_and_add(&summary_full, 1);
+    }
+    f->last_ns = now;
+
+    if (!__sync_val_compare_and_swap(&f->armed, 0, 1))
+        bpf_timer_start(&f->timer, flush_interval_ns, 0);
+    return 0;
+}
+
+/* 止まっていれば flusher を張る。now ならすぐ発火させる（しきい値に達した） */
+static __always_inline void kick_flusher(bool now)
+{
+    u32 zero = 0;
+    struct flusher *f = bpf_map_lookup_elem(&flusher, &zero);
+
+    if (!f)
+        return;
+
+    if (*(volatile u32 *)&f->armed || __sync_val_compare_and_swap(&f->armed, 0, 1)) {
+        /* もう張られている（ふつうはここで終わる） */
+        if (now)
+            bpf_timer_start(&f->timer, 0, 0);
+        return;
+    }
+
+    f->last_ns = bpf_ktime_get_ns();
+    bpf_timer_init(&f->timer, &flusher, CLOCK_MONOTONIC);   /* 2 回目以降は -EBUSY（無視してよい） */
+    bpf_timer_set_callback(&f->timer, flush_timer);
+    bpf_timer_start(&f->timer, now ? 0 : flush_interval_ns, 0);
+}
+
+static __always_inline void send_sample(const struct drop_key *key, struct sk_buff *skb)
+{
+    struct drop_sample *s;
+    unsigned char *head = BPF_CORE_READ(skb, head);
+    u16 nh = BPF_CORE_READ(skb, network_header);
+    u32 len = BPF_CORE_READ(skb, len);
+    u32 tail = BPF_CORE_READ(skb, tail);   /* 64 bit では head からのオフセット */
+    u32 off, n;
+
+    s = bpf_ringbuf_reserve(&samples, sizeof(*s), 0);
+    if (!s)
+        return;
+
+    s->key = *key;
+    s->skb_len = len;
+
+    /* network_header が未設定（~0）なら data から */
+    if (nh == (u16)~0U)
+        off = BPF_CORE_READ(skb, data) - head;
+    else
+        off = nh;
+
+    /*
+     * 読めるのは off から tail までの線形部分だけ（skb->len は data からの長さで、
+     * frag も含む）。それを超えて読むと tailroom や隣のメモリに出てしまう。
+     */
+    n = tail > off ? tail - off : 0;
+    if (n > SAMPLE_BYTES)
+        n = SAMPLE_BYTES;
+    s->len = n;
+    if (n && bpf_probe_read_kernel(s->data, n, head + off))
+        s->len = 0;
+    bpf_ringbuf_submit(s, 0);
+}
+
+SEC("tp_btf/kfree_skb")
+int BPF_PROG(on_kfree_skb, struct sk_buff *skb, void *location, enum skb_drop_reason reason)
+{
+    struct drop_key key = {};
+    u64 *cnt, zero = 0, n;
+
+    if (reason <= SKB_CONSUMED)
+        return 0;
+
+    key.location = (u64)location;
+    key.reason = reason;
+    key.ifindex = BPF_CORE_READ(skb, dev, ifindex);
+    key.proto = __builtin_bswap16(BPF_CORE_READ(skb, protocol));
+
+    cnt = bpf_map_lookup_elem(&drops, &key);
+    if (!cnt) {
+        /* 他の CPU が同時に作っても NOEXIST で片方だけが作り、両方が加算する */
+        bpf_map_update_elem(&drops, &key, &zero, BPF_NOEXIST);
+        cnt = bpf_map_lookup_elem(&drops, &key);
+    }
+    if (cnt) {
+        n = __sync_fetch_and_add(cnt, 1) + 1;
+        kick_flusher(flush_threshold && n == flush_threshold);
+    }
+
+    if (sample_rate && bpf_get_prandom_u32() % sample_rate == 0)
+        send_sample(&key, skb);
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
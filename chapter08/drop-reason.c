@@ -0,0 +1,381 @@
+/*
+ * drop-reason.c（ユーザ空間側 / ドロップ理由の間隔ごとの top 表示とサンプルの要約）
+ *
+ * 目的:
+ *   drop-reason.bpf.c を attach し、flusher（bpf_timer）が押し出してくる「前回の flush から増えたドロップ」を
+ *   (理由, プロトコル, インタフェース, 呼び出し元シンボル) の多い順に表示する。
+ *   サンプルとして届いたパケットは IPv4/IPv6 ヘッダを要約して表示する。
+ *
+ *   map を読みに行くことはせず、2 つの ring buffer を待つだけ（summaries の END で 1 回起こされる）。
+ *   ドロップが無い間は BPF 側のタイマも止まるので、このプロセスは epoll で眠ったまま何もしない。
+ *
+ * 使い方:
+ *   sudo ./drop-reason [-n top_n] [-s sample_rate] [-i interval_ms] [-t threshold]
+ *
+ *   -n <n>  1 回の flush で表示する行数（既定 10）
+ *   -s <n>  N 回に 1 回サンプルを送る（既定 64。0 で無効）
+ *   -i <ms> flush の間隔（既定 1000）
+ *   -t <n>  1 つの key がこの件数に達したら間隔を待たずに flush（既定 0 = 使わない）
+ *
+ * 既知の理由を起こして確かめる（drop-test.sh）:
+ *   sudo ./netns.sh pair
+ *   sudo ./drop-reason &
+ *   sudo ./drop-test.sh          # NO_SOCKET / NETFILTER_DROP / TC_INGRESS などが出る
+ *
+ * 名前の解決:
+ *   - reason : vmlinux BTF の enum skb_drop_reason から（カーネルごとに番号が違うので固定表は持たない）
+ *   - location : /proc/kallsyms を読み込んで二分探索（root でないとアドレスが 0 になる）
+ *   - ifindex : このプロセスの netns で if_indextoname（引けなければ if<N>）
+ *
+ * 注意:
+ *   - bpf_timer を tp_btf から使うので 5.15+（kfree_skb の reason のために 5.17+ は元から必要）。
+ *   - drops/s は END の経過時間（前回の flush から）で割る。-t で早めに flush した回は間隔が短い。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include <bpf/btf.h>
+
+#include "drop-reason.h"
+#include "drop-reason.skel.h"
+
+#define MAX_ROWS    4096
+#define MAX_REASONS 512
+#define MAX_SAMPLES_PER_FLUSH 5
+
+struct ksym {
+    unsigned long long addr;
+    char name[64];
+};
+
+struct row {
+    struct drop_key key;
+    unsigned long long delta;
+};
+
+static volatile sig_atomic_t exiting = 0;
+static char *reason_names[MAX_REASONS];
+static struct ksym *ksyms;
+static int nr_ksyms;
+static int samples_shown;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* enum skb_drop_reason の値 → 名前（SKB_DROP_REASON_ は省く） */
+static void load_reason_names(void)
+{
+    struct btf *btf = btf__load_vmlinux_btf();
+    const struct btf_type *t;
+    const struct btf_enum *e;
+    int id;
+
+    if (!btf)
+        return;
+    id = btf__find_by_name_kind(btf, "skb_drop_reason", BTF_KIND_ENUM);
+    if (id < 0)
+        goto out;
+
+    t = btf__type_by_id(btf, id);
+    e = btf_enum(t);
+    for (int i = 0; i < btf_vlen(t); i++, e++) {
+        const char *name = btf__name_by_offset(btf, e->name_off);
+
+        if (e->val < 0 || e->val >= MAX_REASONS || !name)
+            continue;
+        if (!strncmp(name, "SKB_DROP_REASON_", 16))
+            name += 16;
+        reason_names[e->val] = strdup(name);
+    }
+out:
+    btf__free(btf);
+}
+
+static const char *reason_name(unsigned int reason, char *buf, size_t len)
+{
+    if (reason < MAX_REASONS && reason_names[reason])
+        return reason_names[reason];
+    snprintf(buf, len, "reason%u", reason);
+    return buf;
+}
+
+static int cmp_ksym(const void *a, const void *b)
+{
+    const struct ksym *x = a, *y = b;
+
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static void load_ksyms(void)
+{
+    FILE *f = fopen("/proc/kallsyms", "r");
+    char line[256], type;
+    unsigned long long addr;
+    char name[128];
+    int cap = 0;
+
+    if (!f)
+        return;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%llx %c %127s", &addr, &type, name) != 3 || !addr)
+            continue;
+        if (type != 't' && type != 'T')
+            continue;
+        if (nr_ksyms == cap) {
+            struct ksym *tmp;
+
+            cap = cap ? cap * 2 : 65536;
+            tmp = realloc(ksyms, cap * sizeof(*ksyms));
+            if (!tmp)
+                break;
+            ksyms = tmp;
+        }
+        ksyms[nr_ksyms].addr = addr;
+        snprintf(ksyms[nr_ksyms].name, sizeof(ksyms[0].name), "%s", name);
+        nr_ksyms++;
+    }
+    fclose(f);
+    qsort(ksyms, nr_ksyms, sizeof(*ksyms), cmp_ksym);
+}
+
+static const char *ksym_name(unsigned long long addr, char *buf, size_t len)
+{
+    int lo = 0, hi = nr_ksyms - 1, found = -1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (ksyms[mid].addr <= addr) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (found < 0)
+        snprintf(buf, len, "0x%llx", addr);
+    else
+        snprintf(buf, len, "%s+0x%llx", ksyms[found].name, addr - ksyms[found].addr);
+    return buf;
+}
+
+static const char *if_name(unsigned int ifindex, char *buf)
+{
+    if (!ifindex)
+        return "-";
+    if (!if_indextoname(ifindex, buf))
+        snprintf(buf, IF_NAMESIZE, "if%u", ifindex);
+    return buf;
+}
+
+/* サンプルの L3/L4 ヘッダを 1 行に要約する */
+static int handle_sample(void *ctx, void *data, size_t size)
+{
+    const struct drop_sample *s = data;
+    const unsigned char *p = s->data;
+    char rbuf[32], ifbuf[IF_NAMESIZE], src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+    unsigned int l4 = 0, proto = 0;
+
+    (void)ctx;
+    if (size < sizeof(*s) || samples_shown >= MAX_SAMPLES_PER_FLUSH)
+        return 0;
+    samples_shown++;
+
+    printf("  sample: %-24s dev=%-8s len=%-5u ",
+           reason_name(s->key.reason, rbuf, sizeof(rbuf)),
+           if_name(s->key.ifindex, ifbuf), s->skb_len);
+
+    if (s->key.proto == 0x0800 && s->len >= 20 && (p[0] >> 4) == 4) {
+        inet_ntop(AF_INET, p + 12, src, sizeof(src));
+        inet_ntop(AF_INET, p + 16, dst, sizeof(dst));
+        proto = p[9];
+        l4 = (p[0] & 0xf) * 4;
+    } else if (s->key.proto == 0x86DD && s->len >= 40 && (p[0] >> 4) == 6) {
+        inet_ntop(AF_INET6, p + 8, src, sizeof(src));
+        inet_ntop(AF_INET6, p + 24, dst, sizeof(dst));
+        proto = p[6];
+        l4 = 40;
+    } else {
+        printf("proto=0x%04x\n", s->key.proto);
+        return 0;
+    }
+
+    if ((proto == 6 || proto == 17) && l4 + 4 <= s->len)
+        printf("%s %s:%u -> %s:%u\n", proto == 6 ? "tcp" : "udp",
+               src, (p[l4] << 8) | p[l4 + 1], dst, (p[l4 + 2] << 8) | p[l4 + 3]);
+    else
+        printf("proto=%u %s -> %s\n", proto, src, dst);
+    return 0;
+}
+
+/* 1 回の flush 分の ROW をためておき、END が来たら増分の多い順に表示する */
+static struct row rows[MAX_ROWS];
+static int nr_rows, top_n = 10;
+
+static int cmp_delta(const void *a, const void *b)
+{
+    const struct row *x = a, *y = b;
+
+    return x->delta < y->delta ? 1 : x->delta > y->delta ? -1 : 0;
+}
+
+static void print_top(unsigned long long elapsed_ns)
+{
+    char rbuf[32], ifbuf[IF_NAMESIZE], sbuf[128];
+    double secs = elapsed_ns ? elapsed_ns / 1e9 : 1.0;
+
+    qsort(rows, nr_rows, sizeof(rows[0]), cmp_delta);
+
+    printf("\n%-8s %-24s %-6s %-8s %s\n", "drops/s", "reason", "proto", "dev", "location");
+    for (int i = 0; i < nr_rows && i < top_n; i++) {
+        printf("%-8.0f %-24s 0x%04x %-8s %s\n",
+               rows[i].delta / secs, reason_name(rows[i].key.reason, rbuf, sizeof(rbuf)),
+               rows[i].key.proto, if_name(rows[i].key.ifindex, ifbuf),
+               ksym_name(rows[i].key.location, sbuf, sizeof(sbuf)));
+    }
+}
+
+static int handle_summary(void *ctx, void *data, size_t size)
+{
+    const struct drop_summary *s = data;
+
+    (void)ctx;
+    if (size < sizeof(*s))
+        return 0;
+
+    if (s->kind == SUMMARY_END) {
+        print_top(s->count);
+        nr_rows = 0;
+        samples_shown = 0;
+        return 0;
+    }
+    if (nr_rows < MAX_ROWS) {
+        rows[nr_rows].key = s->key;
+        rows[nr_rows].delta = s->count;
+        nr_rows++;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct drop_reason_bpf *skel = NULL;
+    struct ring_buffer *rb = NULL;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    skel = drop_reason_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    while ((opt = getopt(argc, argv, "n:s:i:t:")) != -1) {
+        switch (opt) {
+        case 'n': top_n = atoi(optarg); break;
+        case 's':
+            skel->rodata->sample_rate = (__u32)strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            skel->rodata->flush_interval_ns = strtoull(optarg, NULL, 0) * 1000000ULL;
+            break;
+        case 't':
+            skel->rodata->flush_threshold = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n top_n] [-s sample_rate] [-i interval_ms] [-t threshold]\n",
+                    argv[0]);
+            err = -EINVAL;
+            goto cleanup;
+        }
+    }
+
+    err = drop_reason_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    err = drop_reason_bpf__attach(skel);
+    if (err) {
+        fprintf(stderr, "Failed to attach BPF programs (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    if (!skel->rodata->flush_interval_ns) {
+        fprintf(stderr, "interval must be > 0\n");
+        err = -EINVAL;
+        goto cleanup;
+    }
+
+    rb = ring_buffer__new(bpf_map__fd(skel->maps.summaries), handle_summary, NULL, NULL);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create ring buffer: %d\n", err);
+        goto cleanup;
+    }
+    err = ring_buffer__add(rb, bpf_map__fd(skel->maps.samples), handle_sample, NULL);
+    if (err) {
+        fprintf(stderr, "Failed to add samples ring buffer: %d\n", err);
+        goto cleanup;
+    }
+
+    load_reason_names();
+    load_ksyms();
+    printf("Tracing kfree_skb drops (sample 1/%u). Ctrl-C to stop.\n",
+           skel->rodata->sample_rate);
+
+    /* 起こされるまで眠る（タイムアウト無し）。Ctrl-C は EINTR で抜ける */
+    while (!exiting) {
+        err = ring_buffer__poll(rb, -1);
+        if (err == -EINTR) {
+            err = 0;
+            continue;
+        }
+        if (err < 0) {
+            fprintf(stderr, "Error polling ring buffer: %d\n", err);
+            break;
+        }
+        err = 0;
+    }
+    if (skel->bss->summary_full)
+        fprintf(stderr, "summaries ring buffer was full %llu times (rows deferred)\n",
+                (unsigned long long)skel->bss->summary_full);
+
+cleanup:
+    ring_buffer__free(rb);
+    drop_reason_bpf__destroy(skel);
+    free(ksyms);
+    for (int i = 0; i < MAX_REASONS; i++)
+        free(reason_names[i]);
+    return err < 0 ? -err : 0;
+}
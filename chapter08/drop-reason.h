@@ -0,0 +1,62 @@
+#ifndef DROP_REASON_H
+#define DROP_REASON_H
+
+/*
+ * drop-reason.h（kfree_skb のドロップ理由集計の共有定義）
+ */
+
+#define SAMPLE_BYTES 128   /* サンプルとして送るパケット先頭のバイト数 */
+
+/*
+ * struct drop_key:
+ *   drops map（HASH, value = 前回の flush からの件数）の key。
+ *
+ *   location : kfree_skb_reason を呼んだカーネル内のアドレス（ローダが /proc/kallsyms でシンボルに直す）
+ *   reason   : enum skb_drop_reason（名前はローダが vmlinux BTF から引く）
+ *   ifindex  : skb->dev の ifindex（デバイスが無ければ 0）
+ *   proto    : skb->protocol（ホストバイトオーダ。0x0800 = IPv4 など）
+ */
+struct drop_key {
+   unsigned long long location;
+   unsigned int reason;
+   unsigned int ifindex;
+   unsigned short proto;
+   unsigned char pad[6];
+};
+
+/*
+ * struct drop_sample:
+ *   サンプリングしたドロップの ring buffer レコード。
+ *   data はネットワークヘッダ（あれば）から最大 SAMPLE_BYTES バイト、len はそのうち有効な長さ
+ *   （skb の線形部分、つまり tail までに収まる分だけ。frag の中身は入らない）。
+ */
+struct drop_sample {
+   struct drop_key key;
+   unsigned int skb_len;
+   unsigned int len;
+   unsigned char data[SAMPLE_BYTES];
+};
+
+/*
+ * struct drop_summary:
+ *   flusher（bpf_timer）が summaries ring buffer に積むレコード。
+ *
+ *   SUMMARY_ROW : 前回の flush から増えた key 1 つ分。count = 件数
+ *   SUMMARY_END : 1 回の flush の終わり。count = 前回の flush からの経過 ns（key は使わない）
+ *
+ *   ROW は起こさずに積み（BPF_RB_NO_WAKEUP）、END で 1 回だけユーザ空間を起こす。
+ *   何も増えていない間は何も積まれず、flusher 自体も止まる。
+ */
+enum summary_kind {
+   SUMMARY_ROW = 0,
+   SUMMARY_END,
+};
+
+struct drop_summary {
+   unsigned int kind;
+   unsigned int pad;
+   unsigned long long count;
+   struct drop_key key;
+};
+
+#endif /* DROP_REASON_H */
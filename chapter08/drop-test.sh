@@ -0,0 +1,59 @@
+#!/bin/bash
+# -----------------------------------------------------------------------------
+# drop-test.sh（既知のドロップ理由を netns 内で意図的に起こす）
+#
+# 目的:
+#   drop-reason が正しい理由・インタフェース・呼び出し元を出しているかを、
+#   理由の分かっているドロップを起こして確かめる。
+#
+# 前提:
+#   ./netns.sh pair 済み（ns1 veth1 10.0.0.1 <-> ns2 veth2 10.0.0.2）
+#   tcp-bulk / udp-ping がビルド済み
+#
+# 使い方（root で実行, drop-reason を別端末で動かしておく）:
+#   ./drop-test.sh
+#
+# 起こすドロップ（カーネルのバージョンによって理由名は多少変わる）:
+#   1. 閉じたポートへの UDP          → NO_SOCKET（udp_rcv 系）
+#   2. 閉じたポートへの TCP connect  → NO_SOCKET（tcp_v4_rcv 系）
+#   3. nft で ICMP を落とす          → NETFILTER_DROP（nft が無ければ飛ばす）
+#   4. tc ingress の drop action      → TC_INGRESS
+# -----------------------------------------------------------------------------
+
+set -e
+cd "$(dirname "$0")"
+
+NS1=ns1
+NS2=ns2
+PEER=10.0.0.2
+
+step() {
+    echo "==> $*"
+}
+
+step "UDP to closed port (expect NO_SOCKET)"
+ip netns exec $NS1 ./udp-ping client $PEER -p 9 -d 1 -i 1000 >/dev/null || true
+
+step "TCP connect to closed port (expect NO_SOCKET)"
+for _ in $(seq 1 20); do
+    ip netns exec $NS1 ./tcp-bulk client $PEER -p 9 -d 1 >/dev/null 2>&1 || true
+done
+
+if command -v nft >/dev/null 2>&1; then
+    step "ICMP dropped by nftables (expect NETFILTER_DROP)"
+    ip netns exec $NS2 nft add table inet droptest
+    ip netns exec $NS2 nft add chain inet droptest input '{ type filter hook input priority 0; }'
+    ip netns exec $NS2 nft add rule inet droptest input ip protocol icmp drop
+    ip netns exec $NS1 ping -c 20 -i 0.05 -W 1 $PEER >/dev/null 2>&1 || true
+    ip netns exec $NS2 nft delete table inet droptest
+else
+    step "nft not found; skipping NETFILTER_DROP"
+fi
+
+step "tc ingress drop action (expect TC_INGRESS)"
+tc -n $NS2 qdisc add dev veth2 clsact
+tc -n $NS2 filter add dev veth2 ingress protocol ip matchall action drop
+ip netns exec $NS1 ping -c 20 -i 0.05 -W 1 $PEER >/dev/null 2>&1 || true
+tc -n $NS2 qdisc del dev veth2 clsact
+
+step "done"
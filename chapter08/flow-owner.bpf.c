@@ -0,0 +1,180 @@
+/*
+ * flow-owner.bpf.c（socket cookie でフロー統計にプロセス情報を付ける）
+ *
+ * 目的:
+ *   XDP / TC のカウンタはパケットしか見えないので、「どのプロセスの通信か」を出すには
+ *   ユーザ空間で /proc/net/tcp や /proc/<pid>/fd と突き合わせる必要があった。
+ *   socket cookie（ソケットごとに一意な 64bit 値）を共通キーにして、
+ *   ソケット作成/接続時にプロセス情報を記録し、TC 側でそれを引いてフローに付ける。
+ *
+ * 流れ:
+ *
+ *   socket()  ──> cgroup/sock_create   owners[cookie] = {tgid, uid, cgid, comm}
+ *   connect() ──> cgroup/connect4/6    owners[cookie] を上書き（fork 後の connect にも追従）
+ *   close()   ──> cgroup/sock_release  owners[cookie] を消す
+ *
+ *   送信 skb ──> tc egress
+ *                  cookie = bpf_get_socket_cookie(skb)
+ *                  flows[{cookie, 5-tuple}] が無ければ owners[cookie] をコピーして作る
+ *                  bytes/packets/last_ns を加算
+ *
+ * 注意:
+ *   - TC ingress の時点では skb にソケットが結びついていない（cookie = 0）ので、ここでは egress だけを見る。
+ *   - accept() で生まれたソケットは sock_create を通らないので owners に載らない
+ *     （そのフローは owner.tgid = 0 のまま数える）。
+ *   - cgroup 系のプログラムは attach した cgroup の子孫すべてに効く。ルート cgroup に attach すればホスト全体。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "flow-owner.h"
+
+#define TC_ACT_OK  0
+#define ETH_P_IP   0x0800
+#define ETH_P_IPV6 0x86DD
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 65536);
+    __type(key, u64);
+    __type(value, struct owner);
+} owners SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 65536);
+    __type(key, struct flow_key);
+    __type(value, struct flow_val);
+} flows SEC(".maps");
+
+static __always_inline void fill_owner(struct owner *o)
+{
+    u64 pid_tgid = bpf_get_current_pid_tgid();
+
+    o->tgid = pid_tgid >> 32;
+    o->uid = (u32)bpf_get_current_uid_gid();
+    o->cgid = bpf_get_current_cgroup_id();
+    bpf_get_current_comm(o->comm, sizeof(o->comm));
+}
+
+SEC("cgroup/sock_create")
+int owner_create(struct bpf_sock *sk)
+{
+    struct owner o = {};
+    u64 cookie = bpf_get_socket_cookie(sk);
+
+    fill_owner(&o);
+    bpf_map_update_elem(&owners, &cookie, &o, BPF_ANY);
+    return 1;
+}
+
+static __always_inline int record_connect(struct bpf_sock_addr *ctx)
+{
+    struct owner o = {};
+    u64 cookie = bpf_get_socket_cookie(ctx);
+
+    fill_owner(&o);
+    bpf_map_update_elem(&owners, &cookie, &o, BPF_ANY);
+    return 1;
+}
+
+SEC("cgroup/connect4")
+int owner_connect4(struct bpf_sock_addr *ctx)
+{
+    return record_connect(ctx);
+}
+
+SEC("cgroup/connect6")
+int owner_connect6(struct bpf_sock_addr *ctx)
+{
+    return record_connect(ctx);
+}
+
+SEC("cgroup/sock_release")
+int owner_release(struct bpf_sock *sk)
+{
+    u64 cookie = bpf_get_socket_cookie(sk);
+
+    bpf_map_delete_elem(&owners, &cookie);
+    return 1;
+}
+
+/* L3/L4 ヘッダから 5-tuple を取り出す（TCP/UDP 以外や短いパケットは -1） */
+static __always_inline int parse_tuple(struct __sk_buff *skb, struct flow_key *key)
+{
+    void *data = (void *)(long)skb->data;
+    void *data_end = (void *)(long)skb->data_end;
+    struct ethhdr *eth = data;
+    void *l4;
+
+    if ((void *)(eth + 1) > data_end)
+        return -1;
+
+    if (eth->h_proto == bpf_htons(ETH_P_IP)) {
+        struct iphdr *iph = (void *)(eth + 1);
+
+        if ((void *)(iph + 1) > data_end)
+            return -1;
+        key->family = 4;
+        key->proto = iph->protocol;
+        __builtin_memcpy(key->saddr, &iph->saddr, 4);
+        __builtin_memcpy(key->daddr, &iph->daddr, 4);
+        l4 = (void *)iph + iph->ihl * 4;
+    } else if (eth->h_proto == bpf_htons(ETH_P_IPV6)) {
+        struct ipv6hdr *ip6h = (void *)(eth + 1);
+
+        if ((void *)(ip6h + 1) > data_end)
+            return -1;
+        key->family = 6;
+        key->proto = ip6h->nexthdr;
+        __builtin_memcpy(key->saddr, &ip6h->saddr, 16);
+        __builtin_memcpy(key->daddr, &ip6h->daddr, 16);
+        l4 = (void *)(ip6h + 1);
+    } else {
+        return -1;
+    }
+
+    if (key->proto != IPPROTO_TCP && key->proto != IPPROTO_UDP)
+        return -1;
+
+    /* TCP/UDP とも先頭 4 バイトが sport, dport */
+    if (l4 + 4 > data_end)
+        return -1;
+    key->sport = *(u16 *)l4;
+    key->dport = *(u16 *)(l4 + 2);
+    return 0;
+}
+
+SEC("tc")
+int flow_egress(struct __sk_buff *skb)
+{
+    struct flow_key key = {};
+    struct flow_val *val, init = {};
+    struct owner *o;
+    u64 now = bpf_ktime_get_ns();
+
+    if (parse_tuple(skb, &key))
+        return TC_ACT_OK;
+
+    key.cookie = bpf_get_socket_cookie(skb);
+
+    val = bpf_map_lookup_elem(&flows, &key);
+    if (!val) {
+        o = key.cookie ? bpf_map_lookup_elem(&owners, &key.cookie) : NULL;
+        if (o)
+            init.owner = *o;
+        init.first_ns = now;
+        bpf_map_update_elem(&flows, &key, &init, BPF_NOEXIST);
+        val = bpf_map_lookup_elem(&flows, &key);
+        if (!val)
+            return TC_ACT_OK;
+    }
+
+    __sync_fetch_and_add(&val->bytes, skb->len);
+    __sync_fetch_and_add(&val->packets, 1);
+    val->last_ns = now;
+    return TC_ACT_OK;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
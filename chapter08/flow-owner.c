@@ -0,0 +1,212 @@
+/*
+ * flow-owner.c（ユーザ空間側 / プロセス付きフローレコードの表示）
+ *
+ * 目的:
+ *   flow-owner.bpf.c の cgroup 系プログラム（sock_create / connect4 / connect6 / sock_release）を
+ *   cgroup に、TC プログラムを指定インタフェースの egress に attach し、
+ *   1 秒ごとに「その間に送信があったフロー」をプロセス情報付きで表示する。
+ *   プロセス情報は BPF 側でフローに埋め込まれているので、ここでは map を読むだけ。
+ *
+ * 使い方:
+ *   sudo ./flow-owner -i <ifname> [-c cgroup]
+ *
+ *   -i <ifname>  TC egress を付けるインタフェース（例: eth0, veth1）
+ *   -c <path>    cgroup 系プログラムの attach 先（既定 /sys/fs/cgroup = ホスト全体）
+ *
+ *   例（netns.sh pair の ns1 から送る場合）:
+ *     sudo ./netns.sh pair
+ *     sudo ip netns exec ns1 ./flow-owner -i veth1 &
+ *     sudo ip netns exec ns2 ./tcp-bulk server &
+ *     sudo ip netns exec ns1 ./tcp-bulk client 10.0.0.2 -d 5
+ *
+ * 注意:
+ *   - TC の clsact qdisc は無ければ作り、終了時に作ったものだけ消す。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "flow-owner.h"
+#include "flow-owner.skel.h"
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void format_addr(char *buf, size_t len, int family, const unsigned char *addr,
+                        unsigned short port)
+{
+    char ip[INET6_ADDRSTRLEN];
+
+    inet_ntop(family == 6 ? AF_INET6 : AF_INET, addr, ip, sizeof(ip));
+    snprintf(buf, len, family == 6 ? "[%s]:%u" : "%s:%u", ip, ntohs(port));
+}
+
+/* 前回表示以降に送信があったフローだけを表示する */
+static void print_flows(struct flow_owner_bpf *skel, unsigned long long since)
+{
+    int fd = bpf_map__fd(skel->maps.flows);
+    struct flow_key key, next, *pkey = NULL;
+    struct flow_val val;
+    char src[64], dst[64];
+    int shown = 0;
+
+    printf("%-16s %-8s %-10s %-4s %-26s %-26s %-12s %-8s\n",
+           "comm", "tgid", "cgroup", "prot", "src", "dst", "bytes", "pkts");
+
+    while (!bpf_map_get_next_key(fd, pkey, &next)) {
+        key = next;
+        pkey = &key;
+        if (bpf_map_lookup_elem(fd, &key, &val) || val.last_ns < since)
+            continue;
+
+        format_addr(src, sizeof(src), key.family, key.saddr, key.sport);
+        format_addr(dst, sizeof(dst), key.family, key.daddr, key.dport);
+        printf("%-16.16s %-8u %-10llu %-4s %-26s %-26s %-12llu %-8llu\n",
+               val.owner.tgid ? val.owner.comm : "-", val.owner.tgid, val.owner.cgid,
+               key.proto == 6 ? "tcp" : "udp", src, dst, val.bytes, val.packets);
+        shown++;
+    }
+    if (!shown)
+        printf("(no active flows)\n");
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct flow_owner_bpf *skel = NULL;
+    struct bpf_link *links[4] = {};
+    const char *cgroup = "/sys/fs/cgroup";
+    const char *ifname = NULL;
+    bool hook_created = false;
+    unsigned long long since;
+    int cgfd = -1;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    while ((opt = getopt(argc, argv, "i:c:")) != -1) {
+        switch (opt) {
+        case 'i': ifname = optarg; break;
+        case 'c': cgroup = optarg; break;
+        default: ifname = NULL; optind = argc; break;
+        }
+    }
+    if (!ifname) {
+        fprintf(stderr, "Usage: %s -i <ifname> [-c cgroup]\n", argv[0]);
+        return 1;
+    }
+
+    LIBBPF_OPTS(bpf_tc_hook, hook, .ifindex = if_nametoindex(ifname),
+                .attach_point = BPF_TC_EGRESS);
+    LIBBPF_OPTS(bpf_tc_opts, tc_opts, .handle = 1, .priority = 1);
+
+    if (!hook.ifindex) {
+        fprintf(stderr, "Unknown interface: %s\n", ifname);
+        return 1;
+    }
+
+    skel = flow_owner_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open/load BPF object\n");
+        return 1;
+    }
+
+    cgfd = open(cgroup, O_RDONLY | O_DIRECTORY);
+    if (cgfd < 0) {
+        err = -errno;
+        fprintf(stderr, "Failed to open cgroup %s: %s\n", cgroup, strerror(errno));
+        goto cleanup;
+    }
+
+    links[0] = bpf_program__attach_cgroup(skel->progs.owner_create, cgfd);
+    links[1] = bpf_program__attach_cgroup(skel->progs.owner_connect4, cgfd);
+    links[2] = bpf_program__attach_cgroup(skel->progs.owner_connect6, cgfd);
+    links[3] = bpf_program__attach_cgroup(skel->progs.owner_release, cgfd);
+    for (int i = 0; i < 4; i++) {
+        if (!links[i]) {
+            err = -errno;
+            fprintf(stderr, "Failed to attach cgroup program %d: %d\n", i, err);
+            goto cleanup;
+        }
+    }
+
+    /* clsact が既にあれば -EEXIST。そのときは作っていないので終了時に消さない */
+    err = bpf_tc_hook_create(&hook);
+    if (err && err != -EEXIST) {
+        fprintf(stderr, "Failed to create TC hook on %s: %d\n", ifname, err);
+        goto cleanup;
+    }
+    hook_created = !err;
+
+    tc_opts.prog_fd = bpf_program__fd(skel->progs.flow_egress);
+    err = bpf_tc_attach(&hook, &tc_opts);
+    if (err) {
+        fprintf(stderr, "Failed to attach TC egress on %s: %d\n", ifname, err);
+        goto cleanup;
+    }
+
+    printf("Tracking flows on %s egress, owners from cgroup %s. Ctrl-C to stop.\n",
+           ifname, cgroup);
+
+    since = now_ns();
+    while (!exiting) {
+        sleep(1);
+        print_flows(skel, since);
+        since += 1000000000ULL;
+    }
+
+    tc_opts.flags = tc_opts.prog_fd = tc_opts.prog_id = 0;
+    bpf_tc_detach(&hook, &tc_opts);
+
+cleanup:
+    if (hook_created) {
+        hook.attach_point = BPF_TC_INGRESS | BPF_TC_EGRESS;
+        bpf_tc_hook_destroy(&hook);
+    }
+    for (int i = 3; i >= 0; i--)
+        bpf_link__destroy(links[i]);
+    if (cgfd >= 0)
+        close(cgfd);
+    flow_owner_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef FLOW_OWNER_H
+#define FLOW_OWNER_H
+
+/*
+ * flow-owner.h（ソケット所有者の記録と、それを付けたフロー統計の共有定義）
+ */
+
+#define TASK_COMM_LEN 16
+
+/*
+ * struct owner:
+ *   owners map（key = socket cookie）の value。
+ *   cgroup/sock_create（ソケット作成時）と cgroup/connect4/6（connect 時）に書く。
+ *   fork 後に子が connect した場合などは connect 時の値で上書きされる。
+ */
+struct owner {
+   unsigned int tgid;
+   unsigned int uid;
+   unsigned long long cgid;
+   char comm[TASK_COMM_LEN];
+};
+
+/*
+ * struct flow_key:
+ *   flows map の key。socket cookie + 5-tuple（アドレスは IPv4 なら先頭 4 バイトだけ使う）。
+ *   ポートはネットワークバイトオーダのまま。
+ */
+struct flow_key {
+   unsigned long long cookie;
+   unsigned char saddr[16];
+   unsigned char daddr[16];
+   unsigned short sport;
+   unsigned short dport;
+   unsigned char proto;
+   unsigned char family;
+   unsigned char pad[2];
+};
+
+/*
+ * struct flow_val:
+ *   flows map の value。フロー作成時に owners から所有者をコピーしておくので、
+ *   読み出す側は /proc/net/tcp 等と突き合わせずにそのままプロセス付きのレコードとして出せる。
+ */
+struct flow_val {
+   struct owner owner;
+   unsigned long long bytes;
+   unsigned long long packets;
+   unsigned long long first_ns;
+   unsigned long long last_ns;
+};
+
+#endif /* FLOW_OWNER_H */
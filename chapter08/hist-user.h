@@ -0,0 +1,355 @@
+#ifndef HIST_USER_H
+#define HIST_USER_H
+
+/*
+ * hist-user.h（ユーザ空間側のヒストグラム: 読み出し / CPU の合算 / 区間の差分 / 表示）
+ *
+ * 目的:
+ *   hist.bpf.h の HIST_MAP（PERCPU_HASH, key = 任意の struct, value = u64[nr_slots]）を読み、
+ *   key ごとに CPU を合算したスナップショットを作る。2 つのスナップショットの差をとれば
+ *   「この間隔に起きた分」だけのヒストグラムになる。バケットの意味は struct hist_layout で渡す
+ *   （BPF 側で使った hist_add_* と同じ種類・パラメータにする）。
+ *
+ * 使い方:
+ *
+ *   struct hist_layout l = { .kind = HIST_LOG2, .nr_slots = 32, .unit = "ns" };
+ *   struct hist_snapshot prev = {}, cur, delta;
+ *
+ *   hist_snapshot_read(fd, sizeof(struct lat_key), l.nr_slots, &cur);
+ *   hist_snapshot_diff(&cur, &prev, &delta);           // prev が空なら cur の複製
+ *   for (size_t i = 0; i < delta.nr; i++) {
+ *       const struct lat_key *k = hist_snapshot_key(&delta, i);
+ *       hist_print(&l, hist_snapshot_slots(&delta, i));
+ *       hist_print_percentiles(&l, hist_snapshot_slots(&delta, i));
+ *   }
+ *   hist_snapshot_free(&prev); hist_snapshot_free(&delta);
+ *   prev = cur;
+ *
+ *   ユーザ空間で数える場合（BPF を使わないツール）は hist_slot() で番号を出し、
+ *   自分の配列に数えて同じ hist_print() で描ける。
+ *
+ * 注意:
+ *   - 読み出しは get_next_key + lookup なので、読んでいる間に増えた分はそのスナップショットに
+ *     入ったり入らなかったりする（次の差分で拾われるので、区間の合計はずれない）。
+ *   - key が消されて作り直された場合、差分が負になるバケットは 0 にする。
+ *   - パーセンタイルはバケット内を一様とみなした線形補間。誤差はバケット幅まで
+ *     （log2 なら最大 2 倍。精度が要るなら HIST_LOG_LINEAR を使う）。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "hist.h"
+#include "percpu-read.h"
+
+struct hist_layout {
+    enum hist_kind kind;
+    unsigned int nr_slots;
+    unsigned int sub_bits;       /* HIST_LOG_LINEAR */
+    unsigned long long min;      /* HIST_LINEAR */
+    unsigned long long step;     /* HIST_LINEAR */
+    const char *unit;            /* 表示用（"ns" / "bytes" ...） */
+};
+
+/*
+ * struct hist_snapshot:
+ *   ある時点の map の中身（CPU は合算済み）。i 番目の key と slots は
+ *   keys[i * key_size] / slots[i * nr_slots] にある。
+ */
+struct hist_snapshot {
+    size_t nr;
+    size_t cap;
+    size_t key_size;
+    unsigned int nr_slots;
+    unsigned char *keys;
+    unsigned long long *slots;
+};
+
+static inline unsigned int hist_slot(const struct hist_layout *l, unsigned long long v)
+{
+    switch (l->kind) {
+    case HIST_LOG_LINEAR:
+        return hist_log_linear_slot(v, l->sub_bits, l->nr_slots);
+    case HIST_LINEAR:
+        return hist_linear_slot(v, l->min, l->step, l->nr_slots);
+    default:
+        return hist_log2_slot(v, l->nr_slots);
+    }
+}
+
+/* slot 番目のバケットに入る値の範囲 [lo, hi]。最後のバケットは頭打ち分も含むので hi = ~0 */
+static inline void hist_bucket_range(const struct hist_layout *l, unsigned int i,
+                                     unsigned long long *lo, unsigned long long *hi)
+{
+    unsigned int shift;
+
+    switch (l->kind) {
+    case HIST_LOG_LINEAR:
+        if (i < (1U << l->sub_bits)) {
+            *lo = *hi = i;
+            break;
+        }
+        shift = (i >> l->sub_bits) - 1;
+        if (shift + l->sub_bits >= 64) {
+            *lo = *hi = ~0ULL;
+            break;
+        }
+        *lo = ((1ULL << l->sub_bits) + (i & ((1U << l->sub_bits) - 1))) << shift;
+        *hi = *lo + (1ULL << shift) - 1;
+        break;
+    case HIST_LINEAR:
+        *lo = i ? l->min + i * l->step : 0;
+        *hi = l->min + (i + 1) * l->step - 1;
+        break;
+    default:
+        *lo = i ? 1ULL << i : 0;
+        *hi = i >= 63 ? ~0ULL : (1ULL << (i + 1)) - 1;
+        break;
+    }
+    if (i == l->nr_slots - 1)
+        *hi = ~0ULL;
+}
+
+static inline unsigned long long hist_total(const unsigned long long *slots, unsigned int nr)
+{
+    unsigned long long total = 0;
+
+    for (unsigned int i = 0; i < nr; i++)
+        total += slots[i];
+    return total;
+}
+
+/* per-CPU の value（CPU 数 x u64[nr_slots]）を 1 本に足し込む（percpu-read.h の SIMD 合算） */
+static inline void hist_sum_cpus(const unsigned long long *percpu, int nr_cpus,
+                                 unsigned int nr_slots, unsigned long long *out)
+{
+    static enum percpu_impl impl = PERCPU_AUTO;
+
+    if (impl == PERCPU_AUTO)
+        impl = percpu_impl_select(PERCPU_AUTO);
+    percpu_reduce(impl, percpu, nr_cpus, nr_slots, out);
+}
+
+static inline void hist_snapshot_free(struct hist_snapshot *s)
+{
+    free(s->keys);
+    free(s->slots);
+    memset(s, 0, sizeof(*s));
+}
+
+static inline const void *hist_snapshot_key(const struct hist_snapshot *s, size_t i)
+{
+    return s->keys + i * s->key_size;
+}
+
+static inline unsigned long long *hist_snapshot_slots(const struct hist_snapshot *s, size_t i)
+{
+    return s->slots + i * s->nr_slots;
+}
+
+/* 空きを 1 つ作って、その番号を返す（失敗は -ENOMEM） */
+static inline long hist_snapshot_grow(struct hist_snapshot *s)
+{
+    if (s->nr == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 64;
+        unsigned char *keys = realloc(s->keys, cap * s->key_size);
+        unsigned long long *slots;
+
+        if (!keys)
+            return -ENOMEM;
+        s->keys = keys;
+        slots = realloc(s->slots, cap * s->nr_slots * sizeof(*slots));
+        if (!slots)
+            return -ENOMEM;
+        s->slots = slots;
+        s->cap = cap;
+    }
+    return s->nr++;
+}
+
+/* HIST_MAP を読んで CPU を合算する。s は空（0 埋め）で渡す。失敗は負の errno */
+static inline int hist_snapshot_read(int fd, size_t key_size, unsigned int nr_slots,
+                                     struct hist_snapshot *s)
+{
+    int nr_cpus = libbpf_num_possible_cpus();
+    unsigned char *key, *next;
+    unsigned long long *percpu;
+    void *pkey = NULL;
+    int err = 0;
+
+    if (nr_cpus <= 0)
+        return nr_cpus ? nr_cpus : -EINVAL;
+
+    memset(s, 0, sizeof(*s));
+    s->key_size = key_size;
+    s->nr_slots = nr_slots;
+
+    key = malloc(key_size);
+    next = malloc(key_size);
+    percpu = malloc((size_t)nr_cpus * nr_slots * sizeof(*percpu));
+    if (!key || !next || !percpu) {
+        err = -ENOMEM;
+        goto out;
+    }
+
+    while (!bpf_map_get_next_key(fd, pkey, next)) {
+        long i;
+
+        memcpy(key, next, key_size);
+        pkey = key;
+        if (bpf_map_lookup_elem(fd, key, percpu))
+            continue;   /* 読む間に消された */
+
+        i = hist_snapshot_grow(s);
+        if (i < 0) {
+            err = i;
+            goto out;
+        }
+        memcpy(s->keys + i * key_size, key, key_size);
+        hist_sum_cpus(percpu, nr_cpus, nr_slots, hist_snapshot_slots(s, i));
+    }
+
+out:
+    free(key);
+    free(next);
+    free(percpu);
+    if (err)
+        hist_snapshot_free(s);
+    return err;
+}
+
+static inline const unsigned long long *hist_snapshot_find(const struct hist_snapshot *s,
+                                                           const void *key)
+{
+    for (size_t i = 0; i < s->nr; i++) {
+        if (!memcmp(hist_snapshot_key(s, i), key, s->key_size))
+            return hist_snapshot_slots(s, i);
+    }
+    return NULL;
+}
+
+/*
+ * hist_snapshot_diff:
+ *   out = cur - prev（key ごと）。prev に無い key は cur のまま、増えていない key は out に入れない。
+ *   out は空（0 埋め）で渡す。失敗は負の errno。
+ */
+static inline int hist_snapshot_diff(const struct hist_snapshot *cur,
+                                     const struct hist_snapshot *prev,
+                                     struct hist_snapshot *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->key_size = cur->key_size;
+    out->nr_slots = cur->nr_slots;
+
+    for (size_t i = 0; i < cur->nr; i++) {
+        const unsigned long long *c = hist_snapshot_slots(cur, i);
+        const unsigned long long *p = NULL;
+        unsigned long long *d;
+        unsigned long long total = 0;
+        long j;
+
+        if (prev->nr_slots == cur->nr_slots && prev->key_size == cur->key_size)
+            p = hist_snapshot_find(prev, hist_snapshot_key(cur, i));
+
+        j = hist_snapshot_grow(out);
+        if (j < 0) {
+            hist_snapshot_free(out);
+            return j;
+        }
+        memcpy(out->keys + j * out->key_size, hist_snapshot_key(cur, i), cur->key_size);
+        d = hist_snapshot_slots(out, j);
+        for (unsigned int k = 0; k < cur->nr_slots; k++) {
+            d[k] = p && p[k] > c[k] ? 0 : c[k] - (p ? p[k] : 0);
+            total += d[k];
+        }
+        if (!total)
+            out->nr--;
+    }
+    return 0;
+}
+
+/*
+ * hist_percentile:
+ *   pct（0 - 100）パーセンタイルの推定値。入っているバケットの中を線形補間する。
+ *   頭打ちのバケット（最後）に入ったら、その下限を返す。空なら 0。
+ */
+static inline double hist_percentile(const struct hist_layout *l,
+                                     const unsigned long long *slots, double pct)
+{
+    unsigned long long total = hist_total(slots, l->nr_slots), lo, hi;
+    double target, cum = 0;
+
+    if (!total)
+        return 0;
+    target = total * pct / 100.0;
+
+    for (unsigned int i = 0; i < l->nr_slots; i++) {
+        if (!slots[i])
+            continue;
+        if (cum + slots[i] >= target) {
+            hist_bucket_range(l, i, &lo, &hi);
+            if (hi == ~0ULL)
+                return lo;
+            return lo + (hi - lo + 1) * ((target - cum) / slots[i]);
+        }
+        cum += slots[i];
+    }
+    return 0;
+}
+
+/* bcc の print_log2_hist と同じ形式で 1 本のヒストグラムを描く（空のバケットは前後を詰める） */
+static inline void hist_print(const struct hist_layout *l, const unsigned long long *slots)
+{
+    unsigned long long max = 0, lo, hi;
+    int first = -1, last = -1;
+
+    for (unsigned int i = 0; i < l->nr_slots; i++) {
+        if (slots[i] > max)
+            max = slots[i];
+        if (slots[i]) {
+            if (first < 0)
+                first = i;
+            last = i;
+        }
+    }
+    if (last < 0)
+        return;
+    /* log2 は bcc と同じく 0 から描く（どこから始まるかが見た目で分かる） */
+    if (l->kind == HIST_LOG2)
+        first = 0;
+
+    printf("%24s : %-10s %s\n", l->unit ? l->unit : "value", "count", "distribution");
+    for (int i = first; i <= last; i++) {
+        int width = (int)(slots[i] * 40 / max);
+        char bar[41], hibuf[24];
+
+        hist_bucket_range(l, i, &lo, &hi);
+        if (hi == ~0ULL)
+            snprintf(hibuf, sizeof(hibuf), "inf");
+        else
+            snprintf(hibuf, sizeof(hibuf), "%llu", hi);
+
+        memset(bar, '*', width);
+        bar[width] = '\0';
+        printf("%10llu -> %-10s : %-10llu |%-40s|\n", lo, hibuf, slots[i], bar);
+    }
+}
+
+static inline void hist_print_percentiles(const struct hist_layout *l,
+                                          const unsigned long long *slots)
+{
+    unsigned long long total = hist_total(slots, l->nr_slots);
+
+    if (!total)
+        return;
+    printf("count %llu  p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f (%s)\n", total,
+           hist_percentile(l, slots, 50), hist_percentile(l, slots, 90),
+           hist_percentile(l, slots, 99), hist_percentile(l, slots, 99.9),
+           l->unit ? l->unit : "value");
+}
+
+#endif /* HIST_USER_H */
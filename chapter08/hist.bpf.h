@@ -0,0 +1,92 @@
+#ifndef HIST_BPF_H
+#define HIST_BPF_H
+
+/*
+ * hist.bpf.h（BPF 側のヒストグラム: map 定義と加算）
+ *
+ * 目的:
+ *   任意の struct を key にした per-CPU のヒストグラム map を 1 行で定義し、
+ *   値を hist.h のバケットに数える。読み出し・CPU の合算・区間の差分・表示は hist-user.h。
+ *
+ * 使い方:
+ *
+ *   #include "hist.bpf.h"
+ *
+ *   struct lat_key { u32 ifindex; u32 stage; };
+ *   HIST_MAP(lats, struct lat_key, 32, 1024);              // PERCPU_HASH, value = u64[32]
+ *
+ *   hist_add_log2(&lats, &key, delta_ns, 32);              // [2^i, 2^(i+1)) に 1 足す
+ *   hist_add_log_linear(&lats, &key, delta_ns, 3, 128);    // 2 の冪を 8 分割（誤差 12.5%）
+ *   hist_add_linear(&sizes, &key, len, 0, 64, 24);         // 0, 64, 128 ... の 64 bytes 刻み
+ *
+ *   ユーザ空間では同じ nr_slots と種類を struct hist_layout に書いて hist-user.h で読む。
+ *
+ * value:
+ *
+ *   key ──> CPU 0: [ slot 0 | slot 1 | ... | slot nr_slots-1 ]   u64 の配列
+ *           CPU 1: [ ...                                     ]
+ *
+ *   per-CPU なのでアトミック命令は要らない（同じ CPU 上では BPF プログラムは入れ子にならない
+ *   フックで使う前提。NMI から呼ばれる perf_event などでは数え落としが起き得る）。
+ *
+ * 注意:
+ *   - 初めて見る key は 0 埋めで作る。0 の元は .rodata の hist_zero（最大 HIST_MAX_SLOTS 分）で、
+ *     スタックに nr_slots x 8 bytes の 0 を置かずに済ませる（512 bytes の制限に当たらない）。
+ *   - key の数が max_entries を超えると新しい key は数えられない（既存の key は数え続ける）。
+ */
+
+#include "hist.h"
+
+static const __u64 hist_zero[HIST_MAX_SLOTS];
+
+/* key_type を key、u64[nr_slots] を value にした PERCPU_HASH */
+#define HIST_MAP(name, key_type, nr_slots, max)       \
+    struct {                                          \
+        __uint(type, BPF_MAP_TYPE_PERCPU_HASH);       \
+        __uint(max_entries, max);                     \
+        __type(key, key_type);                        \
+        __type(value, __u64[nr_slots]);               \
+    } name SEC(".maps")
+
+/*
+ * hist_add:
+ *   map[key] の slot 番目に inc を足す。nr_slots は HIST_MAP に渡したものと同じ定数にする
+ *   （インライン展開後に定数になるので、verifier は slot の範囲をここで確認できる）。
+ */
+static __always_inline void hist_add(void *map, const void *key, __u32 slot,
+                                     __u32 nr_slots, __u64 inc)
+{
+    __u64 *slots;
+
+    if (slot >= nr_slots)
+        slot = nr_slots - 1;
+
+    slots = bpf_map_lookup_elem(map, key);
+    if (!slots) {
+        bpf_map_update_elem(map, key, hist_zero, BPF_NOEXIST);
+        slots = bpf_map_lookup_elem(map, key);
+        if (!slots)
+            return;
+    }
+    slots[slot] += inc;
+}
+
+static __always_inline void hist_add_log2(void *map, const void *key, __u64 v,
+                                          __u32 nr_slots)
+{
+    hist_add(map, key, hist_log2_slot(v, nr_slots), nr_slots, 1);
+}
+
+static __always_inline void hist_add_log_linear(void *map, const void *key, __u64 v,
+                                                __u32 sub_bits, __u32 nr_slots)
+{
+    hist_add(map, key, hist_log_linear_slot(v, sub_bits, nr_slots), nr_slots, 1);
+}
+
+static __always_inline void hist_add_linear(void *map, const void *key, __u64 v,
+                                            __u64 min, __u64 step, __u32 nr_slots)
+{
+    hist_add(map, key, hist_linear_slot(v, min, step, nr_slots), nr_slots, 1);
+}
+
+#endif /* HIST_BPF_H */
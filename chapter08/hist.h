@@ -0,0 +1,90 @@
+#ifndef HIST_H
+#define HIST_H
+
+/*
+ * hist.h（ヒストグラムのバケット計算。BPF 側とユーザ空間の両方から include する）
+ *
+ * 目的:
+ *   遅延やサイズを数えるツールが、それぞれ log2 の計算や per-CPU map のレイアウトを
+ *   作り直さなくて済むようにする。バケット番号の計算（値 → 番号）と、その逆（番号 → 値の範囲）を
+ *   同じファイルに置き、BPF 側で数えた番号をユーザ空間が必ず同じ意味で読めるようにする。
+ *
+ *   BPF 側の map 定義と加算は hist.bpf.h、ユーザ空間の読み出し・合算・差分・表示は hist-user.h。
+ *
+ * バケットの種類:
+ *
+ *   HIST_LOG2       : [2^i, 2^(i+1)) を 1 バケット（0 と 1 はバケット 0）。bcc の log2 hist と同じ。
+ *   HIST_LOG_LINEAR : 2 の冪の区間をさらに 2^sub_bits 個に等分する（HDR ヒストグラム風）。
+ *                     相対誤差が 1 / 2^sub_bits に収まる。v < 2^sub_bits はそのまま v 番。
+ *   HIST_LINEAR     : min から step 刻み。min 未満は 0 番、範囲を超えたら最後のバケット。
+ *
+ *   例（HIST_LOG_LINEAR, sub_bits = 2）:
+ *     値    0 1 2 3 | 4 5 6 7 | 8-9 10-11 12-13 14-15 | 16-19 ...
+ *     番号  0 1 2 3 | 4 5 6 7 |  8    9    10    11   |  12   ...
+ *
+ * 注意:
+ *   - 関数は BPF（clang -target bpf）でもユーザ空間（gcc）でも使えるように、
+ *     標準の型だけで書き、常にインライン展開させる（BPF でループも関数呼び出しも作らない）。
+ */
+
+#define HIST_MAX_SLOTS 128   /* 1 本のヒストグラムのバケット数の上限（value = u64 x nr_slots） */
+
+#define HIST_INLINE static inline __attribute__((always_inline))
+
+enum hist_kind {
+   HIST_LOG2 = 0,
+   HIST_LOG_LINEAR,
+   HIST_LINEAR,
+};
+
+/* 分岐のない二分探索で floor(log2(v))（v = 0 は 0） */
+HIST_INLINE unsigned int hist_log2_floor(unsigned long long v)
+{
+    unsigned int r = 0;
+
+    if (v >> 32) { v >>= 32; r += 32; }
+    if (v >> 16) { v >>= 16; r += 16; }
+    if (v >> 8)  { v >>= 8;  r += 8;  }
+    if (v >> 4)  { v >>= 4;  r += 4;  }
+    if (v >> 2)  { v >>= 2;  r += 2;  }
+    if (v >> 1)  { r += 1; }
+    return r;
+}
+
+/* 以下の *_slot() は nr_slots - 1 で頭打ちにした番号を返す */
+
+HIST_INLINE unsigned int hist_log2_slot(unsigned long long v, unsigned int nr_slots)
+{
+    unsigned int slot = hist_log2_floor(v);
+
+    return slot < nr_slots ? slot : nr_slots - 1;
+}
+
+HIST_INLINE unsigned int hist_log_linear_slot(unsigned long long v, unsigned int sub_bits,
+                                              unsigned int nr_slots)
+{
+    unsigned long long sub = 1ULL << sub_bits;
+    unsigned long long slot;
+    unsigned int e;
+
+    if (v < sub) {
+        slot = v;
+    } else {
+        e = hist_log2_floor(v);
+        slot = (unsigned long long)(e - sub_bits + 1) * sub + ((v >> (e - sub_bits)) - sub);
+    }
+    return slot < nr_slots ? (unsigned int)slot : nr_slots - 1;
+}
+
+HIST_INLINE unsigned int hist_linear_slot(unsigned long long v, unsigned long long min,
+                                          unsigned long long step, unsigned int nr_slots)
+{
+    unsigned long long slot;
+
+    if (v < min || !step)
+        return 0;
+    slot = (v - min) / step;
+    return slot < nr_slots ? (unsigned int)slot : nr_slots - 1;
+}
+
+#endif /* HIST_H */
@@ -0,0 +1,127 @@
+#!/bin/bash
+# -----------------------------------------------------------------------------
+# netns.sh（chapter08 の検証用 veth + network namespace トポロジ）
+#
+# 目的:
+#   ホストのネットワークを汚さずに、BPF のネットワーク系サンプルを
+#   「実際にパケットが流れる」状態で試すための箱を作る/壊す。
+#
+# 使い方（root で実行）:
+#   ./netns.sh pair                 # ns1(10.0.0.1) <--veth--> ns2(10.0.0.2)
+#   ./netns.sh shaped [rate] [delay] [leaf]
+#                                   # pair + ns1 側の送信に rate 制限 + ECN マーク,
+#                                   #        ns2 側の送信（ACK 方向）に netem 遅延
+#                                   # leaf: htb の葉 qdisc（既定 "fq_codel ecn ce_threshold 1ms"）
+#   ./netns.sh router               # ns1(10.0.1.1) <--> nsr(ルータ) <--> ns2(10.0.2.1)
+#   ./netns.sh clean                # 作ったものを全部消す
+#
+# トポロジ（pair / shaped）:
+#
+#   ┌──────── ns1 ────────┐            ┌──────── ns2 ────────┐
+#   │ veth1  10.0.0.1/24  │ <--------> │ veth2  10.0.0.2/24  │
+#   └─────────────────────┘            └─────────────────────┘
+#
+#   shaped の場合:
+#     veth1 egress : htb(rate) → leaf（既定 fq_codel ecn ce_threshold 1ms）
+#                    （ボトルネックでキューが 1ms を超えたら CE マーク = DCTCP が反応する）
+#                    葉は classid 1:10 の下（qdisc-fq -p 1:10 で bpf_fq に差し替えられる）
+#     veth2 egress : netem delay（往復で delay 分の RTT を足す）
+#     両 ns        : net.ipv4.tcp_ecn=1
+#
+# トポロジ（router）:
+#
+#   ┌──── ns1 ─────┐      ┌──────────── nsr ────────────┐      ┌──── ns2 ─────┐
+#   │ veth1        │ <--> │ r1 10.0.1.254  r2 10.0.2.254 │ <--> │ veth2        │
+#   │ 10.0.1.1/24  │      │      ip_forward=1           │      │ 10.0.2.1/24  │
+#   └──────────────┘      └─────────────────────────────┘      └──────────────┘
+#
+#   ns1 / ns2 は nsr を default gateway にする。nsr は普通のカーネルルータとして転送するので、
+#   そこに xdp-router を載せると XDP 転送との比較になる。
+#   XDP redirect で veth に出したフレームを受け側が受けられるよう、端点側の veth は gro on（NAPI）にする。
+# -----------------------------------------------------------------------------
+
+set -e
+
+NS1=ns1
+NS2=ns2
+NSR=nsr
+
+pair() {
+    ip netns add $NS1
+    ip netns add $NS2
+    ip link add veth1 netns $NS1 type veth peer name veth2 netns $NS2
+
+    ip -n $NS1 addr add 10.0.0.1/24 dev veth1
+    ip -n $NS2 addr add 10.0.0.2/24 dev veth2
+    ip -n $NS1 link set lo up
+    ip -n $NS2 link set lo up
+    ip -n $NS1 link set veth1 up
+    ip -n $NS2 link set veth2 up
+}
+
+shaped() {
+    local rate=${1:-1gbit}
+    local delay=${2:-2ms}
+    local leaf=${3:-fq_codel ecn ce_threshold 1ms}
+
+    pair
+
+    ip netns exec $NS1 sysctl -q -w net.ipv4.tcp_ecn=1
+    ip netns exec $NS2 sysctl -q -w net.ipv4.tcp_ecn=1
+
+    # veth は GSO/TSO で巨大 skb を作るので、rate 制限の精度のために切っておく
+    ip netns exec $NS1 ethtool -K veth1 tso off gso off gro off >/dev/null 2>&1 || true
+
+    tc -n $NS1 qdisc add dev veth1 root handle 1: htb default 10
+    tc -n $NS1 class add dev veth1 parent 1: classid 1:10 htb rate "$rate"
+    tc -n $NS1 qdisc add dev veth1 parent 1:10 handle 10: $leaf
+
+    tc -n $NS2 qdisc add dev veth2 root netem delay "$delay"
+}
+
+router() {
+    ip netns add $NS1
+    ip netns add $NS2
+    ip netns add $NSR
+    ip link add veth1 netns $NS1 type veth peer name r1 netns $NSR
+    ip link add veth2 netns $NS2 type veth peer name r2 netns $NSR
+
+    ip -n $NS1 addr add 10.0.1.1/24 dev veth1
+    ip -n $NSR addr add 10.0.1.254/24 dev r1
+    ip -n $NSR addr add 10.0.2.254/24 dev r2
+    ip -n $NS2 addr add 10.0.2.1/24 dev veth2
+
+    for ns in $NS1 $NS2 $NSR; do
+        ip -n $ns link set lo up
+    done
+    ip -n $NS1 link set veth1 up
+    ip -n $NS2 link set veth2 up
+    ip -n $NSR link set r1 up
+    ip -n $NSR link set r2 up
+
+    ip -n $NS1 route add default via 10.0.1.254
+    ip -n $NS2 route add default via 10.0.2.254
+    ip netns exec $NSR sysctl -q -w net.ipv4.ip_forward=1
+
+    ip netns exec $NS1 ethtool -K veth1 gro on >/dev/null 2>&1 || true
+    ip netns exec $NS2 ethtool -K veth2 gro on >/dev/null 2>&1 || true
+    ip netns exec $NSR ethtool -K r1 gro on >/dev/null 2>&1 || true
+    ip netns exec $NSR ethtool -K r2 gro on >/dev/null 2>&1 || true
+}
+
+clean() {
+    ip netns del $NS1 2>/dev/null || true
+    ip netns del $NS2 2>/dev/null || true
+    ip netns del $NSR 2>/dev/null || true
+}
+
+case "$1" in
+    pair)   pair ;;
+    shaped) shift; shaped "$@" ;;
+    router) router ;;
+    clean)  clean ;;
+    *)
+        echo "Usage: $0 {pair|shaped [rate] [delay] [leaf]|router|clean}" >&2
+        exit 1
+        ;;
+esac
@@ -0,0 +1,133 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+/*
+ * packet.h（libbpf 版の XDP / TC プログラムで共有するパケット解析ヘルパ）
+ *
+ * network.bpf.c（BCC）の is_icmp_ping_request と同じ「data / data_end の範囲を確かめながら
+ * Ethernet → IP → L4 と順にヘッダを進める」やり方を、vmlinux.h の構造体で書き直したもの。
+ *
+ *   struct hdr_cursor nh = { .pos = data };
+ *   proto = parse_ethhdr(&nh, data_end, &eth);   … EtherType（ネットワークバイトオーダ）/ 失敗 -1
+ *   l4    = parse_iphdr(&nh, data_end, &iph);    … IP protocol / 失敗 -1
+ *
+ * 各 parse_* は成功するとカーソルをヘッダの直後に進める。verifier が境界を追えるように
+ * 比較は必ず「ヘッダ末尾 > data_end」の形で行う。
+ *
+ * 注意:
+ *   - vmlinux.h と bpf_endian.h を include した後に include すること。
+ *   - VLAN タグや IPv6 拡張ヘッダは辿らない（それらは parse_* が -1 を返すか、nexthdr をそのまま返す）。
+ */
+
+#ifndef ETH_P_IP
+#define ETH_P_IP   0x0800
+#endif
+#ifndef ETH_P_IPV6
+#define ETH_P_IPV6 0x86DD
+#endif
+#ifndef ETH_ALEN
+#define ETH_ALEN   6
+#endif
+#ifndef ICMP_ECHO
+#define ICMP_ECHO  8
+#endif
+
+struct hdr_cursor {
+    void *pos;
+};
+
+static __always_inline int parse_ethhdr(struct hdr_cursor *nh, void *data_end,
+                                        struct ethhdr **ethhdr)
+{
+    struct ethhdr *eth = nh->pos;
+
+    if ((void *)(eth + 1) > data_end)
+        return -1;
+
+    nh->pos = eth + 1;
+    *ethhdr = eth;
+    return eth->h_proto;
+}
+
+static __always_inline int parse_iphdr(struct hdr_cursor *nh, void *data_end,
+                                       struct iphdr **iphdr)
+{
+    struct iphdr *iph = nh->pos;
+    int hdrsize;
+
+    if ((void *)(iph + 1) > data_end)
+        return -1;
+
+    hdrsize = iph->ihl * 4;
+    if (hdrsize < (int)sizeof(*iph) || nh->pos + hdrsize > data_end)
+        return -1;
+
+    nh->pos += hdrsize;
+    *iphdr = iph;
+    return iph->protocol;
+}
+
+static __always_inline int parse_ipv6hdr(struct hdr_cursor *nh, void *data_end,
+                                         struct ipv6hdr **ip6hdr)
+{
+    struct ipv6hdr *ip6h = nh->pos;
+
+    if ((void *)(ip6h + 1) > data_end)
+        return -1;
+
+    nh->pos = ip6h + 1;
+    *ip6hdr = ip6h;
+    return ip6h->nexthdr;
+}
+
+static __always_inline int parse_tcphdr(struct hdr_cursor *nh, void *data_end,
+                                        struct tcphdr **tcphdr)
+{
+    struct tcphdr *tcph = nh->pos;
+    int len;
+
+    if ((void *)(tcph + 1) > data_end)
+        return -1;
+
+    len = tcph->doff * 4;
+    if (len < (int)sizeof(*tcph) || nh->pos + len > data_end)
+        return -1;
+
+    nh->pos += len;
+    *tcphdr = tcph;
+    return len;
+}
+
+static __always_inline int parse_udphdr(struct hdr_cursor *nh, void *data_end,
+                                        struct udphdr **udphdr)
+{
+    struct udphdr *udph = nh->pos;
+
+    if ((void *)(udph + 1) > data_end)
+        return -1;
+
+    nh->pos = udph + 1;
+    *udphdr = udph;
+    return bpf_ntohs(udph->len) - (int)sizeof(*udph);
+}
+
+/* network.bpf.c の is_icmp_ping_request と同じ判定（Ethernet + IPv4 + ICMP echo request） */
+static __always_inline bool is_icmp_ping_request(void *data, void *data_end)
+{
+    struct hdr_cursor nh = { .pos = data };
+    struct ethhdr *eth;
+    struct iphdr *iph;
+    struct icmphdr *icmp;
+
+    if (parse_ethhdr(&nh, data_end, &eth) != bpf_htons(ETH_P_IP))
+        return false;
+    if (parse_iphdr(&nh, data_end, &iph) != IPPROTO_ICMP)
+        return false;
+
+    icmp = nh.pos;
+    if ((void *)(icmp + 1) > data_end)
+        return false;
+    return icmp->type == ICMP_ECHO;
+}
+
+#endif /* PACKET_H */
@@ -0,0 +1,751 @@
+/*
+ * pcap-replay.c（キャプチャしたパケットを XDP / TC プログラムにオフラインで通す）
+ *
+ * 目的:
+ *   本番で起きた事象を再現するために、pcap / pcapng の各フレームを chapter08 の任意の .bpf.o 内の
+ *   XDP / TC プログラムへ BPF_PROG_TEST_RUN で 1 つずつ流し、
+ *     - verdict（XDP_* / TC_ACT_*）の内訳
+ *     - 実行前後の map の差分（増えた / 消えた / 値が変わったエントリ）
+ *     - 1 パケットあたりの実行時間の分布（p50 / p90 / p99 と log2 ヒストグラム）
+ *   を出す。-w で verdict と時間をパケットごとのコメントに付けた pcapng を書き出す。
+ *
+ * 使い方:
+ *   sudo ./pcap-replay -o <obj.bpf.o> -p <prog> [-j threads] [-B batch] [-r repeat] [-w out.pcapng] [-v] <in.pcap>
+ *
+ *   -o / -p  プログラムを含む BPF オブジェクトと、その中のプログラム名（SEC("xdp") / SEC("tc") のもの）
+ *   -j       並列に test_run するスレッド数（既定 1）
+ *   -B       スレッドが 1 回に取るフレーム数（既定 256）
+ *   -r       1 フレームを何回繰り返して時間を平均するか（既定 1。map への副作用も repeat 回起きる）
+ *   -w       verdict 付き pcapng の出力先（パケットはプログラム実行後の内容, コメントに verdict と時間）
+ *   -v       値が変わった map エントリを hex で表示する
+ *
+ *   例:
+ *     sudo ./pcap-replay -o conntrack.bpf.o -p ct_ingress -w out.pcapng capture.pcap
+ *     sudo ./pcap-replay -o xdp-chain-progs.bpf.o -p xdp_monolithic -j 4 capture.pcapng
+ *
+ * 流れ:
+ *
+ *   pcap / pcapng を全部メモリに読む（Ethernet のフレームだけ）
+ *     → bpf_object__open_file → 指定プログラム以外は autoload しない → load
+ *     → 全 map のスナップショット（key でソート）
+ *     → スレッドが B フレームずつ取り出して test_run（retval / duration / data_out を記録）
+ *     → 再スナップショットして差分、統計、pcapng 出力
+ *
+ * 注意:
+ *   - -j 2 以上ではフレームの処理順が入れ替わるので、conntrack のように順序に意味がある map の
+ *     結果は -j 1 と変わることがある（再現が目的なら -j 1）。
+ *   - ringbuf / perf / prog_array / sockmap などユーザ空間から lookup できない map は差分の対象外。
+ *   - freplace や struct_ops など、attach 先が要るプログラムは対象外。.rodata の設定は既定値のまま。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "hist-user.h"
+
+#define MAX_SLOTS    32
+#define MAX_FRAME    (64 * 1024)         /* 読み込む 1 フレームの上限（これを超えるブロックは壊れているとみなす） */
+#define MAX_OUT      (64 * 1024 + 512)   /* data_out の大きさ（XDP の headroom 込みで足りる量） */
+#define MAX_MAPS     64
+#define MAX_VERDICTS 16
+
+struct frame {
+    unsigned long long ts_ns;
+    unsigned int len;
+    unsigned char *data;
+    /* 実行結果 */
+    int err;
+    unsigned int retval;
+    unsigned int duration;
+    unsigned int out_len;
+    unsigned char *out;
+};
+
+struct snapshot {
+    struct bpf_map *map;
+    unsigned int key_size;
+    unsigned int value_size;   /* per-CPU map は CPU 分 */
+    size_t nr;
+    unsigned char *keys;
+    unsigned char *values;
+};
+
+static struct frame *frames;
+static size_t nr_frames;
+
+/* スレッド間で共有する作業キュー */
+static struct {
+    int prog_fd;
+    int repeat;
+    size_t batch;
+    bool keep_out;
+    size_t next;
+    pthread_mutex_t lock;
+} work = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* ---- pcap / pcapng の読み込み --------------------------------------------- */
+
+static uint32_t rd32(const unsigned char *p, bool swap)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t rd16(const unsigned char *p, bool swap)
+{
+    uint16_t v;
+
+    memcpy(&v, p, 2);
+    return swap ? __builtin_bswap16(v) : v;
+}
+
+static int add_frame(const unsigned char *data, unsigned int len, unsigned long long ts_ns)
+{
+    static size_t cap;
+    struct frame *f;
+
+    if (nr_frames == cap) {
+        cap = cap ? cap * 2 : 4096;
+        f = realloc(frames, cap * sizeof(*frames));
+        if (!f)
+            return -ENOMEM;
+        frames = f;
+    }
+    f = &frames[nr_frames];
+    memset(f, 0, sizeof(*f));
+    f->data = malloc(len);
+    if (!f->data)
+        return -ENOMEM;
+    memcpy(f->data, data, len);
+    f->len = len;
+    f->ts_ns = ts_ns;
+    nr_frames++;
+    return 0;
+}
+
+static int read_pcap(const unsigned char *buf, size_t size)
+{
+    uint32_t magic = rd32(buf, false);
+    bool swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    bool nsec = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+    size_t off = 24;
+
+    if (rd32(buf + 20, swap) != 1) {
+        fprintf(stderr, "Only Ethernet (linktype 1) captures are supported\n");
+        return -EINVAL;
+    }
+    while (off + 16 <= size) {
+        uint32_t sec = rd32(buf + off, swap), frac = rd32(buf + off + 4, swap);
+        uint32_t caplen = rd32(buf + off + 8, swap);
+
+        off += 16;
+        if (off + caplen > size)
+            break;
+        if (caplen > MAX_FRAME) {
+            fprintf(stderr, "Skipping oversized pcap record at offset %zu\n", off - 16);
+            off += caplen;
+            continue;
+        }
+        if (add_frame(buf + off, caplen, sec * 1000000000ULL + (nsec ? frac : frac * 1000ULL)))
+            return -ENOMEM;
+        off += caplen;
+    }
+    return 0;
+}
+
+static int read_pcapng(const unsigned char *buf, size_t size)
+{
+    bool swap = false, ether[256] = {};
+    unsigned int nr_ifaces = 0;
+    size_t off = 0;
+
+    while (off + 12 <= size) {
+        uint32_t type = rd32(buf + off, false), len;
+
+        if (type == 0x0A0D0D0A) {                          /* Section Header: バイト順を決める */
+            swap = rd32(buf + off + 8, false) != 0x1A2B3C4D;
+            nr_ifaces = 0;
+        }
+        len = rd32(buf + off + 4, swap);
+        if (len < 12 || off + len > size)
+            break;
+
+        if (type == 0x0A0D0D0A) {
+            /* 何もしない */
+        } else if (rd32(buf + off, swap) == 1) {           /* Interface Description */
+            if (nr_ifaces < 256)
+                ether[nr_ifaces] = rd16(buf + off + 8, swap) == 1;
+            nr_ifaces++;
+        } else if (rd32(buf + off, swap) == 6 && len >= 32) {   /* Enhanced Packet */
+            uint32_t ifid = rd32(buf + off + 8, swap);
+            unsigned long long ts = ((unsigned long long)rd32(buf + off + 12, swap) << 32) |
+                                    rd32(buf + off + 16, swap);
+            uint32_t caplen = rd32(buf + off + 20, swap);
+
+            /*
+             * タイムスタンプは既定の if_tsresol（マイクロ秒）として扱う。
+             * 28 + caplen は uint32_t で回り込むので len - 28（len >= 32 は確認済み）と比べる。
+             * MAX_FRAME を超えるものは壊れたブロックとして捨てる（切り詰めて送らない）。
+             */
+            if (caplen > len - 28 || caplen > MAX_FRAME) {
+                fprintf(stderr, "Skipping malformed Enhanced Packet Block at offset %zu\n", off);
+            } else if (ifid < 256 && ether[ifid] &&
+                       add_frame(buf + off + 28, caplen, ts * 1000ULL)) {
+                return -ENOMEM;
+            }
+        } else if (rd32(buf + off, swap) == 3 && len >= 16) {   /* Simple Packet */
+            /* len - 16 は 32 bit 境界までの詰め物を含むので、元の長さ（off + 8）で切る */
+            uint32_t orig_len = rd32(buf + off + 8, swap);
+            uint32_t caplen = orig_len < len - 16 ? orig_len : len - 16;
+
+            if (caplen > MAX_FRAME)
+                fprintf(stderr, "Skipping oversized Simple Packet Block at offset %zu\n", off);
+            else if (ether[0] && add_frame(buf + off + 12, caplen, 0))
+                return -ENOMEM;
+        }
+        off += len;
+    }
+    return 0;
+}
+
+static int load_capture(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    unsigned char *buf;
+    long size;
+    int err;
+
+    if (!f)
+        return -errno;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = malloc(size > 0 ? size : 1);
+    if (!buf || size < 24 || fread(buf, 1, size, f) != (size_t)size) {
+        free(buf);
+        fclose(f);
+        return -EINVAL;
+    }
+    fclose(f);
+
+    if (rd32(buf, false) == 0x0A0D0D0A)
+        err = read_pcapng(buf, size);
+    else
+        err = read_pcap(buf, size);
+    free(buf);
+    return err;
+}
+
+/* ---- verdict 付き pcapng の書き出し -------------------------------------- */
+
+static void write_block(FILE *f, uint32_t type, const void *body, uint32_t body_len)
+{
+    static const unsigned char pad[4];
+    uint32_t total = 12 + ((body_len + 3) & ~3U);
+
+    fwrite(&type, 4, 1, f);
+    fwrite(&total, 4, 1, f);
+    fwrite(body, 1, body_len, f);
+    fwrite(pad, 1, total - 12 - body_len, f);
+    fwrite(&total, 4, 1, f);
+}
+
+static int write_pcapng(const char *path, const char *(*verdict_name)(unsigned int, char *))
+{
+    struct { uint32_t magic; uint16_t major, minor; int64_t section_len; } shb = { 0x1A2B3C4D, 1, 0, -1 };
+    struct { uint16_t linktype, reserved; uint32_t snaplen; } idb = { 1, 0, 0 };
+    unsigned char *body = malloc(MAX_OUT + 256);
+    FILE *f = fopen(path, "wb");
+
+    if (!f || !body) {
+        free(body);
+        if (f)
+            fclose(f);
+        return -errno;
+    }
+    write_block(f, 0x0A0D0D0A, &shb, sizeof(shb));
+    write_block(f, 1, &idb, sizeof(idb));
+
+    for (size_t i = 0; i < nr_frames; i++) {
+        const struct frame *fr = &frames[i];
+        const unsigned char *data = fr->out && fr->out_len ? fr->out : fr->data;
+        uint32_t caplen = fr->out && fr->out_len ? fr->out_len : fr->len;
+        uint32_t hdr[5] = { 0, (uint32_t)((fr->ts_ns / 1000) >> 32), (uint32_t)(fr->ts_ns / 1000),
+                            caplen, fr->len };
+        char comment[96], vbuf[32];
+        uint16_t opt[2];
+        size_t off = 0, clen;
+
+        if (fr->err)
+            snprintf(comment, sizeof(comment), "test_run error %d", fr->err);
+        else
+            snprintf(comment, sizeof(comment), "verdict=%s cost=%uns",
+                     verdict_name(fr->retval, vbuf), fr->duration);
+        clen = strlen(comment);
+
+        memcpy(body, hdr, sizeof(hdr));
+        off = sizeof(hdr);
+        memcpy(body + off, data, caplen);
+        off += caplen;
+        while (off & 3)
+            body[off++] = 0;
+
+        opt[0] = 1;                                        /* opt_comment */
+        opt[1] = clen;
+        memcpy(body + off, opt, 4);
+        off += 4;
+        memcpy(body + off, comment, clen);
+        off += clen;
+        while (off & 3)
+            body[off++] = 0;
+        memset(body + off, 0, 4);                          /* opt_endofopt */
+        off += 4;
+
+        write_block(f, 6, body, off);
+    }
+    free(body);
+    fclose(f);
+    return 0;
+}
+
+/* ---- verdict の名前 ------------------------------------------------------- */
+
+static const char *xdp_verdict(unsigned int v, char *buf)
+{
+    static const char *names[] = { "XDP_ABORTED", "XDP_DROP", "XDP_PASS", "XDP_TX", "XDP_REDIRECT" };
+
+    if (v < sizeof(names) / sizeof(names[0]))
+        return names[v];
+    snprintf(buf, 32, "%u", v);
+    return buf;
+}
+
+static const char *tc_verdict(unsigned int v, char *buf)
+{
+    static const char *names[] = { "TC_ACT_OK", "TC_ACT_RECLASSIFY", "TC_ACT_SHOT", "TC_ACT_PIPE",
+                                   "TC_ACT_STOLEN", "TC_ACT_QUEUED", "TC_ACT_REPEAT",
+                                   "TC_ACT_REDIRECT", "TC_ACT_TRAP" };
+
+    if (v == (unsigned int)-1)
+        return "TC_ACT_UNSPEC";
+    if (v < sizeof(names) / sizeof(names[0]))
+        return names[v];
+    snprintf(buf, 32, "%u", v);
+    return buf;
+}
+
+/* ---- map のスナップショットと差分 ----------------------------------------- */
+
+static unsigned int cmp_key_size;
+
+static int cmp_key(const void *a, const void *b)
+{
+    return memcmp(a, b, cmp_key_size);
+}
+
+static bool snapshot_supported(const struct bpf_map *map)
+{
+    switch (bpf_map__type(map)) {
+    case BPF_MAP_TYPE_RINGBUF:
+    case BPF_MAP_TYPE_USER_RINGBUF:
+    case BPF_MAP_TYPE_PERF_EVENT_ARRAY:
+    case BPF_MAP_TYPE_PROG_ARRAY:
+    case BPF_MAP_TYPE_SOCKMAP:
+    case BPF_MAP_TYPE_SOCKHASH:
+    case BPF_MAP_TYPE_STRUCT_OPS:
+    case BPF_MAP_TYPE_SK_STORAGE:
+        return false;
+    default:
+        return bpf_map__key_size(map) > 0;
+    }
+}
+
+static bool is_percpu(const struct bpf_map *map)
+{
+    switch (bpf_map__type(map)) {
+    case BPF_MAP_TYPE_PERCPU_ARRAY:
+    case BPF_MAP_TYPE_PERCPU_HASH:
+    case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+    case BPF_MAP_TYPE_PERCPU_CGROUP_STORAGE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * map 全体を (key, value) の組で読み、key の memcmp 順に並べる。
+ * 値は key の並びと同じ順に values に詰める（ソートは key + value を 1 レコードにして行う）。
+ */
+static int take_snapshot(struct bpf_map *map, int nr_cpus, struct snapshot *s)
+{
+    int fd = bpf_map__fd(map);
+    unsigned int ksz = bpf_map__key_size(map);
+    unsigned int vsz = bpf_map__value_size(map);
+    size_t max = bpf_map__max_entries(map), rec;
+    unsigned char *recs, *key, *prev = NULL;
+
+    if (is_percpu(map))
+        vsz = ((vsz + 7) & ~7U) * nr_cpus;
+    rec = ksz + vsz;
+
+    memset(s, 0, sizeof(*s));
+    s->map = map;
+    s->key_size = ksz;
+    s->value_size = vsz;
+
+    recs = malloc(rec * (max ? max : 1));
+    key = malloc(ksz);
+    if (!recs || !key) {
+        free(recs);
+        free(key);
+        return -ENOMEM;
+    }
+
+    while (s->nr < max && !bpf_map_get_next_key(fd, prev, key)) {
+        unsigned char *r = recs + s->nr * rec;
+
+        memcpy(r, key, ksz);
+        prev = r;
+        if (bpf_map_lookup_elem(fd, key, r + ksz))
+            continue;
+        s->nr++;
+    }
+    free(key);
+
+    cmp_key_size = ksz;
+    qsort(recs, s->nr, rec, cmp_key);
+
+    /* key と value を別々の配列に分ける（表示で使いやすいように） */
+    s->keys = malloc(ksz * (s->nr ? s->nr : 1));
+    s->values = malloc(vsz * (s->nr ? s->nr : 1));
+    if (!s->keys || !s->values) {
+        free(recs);
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < s->nr; i++) {
+        memcpy(s->keys + i * ksz, recs + i * rec, ksz);
+        memcpy(s->values + i * vsz, recs + i * rec + ksz, vsz);
+    }
+    free(recs);
+    return 0;
+}
+
+static void free_snapshot(struct snapshot *s)
+{
+    free(s->keys);
+    free(s->values);
+}
+
+static void print_hex(const char *label, const unsigned char *p, unsigned int len)
+{
+    printf("      %s", label);
+    for (unsigned int i = 0; i < len && i < 48; i++)
+        printf("%02x", p[i]);
+    printf("%s\n", len > 48 ? "..." : "");
+}
+
+/* before / after をマージしながら比べる */
+static void diff_snapshot(const struct snapshot *a, const struct snapshot *b, bool verbose)
+{
+    unsigned int ksz = a->key_size, vsz = a->value_size;
+    size_t i = 0, j = 0, added = 0, removed = 0, changed = 0, shown = 0;
+
+    while (i < a->nr || j < b->nr) {
+        int c = i == a->nr ? 1 : j == b->nr ? -1 : memcmp(a->keys + i * ksz, b->keys + j * ksz, ksz);
+
+        if (c < 0) {
+            removed++;
+            i++;
+        } else if (c > 0) {
+            added++;
+            if (verbose && shown++ < 8) {
+                print_hex("+ key ", b->keys + j * ksz, ksz);
+                print_hex("  val ", b->values + j * vsz, vsz);
+            }
+            j++;
+        } else {
+            if (memcmp(a->values + i * vsz, b->values + j * vsz, vsz)) {
+                changed++;
+                if (verbose && shown++ < 8) {
+                    print_hex("~ key ", b->keys + j * ksz, ksz);
+                    print_hex("  old ", a->values + i * vsz, vsz);
+                    print_hex("  new ", b->values + j * vsz, vsz);
+                }
+            }
+            i++;
+            j++;
+        }
+    }
+
+    printf("  %-20s entries %zu -> %zu   +%zu -%zu ~%zu\n",
+           bpf_map__name(a->map), a->nr, b->nr, added, removed, changed);
+}
+
+/* ---- test_run のワーカ ---------------------------------------------------- */
+
+static void *worker(void *arg)
+{
+    unsigned char *out = malloc(MAX_OUT);
+
+    (void)arg;
+    if (!out)
+        return NULL;
+
+    for (;;) {
+        size_t begin, end;
+
+        pthread_mutex_lock(&work.lock);
+        begin = work.next;
+        end = begin + work.batch < nr_frames ? begin + work.batch : nr_frames;
+        work.next = end;
+        pthread_mutex_unlock(&work.lock);
+        if (begin >= nr_frames)
+            break;
+
+        for (size_t i = begin; i < end; i++) {
+            struct frame *f = &frames[i];
+            LIBBPF_OPTS(bpf_test_run_opts, opts,
+                        .data_in = f->data,
+                        .data_size_in = f->len,
+                        .data_out = out,
+                        .data_size_out = MAX_OUT,
+                        .repeat = work.repeat);
+
+            if (bpf_prog_test_run_opts(work.prog_fd, &opts)) {
+                f->err = -errno;
+                continue;
+            }
+            f->retval = opts.retval;
+            f->duration = opts.duration;
+            f->out_len = opts.data_size_out;
+            if (work.keep_out && (f->out = malloc(f->out_len)))
+                memcpy(f->out, out, f->out_len);
+        }
+    }
+    free(out);
+    return NULL;
+}
+
+/* ---- 統計 ----------------------------------------------------------------- */
+
+static int cmp_u32(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void print_report(const char *(*verdict_name)(unsigned int, char *))
+{
+    const struct hist_layout layout = { .kind = HIST_LOG2, .nr_slots = MAX_SLOTS, .unit = "ns" };
+    unsigned long long slots[MAX_SLOTS] = {}, sum = 0;
+    unsigned int verdicts[MAX_VERDICTS] = {}, *costs;
+    size_t nr = 0, errors = 0, other = 0;
+    char vbuf[32];
+
+    costs = malloc(nr_frames * sizeof(*costs));
+    if (!costs)
+        return;
+
+    for (size_t i = 0; i < nr_frames; i++) {
+        const struct frame *f = &frames[i];
+
+        if (f->err) {
+            errors++;
+            continue;
+        }
+        if (f->retval < MAX_VERDICTS)
+            verdicts[f->retval]++;
+        else
+            other++;
+
+        costs[nr++] = f->duration;
+        sum += f->duration;
+        slots[hist_slot(&layout, f->duration)]++;
+    }
+
+    printf("\nverdicts (%zu frames, %zu test_run errors):\n", nr_frames, errors);
+    for (unsigned int v = 0; v < MAX_VERDICTS; v++) {
+        if (verdicts[v])
+            printf("  %-20s %u\n", verdict_name(v, vbuf), verdicts[v]);
+    }
+    if (other)
+        printf("  %-20s %zu\n", "(other)", other);
+
+    if (nr) {
+        qsort(costs, nr, sizeof(*costs), cmp_u32);
+        printf("\nper-packet cost (ns): min %u  p50 %u  p90 %u  p99 %u  max %u  avg %llu\n",
+               costs[0], costs[nr / 2], costs[nr * 90 / 100], costs[nr * 99 / 100], costs[nr - 1],
+               sum / nr);
+        hist_print(&layout, slots);
+    }
+    free(costs);
+}
+
+int main(int argc, char **argv)
+{
+    const char *obj_path = NULL, *prog_name = NULL, *out_path = NULL;
+    const char *(*verdict_name)(unsigned int, char *);
+    struct snapshot before[MAX_MAPS], after[MAX_MAPS];
+    struct bpf_object *obj = NULL;
+    struct bpf_program *prog, *p;
+    struct bpf_map *map;
+    pthread_t *threads = NULL;
+    int nr_cpus = libbpf_num_possible_cpus();
+    int nthreads = 1, nr_maps = 0;
+    bool verbose = false;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    work.repeat = 1;
+    work.batch = 256;
+
+    while ((opt = getopt(argc, argv, "o:p:j:B:r:w:v")) != -1) {
+        switch (opt) {
+        case 'o': obj_path = optarg; break;
+        case 'p': prog_name = optarg; break;
+        case 'j': nthreads = atoi(optarg); break;
+        case 'B': work.batch = strtoul(optarg, NULL, 0); break;
+        case 'r': work.repeat = atoi(optarg); break;
+        case 'w': out_path = optarg; break;
+        case 'v': verbose = true; break;
+        default: obj_path = NULL; optind = argc; break;
+        }
+    }
+    if (!obj_path || !prog_name || optind != argc - 1 || nthreads <= 0 || !work.batch ||
+        work.repeat <= 0 || nr_cpus <= 0) {
+        fprintf(stderr, "Usage: %s -o <obj.bpf.o> -p <prog> [-j threads] [-B batch] [-r repeat] "
+                        "[-w out.pcapng] [-v] <in.pcap|in.pcapng>\n", argv[0]);
+        return 1;
+    }
+
+    err = load_capture(argv[optind]);
+    if (err) {
+        fprintf(stderr, "Failed to read %s: %d\n", argv[optind], err);
+        return 1;
+    }
+    printf("Read %zu Ethernet frames from %s\n", nr_frames, argv[optind]);
+
+    obj = bpf_object__open_file(obj_path, NULL);
+    if (!obj) {
+        fprintf(stderr, "Failed to open %s: %d\n", obj_path, -errno);
+        return 1;
+    }
+
+    prog = bpf_object__find_program_by_name(obj, prog_name);
+    if (!prog) {
+        fprintf(stderr, "No program %s in %s\n", prog_name, obj_path);
+        err = -ENOENT;
+        goto cleanup;
+    }
+    switch (bpf_program__type(prog)) {
+    case BPF_PROG_TYPE_XDP:
+        verdict_name = xdp_verdict;
+        break;
+    case BPF_PROG_TYPE_SCHED_CLS:
+    case BPF_PROG_TYPE_SCHED_ACT:
+        verdict_name = tc_verdict;
+        break;
+    default:
+        fprintf(stderr, "%s is neither an XDP nor a TC program\n", prog_name);
+        err = -EINVAL;
+        goto cleanup;
+    }
+
+    /* 指定したプログラムだけをロードする（他のプログラムの attach 先などを気にしなくて済む） */
+    bpf_object__for_each_program(p, obj)
+        bpf_program__set_autoload(p, p == prog);
+
+    err = bpf_object__load(obj);
+    if (err) {
+        fprintf(stderr, "Failed to load %s (err=%d)\n", obj_path, err);
+        goto cleanup;
+    }
+
+    bpf_object__for_each_map(map, obj) {
+        if (nr_maps < MAX_MAPS && snapshot_supported(map) &&
+            !take_snapshot(map, nr_cpus, &before[nr_maps]))
+            nr_maps++;
+    }
+
+    work.prog_fd = bpf_program__fd(prog);
+    work.keep_out = out_path != NULL;
+    threads = calloc(nthreads, sizeof(*threads));
+    if (!threads) {
+        err = -ENOMEM;
+        goto cleanup;
+    }
+    for (int i = 0; i < nthreads; i++) {
+        err = pthread_create(&threads[i], NULL, worker, NULL);
+        if (err) {
+            fprintf(stderr, "Failed to create worker thread: %s\n", strerror(err));
+            err = -err;
+            /* 残りのフレームを取らせずに、動き出した分だけ止めて待つ */
+            pthread_mutex_lock(&work.lock);
+            work.next = nr_frames;
+            pthread_mutex_unlock(&work.lock);
+            nthreads = i;
+            break;
+        }
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    if (err)
+        goto cleanup;
+
+    print_report(verdict_name);
+
+    printf("\nmap side effects:\n");
+    for (int i = 0; i < nr_maps; i++) {
+        if (take_snapshot(before[i].map, nr_cpus, &after[i]))
+            continue;
+        diff_snapshot(&before[i], &after[i], verbose);
+        free_snapshot(&after[i]);
+    }
+
+    if (out_path) {
+        err = write_pcapng(out_path, verdict_name);
+        if (err)
+            fprintf(stderr, "Failed to write %s: %d\n", out_path, err);
+        else
+            printf("\nWrote verdict-annotated capture to %s\n", out_path);
+    }
+
+cleanup:
+    for (int i = 0; i < nr_maps; i++)
+        free_snapshot(&before[i]);
+    for (size_t i = 0; i < nr_frames; i++) {
+        free(frames[i].data);
+        free(frames[i].out);
+    }
+    free(frames);
+    free(threads);
+    bpf_object__close(obj);
+    return err < 0 ? -err : 0;
+}
@@ -0,0 +1,350 @@
+/*
+ * percpu-bench.c（大きな per-CPU map の読み出し時間: 素朴なループ vs lookup_batch + SIMD 合算）
+ *
+ * 目的:
+ *   percpu-read.h の効果を、本物の PERCPU_HASH を読み切るまでの時間（end-to-end）で比べる。
+ *   BPF プログラムは使わず、bpf_map_create で map を作って update_batch で埋め、
+ *
+ *     naive        : get_next_key + lookup_elem（1 key 2 syscall）+ 二重ループで CPU を合算
+ *     batch/scalar : lookup_batch + スカラの合算
+ *     batch/sse4.2 : lookup_batch + SSE4.2 の合算
+ *     batch/avx2   : lookup_batch + AVX2 の合算
+ *
+ *   をそれぞれ -r 回読み、最短 / 中央値と naive に対する倍率を出す。合算の結果は全方式で一致を確認する。
+ *   続けて、syscall を除いた「合算だけ」「差分だけ」の速さもメモリ上で測る（-C で CPU 数を偽れるので、
+ *   128 CPU のホストでの合算コストを手元のマシンで見積もれる）。
+ *
+ * 使い方:
+ *   sudo ./percpu-bench [-n keys] [-f fields] [-b batch] [-r rounds] [-C cpus]
+ *
+ *   -n  key の数（既定 1048576。カーネルのメモリを keys x CPU 数 x fields x 8 bytes 使う）
+ *   -f  value の u64 の数（既定 2 = sock-top の tx / rx。hist.bpf.h の 32 スロットなら 32）
+ *   -b  lookup_batch の 1 回の key 数（既定 1024）
+ *   -r  各方式を読む回数（既定 5）
+ *   -C  メモリ上の合算 / 差分を測るときの CPU 数（既定 possible CPU 数）
+ *
+ *   map を作れない（root でない等）ときは、メモリ上の測定だけを行う。
+ *
+ * 注意:
+ *   - map を作るカーネル側のメモリは大きい（1M key x 128 CPU x 2 fields で約 2 GiB）。-n を下げて試すこと。
+ *   - naive はリーダの以前の書き方（rx-lat / cgroup-acct / drop-reason の読み出し）と同じ形。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "percpu-read.h"
+
+#define MAX_ROUNDS 64
+
+static int nr_keys = 1 << 20;
+static unsigned int nr_fields = 2;
+static unsigned int batch = 1024;
+static int rounds = 5;
+static int nr_cpus;
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* key i の CPU c, field f に入れる値（合算結果を検算できるように決めうち） */
+static unsigned long long fill_value(unsigned long long key, int c, unsigned int f)
+{
+    return key * 131 + c * 7 + f;
+}
+
+static unsigned long long expected_sum(unsigned long long key, unsigned int f)
+{
+    return key * 131 * nr_cpus + 7ULL * nr_cpus * (nr_cpus - 1) / 2 + (unsigned long long)f * nr_cpus;
+}
+
+static int create_map(void)
+{
+    LIBBPF_OPTS(bpf_map_batch_opts, opts);
+    unsigned long long *keys, *values;
+    int fd, err = 0;
+
+    fd = bpf_map_create(BPF_MAP_TYPE_PERCPU_HASH, "percpu_bench", sizeof(unsigned long long),
+                        nr_fields * 8, nr_keys, NULL);
+    if (fd < 0)
+        return -errno;
+
+    keys = malloc(batch * sizeof(*keys));
+    values = percpu_alloc((size_t)batch * nr_cpus * nr_fields);
+    if (!keys || !values) {
+        err = -ENOMEM;
+        goto out;
+    }
+
+    for (int base = 0; base < nr_keys && !err; base += batch) {
+        __u32 count = nr_keys - base < (int)batch ? (__u32)(nr_keys - base) : batch;
+
+        for (__u32 i = 0; i < count; i++) {
+            keys[i] = base + i;
+            for (int c = 0; c < nr_cpus; c++)
+                for (unsigned int f = 0; f < nr_fields; f++)
+                    values[((size_t)i * nr_cpus + c) * nr_fields + f] = fill_value(base + i, c, f);
+        }
+        if (bpf_map_update_batch(fd, keys, values, &count, &opts))
+            err = -errno;
+    }
+
+out:
+    free(keys);
+    free(values);
+    if (err) {
+        close(fd);
+        return err;
+    }
+    return fd;
+}
+
+/* 以前のリーダと同じ形: 1 key ずつ get_next_key + lookup、CPU 分を二重ループで足す */
+static int read_naive(int fd, struct percpu_snapshot *s)
+{
+    unsigned long long key, next, *pkey = NULL;
+    unsigned long long *values = malloc((size_t)nr_cpus * nr_fields * sizeof(*values));
+
+    if (!values)
+        return -ENOMEM;
+    s->nr = 0;
+    while (!bpf_map_get_next_key(fd, pkey, &next)) {
+        unsigned long long *sums;
+
+        key = next;
+        pkey = &key;
+        if (bpf_map_lookup_elem(fd, &key, values))
+            continue;
+        if (percpu_snapshot_reserve(s, s->nr + 1)) {
+            free(values);
+            return -ENOMEM;
+        }
+        memcpy(s->keys + s->nr * s->key_size, &key, sizeof(key));
+        sums = percpu_snapshot_sums(s, s->nr);
+        for (unsigned int f = 0; f < nr_fields; f++)
+            sums[f] = 0;
+        for (int c = 0; c < nr_cpus; c++)
+            for (unsigned int f = 0; f < nr_fields; f++)
+                sums[f] += values[(size_t)c * nr_fields + f];
+        s->nr++;
+    }
+    free(values);
+    return 0;
+}
+
+static int verify(const struct percpu_snapshot *s)
+{
+    if (s->nr != (size_t)nr_keys)
+        return -1;
+    for (size_t i = 0; i < s->nr; i++) {
+        unsigned long long key;
+        const unsigned long long *sums = percpu_snapshot_sums(s, i);
+
+        memcpy(&key, percpu_snapshot_key(s, i), sizeof(key));
+        for (unsigned int f = 0; f < nr_fields; f++)
+            if (sums[f] != expected_sum(key, f))
+                return -1;
+    }
+    return 0;
+}
+
+static void report(const char *name, unsigned long long *t, int n, double base_ms, int ok)
+{
+    double best, med;
+
+    qsort(t, n, sizeof(*t), cmp_ull);
+    best = t[0] / 1e6;
+    med = t[n / 2] / 1e6;
+    printf("%-16s %10.1f %10.1f %10.1f %9.2fx  %s\n", name, best, med,
+           t[0] / (double)nr_keys, base_ms > 0 ? base_ms / best : 1.0, ok ? "ok" : "MISMATCH");
+}
+
+static void bench_map(int fd)
+{
+    unsigned long long t[MAX_ROUNDS];
+    struct percpu_snapshot s = { .key_size = sizeof(unsigned long long), .nr_fields = nr_fields };
+    double naive_ms = 0;
+    int ok = 1;
+
+    printf("\nreadout of %d keys x %d cpus x %u u64 (PERCPU_HASH, batch %u)\n",
+           nr_keys, nr_cpus, nr_fields, batch);
+    printf("%-16s %10s %10s %10s %10s\n", "method", "best ms", "median ms", "ns/key", "speedup");
+
+    for (int r = 0; r < rounds; r++) {
+        unsigned long long t0 = now_ns();
+
+        if (read_naive(fd, &s))
+            ok = 0;
+        t[r] = now_ns() - t0;
+        if (r == 0 && verify(&s))
+            ok = 0;
+    }
+    qsort(t, rounds, sizeof(*t), cmp_ull);
+    naive_ms = t[0] / 1e6;
+    report("naive", t, rounds, naive_ms, ok);
+
+    for (enum percpu_impl impl = PERCPU_SCALAR; impl <= PERCPU_AVX2; impl++) {
+        struct percpu_reader r;
+        char name[32];
+
+        if (percpu_impl_select(impl) != impl)
+            continue;   /* この CPU では使えない */
+        if (percpu_reader_init(&r, fd, sizeof(unsigned long long), nr_fields * 8, batch, impl))
+            break;
+
+        ok = 1;
+        for (int i = 0; i < rounds; i++) {
+            unsigned long long t0 = now_ns();
+
+            if (percpu_read(&r, &s))
+                ok = 0;
+            t[i] = now_ns() - t0;
+            if (i == 0 && verify(&s))
+                ok = 0;
+        }
+        snprintf(name, sizeof(name), "batch/%s", percpu_impl_names[impl]);
+        report(name, t, rounds, naive_ms, ok);
+        percpu_reader_free(&r);
+    }
+    percpu_snapshot_free(&s);
+}
+
+/*
+ * syscall を除いた合算 / 差分の速さ。
+ * batch 個分の per-CPU value を何度も合算して nr_keys 個分にする（lookup_batch 後のバッファと同じ大きさ）。
+ */
+static void bench_compute(int cpus)
+{
+    size_t per_key = (size_t)cpus * nr_fields;
+    unsigned long long *src, *sums, *prev, *out;
+    unsigned long long check[PERCPU_AVX2 + 1] = {};
+
+    src = percpu_alloc((size_t)batch * per_key);
+    sums = percpu_alloc((size_t)nr_keys * nr_fields);
+    prev = percpu_alloc((size_t)nr_keys * nr_fields);
+    out = percpu_alloc((size_t)nr_keys * nr_fields);
+    if (!src || !sums || !prev || !out)
+        goto out;
+
+    srand(1);
+    for (size_t i = 0; i < (size_t)batch * per_key; i++)
+        src[i] = rand();
+    for (size_t i = 0; i < (size_t)nr_keys * nr_fields; i++)
+        prev[i] = rand() & 0xffff;
+
+    printf("\nin-memory, %d keys x %d cpus x %u u64 (no syscalls)\n", nr_keys, cpus, nr_fields);
+    printf("%-16s %12s %12s %12s %12s\n", "impl", "reduce ns/key", "reduce GB/s",
+           "delta ns/key", "delta GB/s");
+
+    for (enum percpu_impl impl = PERCPU_SCALAR; impl <= PERCPU_AVX2; impl++) {
+        unsigned long long t_red = ~0ULL, t_sub = ~0ULL, sum = 0;
+
+        if (percpu_impl_select(impl) != impl)
+            continue;
+
+        for (int r = 0; r < rounds; r++) {
+            unsigned long long t0 = now_ns();
+
+            for (int k = 0; k < nr_keys; k++)
+                percpu_reduce(impl, src + (size_t)(k % batch) * per_key, cpus, nr_fields,
+                              sums + (size_t)k * nr_fields);
+            t0 = now_ns() - t0;
+            if (t0 < t_red)
+                t_red = t0;
+
+            memcpy(out, prev, (size_t)nr_keys * nr_fields * sizeof(*out));
+            t0 = now_ns();
+            percpu_sub(impl, sums, out, (size_t)nr_keys * nr_fields);
+            t0 = now_ns() - t0;
+            if (t0 < t_sub)
+                t_sub = t0;
+        }
+        for (size_t i = 0; i < (size_t)nr_keys * nr_fields; i++)
+            sum += out[i] * (i + 1);
+        check[impl] = sum;
+
+        printf("%-16s %12.2f %12.2f %12.3f %12.2f  %s\n", percpu_impl_names[impl],
+               (double)t_red / nr_keys, (double)nr_keys * per_key * 8 / t_red,
+               (double)t_sub / nr_keys, (double)nr_keys * nr_fields * 24 / t_sub,
+               check[impl] == check[PERCPU_SCALAR] ? "ok" : "MISMATCH");
+    }
+
+out:
+    free(src);
+    free(sums);
+    free(prev);
+    free(out);
+}
+
+int main(int argc, char **argv)
+{
+    int cpus = 0, fd, opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    while ((opt = getopt(argc, argv, "n:f:b:r:C:")) != -1) {
+        switch (opt) {
+        case 'n': nr_keys = atoi(optarg); break;
+        case 'f': nr_fields = atoi(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'C': cpus = atoi(optarg); break;
+        default: nr_keys = 0; break;
+        }
+    }
+    if (nr_keys <= 0 || nr_fields == 0 || nr_fields > 1024 || batch == 0 ||
+        rounds <= 0 || rounds > MAX_ROUNDS || cpus < 0) {
+        fprintf(stderr, "Usage: %s [-n keys] [-f fields] [-b batch] [-r rounds] [-C cpus]\n",
+                argv[0]);
+        return 1;
+    }
+
+    nr_cpus = libbpf_num_possible_cpus();
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+    printf("best available: %s\n", percpu_impl_names[percpu_impl_select(PERCPU_AUTO)]);
+
+    fd = create_map();
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create PERCPU_HASH (%s); skipping map readout\n",
+                strerror(-fd));
+    } else {
+        bench_map(fd);
+        close(fd);
+    }
+
+    bench_compute(cpus ? cpus : nr_cpus);
+    return 0;
+}
@@ -0,0 +1,526 @@
+#ifndef PERCPU_READ_H
+#define PERCPU_READ_H
+
+/*
+ * percpu-read.h（per-CPU map の一括読み出しと、CPU 方向の合算 / 前回との差分の SIMD 化）
+ *
+ * 目的:
+ *   PERCPU_HASH / LRU_PERCPU_HASH を読むと、1 key あたり「CPU 数 x value」が返ってくる。
+ *   1M key x 128 CPU なら 1 回の読み出しで 1 億以上の u64 を足すことになり、
+ *   get_next_key + lookup（1 key 2 syscall）と素朴な二重ループでは、読み出しの大半が
+ *   syscall とこの足し算になる。ここでは
+ *     - bpf_map_lookup_batch で batch 個ずつ、32 bytes 境界のバッファに読む
+ *     - CPU 方向の合算を AVX2 / SSE4.2（なければスカラ）で行う
+ *     - 前回のスナップショットとの差分も同じく SIMD で引く
+ *   ところまでをまとめる。value は u64 のカウンタを nr_fields 個並べた struct を前提にする
+ *   （sock-top の talk_val, hist.bpf.h の u64[nr_slots] など）。
+ *
+ * 使い方:
+ *
+ *   struct percpu_reader r;
+ *   struct percpu_snapshot cur = {}, prev = {};
+ *   unsigned long long *delta;
+ *
+ *   percpu_reader_init(&r, fd, sizeof(key), sizeof(value), 1024, PERCPU_AUTO);
+ *   percpu_read(&r, &cur);                         // cur.keys / cur.sums（CPU 合算済み）
+ *   delta = percpu_alloc(cur.nr * cur.nr_fields);
+ *   percpu_delta(r.impl, &cur, &prev, delta);      // 行は cur の順。prev に無い key は cur のまま
+ *   ...
+ *   swap(cur, prev);                               // 次の間隔では今回が prev
+ *
+ * 合算（percpu_reduce）:
+ *
+ *   batch で返る value の並び（1 key 分）:
+ *
+ *     cpu0: f0 f1 ... f(n-1) | cpu1: f0 f1 ... | ... | cpuN: ...
+ *
+ *   nr_fields が 4（AVX2）/ 2（SSE）の倍数なら、field 方向に 4 / 2 本ずつレジスタに載せて CPU 分を足す。
+ *   nr_fields が 1 / 2（sock-top は tx / rx の 2）なら 1 key 分を平らな配列とみなして 4 レーンで足し、
+ *   最後にレーン j を field (j % nr_fields) に畳む。どちらでもない端数の field はスカラで足す。
+ *
+ * 差分（percpu_delta）:
+ *   cur と同じ順に prev の行を並べ直し（key の並びが同じなら並べ直しは要らない。違えば key のハッシュ表で引く）、
+ *   まとめて cur - prev を計算する。prev > cur（key が消されて作り直された）のレーンは 0 にする。
+ *
+ * 注意:
+ *   - SIMD の関数は __attribute__((target(...))) で個別にコンパイルし、実行時に
+ *     __builtin_cpu_supports で選ぶ。-mavx2 なしでビルドしても AVX2 の無い CPU で落ちない。
+ *   - x86 以外ではスカラだけになる（arm64 ではコンパイラの自動ベクトル化に任せる）。
+ *   - lookup_batch は 5.6 以降。1 つのハッシュバケットに batch を超える key があると ENOSPC が返るので、
+ *     そのときは batch を倍にして読み直す。
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PERCPU_X86 1
+#endif
+
+enum percpu_impl {
+    PERCPU_AUTO = 0,
+    PERCPU_SCALAR,
+    PERCPU_SSE42,
+    PERCPU_AVX2,
+};
+
+static const char *const percpu_impl_names[] = {
+    [PERCPU_AUTO]   = "auto",
+    [PERCPU_SCALAR] = "scalar",
+    [PERCPU_SSE42]  = "sse4.2",
+    [PERCPU_AVX2]   = "avx2",
+};
+
+struct percpu_snapshot {
+    size_t nr;
+    size_t cap;
+    size_t key_size;
+    unsigned int nr_fields;
+    unsigned char *keys;          /* nr x key_size */
+    unsigned long long *sums;     /* nr x nr_fields（CPU 合算済み, 32 bytes 境界） */
+};
+
+struct percpu_reader {
+    int fd;
+    int nr_cpus;
+    size_t key_size;
+    unsigned int nr_fields;
+    unsigned int batch;
+    enum percpu_impl impl;
+    unsigned char *keys;          /* batch x key_size */
+    unsigned long long *values;   /* batch x nr_cpus x nr_fields（32 bytes 境界） */
+};
+
+/* 32 bytes 境界の u64 配列（AVX2 の 1 レジスタ分）。0 埋めはしない */
+static inline unsigned long long *percpu_alloc(size_t nr)
+{
+    size_t bytes = (nr * sizeof(unsigned long long) + 31) & ~(size_t)31;
+
+    return aligned_alloc(32, bytes ? bytes : 32);
+}
+
+/* want が使えなければ使える中で一番近いものに落とす（AUTO は一番速いもの） */
+static inline enum percpu_impl percpu_impl_select(enum percpu_impl want)
+{
+#ifdef PERCPU_X86
+    bool avx2, sse42;
+
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+    sse42 = __builtin_cpu_supports("sse4.2");
+
+    if ((want == PERCPU_AUTO || want == PERCPU_AVX2) && avx2)
+        return PERCPU_AVX2;
+    if (want != PERCPU_SCALAR && sse42)
+        return PERCPU_SSE42;
+#else
+    (void)want;
+#endif
+    return PERCPU_SCALAR;
+}
+
+/* ---- 合算 / 差分のカーネル ------------------------------------------------ */
+
+static inline void percpu_reduce_scalar(const unsigned long long *src, unsigned int nr_cpus,
+                                        unsigned int nf, unsigned long long *dst)
+{
+    memset(dst, 0, nf * sizeof(*dst));
+    for (unsigned int c = 0; c < nr_cpus; c++)
+        for (unsigned int f = 0; f < nf; f++)
+            dst[f] += src[(size_t)c * nf + f];
+}
+
+/* out[i] = cur[i] - out[i]（out には並べ直した prev が入っている。負になるなら 0） */
+static inline void percpu_sub_scalar(const unsigned long long *cur, unsigned long long *out,
+                                     size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = cur[i] >= out[i] ? cur[i] - out[i] : 0;
+}
+
+#ifdef PERCPU_X86
+
+__attribute__((target("avx2")))
+static inline void percpu_reduce_avx2(const unsigned long long *src, unsigned int nr_cpus,
+                                      unsigned int nf, unsigned long long *dst)
+{
+    size_t n = (size_t)nr_cpus * nf, i = 0;
+    unsigned int f = 0;
+
+    if (nf == 1 || nf == 2) {
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+        unsigned long long lane[4];
+
+        /* 2 本のアキュムレータで加算の依存を切る */
+        for (; i + 8 <= n; i += 8) {
+            a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i *)(src + i)));
+            a1 = _mm256_add_epi64(a1, _mm256_loadu_si256((const __m256i *)(src + i + 4)));
+        }
+        for (; i + 4 <= n; i += 4)
+            a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i *)(src + i)));
+        _mm256_storeu_si256((__m256i *)lane, _mm256_add_epi64(a0, a1));
+
+        if (nf == 1) {
+            dst[0] = lane[0] + lane[1] + lane[2] + lane[3];
+        } else {
+            dst[0] = lane[0] + lane[2];
+            dst[1] = lane[1] + lane[3];
+        }
+        for (; i < n; i++)
+            dst[i % nf] += src[i];
+        return;
+    }
+
+    for (; f + 4 <= nf; f += 4) {
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+        unsigned int c = 0;
+
+        for (; c + 2 <= nr_cpus; c += 2) {
+            a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i *)(src + (size_t)c * nf + f)));
+            a1 = _mm256_add_epi64(a1, _mm256_loadu_si256((const __m256i *)(src + (size_t)(c + 1) * nf + f)));
+        }
+        if (c < nr_cpus)
+            a0 = _mm256_add_epi64(a0, _mm256_loadu_si256((const __m256i *)(src + (size_t)c * nf + f)));
+        _mm256_storeu_si256((__m256i *)(dst + f), _mm256_add_epi64(a0, a1));
+    }
+    for (; f < nf; f++) {
+        dst[f] = 0;
+        for (unsigned int c = 0; c < nr_cpus; c++)
+            dst[f] += src[(size_t)c * nf + f];
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void percpu_sub_avx2(const unsigned long long *cur, unsigned long long *out,
+                                   size_t n)
+{
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(cur + i));
+        __m256i p = _mm256_loadu_si256((const __m256i *)(out + i));
+        /* 符号なし比較は符号ビットを反転してから符号付きで比べる */
+        __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(p, sign), _mm256_xor_si256(c, sign));
+
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm256_andnot_si256(gt, _mm256_sub_epi64(c, p)));
+    }
+    percpu_sub_scalar(cur + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static inline void percpu_reduce_sse42(const unsigned long long *src, unsigned int nr_cpus,
+                                       unsigned int nf, unsigned long long *dst)
+{
+    size_t n = (size_t)nr_cpus * nf, i = 0;
+    unsigned int f = 0;
+
+    if (nf == 1) {
+        __m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+        unsigned long long lane[2];
+
+        for (; i + 4 <= n; i += 4) {
+            a0 = _mm_add_epi64(a0, _mm_loadu_si128((const __m128i *)(src + i)));
+            a1 = _mm_add_epi64(a1, _mm_loadu_si128((const __m128i *)(src + i + 2)));
+        }
+        _mm_storeu_si128((__m128i *)lane, _mm_add_epi64(a0, a1));
+        dst[0] = lane[0] + lane[1];
+        for (; i < n; i++)
+            dst[0] += src[i];
+        return;
+    }
+
+    for (; f + 2 <= nf; f += 2) {
+        __m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+        unsigned int c = 0;
+
+        for (; c + 2 <= nr_cpus; c += 2) {
+            a0 = _mm_add_epi64(a0, _mm_loadu_si128((const __m128i *)(src + (size_t)c * nf + f)));
+            a1 = _mm_add_epi64(a1, _mm_loadu_si128((const __m128i *)(src + (size_t)(c + 1) * nf + f)));
+        }
+        if (c < nr_cpus)
+            a0 = _mm_add_epi64(a0, _mm_loadu_si128((const __m128i *)(src + (size_t)c * nf + f)));
+        _mm_storeu_si128((__m128i *)(dst + f), _mm_add_epi64(a0, a1));
+    }
+    for (; f < nf; f++) {
+        dst[f] = 0;
+        for (unsigned int c = 0; c < nr_cpus; c++)
+            dst[f] += src[(size_t)c * nf + f];
+    }
+}
+
+__attribute__((target("sse4.2")))
+static inline void percpu_sub_sse42(const unsigned long long *cur, unsigned long long *out,
+                                    size_t n)
+{
+    const __m128i sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+    size_t i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(cur + i));
+        __m128i p = _mm_loadu_si128((const __m128i *)(out + i));
+        __m128i gt = _mm_cmpgt_epi64(_mm_xor_si128(p, sign), _mm_xor_si128(c, sign));
+
+        _mm_storeu_si128((__m128i *)(out + i), _mm_andnot_si128(gt, _mm_sub_epi64(c, p)));
+    }
+    percpu_sub_scalar(cur + i, out + i, n - i);
+}
+
+#endif /* PERCPU_X86 */
+
+/* 1 key 分の per-CPU value（nr_cpus x nf 個の u64）を dst[nf] に合算する */
+static inline void percpu_reduce(enum percpu_impl impl, const unsigned long long *src,
+                                 unsigned int nr_cpus, unsigned int nf, unsigned long long *dst)
+{
+#ifdef PERCPU_X86
+    if (impl == PERCPU_AVX2) {
+        percpu_reduce_avx2(src, nr_cpus, nf, dst);
+        return;
+    }
+    if (impl == PERCPU_SSE42) {
+        percpu_reduce_sse42(src, nr_cpus, nf, dst);
+        return;
+    }
+#endif
+    (void)impl;
+    percpu_reduce_scalar(src, nr_cpus, nf, dst);
+}
+
+static inline void percpu_sub(enum percpu_impl impl, const unsigned long long *cur,
+                              unsigned long long *out, size_t n)
+{
+#ifdef PERCPU_X86
+    if (impl == PERCPU_AVX2) {
+        percpu_sub_avx2(cur, out, n);
+        return;
+    }
+    if (impl == PERCPU_SSE42) {
+        percpu_sub_sse42(cur, out, n);
+        return;
+    }
+#endif
+    (void)impl;
+    percpu_sub_scalar(cur, out, n);
+}
+
+/* ---- 読み出し ------------------------------------------------------------- */
+
+static inline void percpu_snapshot_free(struct percpu_snapshot *s)
+{
+    free(s->keys);
+    free(s->sums);
+    memset(s, 0, sizeof(*s));
+}
+
+static inline const void *percpu_snapshot_key(const struct percpu_snapshot *s, size_t i)
+{
+    return s->keys + i * s->key_size;
+}
+
+static inline unsigned long long *percpu_snapshot_sums(const struct percpu_snapshot *s, size_t i)
+{
+    return s->sums + i * s->nr_fields;
+}
+
+/* 少なくとも want 行入るようにする */
+static inline int percpu_snapshot_reserve(struct percpu_snapshot *s, size_t want)
+{
+    unsigned long long *sums;
+    unsigned char *keys;
+    size_t cap;
+
+    if (want <= s->cap)
+        return 0;
+    cap = s->cap ? s->cap : 1024;
+    while (cap < want)
+        cap *= 2;
+
+    keys = realloc(s->keys, cap * s->key_size);
+    if (!keys)
+        return -ENOMEM;
+    s->keys = keys;
+
+    /* aligned_alloc の領域は realloc できないので作り直して写す */
+    sums = percpu_alloc(cap * s->nr_fields);
+    if (!sums)
+        return -ENOMEM;
+    if (s->sums)
+        memcpy(sums, s->sums, s->nr * s->nr_fields * sizeof(*sums));
+    free(s->sums);
+    s->sums = sums;
+    s->cap = cap;
+    return 0;
+}
+
+static inline void percpu_reader_free(struct percpu_reader *r)
+{
+    free(r->keys);
+    free(r->values);
+    r->keys = NULL;
+    r->values = NULL;
+}
+
+static inline int percpu_reader_alloc(struct percpu_reader *r, unsigned int batch)
+{
+    percpu_reader_free(r);
+    r->batch = batch;
+    r->keys = malloc((size_t)batch * r->key_size);
+    r->values = percpu_alloc((size_t)batch * r->nr_cpus * r->nr_fields);
+    if (!r->keys || !r->values) {
+        percpu_reader_free(r);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/*
+ * percpu_reader_init:
+ *   value_size は 8 の倍数（u64 のカウンタの並び）であること。impl は PERCPU_AUTO で一番速いものを選ぶ。
+ *   失敗は負の errno。
+ */
+static inline int percpu_reader_init(struct percpu_reader *r, int fd, size_t key_size,
+                                     size_t value_size, unsigned int batch,
+                                     enum percpu_impl impl)
+{
+    memset(r, 0, sizeof(*r));
+    if (!key_size || !value_size || value_size % 8)
+        return -EINVAL;
+
+    r->nr_cpus = libbpf_num_possible_cpus();
+    if (r->nr_cpus <= 0)
+        return r->nr_cpus ? r->nr_cpus : -EINVAL;
+
+    r->fd = fd;
+    r->key_size = key_size;
+    r->nr_fields = value_size / 8;
+    r->impl = percpu_impl_select(impl);
+    return percpu_reader_alloc(r, batch ? batch : 1024);
+}
+
+/* map 全体を読んで s に詰め直す（s の領域は使い回す）。s は 0 埋めか、前回の percpu_read の結果 */
+static inline int percpu_read(struct percpu_reader *r, struct percpu_snapshot *s)
+{
+    __u32 out_batch = 0, count;
+    void *in = NULL;
+    int err;
+
+    if (s->key_size != r->key_size || s->nr_fields != r->nr_fields) {
+        percpu_snapshot_free(s);
+        s->key_size = r->key_size;
+        s->nr_fields = r->nr_fields;
+    }
+    s->nr = 0;
+
+    for (;;) {
+        count = r->batch;
+        err = bpf_map_lookup_batch(r->fd, in, &out_batch, r->keys, r->values, &count, NULL);
+        if (err && errno == ENOSPC && !count) {
+            /* 1 つのバケットに batch を超える key がある: 大きくして同じ位置から読み直す */
+            if (r->batch >= (1U << 20) || percpu_reader_alloc(r, r->batch * 2))
+                return -ENOSPC;
+            continue;
+        }
+        if (err && errno != ENOENT)
+            return -errno;
+
+        if (percpu_snapshot_reserve(s, s->nr + count))
+            return -ENOMEM;
+        memcpy(s->keys + s->nr * s->key_size, r->keys, (size_t)count * r->key_size);
+        for (__u32 i = 0; i < count; i++)
+            percpu_reduce(r->impl, r->values + (size_t)i * r->nr_cpus * r->nr_fields,
+                          r->nr_cpus, r->nr_fields, percpu_snapshot_sums(s, s->nr + i));
+        s->nr += count;
+        if (err)
+            return 0;   /* ENOENT: 最後まで読んだ */
+        in = &out_batch;
+    }
+}
+
+/* ---- 差分 ----------------------------------------------------------------- */
+
+/* FNV-1a（key の並びが前回と変わったときに prev を引くためだけに使う） */
+static inline unsigned int percpu_key_hash(const void *key, size_t len)
+{
+    const unsigned char *p = key;
+    unsigned int h = 2166136261U;
+
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619U;
+    return h;
+}
+
+/*
+ * percpu_delta:
+ *   out[i * nr_fields + f] = cur の i 行目 - prev の同じ key の行（prev に無ければ cur のまま）。
+ *   out は cur->nr * cur->nr_fields 個（percpu_alloc で確保すると SIMD のロードが境界に揃う）。
+ *   失敗は負の errno。
+ */
+static inline int percpu_delta(enum percpu_impl impl, const struct percpu_snapshot *cur,
+                               const struct percpu_snapshot *prev, unsigned long long *out)
+{
+    size_t nf = cur->nr_fields, row = nf * sizeof(*out);
+    unsigned int *index = NULL, mask = 0;
+
+    impl = percpu_impl_select(impl);
+
+    /* 前回と key の並びがまったく同じなら（よくある）、並べ直さずにそのまま引く */
+    if (prev->nr == cur->nr && prev->nr_fields == nf && prev->key_size == cur->key_size &&
+        !memcmp(prev->keys, cur->keys, cur->nr * cur->key_size)) {
+        memcpy(out, prev->sums, cur->nr * row);
+        percpu_sub(impl, cur->sums, out, cur->nr * nf);
+        return 0;
+    }
+
+    for (size_t i = 0; i < cur->nr; i++) {
+        const void *key = percpu_snapshot_key(cur, i);
+        const unsigned long long *p = NULL;
+
+        if (prev->nr_fields != nf || prev->key_size != cur->key_size) {
+            /* 形の違う prev（初回の空のスナップショットなど）は無いものとして扱う */
+        } else if (i < prev->nr && !memcmp(percpu_snapshot_key(prev, i), key, cur->key_size)) {
+            p = percpu_snapshot_sums(prev, i);
+        } else {
+            unsigned int h, j;
+
+            /* 位置がずれていたら prev の key のハッシュ表を作って引く（初回だけ作る） */
+            if (!index) {
+                mask = 1;
+                while (mask < prev->nr * 2)
+                    mask <<= 1;
+                index = calloc(mask, sizeof(*index));
+                if (!index)
+                    return -ENOMEM;
+                mask--;
+                for (size_t k = 0; k < prev->nr; k++) {
+                    h = percpu_key_hash(percpu_snapshot_key(prev, k), prev->key_size) & mask;
+                    while (index[h])
+                        h = (h + 1) & mask;
+                    index[h] = k + 1;
+                }
+            }
+            for (h = percpu_key_hash(key, cur->key_size) & mask; (j = index[h]); h = (h + 1) & mask) {
+                if (!memcmp(percpu_snapshot_key(prev, j - 1), key, cur->key_size)) {
+                    p = percpu_snapshot_sums(prev, j - 1);
+                    break;
+                }
+            }
+        }
+
+        if (p)
+            memcpy(out + i * nf, p, row);
+        else
+            memset(out + i * nf, 0, row);
+    }
+    free(index);
+
+    percpu_sub(impl, cur->sums, out, cur->nr * nf);
+    return 0;
+}
+
+#endif /* PERCPU_READ_H */
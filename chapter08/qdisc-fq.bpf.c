@@ -0,0 +1,290 @@
+/*
+ * qdisc-fq.bpf.c（struct_ops で登録する BPF qdisc / フロー単位の公平キューイング）
+ *
+ * 目的:
+ *   network.bpf.c の TC プログラムは「通す（TC_ACT_OK）か落とす（TC_ACT_SHOT）か」しか選べず、
+ *   パケットを溜めて順番を入れ替える（= キューイング）ことはできない。
+ *   BPF qdisc（Qdisc_ops の struct_ops, 6.16+）を使うと、enqueue/dequeue そのものを BPF で書ける。
+ *
+ * 方針（Self-Clocked Fair Queueing）:
+ *
+ *   enqueue(skb)
+ *     │  flow = flows[skb の flow hash]
+ *     │  start  = max(vclock, flow.last_finish)
+ *     │  finish = start + pkt_len            … このフローが “これまでに使った帯域” の分だけ後ろへ
+ *     │  flow.last_finish = finish
+ *     v
+ *   rbtree（finish 昇順）に skb を入れる
+ *
+ *   dequeue()
+ *     │  rbtree の先頭（finish 最小）を取り出す
+ *     │  vclock = その finish                … 仮想時計は “いま送っているパケット” に追従
+ *     v
+ *   skb を返す
+ *
+ *   バルクフローは last_finish がどんどん先に進むので後ろに並び、
+ *   たまにしか送らない対話的フローは vclock 付近の finish になって先頭近くに割り込める。
+ *   結果としてフロー数で帯域が等分され、対話的フローの待ち時間はバルクの量に引きずられない。
+ *
+ * データ構造:
+ *   - skb は bpf_obj_new() で確保した skb_node に kptr として保持し、
+ *     グローバルな bpf_rb_root（spin lock で保護）に繋ぐ。
+ *   - フロー状態はパケットを持たないただの数値なので LRU hash に置く。
+ *
+ * 注意:
+ *   - qdisc の enqueue/dequeue は qdisc ロック下で直列に呼ばれるので、
+ *     vclock / flows の更新に追加の排他は不要（rbtree 操作は verifier の要求で lock を取る）。
+ *   - rbtree・vclock・flows はオブジェクトに 1 つずつしかないので、
+ *     1 つのロードにつき qdisc インスタンスは 1 つ（1 デバイス・1 箇所）だけで使う想定。
+ *   - bpf_list / bpf_rbtree 系 kfunc の宣言は selftests の bpf_experimental.h 相当を自前で書く。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "qdisc-fq.h"
+
+#define NET_XMIT_SUCCESS 0x00
+#define NET_XMIT_DROP    0x01
+
+/* グラフ型データ構造（list/rbtree）の “中身の型” を BTF に教えるタグ */
+#define __contains(name, node) __attribute__((btf_decl_tag("contains:" #name ":" #node)))
+
+/* lock と rb_root は同じデータセクションに置く必要がある */
+#define private(name) SEC(".data." #name) __hidden __attribute__((aligned(8)))
+
+#ifndef container_of
+#define container_of(ptr, type, member) \
+    ((type *)((void *)(ptr) - __builtin_offsetof(type, member)))
+#endif
+
+/* bpf_obj_new / rbtree 系 kfunc */
+extern void *bpf_obj_new_impl(__u64 local_type_id, void *meta) __ksym;
+extern void bpf_obj_drop_impl(void *kptr, void *meta) __ksym;
+extern int bpf_rbtree_add_impl(struct bpf_rb_root *root, struct bpf_rb_node *node,
+                               bool (less)(struct bpf_rb_node *a, const struct bpf_rb_node *b),
+                               void *meta, __u64 off) __ksym;
+extern struct bpf_rb_node *bpf_rbtree_first(struct bpf_rb_root *root) __ksym;
+extern struct bpf_rb_node *bpf_rbtree_remove(struct bpf_rb_root *root,
+                                             struct bpf_rb_node *node) __ksym;
+
+#define bpf_obj_new(type) ((type *)bpf_obj_new_impl(bpf_core_type_id_local(type), NULL))
+#define bpf_obj_drop(kptr) bpf_obj_drop_impl(kptr, NULL)
+#define bpf_rbtree_add(root, node, less) bpf_rbtree_add_impl(root, node, less, NULL, 0)
+
+/* BPF qdisc 用 kfunc */
+extern void bpf_qdisc_skb_drop(struct sk_buff *skb, struct bpf_sk_buff_ptr *to_free) __ksym;
+extern void bpf_qdisc_bstats_update(struct Qdisc *sch, const struct sk_buff *skb) __ksym;
+extern void bpf_kfree_skb(struct sk_buff *skb) __ksym;
+extern u32 bpf_skb_get_hash(struct sk_buff *skb) __ksym;
+
+/*
+ * パラメータ（.rodata / ローダが load 前に設定）
+ *   limit      : qdisc 全体のパケット数上限
+ *   flow_limit : 1 フローあたりのパケット数上限（1 本のバルクがキューを独占しないように）
+ */
+const volatile u32 limit = 10000;
+const volatile u32 flow_limit = 100;
+
+struct skb_node {
+    u64 finish;
+    u32 hash;
+    struct sk_buff __kptr *skb;
+    struct bpf_rb_node node;
+};
+
+private(A) struct bpf_spin_lock q_lock;
+private(A) struct bpf_rb_root q_tree __contains(skb_node, node);
+
+/* 仮想時計（最後に dequeue したパケットの finish） */
+u64 vclock = 0;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 65536);
+    __type(key, u32);
+    __type(value, struct flow_state);
+} flows SEC(".maps");
+
+static __always_inline u32 qdisc_pkt_len(const struct sk_buff *skb)
+{
+    return ((struct qdisc_skb_cb *)skb->cb)->pkt_len;
+}
+
+static bool finish_less(struct bpf_rb_node *a, const struct bpf_rb_node *b)
+{
+    struct skb_node *na = container_of(a, struct skb_node, node);
+    struct skb_node *nb = container_of(b, struct skb_node, node);
+
+    return na->finish < nb->finish;
+}
+
+static __always_inline struct flow_state *get_flow(u32 hash)
+{
+    struct flow_state zero = {}, *flow;
+
+    flow = bpf_map_lookup_elem(&flows, &hash);
+    if (flow)
+        return flow;
+
+    bpf_map_update_elem(&flows, &hash, &zero, BPF_NOEXIST);
+    return bpf_map_lookup_elem(&flows, &hash);
+}
+
+SEC("struct_ops/bpf_fq_enqueue")
+int BPF_PROG(bpf_fq_enqueue, struct sk_buff *skb, struct Qdisc *sch,
+             struct bpf_sk_buff_ptr *to_free)
+{
+    struct flow_state *flow;
+    struct skb_node *skbn;
+    u32 len = qdisc_pkt_len(skb);
+    u32 hash = bpf_skb_get_hash(skb);
+    u64 start;
+
+    flow = get_flow(hash);
+    if (!flow)
+        goto drop;
+
+    if (sch->q.qlen >= sch->limit || flow->qlen >= flow_limit) {
+        flow->drops++;
+        goto drop;
+    }
+
+    skbn = bpf_obj_new(typeof(*skbn));
+    if (!skbn) {
+        flow->drops++;
+        goto drop;
+    }
+
+    start = flow->last_finish > vclock ? flow->last_finish : vclock;
+    skbn->finish = start + len;
+    skbn->hash = hash;
+    flow->last_finish = skbn->finish;
+    flow->qlen++;
+    flow->pkts++;
+
+    /* skb の所有権を node に移す（古い値は無いはずだが、あれば捨てる） */
+    skb = bpf_kptr_xchg(&skbn->skb, skb);
+    if (skb)
+        bpf_qdisc_skb_drop(skb, to_free);
+
+    bpf_spin_lock(&q_lock);
+    bpf_rbtree_add(&q_tree, &skbn->node, finish_less);
+    bpf_spin_unlock(&q_lock);
+
+    sch->q.qlen++;
+    sch->qstats.backlog += len;
+    return NET_XMIT_SUCCESS;
+
+drop:
+    bpf_qdisc_skb_drop(skb, to_free);
+    return NET_XMIT_DROP;
+}
+
+SEC("struct_ops/bpf_fq_dequeue")
+struct sk_buff *BPF_PROG(bpf_fq_dequeue, struct Qdisc *sch)
+{
+    struct sk_buff *skb = NULL;
+    struct flow_state *flow;
+    struct bpf_rb_node *rb;
+    struct skb_node *skbn;
+    u32 hash;
+
+    bpf_spin_lock(&q_lock);
+    rb = bpf_rbtree_first(&q_tree);
+    if (!rb) {
+        bpf_spin_unlock(&q_lock);
+        return NULL;
+    }
+    rb = bpf_rbtree_remove(&q_tree, rb);
+    bpf_spin_unlock(&q_lock);
+    if (!rb)
+        return NULL;
+
+    skbn = container_of(rb, struct skb_node, node);
+    vclock = skbn->finish;
+    hash = skbn->hash;
+    skb = bpf_kptr_xchg(&skbn->skb, skb);
+    bpf_obj_drop(skbn);
+    if (!skb)
+        return NULL;
+
+    flow = bpf_map_lookup_elem(&flows, &hash);
+    if (flow && flow->qlen)
+        flow->qlen--;
+
+    sch->qstats.backlog -= qdisc_pkt_len(skb);
+    bpf_qdisc_bstats_update(sch, skb);
+    sch->q.qlen--;
+    return skb;
+}
+
+SEC("struct_ops/bpf_fq_init")
+int BPF_PROG(bpf_fq_init, struct Qdisc *sch, struct nlattr *opt,
+             struct netlink_ext_ack *extack)
+{
+    sch->limit = limit;
+    return 0;
+}
+
+/* キューに残っている skb を全部捨てる（reset / destroy 共通） */
+static __always_inline void drain_all(struct Qdisc *sch)
+{
+    struct flow_state *flow;
+    struct bpf_rb_node *rb;
+    struct skb_node *skbn;
+    struct sk_buff *skb;
+    int i;
+
+    bpf_for(i, 0, sch->q.qlen) {
+        skb = NULL;
+
+        bpf_spin_lock(&q_lock);
+        rb = bpf_rbtree_first(&q_tree);
+        if (!rb) {
+            bpf_spin_unlock(&q_lock);
+            break;
+        }
+        rb = bpf_rbtree_remove(&q_tree, rb);
+        bpf_spin_unlock(&q_lock);
+        if (!rb)
+            break;
+
+        skbn = container_of(rb, struct skb_node, node);
+        flow = bpf_map_lookup_elem(&flows, &skbn->hash);
+        if (flow && flow->qlen)
+            flow->qlen--;
+        skb = bpf_kptr_xchg(&skbn->skb, skb);
+        if (skb)
+            bpf_kfree_skb(skb);
+        bpf_obj_drop(skbn);
+    }
+
+    sch->q.qlen = 0;
+    vclock = 0;
+}
+
+SEC("struct_ops/bpf_fq_reset")
+void BPF_PROG(bpf_fq_reset, struct Qdisc *sch)
+{
+    drain_all(sch);
+}
+
+SEC("struct_ops/bpf_fq_destroy")
+void BPF_PROG(bpf_fq_destroy, struct Qdisc *sch)
+{
+    drain_all(sch);
+}
+
+SEC(".struct_ops.link")
+struct Qdisc_ops fq = {
+    .enqueue = (void *)bpf_fq_enqueue,
+    .dequeue = (void *)bpf_fq_dequeue,
+    .init    = (void *)bpf_fq_init,
+    .reset   = (void *)bpf_fq_reset,
+    .destroy = (void *)bpf_fq_destroy,
+    .id      = "bpf_fq",
+};
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,191 @@
+/*
+ * qdisc-fq.c（ユーザ空間側 / BPF qdisc "bpf_fq" の登録と設置）
+ *
+ * 目的:
+ *   qdisc-fq.bpf.c の struct Qdisc_ops を struct_ops として登録し（= tc から "bpf_fq" が選べるようになる）、
+ *   必要なら指定デバイスに tc で設置して、1 秒ごとにフロー単位の統計を表示する。
+ *   Ctrl-C で設置した qdisc を外し、link を破棄して登録を解除する。
+ *
+ * 使い方:
+ *   sudo ./qdisc-fq [-l limit] [-f flow_limit] [-d dev [-n netns] [-p parent]]
+ *
+ *   -l <n>       qdisc 全体のパケット数上限（既定 10000）
+ *   -f <n>       1 フローあたりのパケット数上限（既定 100）
+ *   -d <dev>     登録後に tc qdisc replace で dev に設置する
+ *   -n <netns>   dev がいる network namespace（ip netns exec 経由で tc を呼ぶ）
+ *   -p <parent>  設置位置（既定 root。netns.sh shaped の htb 配下なら 1:10）
+ *
+ * 比較の手順（netns.sh + tcp-bulk + udp-ping）:
+ *
+ *   sudo ./netns.sh shaped 100mbit 2ms          # veth1: htb 100Mbit → 葉 fq_codel
+ *   sudo ./qdisc-fq -n ns1 -d veth1 -p 1:10 &   # 葉を bpf_fq に差し替える
+ *   sudo ip netns exec ns2 ./tcp-bulk server &
+ *   sudo ip netns exec ns2 ./udp-ping server &
+ *   sudo ip netns exec ns1 ./tcp-bulk client 10.0.0.2 -d 20 &   # バルクフロー（複数本並べてもよい）
+ *   sudo ip netns exec ns1 ./udp-ping client 10.0.0.2 -d 10     # 対話的フローの RTT
+ *
+ *   qdisc-fq を起動せずに（葉 = fq_codel のまま）同じ手順を行い、
+ *   udp-ping の p50/p99 と -i 0（flood）での pps を比べる。
+ *   （葉を別の qdisc で比べたいときは netns.sh shaped の第 3 引数で指定する）
+ *
+ * 注意:
+ *   - 終了時に設置した qdisc を消すと、その位置は既定の qdisc（htb 配下なら pfifo）に戻る。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "qdisc-fq.h"
+#include "qdisc-fq.skel.h"
+
+#define MAX_PRINT_FLOWS 16
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* tc qdisc replace/del を（必要なら netns 内で）実行する */
+static int run_tc(const char *netns, const char *verb, const char *dev, const char *parent)
+{
+    char cmd[256];
+
+    snprintf(cmd, sizeof(cmd), "%s%s%stc qdisc %s dev %s %s%s%s%s",
+             netns ? "ip netns exec " : "", netns ? netns : "", netns ? " " : "",
+             verb, dev,
+             strcmp(parent, "root") ? "parent " : "", parent,
+             strcmp(verb, "del") ? " bpf_fq" : "",
+             strcmp(verb, "del") ? "" : " 2>/dev/null");
+    return system(cmd);
+}
+
+/* flows map を走査して、キュー長・累計パケット数・ドロップ数を表示する */
+static void print_flows(struct qdisc_fq_bpf *skel)
+{
+    int fd = bpf_map__fd(skel->maps.flows);
+    struct flow_state fs;
+    __u32 key, next, *prev = NULL;
+    unsigned long long pkts = 0, drops = 0;
+    int nr = 0, shown = 0;
+
+    while (!bpf_map_get_next_key(fd, prev, &next)) {
+        key = next;
+        prev = &key;
+        if (bpf_map_lookup_elem(fd, &key, &fs))
+            continue;
+
+        nr++;
+        pkts += fs.pkts;
+        drops += fs.drops;
+        if (shown < MAX_PRINT_FLOWS && (fs.qlen || fs.drops)) {
+            printf("  flow %08x qlen=%-5u pkts=%-10llu drops=%llu\n",
+                   key, fs.qlen, fs.pkts, fs.drops);
+            shown++;
+        }
+    }
+    printf("flows=%d pkts=%llu drops=%llu vclock=%llu\n",
+           nr, pkts, drops, (unsigned long long)skel->bss->vclock);
+}
+
+int main(int argc, char **argv)
+{
+    struct qdisc_fq_bpf *skel = NULL;
+    struct bpf_link *link = NULL;
+    const char *dev = NULL, *netns = NULL, *parent = "root";
+    bool installed = false;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    skel = qdisc_fq_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    while ((opt = getopt(argc, argv, "l:f:d:n:p:")) != -1) {
+        switch (opt) {
+        case 'l':
+            skel->rodata->limit = (__u32)strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            skel->rodata->flow_limit = (__u32)strtoul(optarg, NULL, 0);
+            break;
+        case 'd': dev = optarg; break;
+        case 'n': netns = optarg; break;
+        case 'p': parent = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-l limit] [-f flow_limit] "
+                            "[-d dev [-n netns] [-p parent]]\n", argv[0]);
+            err = -EINVAL;
+            goto cleanup;
+        }
+    }
+
+    err = qdisc_fq_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    link = bpf_map__attach_struct_ops(skel->maps.fq);
+    if (!link) {
+        err = -errno;
+        fprintf(stderr, "Failed to register bpf_fq: %d\n", err);
+        goto cleanup;
+    }
+
+    printf("bpf_fq registered (limit=%u flow_limit=%u).\n",
+           skel->rodata->limit, skel->rodata->flow_limit);
+
+    if (dev) {
+        if (run_tc(netns, "replace", dev, parent)) {
+            fprintf(stderr, "Failed to install bpf_fq on %s (parent %s)\n", dev, parent);
+            err = -EINVAL;
+            goto cleanup;
+        }
+        installed = true;
+        printf("Installed on %s%s%s parent %s.\n",
+               dev, netns ? " in netns " : "", netns ? netns : "", parent);
+    }
+    printf("Ctrl-C to unregister.\n");
+
+    while (!exiting) {
+        sleep(1);
+        print_flows(skel);
+    }
+
+cleanup:
+    /* qdisc が使用中だと登録解除できないので、先に外す */
+    if (installed)
+        run_tc(netns, "del", dev, parent);
+    bpf_link__destroy(link);
+    qdisc_fq_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
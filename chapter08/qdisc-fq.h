@@ -0,0 +1,25 @@
+#ifndef QDISC_FQ_H
+#define QDISC_FQ_H
+
+/*
+ * qdisc-fq.h（BPF qdisc "bpf_fq" とローダで共有する定義）
+ */
+
+/*
+ * struct flow_state:
+ *   flows map（key = skb の flow hash）の value。
+ *
+ *   last_finish : このフローに最後に積んだパケットの仮想終了時刻（バイト単位の仮想時計）
+ *   qlen        : いまキューに入っているこのフローのパケット数
+ *   pkts        : 積んだパケット数（累計）
+ *   drops       : フロー上限・キュー上限で落としたパケット数（累計）
+ */
+struct flow_state {
+   unsigned long long last_finish;
+   unsigned int qlen;
+   unsigned int pad;
+   unsigned long long pkts;
+   unsigned long long drops;
+};
+
+#endif /* QDISC_FQ_H */
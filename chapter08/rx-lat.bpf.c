@@ -0,0 +1,161 @@
+/*
+ * rx-lat.bpf.c（受信パスの区間別遅延を log2 ヒストグラムにする）
+ *
+ * 目的:
+ *   「受信遅延がホストのどこで使われているか」を、ドライバ → スタック → ソケットの区間に分けて測る。
+ *
+ * 計測点:
+ *
+ *   tp_btf/napi_gro_receive_entry   (ドライバが NAPI poll で skb を渡した)     t_gro
+ *     │
+ *   tp_btf/netif_receive_skb        (GRO を抜けてプロトコルスタックへ)          t_stack
+ *     │
+ *   fentry/tcp_queue_rcv            (TCP 受信キューに入った)                   t_sock
+ *   fentry/__udp_enqueue_schedule_skb (UDP 受信キューに入った)
+ *
+ *   skb ポインタを key に、最初に見えた時刻と受信デバイスを starts map に覚えておき、
+ *   後ろの計測点で差分をとって hists[{ifindex, stage}] の log2 バケットに足す（hist.bpf.h）。
+ *   ソケットに入った時点で starts から消す。
+ *
+ *   tp_btf/kfree_skb, tp_btf/consume_skb (途中で捨てられた / 消費された)      starts から消す
+ *
+ * 注意:
+ *   - key は skb のアドレスなので、残ったエントリは slab の再利用で別の skb に化ける
+ *     （GRO 区間にその間の時間まるごとが入る）。そのため解放の tracepoint で消し、
+ *     さらに t_first から MAX_AGE_NS を超えたエントリは別の skb のものとみなして起点を取り直す。
+ *     GRO でまとめられて tracepoint を通らずに解放される skb（stolen head など）は後者で弾く。
+ *     それでも残るものに備えて map は LRU にしておく。
+ *   - napi_gro_receive_entry を通らないドライバ（GRO オフの veth など）では
+ *     netif_receive_skb が最初の計測点になり、STAGE_GRO_TO_STACK は数えられない。
+ *     veth で GRO 区間も見たいときは受信側で ethtool -K <veth> gro on にする（NAPI モードになる）。
+ *   - sock_def_readable は skb を受け取らないので、skb 単位で突き合わせられる
+ *     tcp_queue_rcv / __udp_enqueue_schedule_skb をソケット到着点にしている。
+ *     tcp_queue_rcv は static 関数なので、インライン化されたカーネルでは attach できない
+ *     （ローダは失敗したら TCP 側の計測を外して続行する）。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "rx-lat.h"
+#include "hist.bpf.h"
+
+struct start {
+    u64 t_first;
+    u64 t_stack;
+    u32 ifindex;
+    u32 pad;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 65536);
+    __type(key, u64);
+    __type(value, struct start);
+} starts SEC(".maps");
+
+HIST_MAP(hists, struct hist_key, RX_LAT_SLOTS, 1024);
+
+/* これより古い starts のエントリは、再利用された skb アドレスに残った古い値とみなす */
+#define MAX_AGE_NS  (1000ULL * 1000 * 1000)
+
+static __always_inline void stage_add(u32 ifindex, u32 stage, u64 delta)
+{
+    struct hist_key key = { .ifindex = ifindex, .stage = stage };
+
+    hist_add_log2(&hists, &key, delta, RX_LAT_SLOTS);
+}
+
+SEC("tp_btf/napi_gro_receive_entry")
+int BPF_PROG(rx_gro, const struct sk_buff *skb)
+{
+    u64 key = (u64)skb;
+    struct start s = {
+        .t_first = bpf_ktime_get_ns(),
+        .ifindex = BPF_CORE_READ(skb, dev, ifindex),
+    };
+
+    bpf_map_update_elem(&starts, &key, &s, BPF_ANY);
+    return 0;
+}
+
+SEC("tp_btf/netif_receive_skb")
+int BPF_PROG(rx_stack, struct sk_buff *skb)
+{
+    u64 key = (u64)skb;
+    u64 now = bpf_ktime_get_ns();
+    struct start *s, init = {};
+
+    s = bpf_map_lookup_elem(&starts, &key);
+    if (s && s->t_first && !s->t_stack && now - s->t_first <= MAX_AGE_NS) {
+        s->t_stack = now;
+        stage_add(s->ifindex, STAGE_GRO_TO_STACK, now - s->t_first);
+        return 0;
+    }
+
+    /* GRO を通らなかった skb（または古いエントリ）はここを起点にする */
+    init.t_first = now;
+    init.t_stack = now;
+    init.ifindex = BPF_CORE_READ(skb, dev, ifindex);
+    bpf_map_update_elem(&starts, &key, &init, BPF_ANY);
+    return 0;
+}
+
+static __always_inline void rx_sock(const struct sk_buff *skb)
+{
+    u64 key = (u64)skb;
+    u64 now = bpf_ktime_get_ns();
+    struct start *s;
+
+    s = bpf_map_lookup_elem(&starts, &key);
+    if (!s)
+        return;
+    if (now - s->t_first > MAX_AGE_NS) {
+        bpf_map_delete_elem(&starts, &key);
+        return;
+    }
+
+    if (s->t_stack)
+        stage_add(s->ifindex, STAGE_STACK_TO_SOCK, now - s->t_stack);
+    stage_add(s->ifindex, STAGE_TOTAL, now - s->t_first);
+    bpf_map_delete_elem(&starts, &key);
+}
+
+SEC("fentry/tcp_queue_rcv")
+int BPF_PROG(rx_tcp_queue, struct sock *sk, struct sk_buff *skb)
+{
+    rx_sock(skb);
+    return 0;
+}
+
+SEC("fentry/__udp_enqueue_schedule_skb")
+int BPF_PROG(rx_udp_queue, struct sock *sk, struct sk_buff *skb)
+{
+    rx_sock(skb);
+    return 0;
+}
+
+/* ソケットに届かずに解放された skb のエントリを消す（引数は先頭の skb だけ使う。後ろはカーネルで変わる） */
+static __always_inline void rx_forget(const struct sk_buff *skb)
+{
+    u64 key = (u64)skb;
+
+    bpf_map_delete_elem(&starts, &key);
+}
+
+SEC("tp_btf/kfree_skb")
+int BPF_PROG(rx_kfree, struct sk_buff *skb)
+{
+    rx_forget(skb);
+    return 0;
+}
+
+SEC("tp_btf/consume_skb")
+int BPF_PROG(rx_consume, struct sk_buff *skb)
+{
+    rx_forget(skb);
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
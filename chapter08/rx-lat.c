@@ -0,0 +1,179 @@
+/*
+ * rx-lat.c（ユーザ空間側 / 受信パス区間別遅延ヒストグラムの表示）
+ *
+ * 目的:
+ *   rx-lat.bpf.c を attach し、指定間隔ごと（既定 Ctrl-C 時に 1 回）に
+ *   インタフェース × 区間の log2 ヒストグラムと p50 / p90 / p99 / p99.9 を表示する。
+ *   -i を付けたときは、前回の表示からの差分（その間隔に受信した分）だけを出す。
+ *
+ * 使い方:
+ *   sudo ./rx-lat [-i interval_sec]
+ *
+ * veth での確認（netns.sh + tcp-bulk / udp-ping）:
+ *
+ *   sudo ./netns.sh pair
+ *   sudo ip netns exec ns2 ethtool -K veth2 gro on   # 受信側 veth を NAPI にして GRO 区間も見る
+ *   sudo ip netns exec ns2 ./rx-lat -i 5 &           # ifindex → 名前を ns2 で引くため ns2 で動かす
+ *   sudo ip netns exec ns2 ./tcp-bulk server &
+ *   sudo ip netns exec ns2 ./udp-ping server &
+ *   sudo ip netns exec ns1 ./tcp-bulk client 10.0.0.2 -d 5
+ *   sudo ip netns exec ns1 ./udp-ping client 10.0.0.2 -d 5
+ *
+ * 注意:
+ *   - tracing 系のフックはホスト全体で効くので、他の netns のインタフェースも同じ ifindex 番号で混ざり得る。
+ *     名前が引けない ifindex は "if<N>" と表示する。
+ *   - tcp_queue_rcv が BTF に無い（インライン化された）カーネルでは TCP 側の計測を外して続行する。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <net/if.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "rx-lat.h"
+#include "hist-user.h"
+#include "rx-lat.skel.h"
+
+static const char *stage_names[NR_STAGES] = {
+    [STAGE_GRO_TO_STACK]  = "gro -> netif_receive_skb",
+    [STAGE_STACK_TO_SOCK] = "netif_receive_skb -> socket",
+    [STAGE_TOTAL]         = "first seen -> socket",
+};
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static const struct hist_layout layout = {
+    .kind = HIST_LOG2,
+    .nr_slots = RX_LAT_SLOTS,
+    .unit = "ns",
+};
+
+/* prev からの差分を表示し、prev を今回のスナップショットに置き換える */
+static int print_hists(struct rx_lat_bpf *skel, struct hist_snapshot *prev)
+{
+    struct hist_snapshot cur, delta;
+    int err;
+
+    err = hist_snapshot_read(bpf_map__fd(skel->maps.hists), sizeof(struct hist_key),
+                             RX_LAT_SLOTS, &cur);
+    if (err)
+        return err;
+    err = hist_snapshot_diff(&cur, prev, &delta);
+    if (err) {
+        hist_snapshot_free(&cur);
+        return err;
+    }
+
+    for (size_t i = 0; i < delta.nr; i++) {
+        const struct hist_key *key = hist_snapshot_key(&delta, i);
+        const unsigned long long *slots = hist_snapshot_slots(&delta, i);
+        char name[IF_NAMESIZE];
+
+        if (key->stage >= NR_STAGES)
+            continue;
+        if (!if_indextoname(key->ifindex, name))
+            snprintf(name, sizeof(name), "if%u", key->ifindex);
+        printf("\n[%s] %s\n", name, stage_names[key->stage]);
+        hist_print(&layout, slots);
+        hist_print_percentiles(&layout, slots);
+    }
+
+    hist_snapshot_free(&delta);
+    hist_snapshot_free(prev);
+    *prev = cur;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct rx_lat_bpf *skel = NULL;
+    struct hist_snapshot prev = {};
+    int interval = 0;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+        case 'i': interval = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-i interval_sec]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    skel = rx_lat_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    /* static 関数 tcp_queue_rcv がインライン化されて BTF に無ければ TCP 側は諦める */
+    if (libbpf_find_vmlinux_btf_id("tcp_queue_rcv", BPF_TRACE_FENTRY) < 0) {
+        fprintf(stderr, "tcp_queue_rcv not found in BTF; TCP socket stage disabled\n");
+        bpf_program__set_autoload(skel->progs.rx_tcp_queue, false);
+    }
+
+    err = rx_lat_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    err = rx_lat_bpf__attach(skel);
+    if (err) {
+        fprintf(stderr, "Failed to attach BPF programs (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    printf("Tracing receive path latency... %s\n",
+           interval ? "printing every interval, Ctrl-C to stop." : "Ctrl-C to print and stop.");
+
+    while (!exiting) {
+        if (interval) {
+            sleep(interval);
+            err = print_hists(skel, &prev);
+            if (err) {
+                fprintf(stderr, "Failed to read histograms (err=%d)\n", err);
+                goto cleanup;
+            }
+        } else {
+            pause();
+        }
+    }
+    if (!interval)
+        err = print_hists(skel, &prev);
+
+cleanup:
+    hist_snapshot_free(&prev);
+    rx_lat_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
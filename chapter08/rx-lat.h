@@ -0,0 +1,35 @@
+#ifndef RX_LAT_H
+#define RX_LAT_H
+
+/*
+ * rx-lat.h（受信パス遅延ヒストグラムの共有定義）
+ */
+
+#define RX_LAT_SLOTS 32   /* log2(ns) のバケット数（2^31 ns ≒ 2 秒まで） */
+
+/*
+ * stage:
+ *   どの区間の遅延か。
+ *
+ *   STAGE_GRO_TO_STACK  : napi_gro_receive_entry → netif_receive_skb（ドライバ/GRO でたまっていた時間）
+ *   STAGE_STACK_TO_SOCK : netif_receive_skb → ソケットの受信キューに入るまで（IP/TCP/UDP の処理）
+ *   STAGE_TOTAL         : 最初に見えた時点 → ソケットの受信キュー
+ */
+enum stage {
+   STAGE_GRO_TO_STACK = 0,
+   STAGE_STACK_TO_SOCK,
+   STAGE_TOTAL,
+   NR_STAGES,
+};
+
+/*
+ * struct hist_key:
+ *   hists map（hist.bpf.h の HIST_MAP, value = u64[RX_LAT_SLOTS]）の key。
+ *   ifindex は skb が最初に見えたときの受信デバイス。
+ */
+struct hist_key {
+   unsigned int ifindex;
+   unsigned int stage;
+};
+
+#endif /* RX_LAT_H */
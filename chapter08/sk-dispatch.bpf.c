@@ -0,0 +1,119 @@
+/*
+ * sk-dispatch.bpf.c（sk_lookup による (アドレス, ポート範囲) → 1 つの listen ソケットへの振り分け）
+ *
+ * 目的:
+ *   何千ものポート / アドレスで接続を受けたいサービスは、普通はポートごとに bind + listen する。
+ *   それだと fd がポート数だけ必要で、bind 自体のコストも無視できない。
+ *   sk_lookup プログラムはカーネルが「SYN を受けたソケットを探す」瞬間に呼ばれ、
+ *   宛先とは無関係な任意の listen ソケットを返せるので、1 つのソケットで全部を受けられる。
+ *
+ * 流れ:
+ *
+ *   SYN (dst = addr:port) 到着
+ *     │
+ *     v
+ *   sk_lookup（このプログラム）
+ *     │  rules[0..nr_rules-1] を先頭から照合
+ *     │    (dst & mask) == addr && port_lo <= port <= port_hi ?
+ *     │
+ *     ├─ 一致 → sk = socks[sock_idx]（SOCKMAP）→ bpf_sk_assign(ctx, sk) → その listen ソケットが受ける
+ *     └─ 不一致 → SK_PASS（通常のポート番号による lookup に任せる）
+ *
+ * 注意:
+ *   - sk_lookup は netns 単位で attach する（bpf_program__attach_netns）。
+ *     ローダを動かした netns の中でだけ効く。
+ *   - 振り分け先の listen ソケットはどのポートに bind していても構わない。
+ *     accept したソケットの getsockname() は “元の宛先” を返すので、サービス側は宛先ポートで処理を分けられる。
+ *   - ここでは TCP / IPv4 だけを扱う（UDP も bpf_sk_assign できるが、listen の概念が無いので省略）。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include "sk-dispatch.h"
+
+#define AF_INET 2
+
+/* 有効なルール数（ローダが rules map を埋めたあとに設定する） */
+u32 nr_rules = 0;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_RULES);
+    __type(key, u32);
+    __type(value, struct dispatch_rule);
+} rules SEC(".maps");
+
+/* 振り分け先の listen ソケット（ユーザ空間から fd を入れる） */
+struct {
+    __uint(type, BPF_MAP_TYPE_SOCKMAP);
+    __uint(max_entries, MAX_SOCKS);
+    __type(key, u32);
+    __type(value, u64);
+} socks SEC(".maps");
+
+/* per-CPU 統計カウンタ（enum stat_idx） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_STATS);
+    __type(key, u32);
+    __type(value, u64);
+} stats SEC(".maps");
+
+static __always_inline void stat_inc(u32 idx)
+{
+    u64 *cnt = bpf_map_lookup_elem(&stats, &idx);
+
+    if (cnt)
+        (*cnt)++;
+}
+
+SEC("sk_lookup")
+int dispatch(struct bpf_sk_lookup *ctx)
+{
+    struct dispatch_rule *rule;
+    struct bpf_sock *sk;
+    u32 port = ctx->local_port;
+    u32 nr = nr_rules;
+    long err;
+
+    if (ctx->family != AF_INET || ctx->protocol != IPPROTO_TCP)
+        return SK_PASS;
+
+    stat_inc(STAT_LOOKUP);
+
+    for (u32 i = 0; i < MAX_RULES; i++) {
+        u32 key = i;
+
+        if (i >= nr)
+            break;
+
+        rule = bpf_map_lookup_elem(&rules, &key);
+        if (!rule)
+            break;
+        if ((ctx->local_ip4 & rule->mask) != rule->addr)
+            continue;
+        if (port < rule->port_lo || port > rule->port_hi)
+            continue;
+
+        stat_inc(STAT_MATCH);
+
+        key = rule->sock_idx;
+        sk = bpf_map_lookup_elem(&socks, &key);
+        if (!sk) {
+            stat_inc(STAT_NO_SOCK);
+            return SK_PASS;
+        }
+
+        err = bpf_sk_assign(ctx, sk, 0);
+        bpf_sk_release(sk);
+        if (err) {
+            stat_inc(STAT_ASSIGN_FAIL);
+            return SK_DROP;
+        }
+        return SK_PASS;
+    }
+
+    return SK_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
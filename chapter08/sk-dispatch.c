@@ -0,0 +1,481 @@
+/*
+ * sk-dispatch.c（ユーザ空間側 / sk_lookup 振り分けの設定と、ポート単位 bind との比較ベンチ）
+ *
+ * 目的:
+ *   sk-dispatch.bpf.c を現在の netns に attach し、
+ *   (アドレス/プレフィックス, ポート範囲) のルールで指定した宛先への接続を 1 つの listen ソケットで受ける。
+ *   bench モードでは専用の netns を作り、同じポート数を
+ *     A) ポートごとに bind + listen
+ *     B) listen ソケット 1 つ + sk_lookup
+ *   で受けたときの「準備にかかる時間 / fd 数」と「接続確立レート」を比べる。
+ *
+ * 使い方:
+ *   sudo ./sk-dispatch [-l listen_port] -r <addr[/prefix]>:<lo[-hi]> [-r ...]
+ *       例: sudo ip netns exec ns2 ./sk-dispatch -r 10.0.0.2:20000-29999 -r 0.0.0.0/0:443
+ *           sudo ip netns exec ns1 nc 10.0.0.2 23456
+ *
+ *   sudo ./sk-dispatch bench [-n ports] [-c conns] [-b base_port]
+ *       -n : 受けるポート数（既定 1000）
+ *       -c : 接続数（既定 20000, ポートを巡回して connect → accept → close）
+ *       -b : 先頭ポート（既定 20000）
+ *
+ * 処理の流れ（通常モード）:
+ *
+ *   open/load → listen ソケット作成 → socks[0] = その fd
+ *     → rules[i] を書き込み → nr_rules 設定 → attach_netns(/proc/self/ns/net)
+ *     → accept ループ（getsockname で元の宛先を表示）+ 1 秒ごとに統計
+ *
+ * 注意:
+ *   - bench は unshare(CLONE_NEWNET) で新しい netns（lo のみ）に入るので、ホストの設定には触らない。
+ *   - クライアント側は SO_LINGER 0 で RST クローズし、TIME_WAIT でエフェメラルポートが尽きないようにする。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "sk-dispatch.h"
+#include "sk-dispatch.skel.h"
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* per-CPU カウンタを CPU 分合算して返す */
+static __u64 read_stat(struct sk_dispatch_bpf *skel, __u32 idx, int nr_cpus)
+{
+    __u64 values[nr_cpus];
+    __u64 sum = 0;
+
+    if (bpf_map__lookup_elem(skel->maps.stats, &idx, sizeof(idx),
+                             values, sizeof(values), 0))
+        return 0;
+
+    for (int i = 0; i < nr_cpus; i++)
+        sum += values[i];
+    return sum;
+}
+
+/* "addr[/prefix]:lo[-hi]" を dispatch_rule に変換する */
+static int parse_rule(const char *s, struct dispatch_rule *rule)
+{
+    char buf[64], *colon, *slash, *dash, *end;
+    struct in_addr in;
+    unsigned long lo, hi;
+    long prefix = 32;
+
+    if (snprintf(buf, sizeof(buf), "%s", s) >= (int)sizeof(buf))
+        return -EINVAL;
+    colon = strrchr(buf, ':');
+    if (!colon)
+        return -EINVAL;
+    *colon = '\0';
+
+    slash = strchr(buf, '/');
+    if (slash) {
+        *slash = '\0';
+        prefix = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end || prefix < 0 || prefix > 32)
+            return -EINVAL;
+    }
+    if (inet_pton(AF_INET, buf, &in) != 1)
+        return -EINVAL;
+
+    /* "80junk" や "80-" のような末尾のゴミは黙って受け入れず、ルールごと弾く */
+    lo = strtoul(colon + 1, &dash, 10);
+    if (dash == colon + 1)
+        return -EINVAL;
+    if (*dash == '-') {
+        hi = strtoul(dash + 1, &end, 10);
+        if (end == dash + 1 || *end)
+            return -EINVAL;
+    } else if (*dash) {
+        return -EINVAL;
+    } else {
+        hi = lo;
+    }
+    if (lo == 0 || hi > 65535 || lo > hi)
+        return -EINVAL;
+
+    rule->mask = prefix ? htonl(~0U << (32 - prefix)) : 0;
+    rule->addr = in.s_addr & rule->mask;
+    rule->port_lo = lo;
+    rule->port_hi = hi;
+    rule->sock_idx = 0;
+    return 0;
+}
+
+static int listen_on(const char *ip, int port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    int one = 1;
+    int fd;
+
+    inet_pton(AF_INET, ip, &addr.sin_addr);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -errno;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1024)) {
+        int err = -errno;
+
+        close(fd);
+        return err;
+    }
+    return fd;
+}
+
+/* rules map と socks map を埋めて、現在の netns に attach する */
+static struct bpf_link *setup_dispatch(struct sk_dispatch_bpf *skel,
+                                       const struct dispatch_rule *rules, int nr,
+                                       int lfd)
+{
+    struct bpf_link *link;
+    __u32 idx = 0;
+    __u64 val = lfd;
+    int nsfd;
+
+    if (bpf_map__update_elem(skel->maps.socks, &idx, sizeof(idx), &val, sizeof(val), BPF_ANY)) {
+        fprintf(stderr, "Failed to add listener to SOCKMAP: %s\n", strerror(errno));
+        return NULL;
+    }
+    for (__u32 i = 0; i < (__u32)nr; i++) {
+        if (bpf_map__update_elem(skel->maps.rules, &i, sizeof(i),
+                                 &rules[i], sizeof(rules[i]), BPF_ANY)) {
+            fprintf(stderr, "Failed to set rule %u: %s\n", i, strerror(errno));
+            return NULL;
+        }
+    }
+    skel->bss->nr_rules = nr;
+
+    nsfd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (nsfd < 0) {
+        perror("open netns");
+        return NULL;
+    }
+    link = bpf_program__attach_netns(skel->progs.dispatch, nsfd);
+    if (!link)
+        fprintf(stderr, "Failed to attach sk_lookup: %s\n", strerror(errno));
+    close(nsfd);
+    return link;
+}
+
+/* ---------------------------------------------------------------------------
+ * bench モード
+ * ------------------------------------------------------------------------- */
+
+static int enter_fresh_netns(void)
+{
+    struct ifreq ifr = {};
+    int fd;
+
+    if (unshare(CLONE_NEWNET)) {
+        perror("unshare(CLONE_NEWNET)");
+        return -1;
+    }
+
+    /* 新しい netns の lo は down なので上げる */
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "lo");
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == 0) {
+        ifr.ifr_flags |= IFF_UP;
+        ioctl(fd, SIOCSIFFLAGS, &ifr);
+    }
+    close(fd);
+    return 0;
+}
+
+/* 127.0.0.1:port へ connect → lfd で accept → 両方 close、を conns 回 */
+static double connect_rate(const int *lfds, int nr_lfds, int base, int nports, int conns)
+{
+    struct linger lg = { .l_onoff = 1, .l_linger = 0 };
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    unsigned long long start;
+    int done = 0;
+
+    start = now_ns();
+    for (int i = 0; i < conns; i++) {
+        int port_off = i % nports;
+        int cfd, afd;
+
+        addr.sin_port = htons(base + port_off);
+        cfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (cfd < 0)
+            break;
+        if (connect(cfd, (struct sockaddr *)&addr, sizeof(addr))) {
+            close(cfd);
+            continue;
+        }
+        afd = accept(lfds[nr_lfds == 1 ? 0 : port_off], NULL, NULL);
+        setsockopt(cfd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        close(cfd);
+        if (afd >= 0) {
+            close(afd);
+            done++;
+        }
+    }
+    return done * 1e9 / (now_ns() - start);
+}
+
+static int run_bench(struct sk_dispatch_bpf *skel, int nports, int conns, int base)
+{
+    struct rlimit rl;
+    struct dispatch_rule rule = {
+        .addr = htonl(INADDR_LOOPBACK),
+        .mask = 0xffffffff,
+        .port_lo = base,
+        .port_hi = base + nports - 1,
+        .sock_idx = 0,
+    };
+    struct bpf_link *link;
+    unsigned long long t0, setup_ns;
+    double rate;
+    int *lfds;
+    int lfd;
+
+    if (base + nports - 1 > 65535) {
+        fprintf(stderr, "Port range exceeds 65535\n");
+        return -EINVAL;
+    }
+    if (enter_fresh_netns())
+        return -errno;
+
+    /* per-port はポート数だけ fd を使うので、足りなければ上限を上げる */
+    if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < (rlim_t)nports + 64) {
+        rl.rlim_cur = nports + 64;
+        if (rl.rlim_max < rl.rlim_cur)
+            rl.rlim_max = rl.rlim_cur;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    lfds = calloc(nports, sizeof(*lfds));
+    if (!lfds)
+        return -ENOMEM;
+
+    printf("netns: fresh (lo only), ports=%d conns=%d base=%d\n", nports, conns, base);
+    printf("%-12s %-8s %-14s %-14s\n", "mode", "fds", "setup_ms", "conn/s");
+
+    /* A) ポートごとに bind + listen */
+    t0 = now_ns();
+    for (int i = 0; i < nports; i++) {
+        lfds[i] = listen_on("127.0.0.1", base + i);
+        if (lfds[i] < 0) {
+            int err = lfds[i];
+
+            fprintf(stderr, "listen on %d failed: %s\n", base + i, strerror(-err));
+            for (int j = 0; j < i; j++)
+                close(lfds[j]);
+            free(lfds);
+            return err;
+        }
+    }
+    setup_ns = now_ns() - t0;
+    rate = connect_rate(lfds, nports, base, nports, conns);
+    printf("%-12s %-8d %-14.3f %-14.0f\n", "per-port", nports, setup_ns / 1e6, rate);
+    for (int i = 0; i < nports; i++)
+        close(lfds[i]);
+
+    /* B) listen ソケット 1 つ（範囲外のポートに bind）+ sk_lookup */
+    t0 = now_ns();
+    lfd = listen_on("127.0.0.1", base > 1024 ? base - 1 : base + nports);
+    if (lfd < 0) {
+        free(lfds);
+        return lfd;
+    }
+    link = setup_dispatch(skel, &rule, 1, lfd);
+    setup_ns = now_ns() - t0;
+    if (!link) {
+        close(lfd);
+        free(lfds);
+        return -EINVAL;
+    }
+    rate = connect_rate(&lfd, 1, base, nports, conns);
+    printf("%-12s %-8d %-14.3f %-14.0f\n", "sk_lookup", 1, setup_ns / 1e6, rate);
+
+    bpf_link__destroy(link);
+    close(lfd);
+    free(lfds);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * 通常モード
+ * ------------------------------------------------------------------------- */
+
+static int run_serve(struct sk_dispatch_bpf *skel, const struct dispatch_rule *rules,
+                     int nr, int port, int nr_cpus)
+{
+    struct bpf_link *link;
+    struct pollfd pfd;
+    unsigned long long next_stat = now_ns() + 1000000000ULL;
+    int lfd;
+
+    lfd = listen_on("0.0.0.0", port);
+    if (lfd < 0) {
+        fprintf(stderr, "Failed to listen on %d: %s\n", port, strerror(-lfd));
+        return lfd;
+    }
+    link = setup_dispatch(skel, rules, nr, lfd);
+    if (!link) {
+        close(lfd);
+        return -EINVAL;
+    }
+
+    printf("Dispatching %d rule(s) to listener on port %d. Ctrl-C to stop.\n", nr, port);
+
+    pfd.fd = lfd;
+    pfd.events = POLLIN;
+    while (!exiting) {
+        struct sockaddr_in local, peer;
+        socklen_t len = sizeof(peer);
+        char lbuf[INET_ADDRSTRLEN], pbuf[INET_ADDRSTRLEN];
+        int afd;
+
+        if (poll(&pfd, 1, 1000) > 0) {
+            afd = accept(lfd, (struct sockaddr *)&peer, &len);
+            if (afd >= 0) {
+                /* getsockname は sk_lookup で振り分けられる前の “元の宛先” を返す */
+                len = sizeof(local);
+                getsockname(afd, (struct sockaddr *)&local, &len);
+                printf("accept %s:%u -> %s:%u\n",
+                       inet_ntop(AF_INET, &peer.sin_addr, pbuf, sizeof(pbuf)), ntohs(peer.sin_port),
+                       inet_ntop(AF_INET, &local.sin_addr, lbuf, sizeof(lbuf)), ntohs(local.sin_port));
+                close(afd);
+            }
+        }
+
+        if (now_ns() >= next_stat) {
+            printf("lookup=%llu match=%llu no_sock=%llu assign_fail=%llu\n",
+                   (unsigned long long)read_stat(skel, STAT_LOOKUP, nr_cpus),
+                   (unsigned long long)read_stat(skel, STAT_MATCH, nr_cpus),
+                   (unsigned long long)read_stat(skel, STAT_NO_SOCK, nr_cpus),
+                   (unsigned long long)read_stat(skel, STAT_ASSIGN_FAIL, nr_cpus));
+            next_stat += 1000000000ULL;
+        }
+    }
+
+    bpf_link__destroy(link);
+    close(lfd);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-l listen_port] -r <addr[/prefix]>:<lo[-hi]> [-r ...]\n"
+                    "       %s bench [-n ports] [-c conns] [-b base_port]\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct sk_dispatch_bpf *skel = NULL;
+    struct dispatch_rule rules[MAX_RULES];
+    int nr_cpus = libbpf_num_possible_cpus();
+    bool bench = false;
+    int nr = 0, port = 8000;
+    int nports = 1000, conns = 20000, base = 20000;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench = true;
+        optind = 2;
+    }
+
+    while ((opt = getopt(argc, argv, "l:r:n:c:b:")) != -1) {
+        switch (opt) {
+        case 'l': port = atoi(optarg); break;
+        case 'n': nports = atoi(optarg); break;
+        case 'c': conns = atoi(optarg); break;
+        case 'b': base = atoi(optarg); break;
+        case 'r':
+            if (nr >= MAX_RULES || parse_rule(optarg, &rules[nr])) {
+                fprintf(stderr, "Invalid or too many rules: %s\n", optarg);
+                return 1;
+            }
+            nr++;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((!bench && nr == 0) || nports <= 0 || conns <= 0 || base <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    skel = sk_dispatch_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open/load BPF object\n");
+        return 1;
+    }
+
+    if (bench)
+        err = run_bench(skel, nports, conns, base);
+    else
+        err = run_serve(skel, rules, nr, port, nr_cpus);
+
+    sk_dispatch_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
@@ -0,0 +1,39 @@
+#ifndef SK_DISPATCH_H
+#define SK_DISPATCH_H
+
+/*
+ * sk-dispatch.h（sk_lookup プログラムとローダで共有する定義）
+ */
+
+#define MAX_RULES 64   /* sk_lookup が 1 回の lookup で順に照合するルール数の上限 */
+#define MAX_SOCKS 16   /* 振り分け先ソケット（SOCKMAP のエントリ）数の上限 */
+
+/*
+ * struct dispatch_rule:
+ *   rules map（ARRAY, 添字 0..nr_rules-1）の value。先頭から順に見て最初に一致したものを使う。
+ *
+ *   addr / mask : 宛先 IPv4 アドレスとネットマスク（ネットワークバイトオーダ）。mask = 0 なら任意のアドレス
+ *   port_lo/hi  : 宛先ポート範囲（ホストバイトオーダ, 両端を含む）
+ *   sock_idx    : 振り分け先ソケットの socks map（SOCKMAP）上の添字
+ */
+struct dispatch_rule {
+   unsigned int addr;
+   unsigned int mask;
+   unsigned short port_lo;
+   unsigned short port_hi;
+   unsigned int sock_idx;
+};
+
+/*
+ * stat_idx:
+ *   per-CPU カウンタ（stats map）の添字。ローダが CPU 分を合算して表示する。
+ */
+enum stat_idx {
+   STAT_LOOKUP = 0,      /* sk_lookup が呼ばれた回数（TCP/IPv4 の SYN のみ数える） */
+   STAT_MATCH,           /* ルールに一致した回数 */
+   STAT_NO_SOCK,         /* 一致したが socks map に振り分け先ソケットが無かった */
+   STAT_ASSIGN_FAIL,     /* bpf_sk_assign に失敗した（ソケットが listen していない等） */
+   NR_STATS,
+};
+
+#endif /* SK_DISPATCH_H */
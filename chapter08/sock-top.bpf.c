@@ -0,0 +1,175 @@
+/*
+ * sock-top.bpf.c（fexit によるプロセス × 相手先ごとの送受信バイト数）
+ *
+ * 目的:
+ *   nethogs のような「どのプロセスがどこと何バイトやりとりしているか」を、
+ *   常時動かしておけるくらい安く数える。パケット単位ではなく send/recv の呼び出し単位で数えるので、
+ *   大きな write 1 回はカウンタ更新 1 回で済む。
+ *
+ * 計測点:
+ *
+ *   fexit/tcp_sendmsg(sk, msg, size, ret)   … tx += ret（実際に書けたバイト数。ret <= 0 は数えない）
+ *   fexit/tcp_cleanup_rbuf(sk, copied)      … rx += copied（recvmsg/read がユーザに渡したバイト数）
+ *   fexit/udp_sendmsg(sk, msg, len, ret)    … tx += ret（相手は msg_name or 接続先）
+ *   fexit/udp_recvmsg(sk, msg, len, ..., ret) … rx += ret（相手は msg_name or 接続先）
+ *   （IPv6 の UDP は udpv6_sendmsg / udpv6_recvmsg。TCP は v4/v6 共通）
+ *
+ *   key = {tgid, 相手アドレス, 相手ポート, family, proto}
+ *   value は LRU_PERCPU_HASH の per-CPU 値に足すだけ（アトミック命令もロックも無し）。
+ *
+ * コスト:
+ *   fentry/fexit は trampoline から直接呼ばれ（kprobe の int3 / ftrace 経由より安い）、
+ *   中身は key を組み立てて map を 1 回引くだけなので、1 呼び出しあたり数十 ns 程度に収まる。
+ *   ローダの bench モードで実測できる。
+ *
+ * 注意:
+ *   - send 側は引数の size ではなく戻り値を使う。size は “送ろうとした量” で、-EAGAIN / -EPIPE などで
+ *     失敗した呼び出しや、ノンブロッキングで一部しか書けなかった残りまで数えてしまい、
+ *     詰まっている（バックプレッシャーがかかっている）相手ほど上位に出てしまう。
+ *     fexit は fentry より trampoline のコストが少し増えるが、順位が正しい方を取る。
+ *   - tcp_cleanup_rbuf は recvmsg 以外（splice 等）からも呼ばれるが、いずれもユーザへの受け渡し量なので同じに扱う。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_endian.h>
+#include "sock-top.h"
+
+#define AF_INET  2
+#define AF_INET6 10
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 16384);
+    __type(key, struct talk_key);
+    __type(value, struct talk_val);
+} talkers SEC(".maps");
+
+/* 接続済みソケットの相手を key に詰める（未接続なら family = 0 のまま） */
+static __always_inline void key_from_sock(struct talk_key *key, const struct sock *sk)
+{
+    u16 family = sk->__sk_common.skc_family;
+
+    key->rport = bpf_ntohs(sk->__sk_common.skc_dport);
+    if (family == AF_INET) {
+        key->family = 4;
+        __builtin_memcpy(key->raddr, &sk->__sk_common.skc_daddr, 4);
+    } else if (family == AF_INET6) {
+        key->family = 6;
+        BPF_CORE_READ_INTO(&key->raddr, sk, __sk_common.skc_v6_daddr);
+    }
+}
+
+/* 未接続 UDP の相手を msghdr の msg_name（カーネルにコピー済みの sockaddr）から詰める */
+static __always_inline void key_from_msg(struct talk_key *key, const struct msghdr *msg)
+{
+    struct sockaddr_in sin = {};
+    void *name = BPF_CORE_READ(msg, msg_name);
+
+    if (!name || bpf_probe_read_kernel(&sin, sizeof(sin), name))
+        return;
+    if (sin.sin_family == AF_INET) {
+        key->family = 4;
+        key->rport = bpf_ntohs(sin.sin_port);
+        __builtin_memcpy(key->raddr, &sin.sin_addr, 4);
+    } else if (sin.sin_family == AF_INET6) {
+        struct sockaddr_in6 sin6 = {};
+
+        bpf_probe_read_kernel(&sin6, sizeof(sin6), name);
+        key->family = 6;
+        key->rport = bpf_ntohs(sin6.sin6_port);
+        __builtin_memcpy(key->raddr, &sin6.sin6_addr, 16);
+    }
+}
+
+static __always_inline void account(struct talk_key *key, u64 tx, u64 rx)
+{
+    struct talk_val *val, zero = {};
+
+    key->tgid = bpf_get_current_pid_tgid() >> 32;
+
+    val = bpf_map_lookup_elem(&talkers, key);
+    if (!val) {
+        bpf_map_update_elem(&talkers, key, &zero, BPF_NOEXIST);
+        val = bpf_map_lookup_elem(&talkers, key);
+        if (!val)
+            return;
+    }
+    /* per-CPU 値なので普通の加算でよい */
+    val->tx_bytes += tx;
+    val->rx_bytes += rx;
+}
+
+SEC("fexit/tcp_sendmsg")
+int BPF_PROG(tcp_send, struct sock *sk, struct msghdr *msg, size_t size, int ret)
+{
+    struct talk_key key = { .proto = IPPROTO_TCP };
+
+    if (ret <= 0)
+        return 0;
+    key_from_sock(&key, sk);
+    account(&key, ret, 0);
+    return 0;
+}
+
+SEC("fexit/tcp_cleanup_rbuf")
+int BPF_PROG(tcp_recv, struct sock *sk, int copied)
+{
+    struct talk_key key = { .proto = IPPROTO_TCP };
+
+    if (copied <= 0)
+        return 0;
+    key_from_sock(&key, sk);
+    account(&key, 0, copied);
+    return 0;
+}
+
+static __always_inline void udp_account(struct sock *sk, struct msghdr *msg, u64 tx, u64 rx)
+{
+    struct talk_key key = { .proto = IPPROTO_UDP };
+
+    key_from_msg(&key, msg);
+    if (!key.family)
+        key_from_sock(&key, sk);
+    account(&key, tx, rx);
+}
+
+/* msg_name は戻った後もカーネルにコピーされたまま残っているので、fexit でも相手を引ける */
+SEC("fexit/udp_sendmsg")
+int BPF_PROG(udp_send, struct sock *sk, struct msghdr *msg, size_t len, int ret)
+{
+    if (ret > 0)
+        udp_account(sk, msg, ret, 0);
+    return 0;
+}
+
+SEC("fexit/udpv6_sendmsg")
+int BPF_PROG(udp6_send, struct sock *sk, struct msghdr *msg, size_t len, int ret)
+{
+    if (ret > 0)
+        udp_account(sk, msg, ret, 0);
+    return 0;
+}
+
+/* 5.19 以降の引数（noblock が無くなった形） */
+SEC("fexit/udp_recvmsg")
+int BPF_PROG(udp_recv, struct sock *sk, struct msghdr *msg, size_t len, int flags,
+             int *addr_len, int ret)
+{
+    if (ret > 0)
+        udp_account(sk, msg, 0, ret);
+    return 0;
+}
+
+SEC("fexit/udpv6_recvmsg")
+int BPF_PROG(udp6_recv, struct sock *sk, struct msghdr *msg, size_t len, int flags,
+             int *addr_len, int ret)
+{
+    if (ret > 0)
+        udp_account(sk, msg, 0, ret);
+    return 0;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
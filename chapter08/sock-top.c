@@ -0,0 +1,302 @@
+/*
+ * sock-top.c（ユーザ空間側 / プロセス × 相手先の top talkers 表示と、フックのコスト計測）
+ *
+ * 目的:
+ *   sock-top.bpf.c を attach し、間隔ごとに talkers map を bpf_map_lookup_batch でまとめて読み、
+ *   前回との差分から送受信レートを出して上位を表示する（nethogs 風）。読み出し・CPU の合算・差分は
+ *   percpu-read.h（SIMD で合算 / 差分する）。
+ *   bench モードでは UDP send のループを「attach なし / あり」で回し、1 呼び出しあたりの増分を測る。
+ *
+ * 使い方:
+ *   sudo ./sock-top [-i interval_sec] [-n top_n]
+ *   sudo ./sock-top bench [-c calls]
+ *
+ * 読み出し:
+ *
+ *   lookup_batch（1 回の syscall で最大 BATCH 個の key と全 CPU 分の value）
+ *     │  繰り返して map 全体を読む
+ *     v
+ *   CPU 分を合算 → 前回のスナップショットとの差分 → bytes/s
+ *     │
+ *     v
+ *   tx+rx のレート順に上位 top_n 件を表示（comm は /proc/<tgid>/comm）
+ *
+ * 注意:
+ *   - bench の差分は udp_sendmsg の fexit 1 回分（trampoline + map 更新）。
+ *     ループバック配送のコストは両方に同じだけ含まれるので差に出ない。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "sock-top.h"
+#include "percpu-read.h"
+#include "sock-top.skel.h"
+
+#define BATCH       256
+
+struct row {
+    struct talk_key key;
+    unsigned long long tx_rate, rx_rate;
+};
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void read_comm(unsigned int tgid, char *buf, size_t len)
+{
+    char path[64];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/%u/comm", tgid);
+    f = fopen(path, "r");
+    if (!f || !fgets(buf, len, f)) {
+        snprintf(buf, len, "?");
+    } else {
+        buf[strcspn(buf, "\n")] = '\0';
+    }
+    if (f)
+        fclose(f);
+}
+
+static int cmp_rate(const void *a, const void *b)
+{
+    const struct row *x = a, *y = b;
+    unsigned long long rx = x->tx_rate + x->rx_rate, ry = y->tx_rate + y->rx_rate;
+
+    return rx < ry ? 1 : rx > ry ? -1 : 0;
+}
+
+/* delta は cur と同じ順の {tx, rx} の増分 */
+static void print_top(const struct percpu_snapshot *cur, const unsigned long long *delta,
+                      struct row *rows, double secs, int top_n)
+{
+    char comm[32], ip[INET6_ADDRSTRLEN], peer[64];
+
+    for (size_t i = 0; i < cur->nr; i++) {
+        memcpy(&rows[i].key, percpu_snapshot_key(cur, i), sizeof(rows[i].key));
+        rows[i].tx_rate = delta[i * 2] / secs;
+        rows[i].rx_rate = delta[i * 2 + 1] / secs;
+    }
+    qsort(rows, cur->nr, sizeof(rows[0]), cmp_rate);
+
+    printf("%-16s %-8s %-4s %-40s %-12s %-12s\n",
+           "comm", "tgid", "prot", "peer", "tx KB/s", "rx KB/s");
+    for (size_t i = 0; i < cur->nr && i < (size_t)top_n; i++) {
+        const struct talk_key *k = &rows[i].key;
+
+        if (!rows[i].tx_rate && !rows[i].rx_rate)
+            break;
+        read_comm(k->tgid, comm, sizeof(comm));
+        if (k->family)
+            inet_ntop(k->family == 6 ? AF_INET6 : AF_INET, k->raddr, ip, sizeof(ip));
+        else
+            snprintf(ip, sizeof(ip), "-");
+        snprintf(peer, sizeof(peer), k->family == 6 ? "[%s]:%u" : "%s:%u", ip, k->rport);
+        printf("%-16.16s %-8u %-4s %-40s %-12.1f %-12.1f\n",
+               comm, k->tgid, k->proto == 6 ? "tcp" : "udp", peer,
+               rows[i].tx_rate / 1024.0, rows[i].rx_rate / 1024.0);
+    }
+    printf("\n");
+}
+
+static int run_top(struct sock_top_bpf *skel, int interval, int top_n)
+{
+    struct percpu_snapshot cur = {}, prev = {}, tmp;
+    struct percpu_reader r;
+    unsigned long long *delta = NULL, t_prev, t_now;
+    struct row *rows = NULL;
+    int err;
+
+    err = percpu_reader_init(&r, bpf_map__fd(skel->maps.talkers), sizeof(struct talk_key),
+                             sizeof(struct talk_val), BATCH, PERCPU_AUTO);
+    if (err)
+        return err;
+
+    err = percpu_read(&r, &prev);
+    t_prev = now_ns();
+
+    while (!exiting && !err) {
+        sleep(interval);
+        err = percpu_read(&r, &cur);
+        if (err)
+            break;
+        t_now = now_ns();
+
+        free(delta);
+        free(rows);
+        delta = percpu_alloc(cur.nr * cur.nr_fields);
+        rows = calloc(cur.nr ? cur.nr : 1, sizeof(*rows));
+        if (!delta || !rows) {
+            err = -ENOMEM;
+            break;
+        }
+        err = percpu_delta(r.impl, &cur, &prev, delta);
+        if (err)
+            break;
+        print_top(&cur, delta, rows, (t_now - t_prev) / 1e9, top_n);
+
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+        t_prev = t_now;
+    }
+
+    if (err)
+        fprintf(stderr, "Failed to read talkers map: %d\n", err);
+    free(delta);
+    free(rows);
+    percpu_snapshot_free(&cur);
+    percpu_snapshot_free(&prev);
+    percpu_reader_free(&r);
+    return err;
+}
+
+/* 受信側は読まずに放置（受信バッファがあふれた分はカーネルが捨てる） */
+static double udp_send_loop(int calls)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t len = sizeof(addr);
+    char buf[64] = {};
+    unsigned long long start;
+    int rfd, sfd;
+
+    rfd = socket(AF_INET, SOCK_DGRAM, 0);
+    sfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (rfd < 0 || sfd < 0 || bind(rfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        getsockname(rfd, (struct sockaddr *)&addr, &len) ||
+        connect(sfd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror("udp socket setup");
+        return -1;
+    }
+
+    start = now_ns();
+    for (int i = 0; i < calls; i++)
+        send(sfd, buf, sizeof(buf), 0);
+    start = now_ns() - start;
+
+    close(sfd);
+    close(rfd);
+    return (double)start / calls;
+}
+
+static int run_bench(struct sock_top_bpf *skel, int calls)
+{
+    double base, hooked;
+    int err;
+
+    udp_send_loop(calls / 10);          /* ウォームアップ */
+    base = udp_send_loop(calls);
+
+    err = sock_top_bpf__attach(skel);
+    if (err) {
+        fprintf(stderr, "Failed to attach BPF programs (err=%d)\n", err);
+        return err;
+    }
+    hooked = udp_send_loop(calls);
+    sock_top_bpf__detach(skel);
+
+    printf("udp send x %d\n", calls);
+    printf("  detached : %.1f ns/call\n", base);
+    printf("  attached : %.1f ns/call\n", hooked);
+    printf("  overhead : %.1f ns/call\n", hooked - base);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct sock_top_bpf *skel = NULL;
+    bool bench = false;
+    int interval = 1, top_n = 20, calls = 1000000;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench = true;
+        optind = 2;
+    }
+
+    while ((opt = getopt(argc, argv, "i:n:c:")) != -1) {
+        switch (opt) {
+        case 'i': interval = atoi(optarg); break;
+        case 'n': top_n = atoi(optarg); break;
+        case 'c': calls = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-i interval_sec] [-n top_n]\n"
+                            "       %s bench [-c calls]\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (interval <= 0)
+        interval = 1;
+    if (calls <= 0)
+        calls = 1000000;
+
+    skel = sock_top_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open/load BPF object\n");
+        return 1;
+    }
+
+    if (bench) {
+        err = run_bench(skel, calls);
+        goto cleanup;
+    }
+
+    err = sock_top_bpf__attach(skel);
+    if (err) {
+        fprintf(stderr, "Failed to attach BPF programs (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    printf("Tracking socket bytes per process. Ctrl-C to stop.\n");
+    err = run_top(skel, interval, top_n);
+
+cleanup:
+    sock_top_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
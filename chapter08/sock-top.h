@@ -0,0 +1,32 @@
+#ifndef SOCK_TOP_H
+#define SOCK_TOP_H
+
+/*
+ * sock-top.h（プロセス × 相手先ごとのソケット送受信量の共有定義）
+ */
+
+/*
+ * struct talk_key:
+ *   talkers map（LRU_PERCPU_HASH）の key。
+ *
+ *   tgid   : 送受信したプロセス
+ *   raddr  : 相手のアドレス（IPv4 は先頭 4 バイト）
+ *   rport  : 相手のポート（ホストバイトオーダ）
+ *   family : 4 / 6
+ *   proto  : 6 (TCP) / 17 (UDP)
+ */
+struct talk_key {
+   unsigned int tgid;
+   unsigned char raddr[16];
+   unsigned short rport;
+   unsigned char family;
+   unsigned char proto;
+};
+
+/* talkers map の value（CPU ごと。リーダが合算する） */
+struct talk_val {
+   unsigned long long tx_bytes;
+   unsigned long long rx_bytes;
+};
+
+#endif /* SOCK_TOP_H */
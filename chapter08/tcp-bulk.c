@@ -0,0 +1,232 @@
+/*
+ * tcp-bulk.c（BPF を使わない補助ツール / 輻輳制御比較用のバルク送信）
+ *
+ * 目的:
+ *   iperf 等を入れなくても、輻輳制御ごとの throughput と RTT を同じ条件で比べられるようにする。
+ *
+ * 使い方:
+ *   ./tcp-bulk server [-p port]
+ *   ./tcp-bulk client <ipv4 addr> [-p port] [-c cc] [-d sec]
+ *
+ *   -c <cc>   送信ソケットの輻輳制御（setsockopt TCP_CONGESTION）。例: bpf_dctcp, cubic
+ *   -d <sec>  送信時間（既定 10 秒）
+ *
+ * 計測（client 側）:
+ *
+ *   connect → TCP_CONGESTION 設定
+ *     │
+ *     v
+ *   d 秒間 128KB ずつ send し続ける
+ *     │   100ms ごとに getsockopt(TCP_INFO) で
+ *     │     tcpi_rtt（平滑化 RTT, us）/ tcpi_snd_cwnd を記録
+ *     v
+ *   throughput（Gbit/s）, RTT の平均/p50/p99, 再送数, 最終 cwnd を表示
+ *
+ * 注意:
+ *   - ECN を使う輻輳制御（bpf_dctcp）は両端で net.ipv4.tcp_ecn=1 が必要
+ *     （netns.sh shaped が両 namespace で設定する）。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define BUF_SIZE      (128 * 1024)
+#define SAMPLE_NS     (100ULL * 1000 * 1000)
+#define MAX_SAMPLES   100000
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int run_server(int port)
+{
+    static char buf[BUF_SIZE];
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int one = 1;
+    int lfd;
+
+    lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) || listen(lfd, 16)) {
+        perror("bind/listen");
+        close(lfd);
+        return 1;
+    }
+
+    /* 1 接続ずつ受けて読み捨てる */
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        unsigned long long total = 0;
+        ssize_t n;
+
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            break;
+        }
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+            total += n;
+        printf("received %llu bytes\n", total);
+        close(fd);
+    }
+
+    close(lfd);
+    return 0;
+}
+
+static int run_client(const char *ip, int port, const char *cc, int duration)
+{
+    static char buf[BUF_SIZE];
+    static unsigned int rtts[MAX_SAMPLES];
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    struct tcp_info ti;
+    socklen_t len;
+    unsigned long long start, end, next_sample, bytes = 0;
+    unsigned long long rtt_sum = 0;
+    size_t nr = 0;
+    int fd;
+
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid address: %s\n", ip);
+        return 1;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    /* connect 前に設定しておくと SYN の時点から指定の輻輳制御（ECN ネゴ含む）になる */
+    if (cc && setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, cc, strlen(cc))) {
+        fprintf(stderr, "Failed to set TCP_CONGESTION=%s: %s\n", cc, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror("connect");
+        close(fd);
+        return 1;
+    }
+
+    memset(buf, 'x', sizeof(buf));
+    start = now_ns();
+    end = start + (unsigned long long)duration * 1000000000ULL;
+    next_sample = start + SAMPLE_NS;
+
+    for (;;) {
+        unsigned long long now;
+        ssize_t n = send(fd, buf, sizeof(buf), 0);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("send");
+            break;
+        }
+        bytes += n;
+
+        now = now_ns();
+        if (now >= next_sample) {
+            len = sizeof(ti);
+            if (!getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) && nr < MAX_SAMPLES) {
+                rtts[nr++] = ti.tcpi_rtt;
+                rtt_sum += ti.tcpi_rtt;
+            }
+            next_sample += SAMPLE_NS;
+        }
+        if (now >= end)
+            break;
+    }
+
+    end = now_ns();
+    len = sizeof(ti);
+    memset(&ti, 0, sizeof(ti));
+    getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len);
+    close(fd);
+
+    printf("cc=%s bytes=%llu seconds=%.2f throughput=%.3f Gbit/s\n",
+           cc ? cc : "(default)", bytes, (end - start) / 1e9,
+           bytes * 8.0 / (end - start));
+    if (nr) {
+        qsort(rtts, nr, sizeof(rtts[0]), cmp_u32);
+        printf("rtt_us: avg=%llu p50=%u p99=%u max=%u (samples=%zu)\n",
+               rtt_sum / nr, rtts[nr / 2], rtts[(nr - 1) * 99 / 100], rtts[nr - 1], nr);
+    }
+    printf("retrans=%u snd_cwnd=%u\n", ti.tcpi_total_retrans, ti.tcpi_snd_cwnd);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *cc = NULL;
+    int port = 5201;
+    int duration = 10;
+    const char *mode;
+    const char *ip = NULL;
+    int opt;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s server [-p port]\n"
+                        "       %s client <addr> [-p port] [-c cc] [-d sec]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    mode = argv[1];
+    optind = 2;
+    if (strcmp(mode, "client") == 0 && argc > 2 && argv[2][0] != '-') {
+        ip = argv[2];
+        optind = 3;
+    }
+
+    while ((opt = getopt(argc, argv, "p:c:d:")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'c': cc = optarg; break;
+        case 'd': duration = atoi(optarg); break;
+        default: return 1;
+        }
+    }
+
+    if (strcmp(mode, "server") == 0)
+        return run_server(port);
+    if (strcmp(mode, "client") == 0 && ip)
+        return run_client(ip, port, cc, duration > 0 ? duration : 10);
+
+    fprintf(stderr, "Unknown mode or missing address\n");
+    return 1;
+}
@@ -0,0 +1,290 @@
+/*
+ * tcp-dctcp.bpf.c（struct_ops で登録する DCTCP 風 TCP 輻輳制御）
+ *
+ * 目的:
+ *   カーネルを再ビルドせずに輻輳制御アルゴリズムを差し替えて試す。
+ *   struct tcp_congestion_ops を BPF プログラムで埋めて struct_ops map として登録すると、
+ *   "bpf_dctcp" という名前の輻輳制御が増え、
+ *     sysctl net.ipv4.tcp_congestion_control=bpf_dctcp
+ *     setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, "bpf_dctcp", ...)
+ *   のどちらでも選べるようになる。
+ *
+ * アルゴリズム（DCTCP: ECN マーク率に比例して cwnd を減らす）:
+ *
+ *   送信側は 1 RTT（next_seq まで ACK されたら 1 窓）ごとに
+ *
+ *       F     = (この窓で CE マークされて届いたバイト) / (この窓で届いたバイト)
+ *       alpha = (1 - g) * alpha + g * F          … g = 1 / 2^shift_g
+ *
+ *   を更新し、ECE（輻輳通知）を受けたら
+ *
+ *       cwnd  = cwnd * (1 - alpha / 2)
+ *
+ *   まで下げる。マークが少なければほとんど減らさず、全部マークされれば reno と同じく半分。
+ *   パケットロスのときは従来どおり cwnd/2（react_to_loss）。
+ *
+ *   受信側では CE 状態が変わった瞬間に即 ACK を返し、送信側が正確な F を数えられるようにする
+ *   （ece_ack_update）。
+ *
+ * パラメータ（.rodata / ローダが load 前に設定）:
+ *   shift_g       : alpha の EWMA 係数（既定 4 → g = 1/16）
+ *   alpha_on_init : 接続開始時の alpha（既定 1024 = 最初の輻輳では半分に下げる）
+ *
+ * verifier 観点:
+ *   - tcp_congestion_ops の BPF から書き換えられるフィールドは限られている
+ *     （snd_cwnd, snd_ssthresh, ecn_flags, icsk_ack.pending, icsk_ca_priv など）。
+ *     それ以外に書くとロードで弾かれる。
+ *   - reno の cong_avoid は tcp_reno_cong_avoid という kfunc をそのまま呼ぶ。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "tcp-dctcp.h"
+
+/* include/net/tcp.h の #define（vmlinux.h には入らない） */
+#define TCP_ECN_OK          1
+#define TCP_ECN_DEMAND_CWR  4
+#define TCP_CONG_NEEDS_ECN  0x2
+
+const volatile u32 shift_g = 4;
+const volatile u32 alpha_on_init = DCTCP_MAX_ALPHA;
+
+/* reno の輻輳回避は kfunc として公開されているものを使う */
+extern void tcp_reno_cong_avoid(struct sock *sk, u32 ack, u32 acked) __ksym;
+
+/*
+ * 接続ごとの状態。
+ * inet_connection_sock.icsk_ca_priv（104 bytes）に置くので、それより大きくしてはいけない。
+ */
+struct dctcp {
+    u32 old_delivered;
+    u32 old_delivered_ce;
+    u32 prior_rcv_nxt;
+    u32 dctcp_alpha;
+    u32 next_seq;
+    u32 ce_state;
+    u32 loss_cwnd;
+    u32 no_ecn;
+};
+
+/* per-CPU 統計カウンタ（enum stat_idx） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_STATS);
+    __type(key, u32);
+    __type(value, u64);
+} stats SEC(".maps");
+
+static __always_inline void stat_inc(u32 idx)
+{
+    u64 *cnt = bpf_map_lookup_elem(&stats, &idx);
+
+    if (cnt)
+        (*cnt)++;
+}
+
+static __always_inline struct tcp_sock *tcp_sk(const struct sock *sk)
+{
+    return (struct tcp_sock *)sk;
+}
+
+static __always_inline struct inet_connection_sock *inet_csk(const struct sock *sk)
+{
+    return (struct inet_connection_sock *)sk;
+}
+
+static __always_inline struct dctcp *inet_csk_ca(const struct sock *sk)
+{
+    return (struct dctcp *)inet_csk(sk)->icsk_ca_priv;
+}
+
+static __always_inline bool before(u32 seq1, u32 seq2)
+{
+    return (s32)(seq1 - seq2) < 0;
+}
+
+static __always_inline void dctcp_reset(const struct tcp_sock *tp, struct dctcp *ca)
+{
+    ca->next_seq = tp->snd_nxt;
+    ca->old_delivered = tp->delivered;
+    ca->old_delivered_ce = tp->delivered_ce;
+}
+
+SEC("struct_ops/dctcp_init")
+void BPF_PROG(dctcp_init, struct sock *sk)
+{
+    const struct tcp_sock *tp = tcp_sk(sk);
+    struct dctcp *ca = inet_csk_ca(sk);
+
+    stat_inc(STAT_INIT);
+
+    /* LISTEN/CLOSE の時点ではまだ ECN ネゴ前なので、ECN 前提で初期化しておく */
+    ca->no_ecn = !(tp->ecn_flags & TCP_ECN_OK) &&
+                 sk->__sk_common.skc_state != TCP_LISTEN &&
+                 sk->__sk_common.skc_state != TCP_CLOSE;
+    if (ca->no_ecn)
+        stat_inc(STAT_NO_ECN);
+
+    ca->prior_rcv_nxt = tp->rcv_nxt;
+    ca->dctcp_alpha = alpha_on_init < DCTCP_MAX_ALPHA ? alpha_on_init : DCTCP_MAX_ALPHA;
+    ca->loss_cwnd = 0;
+    ca->ce_state = 0;
+    dctcp_reset(tp, ca);
+}
+
+SEC("struct_ops/dctcp_ssthresh")
+u32 BPF_PROG(dctcp_ssthresh, struct sock *sk)
+{
+    struct dctcp *ca = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    u32 cwnd = tp->snd_cwnd;
+    u32 next;
+
+    stat_inc(STAT_SSTHRESH);
+    ca->loss_cwnd = cwnd;
+
+    /* ECN が無い接続は reno と同じく半分 */
+    if (ca->no_ecn)
+        next = cwnd >> 1U;
+    else
+        next = cwnd - ((cwnd * ca->dctcp_alpha) >> 11U);
+
+    return next > 2U ? next : 2U;
+}
+
+/*
+ * 1 RTT ごとの alpha 更新（ACK 処理のたびに呼ばれるが、窓が終わったときだけ更新する）
+ */
+SEC("struct_ops/dctcp_update_alpha")
+void BPF_PROG(dctcp_update_alpha, struct sock *sk, u32 flags)
+{
+    const struct tcp_sock *tp = tcp_sk(sk);
+    struct dctcp *ca = inet_csk_ca(sk);
+
+    if (before(tp->snd_una, ca->next_seq))
+        return;
+
+    u32 delivered = tp->delivered - ca->old_delivered;
+    u32 delivered_ce = tp->delivered_ce - ca->old_delivered_ce;
+    u32 alpha = ca->dctcp_alpha;
+    u32 g = shift_g < 10 ? shift_g : 10;
+    u32 decay = alpha >> g;
+
+    /* alpha = (1 - g) * alpha（ただし alpha が小さいときは 0 まで落とし切る） */
+    alpha -= decay ? decay : alpha;
+
+    if (delivered_ce) {
+        /* + g * F（F は 1024 スケール） */
+        delivered_ce <<= (10 - g);
+        delivered_ce /= delivered ? delivered : 1U;
+        alpha += delivered_ce;
+        if (alpha > DCTCP_MAX_ALPHA)
+            alpha = DCTCP_MAX_ALPHA;
+        stat_inc(STAT_CE_WINDOW);
+    }
+
+    ca->dctcp_alpha = alpha;
+    stat_inc(STAT_ALPHA_UPDATE);
+    dctcp_reset(tp, ca);
+}
+
+static __always_inline void dctcp_react_to_loss(struct sock *sk)
+{
+    struct dctcp *ca = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    u32 half = tp->snd_cwnd >> 1U;
+
+    stat_inc(STAT_LOSS);
+    ca->loss_cwnd = tp->snd_cwnd;
+    tp->snd_ssthresh = half > 2U ? half : 2U;
+}
+
+SEC("struct_ops/dctcp_state")
+void BPF_PROG(dctcp_state, struct sock *sk, u8 new_state)
+{
+    if (new_state == TCP_CA_Recovery &&
+        new_state != BPF_CORE_READ_BITFIELD(inet_csk(sk), icsk_ca_state))
+        dctcp_react_to_loss(sk);
+}
+
+/* 受信側: CE 状態（ce_state）に合わせて ECE を立てる/下ろす */
+static __always_inline void dctcp_ece_ack_cwr(struct sock *sk, u32 ce_state)
+{
+    struct tcp_sock *tp = tcp_sk(sk);
+
+    if (ce_state == 1)
+        tp->ecn_flags |= TCP_ECN_DEMAND_CWR;
+    else
+        tp->ecn_flags &= ~TCP_ECN_DEMAND_CWR;
+}
+
+/*
+ * 受信側: CE 状態が変わったら、遅延 ACK 中の分を古い状態で即 ACK してから切り替える。
+ * こうしないと送信側が数える「CE 付きで届いたバイト数」がずれる。
+ */
+static __always_inline void dctcp_ece_ack_update(struct sock *sk, enum tcp_ca_event evt,
+                                                 u32 *prior_rcv_nxt, u32 *ce_state)
+{
+    u32 new_ce_state = (evt == CA_EVENT_ECN_IS_CE) ? 1 : 0;
+
+    if (*ce_state != new_ce_state) {
+        if (inet_csk(sk)->icsk_ack.pending & ICSK_ACK_TIMER) {
+            dctcp_ece_ack_cwr(sk, *ce_state);
+            bpf_tcp_send_ack(sk, *prior_rcv_nxt);
+        }
+        inet_csk(sk)->icsk_ack.pending |= ICSK_ACK_NOW;
+    }
+    *prior_rcv_nxt = tcp_sk(sk)->rcv_nxt;
+    *ce_state = new_ce_state;
+    dctcp_ece_ack_cwr(sk, new_ce_state);
+}
+
+SEC("struct_ops/dctcp_cwnd_event")
+void BPF_PROG(dctcp_cwnd_event, struct sock *sk, enum tcp_ca_event ev)
+{
+    struct dctcp *ca = inet_csk_ca(sk);
+
+    switch (ev) {
+    case CA_EVENT_ECN_IS_CE:
+    case CA_EVENT_ECN_NO_CE:
+        dctcp_ece_ack_update(sk, ev, &ca->prior_rcv_nxt, &ca->ce_state);
+        break;
+    case CA_EVENT_LOSS:
+        dctcp_react_to_loss(sk);
+        break;
+    default:
+        break;
+    }
+}
+
+SEC("struct_ops/dctcp_cwnd_undo")
+u32 BPF_PROG(dctcp_cwnd_undo, struct sock *sk)
+{
+    const struct dctcp *ca = inet_csk_ca(sk);
+    u32 cwnd = tcp_sk(sk)->snd_cwnd;
+
+    return cwnd > ca->loss_cwnd ? cwnd : ca->loss_cwnd;
+}
+
+SEC("struct_ops/dctcp_cong_avoid")
+void BPF_PROG(dctcp_cong_avoid, struct sock *sk, u32 ack, u32 acked)
+{
+    tcp_reno_cong_avoid(sk, ack, acked);
+}
+
+SEC(".struct_ops.link")
+struct tcp_congestion_ops dctcp = {
+    .init         = (void *)dctcp_init,
+    .in_ack_event = (void *)dctcp_update_alpha,
+    .cwnd_event   = (void *)dctcp_cwnd_event,
+    .ssthresh     = (void *)dctcp_ssthresh,
+    .cong_avoid   = (void *)dctcp_cong_avoid,
+    .undo_cwnd    = (void *)dctcp_cwnd_undo,
+    .set_state    = (void *)dctcp_state,
+    .flags        = TCP_CONG_NEEDS_ECN,
+    .name         = "bpf_dctcp",
+};
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
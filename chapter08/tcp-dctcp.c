@@ -0,0 +1,142 @@
+/*
+ * tcp-dctcp.c（ユーザ空間側 / BPF 輻輳制御 "bpf_dctcp" の登録）
+ *
+ * 目的:
+ *   tcp-dctcp.bpf.c の struct tcp_congestion_ops を struct_ops として登録し、
+ *   Ctrl-C まで登録を維持しながら 1 秒ごとに統計を表示する。
+ *   （link を破棄すると "bpf_dctcp" は未登録に戻る。使用中の接続は既定の輻輳制御に切り替わる）
+ *
+ * 使い方:
+ *   sudo ./tcp-dctcp [-g shift_g] [-a alpha_on_init]
+ *
+ * 比較の手順（netns.sh + tcp-bulk）:
+ *
+ *   sudo ./netns.sh shaped 1gbit 2ms     # ns1 --veth--> ns2（1Gbit ボトルネック + ECN マーク, 2ms 遅延）
+ *   sudo ./tcp-dctcp &                   # bpf_dctcp を登録
+ *   sudo ip netns exec ns2 ./tcp-bulk server &
+ *   sudo ip netns exec ns1 ./tcp-bulk client 10.0.0.2 -c bpf_dctcp -d 10
+ *   sudo ip netns exec ns1 ./tcp-bulk client 10.0.0.2 -c cubic     -d 10
+ *
+ *   struct_ops の登録はホスト全体（全 netns 共通）なので、ns1 からも bpf_dctcp が選べる。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <bpf/libbpf.h>
+
+#include "tcp-dctcp.h"
+#include "tcp-dctcp.skel.h"
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* per-CPU カウンタを CPU 分合算して返す */
+static __u64 read_stat(struct tcp_dctcp_bpf *skel, __u32 idx, int nr_cpus)
+{
+    __u64 values[nr_cpus];
+    __u64 sum = 0;
+
+    if (bpf_map__lookup_elem(skel->maps.stats, &idx, sizeof(idx),
+                             values, sizeof(values), 0))
+        return 0;
+
+    for (int i = 0; i < nr_cpus; i++)
+        sum += values[i];
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    struct tcp_dctcp_bpf *skel = NULL;
+    struct bpf_link *link = NULL;
+    int nr_cpus = libbpf_num_possible_cpus();
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+
+    skel = tcp_dctcp_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+
+    while ((opt = getopt(argc, argv, "g:a:")) != -1) {
+        switch (opt) {
+        case 'g':
+            skel->rodata->shift_g = (__u32)strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            skel->rodata->alpha_on_init = (__u32)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-g shift_g] [-a alpha_on_init]\n", argv[0]);
+            err = -EINVAL;
+            goto cleanup;
+        }
+    }
+
+    err = tcp_dctcp_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    link = bpf_map__attach_struct_ops(skel->maps.dctcp);
+    if (!link) {
+        err = -errno;
+        fprintf(stderr, "Failed to register bpf_dctcp: %d\n", err);
+        goto cleanup;
+    }
+
+    printf("bpf_dctcp registered (shift_g=%u alpha_on_init=%u). Ctrl-C to unregister.\n",
+           skel->rodata->shift_g, skel->rodata->alpha_on_init);
+    printf("%-8s %-8s %-10s %-10s %-10s %-8s\n",
+           "init", "no_ecn", "alpha_upd", "ce_window", "ssthresh", "loss");
+
+    while (!exiting) {
+        sleep(1);
+        printf("%-8llu %-8llu %-10llu %-10llu %-10llu %-8llu\n",
+               (unsigned long long)read_stat(skel, STAT_INIT, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_NO_ECN, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_ALPHA_UPDATE, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_CE_WINDOW, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_SSTHRESH, nr_cpus),
+               (unsigned long long)read_stat(skel, STAT_LOSS, nr_cpus));
+    }
+
+cleanup:
+    bpf_link__destroy(link);
+    tcp_dctcp_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
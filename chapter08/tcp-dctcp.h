@@ -0,0 +1,26 @@
+#ifndef TCP_DCTCP_H
+#define TCP_DCTCP_H
+
+/*
+ * tcp-dctcp.h（BPF 輻輳制御とローダで共有する定義）
+ *
+ * DCTCP の alpha は 0..DCTCP_MAX_ALPHA（1024 = 1.0）の固定小数点で持つ。
+ */
+
+#define DCTCP_MAX_ALPHA 1024U
+
+/*
+ * stat_idx:
+ *   per-CPU カウンタ（stats map）の添字。ローダが CPU 分を合算して表示する。
+ */
+enum stat_idx {
+   STAT_INIT = 0,        /* init が呼ばれた（= bpf_dctcp を使う接続ができた）回数 */
+   STAT_NO_ECN,          /* ECN がネゴできず reno 相当で動いた接続 */
+   STAT_ALPHA_UPDATE,    /* 1 RTT ごとの alpha 更新 */
+   STAT_CE_WINDOW,       /* alpha 更新のうち CE マーク付き ACK があった窓 */
+   STAT_SSTHRESH,        /* ssthresh（ECE/loss による cwnd 削減） */
+   STAT_LOSS,            /* loss（Recovery 突入 / RTO） */
+   NR_STATS,
+};
+
+#endif /* TCP_DCTCP_H */
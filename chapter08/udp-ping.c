@@ -0,0 +1,254 @@
+/*
+ * udp-ping.c（BPF を使わない補助ツール / 対話的フローの RTT と pps を測る）
+ *
+ * 目的:
+ *   tcp-bulk のバルクフローでボトルネックを埋めた状態で、小さな UDP パケットの往復時間を測り、
+ *   qdisc（bpf_fq / fq_codel など）が “少量しか送らないフロー” をどれだけ待たせるかを比べる。
+ *
+ * 使い方:
+ *   ./udp-ping server [-p port]
+ *   ./udp-ping client <ipv4 addr> [-p port] [-i interval_us] [-d sec] [-s size]
+ *
+ *   -i <us>    送信間隔（既定 10000us = 100pps）。0 なら応答を待たずに送り続ける flood モード
+ *   -d <sec>   計測時間（既定 10 秒）
+ *   -s <bytes> ペイロード長（既定 64。先頭 16 バイトに seq と送信時刻を入れる）
+ *
+ * 計測（client 側）:
+ *
+ *   seq, 送信時刻を詰めて sendto
+ *     │
+ *     v
+ *   server がそのまま送り返す
+ *     │
+ *     v
+ *   受信時刻 - 送信時刻 = RTT を記録
+ *
+ *   終了時に 送信/受信 pps, 損失数, RTT の p50/p99/max を表示する。
+ *   flood モードでは送信の合間に受信をノンブロッキングで刈り取り、最後に 200ms だけ残りを待つ。
+ *
+ * 注意:
+ *   - 送信時刻は client 自身の CLOCK_MONOTONIC なので、両端の時計合わせは要らない。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MAX_PAYLOAD   1472
+#define MAX_SAMPLES   (4 * 1024 * 1024)
+#define DRAIN_NS      (200ULL * 1000 * 1000)
+
+struct ping_hdr {
+    unsigned long long seq;
+    unsigned long long sent_ns;
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int run_server(int port)
+{
+    char buf[MAX_PAYLOAD];
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct sockaddr_in peer;
+    socklen_t plen;
+    ssize_t n;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror("bind");
+        close(fd);
+        return 1;
+    }
+
+    /* 受け取ったものをそのまま送り返す */
+    for (;;) {
+        plen = sizeof(peer);
+        n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&peer, &plen);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("recvfrom");
+            break;
+        }
+        sendto(fd, buf, n, 0, (struct sockaddr *)&peer, plen);
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* 届いている応答を全部読んで RTT を記録する（timeout_ms < 0 なら 1 つ来るまで待つ） */
+static void reap(int fd, int timeout_ms, unsigned long long *rtts, size_t *nr)
+{
+    char buf[MAX_PAYLOAD];
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    struct ping_hdr hdr;
+    ssize_t n;
+
+    while (poll(&pfd, 1, timeout_ms) > 0) {
+        n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < (ssize_t)sizeof(hdr))
+            break;
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (*nr < MAX_SAMPLES)
+            rtts[(*nr)++] = now_ns() - hdr.sent_ns;
+        timeout_ms = 0;
+    }
+}
+
+static int run_client(const char *ip, int port, int interval_us, int duration, int size)
+{
+    char buf[MAX_PAYLOAD];
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    struct ping_hdr hdr = {};
+    unsigned long long *rtts;
+    unsigned long long start, end, next_send, elapsed;
+    size_t nr = 0;
+    int fd;
+
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid address: %s\n", ip);
+        return 1;
+    }
+
+    rtts = malloc(sizeof(*rtts) * MAX_SAMPLES);
+    if (!rtts) {
+        perror("malloc");
+        return 1;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror("socket/connect");
+        free(rtts);
+        return 1;
+    }
+
+    memset(buf, 'x', sizeof(buf));
+    start = now_ns();
+    end = start + (unsigned long long)duration * 1000000000ULL;
+    next_send = start;
+
+    while (now_ns() < end) {
+        if (interval_us) {
+            /* 次の送信時刻まで応答を待ちながら刈り取る */
+            unsigned long long now = now_ns();
+
+            if (now < next_send) {
+                reap(fd, (int)((next_send - now) / 1000000), rtts, &nr);
+                continue;
+            }
+            next_send += (unsigned long long)interval_us * 1000;
+        }
+
+        hdr.sent_ns = now_ns();
+        memcpy(buf, &hdr, sizeof(hdr));
+        if (send(fd, buf, size, 0) < 0 && errno != ENOBUFS && errno != EAGAIN) {
+            perror("send");
+            break;
+        }
+        hdr.seq++;
+
+        if (!interval_us)
+            reap(fd, 0, rtts, &nr);
+    }
+
+    elapsed = now_ns() - start;
+    reap(fd, (int)(DRAIN_NS / 1000000), rtts, &nr);
+    close(fd);
+
+    printf("sent=%llu recv=%zu lost=%llu tx_pps=%.0f rx_pps=%.0f\n",
+           hdr.seq, nr, hdr.seq > nr ? hdr.seq - nr : 0,
+           hdr.seq * 1e9 / elapsed, nr * 1e9 / elapsed);
+    if (nr) {
+        qsort(rtts, nr, sizeof(rtts[0]), cmp_u64);
+        printf("rtt_us: p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+               rtts[nr / 2] / 1e3, rtts[(nr - 1) * 90 / 100] / 1e3,
+               rtts[(nr - 1) * 99 / 100] / 1e3, rtts[nr - 1] / 1e3);
+    }
+
+    free(rtts);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int port = 5202;
+    int interval_us = 10000;
+    int duration = 10;
+    int size = 64;
+    const char *mode;
+    const char *ip = NULL;
+    int opt;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s server [-p port]\n"
+                        "       %s client <addr> [-p port] [-i interval_us] [-d sec] [-s size]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    mode = argv[1];
+    optind = 2;
+    if (strcmp(mode, "client") == 0 && argc > 2 && argv[2][0] != '-') {
+        ip = argv[2];
+        optind = 3;
+    }
+
+    while ((opt = getopt(argc, argv, "p:i:d:s:")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'i': interval_us = atoi(optarg); break;
+        case 'd': duration = atoi(optarg); break;
+        case 's': size = atoi(optarg); break;
+        default: return 1;
+        }
+    }
+
+    if (size < (int)sizeof(struct ping_hdr))
+        size = sizeof(struct ping_hdr);
+    if (size > MAX_PAYLOAD)
+        size = MAX_PAYLOAD;
+
+    if (strcmp(mode, "server") == 0)
+        return run_server(port);
+    if (strcmp(mode, "client") == 0 && ip)
+        return run_client(ip, port, interval_us > 0 ? interval_us : 0,
+                          duration > 0 ? duration : 10, size);
+
+    fprintf(stderr, "Unknown mode or missing address\n");
+    return 1;
+}
@@ -0,0 +1,185 @@
+/*
+ * xdp-chain-progs.bpf.c（xdp-chain のスロットに freplace で差し込む XDP プログラム群）
+ *
+ * 目的:
+ *   同じインタフェースで同時に動かしたい 4 つの処理を、それぞれ独立した freplace プログラムにする。
+ *   比較用に、同じ処理を 1 本に並べた monolithic 版（SEC("xdp")）も同じオブジェクトに置く。
+ *
+ *   xdp_count    : chapter03 hello のカウンタ（グローバル変数 ++ ではなく per-CPU map で数える）
+ *   xdp_ping     : network.bpf.c の xdp と同じ ping フィルタ（packet.h の is_icmp_ping_request）
+ *   xdp_block    : blocklist（HASH, key = 送信元 IPv4）に載っている送信元を落とす
+ *   xdp_sample   : sample_rate パケットに 1 つ、先頭 SAMPLE_BYTES を samples（ringbuf）へ写す
+ *   xdp_noop     : 何もしない（ベンチでスロット 1 個あたりのコストを測る用）
+ *
+ *   xdp_monolithic : count → ping → block → sample を XDP_PASS の間だけ続ける 1 本の XDP プログラム
+ *   xdp_pass       : 何もしない XDP プログラム（ベンチの基準）
+ *
+ * 注意:
+ *   - SEC("freplace") のプログラムはロード前に差し替え先（ディスパッチャの fd と "slotN"）を
+ *     bpf_program__set_attach_target で指定する必要がある。ローダは slot0 を指定してロードし、
+ *     attach 時に実際のスロットを選ぶ（スロット関数はすべて同じ型なので別スロットにも付けられる）。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "packet.h"
+#include "xdp-chain-progs.h"
+
+/* 0 でサンプリングしない。実行中にローダが書き換える */
+u32 sample_rate = 0;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_PROGS);
+    __type(key, u32);
+    __type(value, struct prog_stat);
+} prog_stats SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 65536);
+    __type(key, u32);      /* 送信元 IPv4（ネットワークバイトオーダ） */
+    __type(value, u64);    /* 落とした数 */
+} blocklist SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} samples SEC(".maps");
+
+static __always_inline struct prog_stat *stat_of(u32 id)
+{
+    struct prog_stat *st = bpf_map_lookup_elem(&prog_stats, &id);
+
+    if (st)
+        st->packets++;
+    return st;
+}
+
+static __always_inline int do_count(struct xdp_md *ctx)
+{
+    stat_of(PROG_COUNT);
+    return XDP_PASS;
+}
+
+static __always_inline int do_ping(struct xdp_md *ctx)
+{
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+    struct prog_stat *st = stat_of(PROG_PING);
+
+    if (!is_icmp_ping_request(data, data_end))
+        return XDP_PASS;
+    if (st)
+        st->hits++;
+    return XDP_DROP;
+}
+
+static __always_inline int do_block(struct xdp_md *ctx)
+{
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+    struct hdr_cursor nh = { .pos = data };
+    struct prog_stat *st = stat_of(PROG_BLOCK);
+    struct ethhdr *eth;
+    struct iphdr *iph;
+    u32 saddr;
+    u64 *cnt;
+
+    if (parse_ethhdr(&nh, data_end, &eth) != bpf_htons(ETH_P_IP))
+        return XDP_PASS;
+    if (parse_iphdr(&nh, data_end, &iph) < 0)
+        return XDP_PASS;
+
+    saddr = iph->saddr;
+    cnt = bpf_map_lookup_elem(&blocklist, &saddr);
+    if (!cnt)
+        return XDP_PASS;
+    __sync_fetch_and_add(cnt, 1);
+    if (st)
+        st->hits++;
+    return XDP_DROP;
+}
+
+static __always_inline int do_sample(struct xdp_md *ctx)
+{
+    struct prog_stat *st = stat_of(PROG_SAMPLE);
+    u32 rate = sample_rate;
+    u32 len = ctx->data_end - ctx->data;
+    struct pkt_sample *s;
+
+    if (!rate || bpf_get_prandom_u32() % rate)
+        return XDP_PASS;
+
+    s = bpf_ringbuf_reserve(&samples, sizeof(*s), 0);
+    if (!s)
+        return XDP_PASS;
+    s->ifindex = ctx->ingress_ifindex;
+    s->len = len;
+    if (len > SAMPLE_BYTES)
+        len = SAMPLE_BYTES;
+    if (len == 0 || bpf_xdp_load_bytes(ctx, 0, s->data, len)) {
+        bpf_ringbuf_discard(s, 0);
+        return XDP_PASS;
+    }
+    bpf_ringbuf_submit(s, 0);
+    if (st)
+        st->hits++;
+    return XDP_PASS;
+}
+
+SEC("freplace")
+int xdp_count(struct xdp_md *ctx)
+{
+    return do_count(ctx);
+}
+
+SEC("freplace")
+int xdp_ping(struct xdp_md *ctx)
+{
+    return do_ping(ctx);
+}
+
+SEC("freplace")
+int xdp_block(struct xdp_md *ctx)
+{
+    return do_block(ctx);
+}
+
+SEC("freplace")
+int xdp_sample(struct xdp_md *ctx)
+{
+    return do_sample(ctx);
+}
+
+SEC("freplace")
+int xdp_noop(struct xdp_md *ctx)
+{
+    return XDP_PASS;
+}
+
+SEC("xdp")
+int xdp_monolithic(struct xdp_md *ctx)
+{
+    int ret;
+
+    ret = do_count(ctx);
+    if (ret != XDP_PASS)
+        return ret;
+    ret = do_ping(ctx);
+    if (ret != XDP_PASS)
+        return ret;
+    ret = do_block(ctx);
+    if (ret != XDP_PASS)
+        return ret;
+    return do_sample(ctx);
+}
+
+SEC("xdp")
+int xdp_pass(struct xdp_md *ctx)
+{
+    return XDP_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,47 @@
+#ifndef XDP_CHAIN_PROGS_H
+#define XDP_CHAIN_PROGS_H
+
+/*
+ * xdp-chain-progs.h（ディスパッチャのスロットに入れる XDP プログラム群とローダで共有する定義）
+ */
+
+#define SAMPLE_BYTES 64   /* sampler がリングバッファに写すパケット先頭のバイト数 */
+
+/*
+ * prog_id:
+ *   prog_stats map（PERCPU_ARRAY）の添字。
+ *
+ *   PROG_COUNT  : chapter03 hello のカウンタ（per-CPU map で数え直したもの）。常に XDP_PASS
+ *   PROG_PING   : network.bpf.c の xdp と同じ ping（ICMP echo request）フィルタ。該当すれば XDP_DROP
+ *   PROG_BLOCK  : 送信元 IPv4 アドレスのブロックリスト。該当すれば XDP_DROP
+ *   PROG_SAMPLE : N パケットに 1 つ先頭を samples（ringbuf）へ写す。常に XDP_PASS
+ */
+enum prog_id {
+   PROG_COUNT = 0,
+   PROG_PING,
+   PROG_BLOCK,
+   PROG_SAMPLE,
+   NR_PROGS,
+};
+
+/*
+ * struct prog_stat:
+ *   packets : そのプログラムが呼ばれた回数
+ *   hits    : ping / blocklist は落とした数、sampler は送ったサンプル数（count は packets と同じ）
+ */
+struct prog_stat {
+   unsigned long long packets;
+   unsigned long long hits;
+};
+
+/*
+ * struct pkt_sample:
+ *   samples（ringbuf）で届くレコード。len は元のパケット長、data にはその先頭 min(len, SAMPLE_BYTES) バイト。
+ */
+struct pkt_sample {
+   unsigned int ifindex;
+   unsigned int len;
+   unsigned char data[SAMPLE_BYTES];
+};
+
+#endif /* XDP_CHAIN_PROGS_H */
@@ -0,0 +1,81 @@
+/*
+ * xdp-chain.bpf.c（複数の XDP プログラムを 1 つのインタフェースで順に動かすディスパッチャ）
+ *
+ * 目的:
+ *   XDP はインタフェースごとに 1 プログラムしか attach できないので、chapter03 のカウンタ、
+ *   ping フィルタ、ブロックリスト、サンプラーを同時に動かすには 1 本にまとめる必要があった。
+ *   ここでは「中身が空のスロット関数を順に呼ぶだけ」のディスパッチャを attach しておき、
+ *   各スロットをユーザ空間から freplace（BPF_PROG_TYPE_EXT）で実際のプログラムに差し替える。
+ *
+ * 流れ:
+ *
+ *   xdp_dispatcher(ctx)
+ *     │  slot0(ctx) ──(freplace で xdp-chain-progs.bpf.c のプログラムに置き換わる)
+ *     │    戻り値 ret が chain_actions[0] に含まれる → 次へ / 含まれない → ret を verdict に
+ *     │  slot1(ctx) ...
+ *     v
+ *   num_slots まで全部「次へ」なら XDP_PASS
+ *
+ * スロット関数の決まりごと:
+ *   - freplace の差し替え先になれるのはグローバル関数だけなので static にしない。
+ *   - __noinline で呼び出しを残す（インライン化されると差し替える関数が無くなる）。
+ *   - volatile の戻り値で、verifier / clang に「常に XDP_PASS」と決め打ちさせない。
+ *
+ * 注意:
+ *   - conf は .rodata なのでロード後は変えられない。構成変更はローダがディスパッチャごと作り直し、
+ *     bpf_xdp_attach(XDP_FLAGS_REPLACE) で入れ替える（その間もパケットはどちらかの構成で処理される）。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include "xdp-chain.h"
+
+const volatile struct chain_config conf = {};
+
+#define DEFINE_SLOT(n)                                      \
+    __noinline int slot##n(struct xdp_md *ctx)              \
+    {                                                       \
+        volatile int ret = XDP_PASS;                        \
+                                                            \
+        if (!ctx)                                           \
+            return XDP_ABORTED;                             \
+        return ret;                                         \
+    }
+
+DEFINE_SLOT(0)
+DEFINE_SLOT(1)
+DEFINE_SLOT(2)
+DEFINE_SLOT(3)
+DEFINE_SLOT(4)
+DEFINE_SLOT(5)
+DEFINE_SLOT(6)
+DEFINE_SLOT(7)
+
+/* slot n を呼び、chain_actions に無い verdict ならそこで返す */
+#define CALL_SLOT(n)                                        \
+    do {                                                    \
+        if (conf.num_slots <= n)                            \
+            return XDP_PASS;                                \
+        ret = slot##n(ctx);                                 \
+        if (ret < 0 || ret > 31 ||                          \
+            !((1U << ret) & conf.chain_actions[n]))         \
+            return ret;                                     \
+    } while (0)
+
+SEC("xdp")
+int xdp_dispatcher(struct xdp_md *ctx)
+{
+    int ret;
+
+    CALL_SLOT(0);
+    CALL_SLOT(1);
+    CALL_SLOT(2);
+    CALL_SLOT(3);
+    CALL_SLOT(4);
+    CALL_SLOT(5);
+    CALL_SLOT(6);
+    CALL_SLOT(7);
+    return XDP_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,702 @@
+/*
+ * xdp-chain.c（ユーザ空間側 / XDP ディスパッチャの組み立て・実行中の差し替えと、オーバーヘッドのベンチ）
+ *
+ * 目的:
+ *   xdp-chain.bpf.c（ディスパッチャ）をインタフェースに attach し、そのスロットに
+ *   xdp-chain-progs.bpf.c のプログラム（count / ping / block / sample）を freplace で差し込む。
+ *   各プログラムには優先度（小さいほど先）と「どの verdict なら次へ進むか」を指定できる。
+ *   実行中は標準入力のコマンドで構成を変えられる。
+ *   bench モードでは BPF_PROG_TEST_RUN で、ディスパッチャのスロット 1 個あたりのコストと、
+ *   同じ 4 処理を 1 本にまとめた monolithic 版との差を測る。
+ *
+ * 使い方:
+ *   sudo ./xdp-chain [-S] -i <ifname> -p <prog>[:prio[:chain]] [-p ...] [-b addr] [-s rate]
+ *
+ *   -S            generic（skb）モードで attach する
+ *   -p            差し込むプログラム。prog = count | ping | block | sample
+ *                   prio  : 優先度（既定 50, 小さいほど先に動く）
+ *                   chain : 次へ進む verdict をカンマ区切りで（pass,drop,tx,redirect,aborted。既定 pass）
+ *   -b <addr>     blocklist に送信元 IPv4 を追加する（複数可）
+ *   -s <rate>     sample の間引き率（N パケットに 1 つ, 既定 1000）
+ *
+ *   実行中のコマンド（標準入力, 1 行 1 コマンド）:
+ *     add <prog>[:prio[:chain]]   del <prog>   block <addr>   unblock <addr>   rate <n>   list
+ *
+ *   例（netns.sh pair の ns2 に 4 つ全部を載せる）:
+ *     sudo ./netns.sh pair
+ *     sudo ip netns exec ns2 ./xdp-chain -i veth2 -p count:10 -p block:20 -p ping:30 -p sample:40 -b 10.0.0.9
+ *     sudo ip netns exec ns1 ping -c3 10.0.0.2     # ping が drop される（count は数えている）
+ *     > del ping                                   # ping が通るようになる
+ *
+ *   sudo ./xdp-chain bench [-r repeat]
+ *
+ * 構成を変えるとき（libxdp と同じ手順）:
+ *
+ *   新しい conf でディスパッチャをロード
+ *     → 有効なプログラムを優先度順に slot0.. へ bpf_program__attach_freplace
+ *     → bpf_xdp_attach(XDP_FLAGS_REPLACE, old_prog_fd = 旧ディスパッチャ) でインタフェース上を入れ替え
+ *     → 旧ディスパッチャの freplace link とディスパッチャを破棄
+ *
+ *   差し込むプログラム自体は 1 回だけロードし、世代ごとのディスパッチャに付け直して使い回す。
+ *
+ * 注意:
+ *   - bench の時間は test_run が返すカーネル内の実行時間（1 パケットあたり, repeat 回の平均）。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/if_link.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "xdp-chain.h"
+#include "xdp-chain-progs.h"
+#include "xdp-chain.skel.h"
+#include "xdp-chain-progs.skel.h"
+
+#define DEFAULT_PRIO 50
+
+/* 差し込めるプログラムと、その設定 */
+struct entry {
+    const char *name;
+    struct bpf_program *prog;
+    int prio;
+    unsigned int chain;
+    bool active;
+};
+
+/* ディスパッチャ 1 世代分（ディスパッチャ本体と、そのスロットへの freplace link） */
+struct chain {
+    struct xdp_chain_bpf *disp;
+    struct bpf_link *links[MAX_SLOTS];
+    const char *names[MAX_SLOTS];
+    int nr_links;
+};
+
+static const char *action_names[] = { "aborted", "drop", "pass", "tx", "redirect" };
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static void init_entries(struct entry entries[NR_PROGS], struct xdp_chain_progs_bpf *progs)
+{
+    entries[PROG_COUNT] = (struct entry){ .name = "count", .prog = progs->progs.xdp_count };
+    entries[PROG_PING] = (struct entry){ .name = "ping", .prog = progs->progs.xdp_ping };
+    entries[PROG_BLOCK] = (struct entry){ .name = "block", .prog = progs->progs.xdp_block };
+    entries[PROG_SAMPLE] = (struct entry){ .name = "sample", .prog = progs->progs.xdp_sample };
+}
+
+/* "pass,drop" → (1 << XDP_PASS) | (1 << XDP_DROP) */
+static int parse_chain(const char *s, unsigned int *bits)
+{
+    char buf[64], *save = NULL;
+
+    *bits = 0;
+    snprintf(buf, sizeof(buf), "%s", s);
+    for (char *t = strtok_r(buf, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+        unsigned int a;
+
+        for (a = 0; a < sizeof(action_names) / sizeof(action_names[0]); a++) {
+            if (!strcmp(t, action_names[a]))
+                break;
+        }
+        if (a == sizeof(action_names) / sizeof(action_names[0]))
+            return -EINVAL;
+        *bits |= 1U << a;
+    }
+    return 0;
+}
+
+/* <prog>[:prio[:chain]] を解釈して該当するエントリを有効にする */
+static int parse_entry(const char *s, struct entry entries[NR_PROGS])
+{
+    char buf[128], *prio, *chain;
+    struct entry *e = NULL;
+
+    snprintf(buf, sizeof(buf), "%s", s);
+    prio = strchr(buf, ':');
+    if (prio)
+        *prio++ = '\0';
+    chain = prio ? strchr(prio, ':') : NULL;
+    if (chain)
+        *chain++ = '\0';
+
+    for (int i = 0; i < NR_PROGS; i++) {
+        if (!strcmp(buf, entries[i].name))
+            e = &entries[i];
+    }
+    if (!e)
+        return -ENOENT;
+
+    e->prio = prio && *prio ? atoi(prio) : DEFAULT_PRIO;
+    e->chain = 1U << XDP_PASS;
+    if (chain && parse_chain(chain, &e->chain))
+        return -EINVAL;
+    e->active = true;
+    return 0;
+}
+
+static int block_addr(struct xdp_chain_progs_bpf *progs, const char *s, bool add)
+{
+    struct in_addr in;
+    __u64 zero = 0;
+
+    if (inet_pton(AF_INET, s, &in) != 1)
+        return -EINVAL;
+    if (add)
+        return bpf_map__update_elem(progs->maps.blocklist, &in.s_addr, sizeof(in.s_addr),
+                                    &zero, sizeof(zero), BPF_ANY);
+    return bpf_map__delete_elem(progs->maps.blocklist, &in.s_addr, sizeof(in.s_addr), 0);
+}
+
+static void destroy_chain(struct chain *c)
+{
+    for (int i = c->nr_links - 1; i >= 0; i--)
+        bpf_link__destroy(c->links[i]);
+    xdp_chain_bpf__destroy(c->disp);
+    memset(c, 0, sizeof(*c));
+}
+
+/*
+ * progs[0..n-1] を順に slot0.. に差し込んだディスパッチャを作る（インタフェースにはまだ付けない）。
+ * chain[i] は slot i の chain_actions、prio[i] は表示用。
+ */
+static int build_chain(struct chain *c, struct bpf_program **progs, const unsigned int *chain,
+                       const int *prio, int n)
+{
+    char slot[16];
+    int err;
+
+    memset(c, 0, sizeof(*c));
+    c->disp = xdp_chain_bpf__open();
+    if (!c->disp)
+        return -errno;
+
+    c->disp->rodata->conf.num_slots = n;
+    for (int i = 0; i < n; i++) {
+        c->disp->rodata->conf.chain_actions[i] = chain[i];
+        c->disp->rodata->conf.prio[i] = prio[i];
+    }
+
+    err = xdp_chain_bpf__load(c->disp);
+    if (err)
+        goto fail;
+
+    for (int i = 0; i < n; i++) {
+        snprintf(slot, sizeof(slot), "slot%d", i);
+        c->links[i] = bpf_program__attach_freplace(progs[i],
+                                                   bpf_program__fd(c->disp->progs.xdp_dispatcher),
+                                                   slot);
+        if (!c->links[i]) {
+            err = -errno;
+            fprintf(stderr, "Failed to attach %s to %s: %d\n",
+                    bpf_program__name(progs[i]), slot, err);
+            goto fail;
+        }
+        c->names[i] = bpf_program__name(progs[i]);
+        c->nr_links++;
+    }
+    return 0;
+
+fail:
+    destroy_chain(c);
+    return err;
+}
+
+static int cmp_prio(const void *a, const void *b)
+{
+    const struct entry *x = *(const struct entry **)a, *y = *(const struct entry **)b;
+
+    return x->prio - y->prio;
+}
+
+/* 有効なエントリを優先度順に並べてディスパッチャを作る */
+static int build_from_entries(struct chain *c, struct entry entries[NR_PROGS])
+{
+    struct entry *sorted[NR_PROGS];
+    struct bpf_program *progs[MAX_SLOTS];
+    unsigned int chain[MAX_SLOTS];
+    int prio[MAX_SLOTS];
+    int n = 0;
+
+    for (int i = 0; i < NR_PROGS; i++) {
+        if (entries[i].active)
+            sorted[n++] = &entries[i];
+    }
+    qsort(sorted, n, sizeof(sorted[0]), cmp_prio);
+
+    for (int i = 0; i < n; i++) {
+        progs[i] = sorted[i]->prog;
+        chain[i] = sorted[i]->chain;
+        prio[i] = sorted[i]->prio;
+    }
+    return build_chain(c, progs, chain, prio, n);
+}
+
+static void print_chain(const struct chain *c)
+{
+    const struct chain_config *conf = &c->disp->rodata->conf;
+
+    printf("dispatcher: %u slot(s)\n", conf->num_slots);
+    for (unsigned int i = 0; i < conf->num_slots; i++) {
+        printf("  slot%u prio=%-4d %-12s chain on:", i, conf->prio[i], c->names[i]);
+        for (unsigned int a = 0; a < sizeof(action_names) / sizeof(action_names[0]); a++) {
+            if (conf->chain_actions[i] & (1U << a))
+                printf(" %s", action_names[a]);
+        }
+        printf("\n");
+    }
+}
+
+/* 新しい構成のディスパッチャを作り、インタフェース上の旧ディスパッチャと入れ替える */
+static int swap_chain(struct chain *cur, struct entry entries[NR_PROGS], int ifindex, __u32 flags)
+{
+    LIBBPF_OPTS(bpf_xdp_attach_opts, opts);
+    struct chain next;
+    int err;
+
+    err = build_from_entries(&next, entries);
+    if (err)
+        return err;
+
+    /*
+     * 最初は IF に何も付いていないときだけ付ける（他のツールの XDP を黙って外さない）。
+     * 2 回目以降は自分のディスパッチャと入れ替わっていないことを確かめながら差し替える。
+     */
+    if (cur->disp) {
+        opts.old_prog_fd = bpf_program__fd(cur->disp->progs.xdp_dispatcher);
+        flags |= XDP_FLAGS_REPLACE;
+    } else {
+        flags |= XDP_FLAGS_UPDATE_IF_NOEXIST;
+    }
+    err = bpf_xdp_attach(ifindex, bpf_program__fd(next.disp->progs.xdp_dispatcher), flags, &opts);
+    if (err) {
+        if (err == -EBUSY && !cur->disp)
+            fprintf(stderr, "Another XDP program is already attached (detach it first)\n");
+        fprintf(stderr, "Failed to attach dispatcher: %d\n", err);
+        destroy_chain(&next);
+        return err;
+    }
+
+    destroy_chain(cur);
+    *cur = next;
+    print_chain(cur);
+    return 0;
+}
+
+static void print_stats(struct xdp_chain_progs_bpf *progs, struct entry entries[NR_PROGS],
+                        int nr_cpus, struct prog_stat prev[NR_PROGS])
+{
+    struct prog_stat values[nr_cpus];
+
+    for (__u32 id = 0; id < NR_PROGS; id++) {
+        struct prog_stat sum = {};
+
+        if (bpf_map__lookup_elem(progs->maps.prog_stats, &id, sizeof(id),
+                                 values, sizeof(values), 0))
+            continue;
+        for (int c = 0; c < nr_cpus; c++) {
+            sum.packets += values[c].packets;
+            sum.hits += values[c].hits;
+        }
+        printf("%s=%llu/%llu ", entries[id].name,
+               sum.packets - prev[id].packets, sum.hits - prev[id].hits);
+        prev[id] = sum;
+    }
+    printf("(pkts/hits per sec)\n");
+}
+
+static int handle_sample(void *ctx, void *data, size_t size)
+{
+    const struct pkt_sample *s = data;
+    const unsigned char *p = s->data;
+    char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+
+    (void)ctx;
+    if (size < sizeof(*s))
+        return 0;
+    if (s->len >= 34 && p[12] == 0x08 && p[13] == 0x00) {
+        inet_ntop(AF_INET, p + 26, src, sizeof(src));
+        inet_ntop(AF_INET, p + 30, dst, sizeof(dst));
+        printf("  sample: if%u len=%u proto=%u %s -> %s\n", s->ifindex, s->len, p[23], src, dst);
+    } else {
+        printf("  sample: if%u len=%u ethertype=0x%02x%02x\n", s->ifindex, s->len, p[12], p[13]);
+    }
+    return 0;
+}
+
+/* 標準入力の 1 行を実行する。構成が変わったら 1 を返す */
+static int run_command(char *line, struct entry entries[NR_PROGS], struct xdp_chain_progs_bpf *progs,
+                       const struct chain *cur)
+{
+    char *cmd = strtok(line, " \t\n"), *arg = strtok(NULL, " \t\n");
+
+    if (!cmd)
+        return 0;
+    if (!strcmp(cmd, "list")) {
+        print_chain(cur);
+        return 0;
+    }
+    if (!arg) {
+        fprintf(stderr, "missing argument: %s\n", cmd);
+        return 0;
+    }
+
+    if (!strcmp(cmd, "add")) {
+        if (parse_entry(arg, entries)) {
+            fprintf(stderr, "invalid program: %s\n", arg);
+            return 0;
+        }
+        return 1;
+    }
+    if (!strcmp(cmd, "del")) {
+        for (int i = 0; i < NR_PROGS; i++) {
+            if (!strcmp(arg, entries[i].name) && entries[i].active) {
+                entries[i].active = false;
+                return 1;
+            }
+        }
+        fprintf(stderr, "not active: %s\n", arg);
+        return 0;
+    }
+    if (!strcmp(cmd, "block") || !strcmp(cmd, "unblock")) {
+        if (block_addr(progs, arg, cmd[0] == 'b'))
+            fprintf(stderr, "failed to %s %s\n", cmd, arg);
+        return 0;
+    }
+    if (!strcmp(cmd, "rate")) {
+        progs->bss->sample_rate = strtoul(arg, NULL, 0);
+        return 0;
+    }
+    fprintf(stderr, "unknown command: %s\n", cmd);
+    return 0;
+}
+
+static int run_chain(struct xdp_chain_progs_bpf *progs, struct entry entries[NR_PROGS],
+                     const char *ifname, __u32 xdp_flags, int nr_cpus)
+{
+    struct prog_stat prev[NR_PROGS] = {};
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    struct ring_buffer *rb = NULL;
+    struct chain cur = {};
+    int ifindex = if_nametoindex(ifname);
+    struct entry saved[NR_PROGS];
+    struct timespec last, now;
+    char line[256];
+    int err;
+
+    if (!ifindex) {
+        fprintf(stderr, "Unknown interface: %s\n", ifname);
+        return -ENODEV;
+    }
+
+    rb = ring_buffer__new(bpf_map__fd(progs->maps.samples), handle_sample, NULL, NULL);
+    if (!rb) {
+        err = -errno;
+        fprintf(stderr, "Failed to create ring buffer: %d\n", err);
+        return err;
+    }
+
+    err = swap_chain(&cur, entries, ifindex, xdp_flags);
+    if (err)
+        goto out;
+    printf("Dispatcher attached to %s (%s mode). Ctrl-C to stop.\n",
+           ifname, xdp_flags == XDP_FLAGS_SKB_MODE ? "skb" : "native");
+
+    clock_gettime(CLOCK_MONOTONIC, &last);
+    while (!exiting) {
+        if (poll(&pfd, 1, 100) > 0) {
+            if (!fgets(line, sizeof(line), stdin)) {
+                pfd.fd = -1;                      /* EOF 以降は標準入力を見ない */
+            } else {
+                /* 差し替えに失敗したら、動いているチェインに entries を戻す */
+                memcpy(saved, entries, sizeof(saved));
+                if (run_command(line, entries, progs, &cur)) {
+                    int serr = swap_chain(&cur, entries, ifindex, xdp_flags);
+
+                    if (serr) {
+                        memcpy(entries, saved, sizeof(saved));
+                        fprintf(stderr, "Chain unchanged (swap failed: %d)\n", serr);
+                    }
+                }
+            }
+        }
+        ring_buffer__consume(rb);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > last.tv_sec) {
+            print_stats(progs, entries, nr_cpus, prev);
+            last = now;
+        }
+    }
+
+    bpf_xdp_detach(ifindex, xdp_flags, NULL);
+    destroy_chain(&cur);
+out:
+    ring_buffer__free(rb);
+    return err;
+}
+
+/* ---- bench ---------------------------------------------------------------- */
+
+/* Ethernet + IPv4 + UDP の 64 バイト（ping でも blocklist の送信元でもない → 全スロットを通る） */
+static void build_udp(unsigned char *pkt, size_t len)
+{
+    memset(pkt, 0, len);
+    pkt[12] = 0x08;                                   /* ETH_P_IP */
+    pkt[14] = 0x45;                                   /* version 4, ihl 5 */
+    pkt[16] = 0; pkt[17] = len - 14;                  /* tot_len */
+    pkt[22] = 64;                                     /* ttl */
+    pkt[23] = IPPROTO_UDP;
+    pkt[26] = 10; pkt[29] = 1;                        /* 10.0.0.1 */
+    pkt[30] = 10; pkt[33] = 2;                        /* 10.0.0.2 */
+    pkt[34] = 0x30; pkt[35] = 0x39;                   /* sport 12345 */
+    pkt[36] = 0x14; pkt[37] = 0x51;                   /* dport 5201 */
+    pkt[39] = len - 34;                               /* udp len */
+}
+
+static long test_run(int prog_fd, unsigned char *pkt, size_t len, int repeat)
+{
+    LIBBPF_OPTS(bpf_test_run_opts, opts, .data_in = pkt, .data_size_in = len, .repeat = repeat);
+
+    if (bpf_prog_test_run_opts(prog_fd, &opts))
+        return -errno;
+    return opts.duration;
+}
+
+static int run_bench(struct xdp_chain_progs_bpf *progs, struct entry entries[NR_PROGS], int repeat)
+{
+    struct bpf_program *list[MAX_SLOTS];
+    unsigned int chain[MAX_SLOTS];
+    int prio[MAX_SLOTS];
+    unsigned char pkt[64];
+    long base, t = 0, t0 = 0, mono, disp4;
+    struct chain c;
+    int err;
+
+    build_udp(pkt, sizeof(pkt));
+    progs->bss->sample_rate = 0;
+
+    /* blocklist は空だと lookup が軽すぎるので、このパケットに当たらない送信元を入れておく */
+    for (__u32 i = 1; i <= 1024; i++) {
+        __u32 addr = htonl(0xc0a80000 | i);
+        __u64 zero = 0;
+
+        bpf_map__update_elem(progs->maps.blocklist, &addr, sizeof(addr), &zero, sizeof(zero), BPF_ANY);
+    }
+
+    base = test_run(bpf_program__fd(progs->progs.xdp_pass), pkt, sizeof(pkt), repeat);
+    if (base < 0) {
+        fprintf(stderr, "BPF_PROG_TEST_RUN failed: %ld\n", base);
+        return base;
+    }
+    printf("%-36s %6ld ns\n", "xdp_pass (empty program)", base);
+
+    /* A) no-op の freplace を k 個差し込んだディスパッチャ */
+    for (int k = 0; k <= MAX_SLOTS; k++) {
+        char label[64];
+
+        for (int i = 0; i < k; i++) {
+            list[i] = progs->progs.xdp_noop;
+            chain[i] = 1U << XDP_PASS;
+            prio[i] = i;
+        }
+        err = build_chain(&c, list, chain, prio, k);
+        if (err)
+            return err;
+        t = test_run(bpf_program__fd(c.disp->progs.xdp_dispatcher), pkt, sizeof(pkt), repeat);
+        destroy_chain(&c);
+        if (t < 0)
+            goto fail;
+
+        if (k == 0)
+            t0 = t;
+        snprintf(label, sizeof(label), "dispatcher + %d noop slot(s)", k);
+        printf("%-36s %6ld ns", label, t);
+        if (k)
+            printf("   (%.1f ns/slot)", (double)(t - t0) / k);
+        printf("\n");
+    }
+
+    /* B) 4 つの処理: monolithic 版 vs ディスパッチャ + freplace 4 本 */
+    mono = test_run(bpf_program__fd(progs->progs.xdp_monolithic), pkt, sizeof(pkt), repeat);
+    if (mono < 0) {
+        t = mono;
+        goto fail;
+    }
+
+    for (int i = 0; i < NR_PROGS; i++) {
+        list[i] = entries[i].prog;
+        chain[i] = 1U << XDP_PASS;
+        prio[i] = i;
+    }
+    err = build_chain(&c, list, chain, prio, NR_PROGS);
+    if (err)
+        return err;
+    disp4 = test_run(bpf_program__fd(c.disp->progs.xdp_dispatcher), pkt, sizeof(pkt), repeat);
+    destroy_chain(&c);
+    if (disp4 < 0) {
+        t = disp4;
+        goto fail;
+    }
+
+    printf("%-36s %6ld ns\n", "monolithic count+ping+block+sample", mono);
+    printf("%-36s %6ld ns   (+%ld ns, %.1f ns/slot)\n", "dispatcher + 4 freplace programs",
+           disp4, disp4 - mono, (double)(disp4 - mono) / NR_PROGS);
+    return 0;
+
+fail:
+    fprintf(stderr, "BPF_PROG_TEST_RUN failed: %ld\n", t);
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    struct xdp_chain_progs_bpf *progs = NULL;
+    struct xdp_chain_bpf *tmpl = NULL;
+    struct entry entries[NR_PROGS];
+    const char *specs[NR_PROGS * 2], *blocks[64];
+    int nr_specs = 0, nr_blocks = 0;
+    int nr_cpus = libbpf_num_possible_cpus();
+    const char *ifname = NULL;
+    __u32 xdp_flags = XDP_FLAGS_DRV_MODE;
+    unsigned int rate = 1000;
+    int repeat = 1000000;
+    bool bench = false, usage = false;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench = true;
+        optind = 2;
+    }
+
+    while ((opt = getopt(argc, argv, "Si:p:b:s:r:")) != -1) {
+        switch (opt) {
+        case 'S': xdp_flags = XDP_FLAGS_SKB_MODE; break;
+        case 'i': ifname = optarg; break;
+        case 's': rate = strtoul(optarg, NULL, 0); break;
+        case 'r': repeat = atoi(optarg); break;
+        case 'p':
+            if (nr_specs < NR_PROGS * 2)
+                specs[nr_specs++] = optarg;
+            break;
+        case 'b':
+            if (nr_blocks < 64)
+                blocks[nr_blocks++] = optarg;
+            break;
+        default: usage = true; break;
+        }
+    }
+    if (usage || (!bench && (!ifname || !nr_specs)) || repeat <= 0) {
+        fprintf(stderr, "Usage: %s [-S] -i <ifname> -p <prog>[:prio[:chain]] [-p ...] [-b addr] [-s rate]\n"
+                        "         prog: count | ping | block | sample\n"
+                        "       %s bench [-r repeat]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+
+    /*
+     * freplace プログラムはロード時に差し替え先が要るので、空のディスパッチャを 1 つロードして
+     * その slot0 を指定する。実際の差し込み先は attach 時に世代ごとのディスパッチャを指定する。
+     */
+    tmpl = xdp_chain_bpf__open_and_load();
+    if (!tmpl) {
+        fprintf(stderr, "Failed to open/load dispatcher\n");
+        return 1;
+    }
+
+    progs = xdp_chain_progs_bpf__open();
+    if (!progs) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        err = -errno;
+        goto cleanup;
+    }
+
+    {
+        struct bpf_program *ext[] = {
+            progs->progs.xdp_count, progs->progs.xdp_ping, progs->progs.xdp_block,
+            progs->progs.xdp_sample, progs->progs.xdp_noop,
+        };
+
+        for (size_t i = 0; i < sizeof(ext) / sizeof(ext[0]); i++) {
+            err = bpf_program__set_attach_target(ext[i],
+                                                 bpf_program__fd(tmpl->progs.xdp_dispatcher),
+                                                 "slot0");
+            if (err) {
+                fprintf(stderr, "Failed to set attach target: %d\n", err);
+                goto cleanup;
+            }
+        }
+    }
+
+    err = xdp_chain_progs_bpf__load(progs);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    init_entries(entries, progs);
+    for (int i = 0; i < nr_specs; i++) {
+        if (parse_entry(specs[i], entries)) {
+            fprintf(stderr, "Invalid program spec: %s\n", specs[i]);
+            err = -EINVAL;
+            goto cleanup;
+        }
+    }
+    for (int i = 0; i < nr_blocks; i++) {
+        if (block_addr(progs, blocks[i], true)) {
+            fprintf(stderr, "Invalid address: %s\n", blocks[i]);
+            err = -EINVAL;
+            goto cleanup;
+        }
+    }
+    progs->bss->sample_rate = rate;
+
+    if (bench)
+        err = run_bench(progs, entries, repeat);
+    else
+        err = run_chain(progs, entries, ifname, xdp_flags, nr_cpus);
+
+cleanup:
+    xdp_chain_progs_bpf__destroy(progs);
+    xdp_chain_bpf__destroy(tmpl);
+    return err < 0 ? -err : 0;
+}
@@ -0,0 +1,26 @@
+#ifndef XDP_CHAIN_H
+#define XDP_CHAIN_H
+
+/*
+ * xdp-chain.h（XDP ディスパッチャとローダで共有する定義）
+ */
+
+#define MAX_SLOTS 8   /* ディスパッチャが持つ差し替え口（slot0..slot7）の数 */
+
+/*
+ * struct chain_config:
+ *   ディスパッチャの .rodata。ロード時に決めて凍結するので、verifier は使わないスロットの呼び出しを消せる。
+ *   構成を変えるときはローダが新しいディスパッチャを作り、インタフェース上で差し替える。
+ *
+ *   num_slots         : 使うスロット数（slot0 から順に呼ぶ）
+ *   chain_actions[i]  : slot i の戻り値がこのビット集合（1 << XDP_*）に含まれていれば次のスロットへ進む。
+ *                       含まれていなければその戻り値をそのまま XDP の verdict にする
+ *   prio[i]           : slot i に入れたプログラムの優先度（小さいほど先。表示用）
+ */
+struct chain_config {
+   unsigned int num_slots;
+   unsigned int chain_actions[MAX_SLOTS];
+   int prio[MAX_SLOTS];
+};
+
+#endif /* XDP_CHAIN_H */
@@ -0,0 +1,368 @@
+/*
+ * xdp-gen.c（ユーザ空間側 / テンプレートフレームを作って XDP live frames で送り続ける）
+ *
+ * 目的:
+ *   Ethernet + IPv4 + UDP / TCP(SYN) / ICMP(echo) のテンプレートフレームを 1 つ作り、
+ *   xdp-gen.bpf.c を BPF_PROG_TEST_RUN（BPF_F_TEST_XDP_LIVE_FRAMES）で repeat 回まわして送信する。
+ *   フレームの複製・フィールドのランダム化・送信はすべてカーネル内で行うので、
+ *   ユーザ空間は数十万フレームに 1 回 syscall するだけになる。
+ *
+ * 使い方:
+ *   sudo ./xdp-gen -i <ifname> [-s src[+n]] [-d dst] [-m dst_mac] [-P udp|tcp|icmp] [-l size]
+ *                  [-p sport[+n]] [-q dport[+n]] [-r redirect_if] [-t seconds] [-c cpu] [-b batch]
+ *
+ *   -i   フレームが「受信された」ことにする IF（XDP_TX ならここから送信される）
+ *   -s   送信元 IPv4。+n で src .. src+n-1 からランダム（既定 10.0.0.1）
+ *   -d   宛先 IPv4（既定 10.0.0.2）
+ *   -m   宛先 MAC（既定 ff:ff:ff:ff:ff:ff）。送信元 MAC は -i の IF のもの
+ *   -P   L4（既定 udp）。tcp は SYN、icmp は echo request（id を -p の範囲でランダム）
+ *   -l   フレーム長（Ethernet ヘッダ込み, 既定 64, 最大 MAX_FRAME）
+ *   -p / -q  送信元 / 宛先ポート。+n で範囲内ランダム（既定 9 / 9）
+ *   -r   XDP_TX ではなくこの IF へ redirect する
+ *   -t   送信時間（秒, 既定 10）
+ *   -c   この CPU に張り付けて回す（既定: 張り付けない）
+ *   -b   live frames のバッチサイズ（既定 0 = カーネル既定の 64）
+ *
+ * veth での使い方（netns.sh pair, ns1 → ns2）:
+ *
+ *   sudo ./netns.sh pair
+ *   sudo ip netns exec ns2 ./xdp-chain -i veth2 -p count           # 受信側の pps を数える
+ *   sudo ip netns exec ns1 ./xdp-gen -i veth1 -s 10.0.0.1+256 -p 1024+4096 -c 2
+ *
+ *   veth の XDP_TX / redirect は、受け側（peer）に XDP プログラムが載っているか GRO が有効でないと
+ *   落とされる。上の例では xdp-chain が載るので受かる（載せないなら ethtool -K veth2 gro on）。
+ *
+ * 注意:
+ *   - 表示する pps は「プログラムを回した回数」。送信キューが詰まって落ちた分は受信側の数との差で分かる。
+ *   - live frames モードはカーネル 5.18 以降。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <limits.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "xdp-gen.h"
+#include "xdp-gen.skel.h"
+
+#define CHUNK (1 << 20)   /* 1 回の test_run で回すフレーム数 */
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* "value[+count]" を分解する（count 省略時は 1） */
+static char *split_count(char *s, unsigned long *count)
+{
+    char *plus = strchr(s, '+');
+
+    *count = 1;
+    if (plus) {
+        *plus = '\0';
+        *count = strtoul(plus + 1, NULL, 0);
+    }
+    return s;
+}
+
+/*
+ * "port[+count]" を読む。gen_config は unsigned short なので、port が 65535 を超えるもの、
+ * port + count - 1 が 65535 を超えるもの（回り込む）は切り詰めずに拒否する。
+ */
+static int parse_port_range(char *s, unsigned short *port, unsigned short *count)
+{
+    unsigned long p, n;
+
+    p = strtoul(split_count(s, &n), NULL, 0);
+    if (p > 65535 || !n || n > 65535 || n > 65536 - p)
+        return -1;
+    *port = p;
+    *count = n;
+    return 0;
+}
+
+static int get_mac(const char *ifname, unsigned char mac[6])
+{
+    struct ifreq ifr = {};
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int err = 0;
+
+    if (fd < 0)
+        return -errno;
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr))
+        err = -errno;
+    else
+        memcpy(mac, ifr.ifr_hwaddr.sa_data, 6);
+    close(fd);
+    return err;
+}
+
+static unsigned int csum_add(unsigned int sum, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+
+    for (size_t i = 0; i + 1 < len; i += 2)
+        sum += (p[i] << 8) | p[i + 1];
+    if (len & 1)
+        sum += p[len - 1] << 8;
+    return sum;
+}
+
+static unsigned short csum_finish(unsigned int sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return htons(~sum & 0xFFFF);
+}
+
+/*
+ * テンプレートフレームを作る。戻り値はフレーム長。
+ * チェックサムはここで正しく計算しておき、その値を conf に写す（BPF 側は差分で直す）。
+ */
+static int build_frame(unsigned char *f, int len, const unsigned char dmac[6], const unsigned char smac[6],
+                       struct gen_config *c, unsigned int daddr)
+{
+    int l4_off = 14 + 20, l4_len = len - l4_off;
+    unsigned int sum;
+
+    memset(f, 0, len);
+    memcpy(f, dmac, 6);
+    memcpy(f + 6, smac, 6);
+    f[12] = 0x08;
+
+    f[14] = 0x45;
+    f[16] = (len - 14) >> 8;
+    f[17] = (len - 14) & 0xFF;
+    f[20] = 0x40;                                      /* DF */
+    f[22] = 64;
+    f[23] = c->proto;
+    memcpy(f + 26, &c->saddr, 4);
+    memcpy(f + 30, &daddr, 4);
+    memcpy(f + 24, (unsigned short[]){ csum_finish(csum_add(0, f + 14, 20)) }, 2);
+
+    if (c->proto == IPPROTO_ICMP) {
+        f[l4_off] = 8;                                 /* echo request */
+        f[l4_off + 4] = c->sport >> 8;                 /* id */
+        f[l4_off + 5] = c->sport & 0xFF;
+        c->l4_check = csum_finish(csum_add(0, f + l4_off, l4_len));
+    } else {
+        f[l4_off] = c->sport >> 8;
+        f[l4_off + 1] = c->sport & 0xFF;
+        f[l4_off + 2] = c->dport >> 8;
+        f[l4_off + 3] = c->dport & 0xFF;
+        if (c->proto == IPPROTO_UDP) {
+            f[l4_off + 4] = l4_len >> 8;
+            f[l4_off + 5] = l4_len & 0xFF;
+        } else {
+            f[l4_off + 12] = 5 << 4;                   /* doff */
+            f[l4_off + 13] = 0x02;                     /* SYN */
+            f[l4_off + 14] = 0xFF;                     /* window */
+            f[l4_off + 15] = 0xFF;
+        }
+        /* 疑似ヘッダ: saddr, daddr, proto, L4 長 */
+        sum = csum_add(0, f + 26, 8);
+        sum += c->proto + l4_len;
+        c->l4_check = csum_finish(csum_add(sum, f + l4_off, l4_len));
+        if (c->proto == IPPROTO_UDP && !c->l4_check)
+            c->l4_check = 0xFFFF;
+    }
+    memcpy(f + (c->proto == IPPROTO_UDP ? l4_off + 6 : c->proto == IPPROTO_TCP ? l4_off + 16 : l4_off + 2),
+           &c->l4_check, 2);
+    memcpy(&c->ip_check, f + 24, 2);
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    struct xdp_gen_bpf *skel = NULL;
+    static unsigned char frame[MAX_FRAME];
+    unsigned char dmac[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }, smac[6];
+    struct gen_config c = { .proto = IPPROTO_UDP, .sport = 9, .dport = 9,
+                            .saddr_count = 1, .sport_count = 1, .dport_count = 1 };
+    char src[64] = "10.0.0.1", sport[32] = "9", dport[32] = "9";
+    const char *ifname = NULL, *dst = "10.0.0.2", *redirect = NULL;
+    unsigned int daddr;
+    unsigned long count;
+    struct in_addr in;
+    int len = 64, seconds = 10, cpu = -1, batch = 0;
+    unsigned long long sent = 0, last_sent = 0;
+    double start, last;
+    bool usage = false;
+    int ifindex, err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    while ((opt = getopt(argc, argv, "i:s:d:m:P:l:p:q:r:t:c:b:")) != -1) {
+        switch (opt) {
+        case 'i': ifname = optarg; break;
+        case 's': snprintf(src, sizeof(src), "%s", optarg); break;
+        case 'd': dst = optarg; break;
+        case 'p': snprintf(sport, sizeof(sport), "%s", optarg); break;
+        case 'q': snprintf(dport, sizeof(dport), "%s", optarg); break;
+        case 'l': len = atoi(optarg); break;
+        case 'r': redirect = optarg; break;
+        case 't': seconds = atoi(optarg); break;
+        case 'c': cpu = atoi(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'm':
+            if (sscanf(optarg, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &dmac[0], &dmac[1], &dmac[2],
+                       &dmac[3], &dmac[4], &dmac[5]) != 6)
+                usage = true;
+            break;
+        case 'P':
+            if (!strcmp(optarg, "udp"))
+                c.proto = IPPROTO_UDP;
+            else if (!strcmp(optarg, "tcp"))
+                c.proto = IPPROTO_TCP;
+            else if (!strcmp(optarg, "icmp"))
+                c.proto = IPPROTO_ICMP;
+            else
+                usage = true;
+            break;
+        default: usage = true; break;
+        }
+    }
+
+    /* saddr + count - 1 が 255.255.255.255 を超えるもの（回り込む）は拒否 */
+    if (inet_pton(AF_INET, split_count(src, &count), &in) != 1 ||
+        !count || count > UINT_MAX || count > 0x100000000ULL - ntohl(in.s_addr))
+        usage = true;
+    c.saddr = in.s_addr;
+    c.saddr_count = count;
+    if (inet_pton(AF_INET, dst, &in) != 1)
+        usage = true;
+    daddr = in.s_addr;
+    if (parse_port_range(sport, &c.sport, &c.sport_count) ||
+        parse_port_range(dport, &c.dport, &c.dport_count))
+        usage = true;
+
+    if (usage || !ifname || len < 64 || len > MAX_FRAME || seconds <= 0) {
+        fprintf(stderr, "Usage: %s -i <ifname> [-s src[+n]] [-d dst] [-m dst_mac] [-P udp|tcp|icmp] [-l size]\n"
+                        "          [-p sport[+n]] [-q dport[+n]] [-r redirect_if] [-t seconds] [-c cpu] [-b batch]\n",
+                argv[0]);
+        return 1;
+    }
+
+    ifindex = if_nametoindex(ifname);
+    if (!ifindex || get_mac(ifname, smac)) {
+        fprintf(stderr, "Unknown interface: %s\n", ifname);
+        return 1;
+    }
+    if (redirect) {
+        c.out_ifindex = if_nametoindex(redirect);
+        if (!c.out_ifindex) {
+            fprintf(stderr, "Unknown interface: %s\n", redirect);
+            return 1;
+        }
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set))
+            fprintf(stderr, "Failed to pin to CPU %d: %s\n", cpu, strerror(errno));
+    }
+
+    build_frame(frame, len, dmac, smac, &c, daddr);
+
+    skel = xdp_gen_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Failed to open BPF object\n");
+        return 1;
+    }
+    skel->rodata->conf = c;
+
+    err = xdp_gen_bpf__load(skel);
+    if (err) {
+        fprintf(stderr, "Failed to load BPF object (err=%d)\n", err);
+        goto cleanup;
+    }
+
+    printf("Sending %d-byte %s frames on %s%s%s for %d s. Ctrl-C to stop.\n", len,
+           c.proto == IPPROTO_UDP ? "udp" : c.proto == IPPROTO_TCP ? "tcp" : "icmp", ifname,
+           redirect ? " -> " : " (XDP_TX)", redirect ? redirect : "", seconds);
+
+    start = last = now_sec();
+    while (!exiting && now_sec() - start < seconds) {
+        struct xdp_md ctx_in = { .data_end = len, .ingress_ifindex = ifindex };
+        LIBBPF_OPTS(bpf_test_run_opts, opts,
+                    .data_in = frame,
+                    .data_size_in = len,
+                    .ctx_in = &ctx_in,
+                    .ctx_size_in = sizeof(ctx_in),
+                    .repeat = CHUNK,
+                    .batch_size = batch,
+                    .flags = BPF_F_TEST_XDP_LIVE_FRAMES);
+        double now;
+
+        err = bpf_prog_test_run_opts(bpf_program__fd(skel->progs.xdp_gen), &opts);
+        if (err && errno != EINTR) {
+            err = -errno;
+            fprintf(stderr, "BPF_PROG_TEST_RUN failed: %d\n", err);
+            break;
+        }
+        if (!err)
+            sent += CHUNK;
+        err = 0;
+
+        now = now_sec();
+        if (now - last >= 1.0) {
+            printf("%.2f Mpps (%.2f Gbit/s on the wire)\n",
+                   (sent - last_sent) / (now - last) / 1e6,
+                   (sent - last_sent) * (len + 24) * 8 / (now - last) / 1e9);
+            last_sent = sent;
+            last = now;
+        }
+    }
+
+    printf("total: %llu frames in %.2f s (%.2f Mpps)\n",
+           sent, now_sec() - start, sent / (now_sec() - start) / 1e6);
+
+cleanup:
+    xdp_gen_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
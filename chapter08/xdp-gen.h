@@ -0,0 +1,37 @@
+#ifndef XDP_GEN_H
+#define XDP_GEN_H
+
+/*
+ * xdp-gen.h（XDP live frames パケットジェネレータとローダで共有する定義）
+ */
+
+#define MAX_FRAME 1514   /* テンプレートフレームの最大長（Ethernet ヘッダ込み, FCS なし） */
+
+/*
+ * struct gen_config:
+ *   xdp-gen.bpf.c の .rodata。ローダがテンプレートフレームを作ったときの値をそのまま書く。
+ *
+ *   out_ifindex   : 0 なら XDP_TX（ingress_ifindex の IF から送る）、それ以外はその IF へ bpf_redirect
+ *   proto         : IPPROTO_UDP / IPPROTO_TCP / IPPROTO_ICMP
+ *   saddr         : テンプレートの送信元 IPv4（ネットワークバイトオーダ）
+ *   saddr_count   : 送信元を saddr から saddr + count - 1 の範囲でランダムにする（1 なら固定）
+ *   sport / dport : テンプレートのポート（ホストバイトオーダ, ICMP では sport が echo の id）
+ *   sport_count / dport_count : ポートを port から port + count - 1 の範囲でランダムにする（1 なら固定）
+ *   ip_check / l4_check : テンプレートのチェックサム（パケット上の値そのまま）。
+ *                         毎回「テンプレート値からの差分」で計算し直すので、前回の書き換えが残っていても正しい
+ */
+struct gen_config {
+   unsigned int out_ifindex;
+   unsigned int saddr;
+   unsigned int saddr_count;
+   unsigned short sport;
+   unsigned short dport;
+   unsigned short sport_count;
+   unsigned short dport_count;
+   unsigned short ip_check;
+   unsigned short l4_check;
+   unsigned char proto;
+   unsigned char pad[3];
+};
+
+#endif /* XDP_GEN_H */
@@ -0,0 +1,143 @@
+/*
+ * xdp-router.bpf.c（bpf_fib_lookup による XDP の L3 転送ファストパス）
+ *
+ * 目的:
+ *   ゲートウェイがパケットを転送するたびに skb を作ってスタック全体（netfilter / routing / neigh）を
+ *   通すのをやめ、NIC ドライバ直後の XDP で「経路を引いて MAC を書き換えて出す」だけにする。
+ *   経路表・ARP 表はカーネルのもの（ip route / ip neigh）を bpf_fib_lookup でそのまま使う。
+ *
+ * 流れ:
+ *
+ *   受信フレーム
+ *     │  packet.h で Ethernet → IPv4 / IPv6 を解析
+ *     │  TTL <= 1 ならカーネルへ（ICMP time exceeded を返してもらう）
+ *     v
+ *   bpf_fib_lookup(dst, src, tos, ingress_ifindex)
+ *     ├─ SUCCESS   : fib.ifindex = 出力 IF, fib.dmac/smac = 次ホップと自分の MAC
+ *     │                TTL-1（IPv4 はチェックサムを差分更新）→ MAC 書き換え
+ *     │                → bpf_redirect_map(tx_ports, fib.ifindex)
+ *     ├─ NO_NEIGH  : XDP_PASS（カーネルが ARP/ND を解決する。以降のパケットは XDP で転送される）
+ *     └─ それ以外  : XDP_PASS（ローカル宛・経路なし・転送禁止など、普通のルータとして振る舞う）
+ *
+ * TTL とチェックサム（RFC 1624 の差分更新）:
+ *   TTL は IPv4 ヘッダの 16bit 語 (TTL << 8 | protocol) の上位バイトなので、TTL を 1 減らすと
+ *   その語は 0x0100 減る → 1 の補数和のチェックサムは 0x0100 増やせばよい（桁あふれは下位へ戻す）。
+ *
+ * 注意:
+ *   - redirect 先は tx_ports（DEVMAP）に登録された IF だけ。登録されていなければ XDP_PASS。
+ *   - veth への XDP redirect は受け側（peer）が XDP を動かしているか GRO（NAPI）が有効でないと落ちる。
+ *     netns.sh router は端点側の veth で gro を有効にしている。
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "packet.h"
+#include "xdp-router.h"
+
+#define AF_INET  2
+#define AF_INET6 10
+
+/* vmlinux.h に入らない uapi の #define */
+#define BPF_FIB_LKUP_RET_SUCCESS  0
+#define BPF_FIB_LKUP_RET_NO_NEIGH 7
+
+struct {
+    __uint(type, BPF_MAP_TYPE_DEVMAP);
+    __uint(max_entries, MAX_IFINDEX);
+    __type(key, u32);
+    __type(value, u32);
+} tx_ports SEC(".maps");
+
+/* per-CPU 統計カウンタ（enum stat_idx） */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, NR_STATS);
+    __type(key, u32);
+    __type(value, u64);
+} stats SEC(".maps");
+
+static __always_inline int stat_ret(u32 idx, int action)
+{
+    u64 *cnt = bpf_map_lookup_elem(&stats, &idx);
+
+    if (cnt)
+        (*cnt)++;
+    return action;
+}
+
+static __always_inline void ip_decrease_ttl(struct iphdr *iph)
+{
+    u32 check = iph->check;
+
+    check += bpf_htons(0x0100);
+    iph->check = (u16)(check + (check >= 0xFFFF));
+    iph->ttl--;
+}
+
+SEC("xdp")
+int xdp_router(struct xdp_md *ctx)
+{
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+    struct hdr_cursor nh = { .pos = data };
+    struct bpf_fib_lookup fib = {};
+    struct ipv6hdr *ip6h = NULL;
+    struct iphdr *iph = NULL;
+    struct ethhdr *eth;
+    int proto, rc;
+
+    proto = parse_ethhdr(&nh, data_end, &eth);
+    if (proto == bpf_htons(ETH_P_IP)) {
+        if (parse_iphdr(&nh, data_end, &iph) < 0)
+            return stat_ret(STAT_PASS_OTHER, XDP_PASS);
+        if (iph->ttl <= 1)
+            return stat_ret(STAT_PASS_TTL, XDP_PASS);
+
+        fib.family = AF_INET;
+        fib.tos = iph->tos;
+        fib.l4_protocol = iph->protocol;
+        fib.tot_len = bpf_ntohs(iph->tot_len);
+        fib.ipv4_src = iph->saddr;
+        fib.ipv4_dst = iph->daddr;
+    } else if (proto == bpf_htons(ETH_P_IPV6)) {
+        if (parse_ipv6hdr(&nh, data_end, &ip6h) < 0)
+            return stat_ret(STAT_PASS_OTHER, XDP_PASS);
+        if (ip6h->hop_limit <= 1)
+            return stat_ret(STAT_PASS_TTL, XDP_PASS);
+
+        fib.family = AF_INET6;
+        fib.flowinfo = *(__be32 *)ip6h & bpf_htonl(0x0FFFFFFF);
+        fib.l4_protocol = ip6h->nexthdr;
+        fib.tot_len = bpf_ntohs(ip6h->payload_len);
+        __builtin_memcpy(fib.ipv6_src, &ip6h->saddr, sizeof(fib.ipv6_src));
+        __builtin_memcpy(fib.ipv6_dst, &ip6h->daddr, sizeof(fib.ipv6_dst));
+    } else {
+        return stat_ret(STAT_PASS_OTHER, XDP_PASS);
+    }
+
+    fib.ifindex = ctx->ingress_ifindex;
+
+    rc = bpf_fib_lookup(ctx, &fib, sizeof(fib), 0);
+    if (rc == BPF_FIB_LKUP_RET_NO_NEIGH)
+        return stat_ret(STAT_PASS_NO_NEIGH, XDP_PASS);
+    if (rc != BPF_FIB_LKUP_RET_SUCCESS)
+        return stat_ret(STAT_PASS_NO_ROUTE, XDP_PASS);
+
+    /* 出力 IF が tx_ports に無ければ（XDP で出せない IF）カーネルに任せる */
+    if (!bpf_map_lookup_elem(&tx_ports, &fib.ifindex))
+        return stat_ret(STAT_PASS_NOT_PORT, XDP_PASS);
+
+    if (iph)
+        ip_decrease_ttl(iph);
+    else if (ip6h)
+        ip6h->hop_limit--;
+
+    __builtin_memcpy(eth->h_dest, fib.dmac, ETH_ALEN);
+    __builtin_memcpy(eth->h_source, fib.smac, ETH_ALEN);
+
+    stat_ret(STAT_FWD, 0);
+    return bpf_redirect_map(&tx_ports, fib.ifindex, 0);
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
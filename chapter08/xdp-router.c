@@ -0,0 +1,181 @@
+/*
+ * xdp-router.c（ユーザ空間側 / XDP L3 フォワーダの attach と転送統計）
+ *
+ * 目的:
+ *   xdp-router.bpf.c を指定した全インタフェースに attach し、それらを tx_ports（DEVMAP）に登録する。
+ *   1 秒ごとに転送 / カーネルへ渡した理由ごとのパケットレートを表示する。
+ *
+ * 使い方:
+ *   sudo ./xdp-router [-S] <ifname> [<ifname> ...]
+ *
+ *   -S : generic（skb）モードで attach する（ドライバが native XDP 非対応のとき）
+ *
+ * カーネルルーティングとの比較（netns.sh router）:
+ *
+ *   sudo ./netns.sh router                 # ns1 -- nsr(ルータ) -- ns2 の 3 namespace
+ *   sudo ip netns exec ns2 ./tcp-bulk server &
+ *   sudo ip netns exec ns1 ./tcp-bulk client 10.0.2.1 -d 10                  # カーネル転送
+ *   sudo ip netns exec ns1 ./udp-ping client 10.0.2.1 -i 0 -d 5              # （ns2 で udp-ping server）
+ *
+ *   sudo ip netns exec nsr ./xdp-router r1 r2 &                              # XDP 転送に切り替え
+ *   sudo ip netns exec ns1 ./tcp-bulk client 10.0.2.1 -d 10
+ *   sudo ip netns exec ns1 ./udp-ping client 10.0.2.1 -i 0 -d 5
+ *
+ *   XDP 転送中は fwd が増え、最初の数パケット（ARP 解決前）だけが no_neigh としてカーネルへ渡る。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <net/if.h>
+#include <linux/if_link.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "xdp-router.h"
+#include "xdp-router.skel.h"
+
+#define MAX_IFACES 16
+
+static const char *stat_names[NR_STATS] = {
+    [STAT_FWD]           = "fwd",
+    [STAT_PASS_NO_NEIGH] = "no_neigh",
+    [STAT_PASS_NO_ROUTE] = "no_route",
+    [STAT_PASS_TTL]      = "ttl",
+    [STAT_PASS_NOT_PORT] = "not_port",
+    [STAT_PASS_OTHER]    = "other",
+};
+
+static volatile sig_atomic_t exiting = 0;
+
+static void sig_handler(int sig)
+{
+    (void)sig;
+    exiting = 1;
+}
+
+static int libbpf_print_fn(enum libbpf_print_level level,
+                           const char *format,
+                           va_list args)
+{
+    if (level >= LIBBPF_DEBUG)
+        return 0;
+
+    return vfprintf(stderr, format, args);
+}
+
+/* per-CPU カウンタを CPU 分合算して返す */
+static __u64 read_stat(struct xdp_router_bpf *skel, __u32 idx, int nr_cpus)
+{
+    __u64 values[nr_cpus];
+    __u64 sum = 0;
+
+    if (bpf_map__lookup_elem(skel->maps.stats, &idx, sizeof(idx),
+                             values, sizeof(values), 0))
+        return 0;
+
+    for (int i = 0; i < nr_cpus; i++)
+        sum += values[i];
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    struct xdp_router_bpf *skel = NULL;
+    int ifindexes[MAX_IFACES];
+    int nr_ifaces = 0, nr_attached = 0;
+    int nr_cpus = libbpf_num_possible_cpus();
+    __u32 xdp_flags = XDP_FLAGS_DRV_MODE;
+    __u64 prev[NR_STATS] = {};
+    bool usage = false;
+    int err = 0;
+    int opt;
+
+    libbpf_set_strict_mode(LIBBPF_STRICT_ALL);
+    libbpf_set_print(libbpf_print_fn);
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "Failed to get number of CPUs: %d\n", nr_cpus);
+        return 1;
+    }
+
+    while ((opt = getopt(argc, argv, "S")) != -1) {
+        switch (opt) {
+        case 'S': xdp_flags = XDP_FLAGS_SKB_MODE; break;
+        default: usage = true; break;
+        }
+    }
+    if (usage || optind >= argc || argc - optind > MAX_IFACES) {
+        fprintf(stderr, "Usage: %s [-S] <ifname> [<ifname> ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        int ifindex = if_nametoindex(argv[i]);
+
+        if (!ifindex || ifindex >= MAX_IFINDEX) {
+            fprintf(stderr, "Unknown or too large ifindex: %s\n", argv[i]);
+            return 1;
+        }
+        ifindexes[nr_ifaces++] = ifindex;
+    }
+
+    skel = xdp_router_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "Failed to open/load BPF object\n");
+        return 1;
+    }
+
+    /* 転送先として使う IF を DEVMAP に登録（key = value = ifindex） */
+    for (int i = 0; i < nr_ifaces; i++) {
+        __u32 key = ifindexes[i], val = ifindexes[i];
+
+        if (bpf_map__update_elem(skel->maps.tx_ports, &key, sizeof(key),
+                                 &val, sizeof(val), BPF_ANY)) {
+            err = -errno;
+            fprintf(stderr, "Failed to add %s to tx_ports: %d\n", argv[optind + i], err);
+            goto cleanup;
+        }
+    }
+
+    for (int i = 0; i < nr_ifaces; i++) {
+        err = bpf_xdp_attach(ifindexes[i], bpf_program__fd(skel->progs.xdp_router),
+                             xdp_flags, NULL);
+        if (err) {
+            fprintf(stderr, "Failed to attach XDP to %s: %d\n", argv[optind + i], err);
+            goto cleanup;
+        }
+        nr_attached++;
+    }
+
+    printf("Forwarding between %d interface(s) (%s mode). Ctrl-C to stop.\n",
+           nr_ifaces, xdp_flags == XDP_FLAGS_SKB_MODE ? "skb" : "native");
+    for (int i = 0; i < NR_STATS; i++)
+        printf("%-12s", stat_names[i]);
+    printf("(pkt/s)\n");
+
+    while (!exiting) {
+        sleep(1);
+        for (int i = 0; i < NR_STATS; i++) {
+            __u64 cur = read_stat(skel, i, nr_cpus);
+
+            printf("%-12llu", (unsigned long long)(cur - prev[i]));
+            prev[i] = cur;
+        }
+        printf("\n");
+    }
+
+cleanup:
+    for (int i = 0; i < nr_attached; i++)
+        bpf_xdp_detach(ifindexes[i], xdp_flags, NULL);
+    xdp_router_bpf__destroy(skel);
+    return err < 0 ? -err : 0;
+}
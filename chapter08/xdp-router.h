@@ -0,0 +1,24 @@
+#ifndef XDP_ROUTER_H
+#define XDP_ROUTER_H
+
+/*
+ * xdp-router.h（XDP L3 フォワーダとローダで共有する定義）
+ */
+
+#define MAX_IFINDEX 256   /* tx_ports（DEVMAP）の大きさ。key = ifindex なのでこれ未満の ifindex だけ扱える */
+
+/*
+ * stat_idx:
+ *   per-CPU カウンタ（stats map）の添字。ローダが CPU 分を合算して表示する。
+ */
+enum stat_idx {
+   STAT_FWD = 0,         /* XDP で書き換えて redirect した */
+   STAT_PASS_NO_NEIGH,   /* 経路はあるが隣接（ARP/ND）未解決 → カーネルに任せて解決させる */
+   STAT_PASS_NO_ROUTE,   /* 経路なし / ローカル宛 / 転送禁止などで fib_lookup が成功しなかった */
+   STAT_PASS_TTL,        /* TTL/hop limit が 1 以下（ICMP time exceeded はカーネルに作らせる） */
+   STAT_PASS_NOT_PORT,   /* 出力先が tx_ports に登録されていない */
+   STAT_PASS_OTHER,      /* IPv4/IPv6 以外、ヘッダ不正 */
+   NR_STATS,
+};
+
+#endif /* XDP_ROUTER_H */